@@ -0,0 +1,49 @@
+/**
+ * @file FDReadoutModulesIssues.hpp fdreadoutmodules specific ERS issues
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_FDREADOUTMODULESISSUES_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_FDREADOUTMODULESISSUES_HPP_
+
+#include "ers/Issue.hpp"
+
+#include <string>
+
+namespace dunedaq {
+
+ERS_DECLARE_ISSUE(fdreadoutmodules,
+                  AsyncWriterError,
+                  "Asynchronous writer of " << filename << ": " << reason,
+                  ((std::string)filename)((std::string)reason))
+
+ERS_DECLARE_ISSUE(fdreadoutmodules,
+                  AsyncWriterNotSupported,
+                  "Asynchronous writer requested for " << filename << " but io_uring support was not compiled in",
+                  ((std::string)filename))
+ERS_DECLARE_ISSUE(fdreadoutmodules,
+                  HugePagesUnavailable,
+                  "Could not map " << bytes << " bytes of " << backing << " pages (" << reason
+                                   << "), falling back to transparent huge pages",
+                  ((std::string)backing)((size_t)bytes)((std::string)reason))
+
+ERS_DECLARE_ISSUE(fdreadoutmodules,
+                  TimestampIndexUnavailable,
+                  "Timestamp index " << filename << " disabled: " << reason,
+                  ((std::string)filename)((std::string)reason))
+
+ERS_DECLARE_ISSUE(fdreadoutmodules,
+                  EmulatorInputError,
+                  "Cannot load emulator input " << filename << ": " << reason,
+                  ((std::string)filename)((std::string)reason))
+
+ERS_DECLARE_ISSUE(fdreadoutmodules,
+                  ProcessorProfilingError,
+                  "Frame processor profiling of " << link << ": " << reason,
+                  ((std::string)link)((std::string)reason))
+
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_FDREADOUTMODULESISSUES_HPP_
@@ -0,0 +1,259 @@
+/**
+ * @file ReadoutModelSpecializations.hpp DataHandlingModel specializations per far detector data type
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_READOUTMODELSPECIALIZATIONS_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_READOUTMODELSPECIALIZATIONS_HPP_
+
+#include "datahandlinglibs/models/BinarySearchQueueModel.hpp"
+#include "datahandlinglibs/models/DataHandlingModel.hpp"
+#include "datahandlinglibs/models/FixedRateQueueModel.hpp"
+#include "datahandlinglibs/models/SkipListLatencyBufferModel.hpp"
+
+#include "fdreadoutlibs/DAPHNEStreamSuperChunkTypeAdapter.hpp"
+#include "fdreadoutlibs/DAPHNESuperChunkTypeAdapter.hpp"
+#include "fdreadoutlibs/DUNEWIBEthTypeAdapter.hpp"
+#include "fdreadoutlibs/TDEEthTypeAdapter.hpp"
+
+#include "fdreadoutlibs/daphne/DAPHNEFrameProcessor.hpp"
+#include "fdreadoutlibs/daphne/DAPHNEListRequestHandler.hpp"
+#include "fdreadoutlibs/daphne/DAPHNEStreamFrameProcessor.hpp"
+#include "fdreadoutlibs/tde/TDEEthFrameProcessor.hpp"
+#include "fdreadoutlibs/wibeth/WIBEthFrameProcessor.hpp"
+
+#include "fdreadoutmodules/dal/HugePageLatencyBufferConf.hpp"
+#include "fdreadoutmodules/dal/RingRecordingLatencyBufferConf.hpp"
+#include "fdreadoutmodules/models/AdaptiveLatencyBufferModel.hpp"
+#include "fdreadoutmodules/models/AdaptiveRequestHandlerModel.hpp"
+#include "fdreadoutmodules/models/BatchedDataHandlingModel.hpp"
+#include "fdreadoutmodules/models/CompressedLatencyBufferModel.hpp"
+#include "fdreadoutmodules/models/CompressedRequestHandlerModel.hpp"
+#include "fdreadoutmodules/models/DeferredRequestHandlerModel.hpp"
+#include "fdreadoutmodules/models/InstrumentedLatencyBufferModel.hpp"
+#include "fdreadoutmodules/models/InstrumentedRequestHandlerModel.hpp"
+#include "fdreadoutmodules/models/PlacedLatencyBufferModel.hpp"
+#include "fdreadoutmodules/models/ProfiledFrameProcessor.hpp"
+#include "fdreadoutmodules/models/RingRecordingLatencyBufferModel.hpp"
+#include "fdreadoutmodules/models/ScatterGatherRequestHandlerModel.hpp"
+#include "fdreadoutmodules/models/TimestampBucketLatencyBufferModel.hpp"
+#include "fdreadoutmodules/models/TimestampBucketRequestHandlerModel.hpp"
+
+#include "appmodel/DataHandlerConf.hpp"
+#include "appmodel/DataHandlerModule.hpp"
+#include "appmodel/LatencyBuffer.hpp"
+
+#include <array>
+#include <string>
+#include <type_traits>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * Each specialization bundles the template arguments that FDDataHandlerModule::create_readout() uses for
+ * one input data type, so that the module and the standalone benchmarks always build the same models.
+ */
+namespace specializations {
+
+namespace rol = dunedaq::datahandlinglibs;
+namespace fdl = dunedaq::fdreadoutlibs;
+namespace fdt = dunedaq::fdreadoutlibs::types;
+
+// Pre- and post-processing tasks of each frame processor, in the order it registers them, named in the
+// FrameProcessorTaskInfo published by ProfiledFrameProcessor
+struct WIBEthTaskNames
+{
+  static constexpr std::array<const char*, 1> preprocess{ "timestamp_check" };
+  static constexpr std::array<const char*, 1> postprocess{ "find_hits" };
+};
+
+struct TDEEthTaskNames
+{
+  static constexpr std::array<const char*, 1> preprocess{ "timestamp_check" };
+  static constexpr std::array<const char*, 0> postprocess{};
+};
+
+struct DAPHNETaskNames
+{
+  static constexpr std::array<const char*, 1> preprocess{ "timestamp_check" };
+  static constexpr std::array<const char*, 0> postprocess{};
+};
+
+struct DAPHNEStreamTaskNames
+{
+  static constexpr std::array<const char*, 1> preprocess{ "timestamp_check" };
+  static constexpr std::array<const char*, 0> postprocess{};
+};
+
+/**
+ * Models of the links whose latency buffer keeps its elements in one array. The layers are only stacked
+ * when the latency buffer configuration asks for them: placement with a HugePageLatencyBufferConf,
+ * resizing with its adaptive_size, ring recording with a RingRecordingLatencyBufferConf.
+ */
+template<class ReadoutType,
+         class QueueType,
+         class ProcessorType,
+         class TaskNames,
+         bool Placed,
+         bool Adaptive,
+         bool Ring>
+struct ContiguousStack
+{
+  static_assert(Placed || !(Adaptive || Ring), "Resizing and ring recording need a placed buffer");
+  using readout_t = ReadoutType;
+  using placed_t = std::conditional_t<Placed, PlacedLatencyBufferModel<readout_t, QueueType>, QueueType>;
+  using sized_t = std::conditional_t<Adaptive, AdaptiveLatencyBufferModel<readout_t, placed_t>, placed_t>;
+  using queue_t = std::conditional_t<Ring, RingRecordingLatencyBufferModel<readout_t, sized_t>, sized_t>;
+  using latency_buffer_t = InstrumentedLatencyBufferModel<readout_t, queue_t>;
+  using gather_t = ScatterGatherRequestHandlerModel<readout_t, latency_buffer_t>;
+  using sizing_t = std::conditional_t<Adaptive, AdaptiveRequestHandlerModel<readout_t, gather_t>, gather_t>;
+  using request_handler_t =
+    InstrumentedRequestHandlerModel<readout_t, DeferredRequestHandlerModel<readout_t, sizing_t>>;
+  using processor_t = ProfiledFrameProcessor<readout_t, ProcessorType, TaskNames>;
+  using model_t = BatchedDataHandlingModel<readout_t, request_handler_t, latency_buffer_t, processor_t>;
+};
+
+template<bool Placed, bool Adaptive, bool Ring>
+struct WIBEth
+  : ContiguousStack<fdt::DUNEWIBEthTypeAdapter,
+                    rol::FixedRateQueueModel<fdt::DUNEWIBEthTypeAdapter>,
+                    fdl::WIBEthFrameProcessor,
+                    WIBEthTaskNames,
+                    Placed,
+                    Adaptive,
+                    Ring>
+{
+  static constexpr const char* data_type = "WIBEthFrame";
+  static constexpr const char* node_name = "WIBEthFrameProcessor";
+};
+
+struct WIBEthCompressed
+{
+  using readout_t = fdt::DUNEWIBEthTypeAdapter;
+  using latency_buffer_t = InstrumentedLatencyBufferModel<readout_t, CompressedLatencyBufferModel<readout_t>>;
+  using request_handler_t = InstrumentedRequestHandlerModel<
+    readout_t,
+    DeferredRequestHandlerModel<readout_t, CompressedRequestHandlerModel<readout_t, latency_buffer_t>>>;
+  using processor_t = ProfiledFrameProcessor<readout_t, fdl::WIBEthFrameProcessor, WIBEthTaskNames>;
+  using model_t = BatchedDataHandlingModel<readout_t, request_handler_t, latency_buffer_t, processor_t>;
+  static constexpr const char* data_type = "WIBEthFrame";
+  static constexpr const char* node_name = "WIBEthFrameProcessor";
+};
+
+template<bool Placed, bool Adaptive, bool Ring>
+struct TDEEth
+  : ContiguousStack<fdt::TDEEthTypeAdapter,
+                    rol::FixedRateQueueModel<fdt::TDEEthTypeAdapter>,
+                    fdl::TDEEthFrameProcessor,
+                    TDEEthTaskNames,
+                    Placed,
+                    Adaptive,
+                    Ring>
+{
+  static constexpr const char* data_type = "TDEEthFrame";
+  static constexpr const char* node_name = "TDEEthFrameProcessor";
+};
+
+struct PDS
+{
+  using readout_t = fdt::DAPHNESuperChunkTypeAdapter;
+  // DAPHNEListRequestHandler is bound to the plain SkipList LB, so only the request side is instrumented.
+  // The skip list allocates per element, page backing and prefaulting do not apply.
+  using latency_buffer_t = rol::SkipListLatencyBufferModel<readout_t>;
+  using request_handler_t = InstrumentedRequestHandlerModel<readout_t, fdl::DAPHNEListRequestHandler>;
+  using processor_t = ProfiledFrameProcessor<readout_t, fdl::DAPHNEFrameProcessor, DAPHNETaskNames>;
+  using model_t = BatchedDataHandlingModel<readout_t, request_handler_t, latency_buffer_t, processor_t>;
+  static constexpr const char* data_type = "PDSFrame";
+  static constexpr const char* node_name = "PDSFrameProcessor";
+};
+
+struct PDSBuckets
+{
+  using readout_t = fdt::DAPHNESuperChunkTypeAdapter;
+  using latency_buffer_t = InstrumentedLatencyBufferModel<readout_t, TimestampBucketLatencyBufferModel<readout_t>>;
+  using request_handler_t = InstrumentedRequestHandlerModel<
+    readout_t,
+    DeferredRequestHandlerModel<readout_t, TimestampBucketRequestHandlerModel<readout_t, latency_buffer_t>>>;
+  using processor_t = ProfiledFrameProcessor<readout_t, fdl::DAPHNEFrameProcessor, DAPHNETaskNames>;
+  using model_t = BatchedDataHandlingModel<readout_t, request_handler_t, latency_buffer_t, processor_t>;
+  static constexpr const char* data_type = "PDSFrame";
+  static constexpr const char* node_name = "PDSFrameProcessor";
+};
+
+// The binary search queue keeps superchunks in one contiguous array like the fixed rate queue, so the
+// record command can write the buffer memory itself with O_DIRECT and requests copy whole runs of it
+template<bool Placed, bool Adaptive, bool Ring>
+struct PDSStream
+  : ContiguousStack<fdt::DAPHNEStreamSuperChunkTypeAdapter,
+                    rol::BinarySearchQueueModel<fdt::DAPHNEStreamSuperChunkTypeAdapter>,
+                    fdl::DAPHNEStreamFrameProcessor,
+                    DAPHNEStreamTaskNames,
+                    Placed,
+                    Adaptive,
+                    Ring>
+{
+  static constexpr const char* data_type = "PDSStreamFrame";
+  static constexpr const char* node_name = "PDSStreamFrameProcessor";
+};
+
+/**
+ * @brief Calls f(Stack<Placed, Adaptive, Ring>{}) with the layers the latency buffer configuration asks for.
+ */
+template<template<bool, bool, bool> class Stack, class Function>
+auto
+with_contiguous_stack(const appmodel::LatencyBuffer* lb_conf, Function&& f) -> decltype(f(Stack<false, false, false>{}))
+{
+  auto hp_conf = lb_conf != nullptr ? lb_conf->cast<dal::HugePageLatencyBufferConf>() : nullptr;
+  if (hp_conf == nullptr) {
+    return f(Stack<false, false, false>{});
+  }
+  const bool ring = lb_conf->cast<dal::RingRecordingLatencyBufferConf>() != nullptr;
+  if (hp_conf->get_adaptive_size()) {
+    return ring ? f(Stack<true, true, true>{}) : f(Stack<true, true, false>{});
+  }
+  return ring ? f(Stack<true, false, true>{}) : f(Stack<true, false, false>{});
+}
+
+/**
+ * @brief Calls f(Specialization{}) with the specialization matching the input data type of the link and
+ * its latency buffer configuration.
+ *
+ * Shared by the single and multi-link data handlers so that both choose models the same way.
+ * @return The result of f, or a value-initialized result if no specialization matches
+ */
+template<class Function>
+auto
+with_specialization(const appmodel::DataHandlerModule* modconf, Function&& f)
+  -> decltype(f(WIBEth<false, false, false>{}))
+{
+  const std::string raw_dt = modconf->get_module_configuration()->get_input_data_type();
+  auto lb_conf = modconf->get_module_configuration()->get_latency_buffer();
+  if (raw_dt.find("WIBEthFrame") != std::string::npos) {
+    if (lb_conf != nullptr && lb_conf->cast<dal::CompressedLatencyBufferConf>() != nullptr) {
+      return f(WIBEthCompressed{});
+    }
+    return with_contiguous_stack<WIBEth>(lb_conf, f);
+  }
+  if (raw_dt.find("TDEEthFrame") != std::string::npos) {
+    return with_contiguous_stack<TDEEth>(lb_conf, f);
+  }
+  if (raw_dt.find("PDSFrame") != std::string::npos) {
+    if (lb_conf != nullptr && lb_conf->cast<dal::TimestampBucketLatencyBufferConf>() != nullptr) {
+      return f(PDSBuckets{});
+    }
+    return f(PDS{});
+  }
+  if (raw_dt.find("PDSStreamFrame") != std::string::npos) {
+    return with_contiguous_stack<PDSStream>(lb_conf, f);
+  }
+  return {};
+}
+
+} // namespace specializations
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_READOUTMODELSPECIALIZATIONS_HPP_
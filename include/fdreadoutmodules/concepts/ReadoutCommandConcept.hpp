@@ -0,0 +1,54 @@
+/**
+ * @file ReadoutCommandConcept.hpp Commands of the fdreadoutmodules readout models beyond DataHandlingConcept
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_CONCEPTS_READOUTCOMMANDCONCEPT_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_CONCEPTS_READOUTCOMMANDCONCEPT_HPP_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Entry points of the readout models for the module commands that DataHandlingConcept has no
+ * method for. The data handlers reach them with a dynamic_pointer_cast of the DataHandlingConcept of a link.
+ */
+class ReadoutCommandConcept
+{
+public:
+  ReadoutCommandConcept() = default;
+  virtual ~ReadoutCommandConcept() = default;
+
+  ReadoutCommandConcept(const ReadoutCommandConcept&) = delete;
+  ReadoutCommandConcept& operator=(const ReadoutCommandConcept&) = delete;
+  ReadoutCommandConcept(ReadoutCommandConcept&&) = delete;
+  ReadoutCommandConcept& operator=(ReadoutCommandConcept&&) = delete;
+
+  //! Keep the ring recorded by the latency buffer. @return false if the latency buffer records no ring
+  virtual bool freeze_ring() = 0;
+
+  /**
+   * @brief Time one call in sample_every of each frame processor task, 0 stops timing.
+   * @param trace_file Also append the sampled calls to this file when not empty
+   * @return false if the frame processor is not profiled
+   */
+  virtual bool profile_processor(uint32_t sample_every, const std::string& trace_file) = 0;
+
+  /**
+   * @brief Call done once, from a thread of the model, when the recording of the latest record command
+   * has ended. A recording still running at stop is not reported, a null done cancels.
+   * @return false if the model cannot report it
+   */
+  virtual bool on_recording_done(std::function<void()> done) = 0;
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_CONCEPTS_READOUTCOMMANDCONCEPT_HPP_
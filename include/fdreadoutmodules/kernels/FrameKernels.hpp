@@ -0,0 +1,78 @@
+/**
+ * @file FrameKernels.hpp Per-ISA kernels over arrays of detector frames
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_KERNELS_FRAMEKERNELS_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_KERNELS_FRAMEKERNELS_HPP_
+
+#include "fdreadoutmodules/utils/CpuFeatures.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * Kernels read one 64-bit word per frame: the word at byte `base + i * stride` for frame i. This covers the
+ * timestamp and the error words of the DAQEthHeader based formats without copying them out first.
+ * The bit plane kernels transpose the 64 channels of one ADC time sample for the latency buffer codec.
+ */
+struct FrameKernels
+{
+  IsaLevel isa;
+
+  /**
+   * @brief Number of neighbouring frames whose words do not differ by exactly `step`.
+   * @param first_gap Set to the index of the first frame after a gap, or n when there is none
+   */
+  std::size_t (*count_step_violations)(const char* base, std::size_t stride, std::size_t n, uint64_t step,
+                                       std::size_t* first_gap);
+
+  //! Number of frames whose word lies outside [begin, end)
+  std::size_t (*count_outside_window)(const char* base, std::size_t stride, std::size_t n, uint64_t begin,
+                                      uint64_t end);
+
+  //! Sum over frames of the number of bits set in (word & mask)
+  uint64_t (*popcount_masked)(const char* base, std::size_t stride, std::size_t n, uint64_t mask);
+
+  //! Per-bit set counts: counts[b] += number of frames with bit b of (word & mask) set, b < 64
+  void (*accumulate_bits)(const char* base, std::size_t stride, std::size_t n, uint64_t mask, uint64_t* counts);
+
+  //! Number of frames whose word is smaller than the one of the previous frame
+  std::size_t (*count_decreasing)(const char* base, std::size_t stride, std::size_t n);
+
+  //! planes[b] bit i = bit b of values[i], for 64 values and b < width <= 16
+  void (*pack_bitplanes)(const uint16_t* values, unsigned width, uint64_t* planes);
+
+  //! Inverse of pack_bitplanes: writes 64 values, bits at and above width are zero
+  void (*unpack_bitplanes)(const uint64_t* planes, unsigned width, uint16_t* values);
+};
+
+/**
+ * @brief Kernel table for the given level, falling back to lower levels that are compiled in.
+ */
+const FrameKernels&
+frame_kernels_for(IsaLevel level);
+
+/**
+ * @brief Kernel table selected once per process from detect_isa_level().
+ */
+const FrameKernels&
+frame_kernels();
+
+namespace kernels {
+extern const FrameKernels scalar_frame_kernels;
+#ifdef WITH_ISA_DISPATCH
+extern const FrameKernels avx2_frame_kernels;
+extern const FrameKernels avx512_frame_kernels;
+#endif
+} // namespace kernels
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_KERNELS_FRAMEKERNELS_HPP_
@@ -0,0 +1,266 @@
+/**
+ * @file AdaptiveLatencyBufferModel.hpp Latency buffer decorator resizing the region of the queue in use
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_ADAPTIVELATENCYBUFFERMODEL_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_ADAPTIVELATENCYBUFFERMODEL_HPP_
+
+#include "fdreadoutmodules/utils/MemoryPlacement.hpp"
+
+#include "appmodel/LatencyBuffer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Wraps a PlacedLatencyBufferModel, letting the queue wrap around before the end of its storage.
+ *
+ * The active size requested with set_active_size() is posted by the next pop() of the cleanup thread and
+ * applied by the consumer thread, the only one writing the wrap size, on a write at which the elements
+ * in the buffer do not wrap around and all lie below the new size, so that neither the elements nor the
+ * indices move. Threads going through the indices of the queue, i.e. requests, cleanup and recording,
+ * hold the wrap size with SizeHold meanwhile; the consumer leaves a posted size pending while any does,
+ * and nobody waits for anybody but for the few instructions of an applying switch. occupancy() and
+ * back() are computed from the active size and need no hold. release_unused() then gives the pages
+ * beyond the active region back to the system; they are faulted in again after growing.
+ */
+template<class ReadoutType, class LatencyBufferType>
+class AdaptiveLatencyBufferModel : public LatencyBufferType
+{
+public:
+  using inherited = LatencyBufferType;
+  using inherited::inherited;
+
+  void conf(const appmodel::LatencyBuffer* cfg) override
+  {
+    inherited::conf(cfg);
+    std::lock_guard<std::mutex> lock(m_resize_mutex);
+    m_capacity = this->size_;
+    m_requested.store(m_capacity, std::memory_order_relaxed);
+    m_active.store(m_capacity, std::memory_order_relaxed);
+    m_switch_to.store(0, std::memory_order_relaxed);
+    m_switch.store(kSwitchIdle, std::memory_order_relaxed);
+    m_resident = m_capacity;
+    // The backing is known once the placement of the wrapped model has run
+    prepare_memory([this]() {
+      switch (this->memory_placement().backing) {
+        case PageBacking::kHugeTLB1G:
+          m_page_size = std::size_t(1) << 30;
+          break;
+        case PageBacking::kHugeTLB2M:
+        case PageBacking::kTransparent:
+          // Releasing part of a transparent huge page would split it
+          m_page_size = std::size_t(1) << 21;
+          break;
+        default:
+          m_page_size = 0;
+      }
+    });
+  }
+
+  void scrap(const nlohmann::json& args) override
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_resize_mutex);
+      // The base model releases its storage by the full size
+      this->size_ = static_cast<decltype(this->size_)>(m_capacity);
+      m_requested.store(m_capacity, std::memory_order_relaxed);
+      m_active.store(m_capacity, std::memory_order_relaxed);
+      m_switch_to.store(0, std::memory_order_relaxed);
+      m_switch.store(kSwitchIdle, std::memory_order_relaxed);
+    }
+    inherited::scrap(args);
+  }
+
+  //! Keeps the wrap size of the queue for its lifetime, for a thread going through the indices
+  class SizeHold
+  {
+  public:
+    explicit SizeHold(AdaptiveLatencyBufferModel& buffer)
+      : m_buffer(buffer)
+    {
+      m_buffer.hold_size();
+    }
+    ~SizeHold() { m_buffer.release_size(); }
+
+    SizeHold(const SizeHold&) = delete;
+    SizeHold& operator=(const SizeHold&) = delete;
+
+  private:
+    AdaptiveLatencyBufferModel& m_buffer;
+  };
+
+  bool write(ReadoutType&& element) override
+  {
+    if (m_switch.load(std::memory_order_relaxed) == kSwitchRequested) {
+      apply_switch();
+    }
+    return inherited::write(std::move(element));
+  }
+
+  std::size_t write_batch(ReadoutType* const* elements, std::size_t count)
+  {
+    if (m_switch.load(std::memory_order_relaxed) == kSwitchRequested) {
+      apply_switch();
+    }
+    return inherited::write_batch(elements, count);
+  }
+
+  //! Cleanup thread. Posts a pending active size to the consumer thread after popping.
+  void pop(std::size_t amount) override
+  {
+    inherited::pop(amount);
+    const std::size_t requested = m_requested.load(std::memory_order_relaxed);
+    if (requested == m_active.load(std::memory_order_relaxed) ||
+        requested == m_switch_to.load(std::memory_order_relaxed)) {
+      return;
+    }
+    // A size posted earlier and not applied yet is replaced
+    int state = kSwitchRequested;
+    m_switch.compare_exchange_strong(state, kSwitchIdle, std::memory_order_acquire);
+    if (state == kSwitchApplying) {
+      return;
+    }
+    m_switch_to.store(requested, std::memory_order_relaxed);
+    m_switch.store(kSwitchRequested, std::memory_order_release);
+  }
+
+  std::size_t occupancy() const override
+  {
+    std::size_t size = m_active.load(std::memory_order_acquire);
+    std::size_t read = 0;
+    std::size_t write = 0;
+    for (;;) {
+      write = this->writeIndex_.load(std::memory_order_acquire);
+      read = this->readIndex_.load(std::memory_order_acquire);
+      const std::size_t checked = m_active.load(std::memory_order_acquire);
+      if (checked == size) {
+        break;
+      }
+      size = checked;
+    }
+    return write >= read ? write - read : write + size - read;
+  }
+
+  const ReadoutType* back() override
+  {
+    const std::size_t write = this->writeIndex_.load(std::memory_order_relaxed);
+    if (write == this->readIndex_.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return &this->records_[write == 0 ? m_active.load(std::memory_order_acquire) - 1 : write - 1];
+  }
+
+  //! Elements of storage, the configured size
+  std::size_t capacity() const { return m_capacity; }
+
+  //! Elements the queue currently wraps around at
+  std::size_t active_size() const { return m_active.load(std::memory_order_relaxed); }
+
+  //! Any thread. Clamped to the capacity.
+  void set_active_size(std::size_t elements)
+  {
+    m_requested.store(std::clamp<std::size_t>(elements, 2, std::max<std::size_t>(m_capacity, 2)),
+                      std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Gives the pages beyond the active region back to the system. Takes a system call per
+   * shrink, so not to be called from the consumer thread.
+   * @return Bytes released
+   */
+  std::size_t release_unused()
+  {
+    std::lock_guard<std::mutex> lock(m_resize_mutex);
+    const std::size_t active = m_active.load(std::memory_order_acquire);
+    if (active >= m_resident) {
+      // Grown: the pages are faulted in again by the writes
+      m_resident = active;
+      return 0;
+    }
+    std::size_t released =
+      release_pages(this->records_ + active, (m_resident - active) * sizeof(ReadoutType), m_page_size);
+    m_resident = active;
+    return released;
+  }
+
+  //! Storage that has not been released, in bytes
+  std::size_t resident_bytes() const
+  {
+    std::lock_guard<std::mutex> lock(m_resize_mutex);
+    return m_resident * sizeof(ReadoutType);
+  }
+
+private:
+  static constexpr int kSwitchIdle = 0;
+  static constexpr int kSwitchRequested = 1;
+  static constexpr int kSwitchApplying = 2;
+
+  //! The elements do not wrap around and all lie below size
+  bool fits(std::size_t size) const
+  {
+    const std::size_t read = this->readIndex_.load(std::memory_order_acquire);
+    const std::size_t write = this->writeIndex_.load(std::memory_order_relaxed);
+    return read <= write && write < size;
+  }
+
+  // Any thread. Pairs with apply_switch(): either the consumer sees the hold or the holder sees the switch.
+  void hold_size()
+  {
+    m_holds.fetch_add(1, std::memory_order_seq_cst);
+    while (m_switch.load(std::memory_order_seq_cst) == kSwitchApplying) {
+      std::this_thread::yield();
+    }
+  }
+
+  void release_size() { m_holds.fetch_sub(1, std::memory_order_release); }
+
+  // Consumer thread
+  void apply_switch()
+  {
+    // Checked before claiming the switch, so that a shrink waiting for the queue to wrap costs no RMW
+    if (m_holds.load(std::memory_order_relaxed) != 0 || !fits(m_switch_to.load(std::memory_order_relaxed))) {
+      return;
+    }
+    int state = kSwitchRequested;
+    if (!m_switch.compare_exchange_strong(state, kSwitchApplying, std::memory_order_seq_cst)) {
+      return;
+    }
+    const std::size_t size = m_switch_to.load(std::memory_order_relaxed);
+    if (m_holds.load(std::memory_order_seq_cst) != 0 || !fits(size)) {
+      m_switch.store(kSwitchRequested, std::memory_order_release);
+      return;
+    }
+    this->size_ = static_cast<decltype(this->size_)>(size);
+    m_active.store(size, std::memory_order_release);
+    m_switch.store(kSwitchIdle, std::memory_order_release);
+  }
+
+  std::size_t m_capacity = 0;
+  std::size_t m_page_size = 0;
+  std::atomic<std::size_t> m_requested{ 0 };
+  std::atomic<std::size_t> m_active{ 0 };
+
+  std::atomic<int> m_switch{ kSwitchIdle };
+  std::atomic<std::size_t> m_switch_to{ 0 }; ///< Written by the cleanup thread while no switch is requested
+  std::atomic<int> m_holds{ 0 };
+
+  mutable std::mutex m_resize_mutex; // Guards m_resident, never taken by the consumer thread
+  std::size_t m_resident = 0;        ///< Elements below which the storage has not been released
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_ADAPTIVELATENCYBUFFERMODEL_HPP_
@@ -0,0 +1,270 @@
+/**
+ * @file AdaptiveRequestHandlerModel.hpp Request handler decorator sizing the latency buffer after request ages
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_ADAPTIVEREQUESTHANDLERMODEL_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_ADAPTIVEREQUESTHANDLERMODEL_HPP_
+
+#include "fdreadoutmodules/dal/HugePageLatencyBufferConf.hpp"
+#include "fdreadoutmodules/opmon/adaptive_latency_buffer_info.pb.h"
+#include "fdreadoutmodules/utils/LogLinearHistogram.hpp"
+
+#include "appmodel/DataHandlerConf.hpp"
+#include "appmodel/DataHandlerModule.hpp"
+#include "appmodel/LatencyBuffer.hpp"
+#include "dfmessages/DataRequest.hpp"
+#include "logging/Logging.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace detail {
+template<class LB, class = void>
+struct has_active_size : std::false_type
+{};
+template<class LB>
+struct has_active_size<LB, std::void_t<decltype(std::declval<LB&>().set_active_size(std::size_t{}))>>
+  : std::true_type
+{};
+} // namespace detail
+
+/**
+ * @brief Wraps a request handler model, sizing an AdaptiveLatencyBufferModel after how far back the
+ * DataRequests it serves reach.
+ *
+ * The age of a request is the newest timestamp in the buffer minus the begin of its window, and the
+ * deepest age of every resize_interval_s is kept for resize_history intervals. On the cleanup thread the
+ * active size is set so that, after a cleanup, size_headroom times the deepest kept age is still in the
+ * buffer, within min_size and the configured size, and the cleanup limit of the wrapped handler follows
+ * the active size. A request reaching further than the buffer is sized for grows it at once; shrinking
+ * waits for the history to be full, so the buffer keeps its configured size for the first intervals of a
+ * run. Pages beyond the active region are released after every shrink.
+ *
+ * Requests, cleanups and recordings hold the wrap size of the buffer while they run, so that the
+ * consumer thread only switches it between them.
+ */
+template<class ReadoutType, class RequestHandlerType>
+class AdaptiveRequestHandlerModel : public RequestHandlerType
+{
+public:
+  using inherited = RequestHandlerType;
+  using RequestResult = typename inherited::RequestResult;
+  using inherited::inherited;
+
+  void conf(const appmodel::DataHandlerModule* modconf) override
+  {
+    inherited::conf(modconf);
+    m_enabled = false;
+    if constexpr (detail::has_active_size<std::decay_t<decltype(*this->m_latency_buffer)>>::value) {
+      auto hp_conf =
+        modconf->get_module_configuration()->get_latency_buffer()->cast<dal::HugePageLatencyBufferConf>();
+      if (hp_conf == nullptr || !hp_conf->get_adaptive_size()) {
+        return;
+      }
+      m_enabled = true;
+      m_capacity = this->m_latency_buffer->capacity();
+      m_min_size = std::min<std::size_t>(std::max<uint32_t>(hp_conf->get_min_size(), 2), m_capacity);
+      m_headroom = std::max(1.f, hp_conf->get_size_headroom());
+      m_interval = std::chrono::seconds(std::max<uint32_t>(hp_conf->get_resize_interval_s(), 1));
+      m_history.assign(std::max<uint32_t>(hp_conf->get_resize_history(), 1), 0);
+      // What is left of the active size after a cleanup of the wrapped handler
+      m_retained_fraction = std::max(0.01f, this->m_pop_limit_pct * (1.f - this->m_pop_size_pct));
+      m_target = m_capacity;
+      m_target_published.store(m_capacity, std::memory_order_relaxed);
+      TLOG() << "Adaptive latency buffer between " << m_min_size << " and " << m_capacity << " elements";
+    }
+  }
+
+  void start(const nlohmann::json& args) override
+  {
+    if (m_enabled) {
+      std::fill(m_history.begin(), m_history.end(), 0);
+      m_intervals = 0;
+      m_interval_start = std::chrono::steady_clock::now();
+      m_interval_max_age.store(0, std::memory_order_relaxed);
+    }
+    inherited::start(args);
+  }
+
+  void scrap(const nlohmann::json& args) override
+  {
+    inherited::scrap(args);
+    std::lock_guard<std::mutex> lock(m_recording_mutex);
+    m_recording_hold.reset();
+  }
+
+  void cleanup_check() override
+  {
+    if constexpr (detail::has_active_size<std::decay_t<decltype(*this->m_latency_buffer)>>::value) {
+      if (m_enabled) {
+        resize();
+        {
+          typename std::decay_t<decltype(*this->m_latency_buffer)>::SizeHold hold(*this->m_latency_buffer);
+          inherited::cleanup_check();
+        }
+        {
+          std::lock_guard<std::mutex> lock(m_recording_mutex);
+          if (m_recording_hold && this->m_recording_thread.get_readiness()) {
+            m_recording_hold.reset();
+          }
+        }
+        m_released_bytes.fetch_add(this->m_latency_buffer->release_unused(), std::memory_order_relaxed);
+        return;
+      }
+    }
+    inherited::cleanup_check();
+  }
+
+  void record(const nlohmann::json& args) override
+  {
+    if constexpr (detail::has_active_size<std::decay_t<decltype(*this->m_latency_buffer)>>::value) {
+      if (m_enabled) {
+        // The recording thread addresses the storage up to the end of the queue, which must not move
+        // before it is done. Held until the first cleanup that finds the recording thread idle, which
+        // cannot happen before the recording is handed to it.
+        std::lock_guard<std::mutex> lock(m_recording_mutex);
+        if (!m_recording_hold) {
+          using size_hold_t = typename std::decay_t<decltype(*this->m_latency_buffer)>::SizeHold;
+          m_recording_hold = std::make_shared<size_hold_t>(*this->m_latency_buffer);
+        }
+        inherited::record(args);
+        return;
+      }
+    }
+    inherited::record(args);
+  }
+
+protected:
+  RequestResult data_request(dfmessages::DataRequest dr) override
+  {
+    if constexpr (detail::has_active_size<std::decay_t<decltype(*this->m_latency_buffer)>>::value) {
+      if (m_enabled) {
+        typename std::decay_t<decltype(*this->m_latency_buffer)>::SizeHold hold(*this->m_latency_buffer);
+        record_age(dr);
+        return inherited::data_request(std::move(dr));
+      }
+    }
+    return inherited::data_request(std::move(dr));
+  }
+
+  void generate_opmon_data() override
+  {
+    inherited::generate_opmon_data();
+    if constexpr (detail::has_active_size<std::decay_t<decltype(*this->m_latency_buffer)>>::value) {
+      if (!m_enabled) {
+        return;
+      }
+      auto& lb = this->m_latency_buffer;
+      opmon::AdaptiveLatencyBufferInfo info;
+      info.set_configured_elements(m_capacity);
+      info.set_active_elements(lb->active_size());
+      info.set_target_elements(m_target_published.load(std::memory_order_relaxed));
+      info.set_resident_bytes(lb->resident_bytes());
+      info.set_released_bytes(m_released_bytes.exchange(0, std::memory_order_relaxed));
+      info.set_resizes(m_resizes.exchange(0, std::memory_order_relaxed));
+      auto ages = m_age_ticks.snapshot_and_reset();
+      info.set_request_age_p50_ticks(ages.percentile(0.50));
+      info.set_request_age_p99_ticks(ages.percentile(0.99));
+      info.set_request_age_max_ticks(ages.max);
+      info.set_ticks_per_element(m_ticks_per_element.load(std::memory_order_relaxed));
+      this->publish(std::move(info));
+    }
+  }
+
+private:
+  // Request threads
+  void record_age(const dfmessages::DataRequest& dr)
+  {
+    auto newest = this->m_latency_buffer->back();
+    if (newest != nullptr && newest->get_timestamp() > dr.request_information.window_begin) {
+      const uint64_t age = newest->get_timestamp() - dr.request_information.window_begin;
+      m_age_ticks.record(age);
+      uint64_t deepest = m_interval_max_age.load(std::memory_order_relaxed);
+      while (age > deepest && !m_interval_max_age.compare_exchange_weak(deepest, age, std::memory_order_relaxed)) {
+      }
+    }
+  }
+
+  // Cleanup thread
+  void resize()
+  {
+    if constexpr (detail::has_active_size<std::decay_t<decltype(*this->m_latency_buffer)>>::value) {
+      auto& lb = this->m_latency_buffer;
+      const std::size_t occupancy = lb->occupancy();
+      if (occupancy < 2) {
+        return;
+      }
+      const uint64_t span = lb->back()->get_timestamp() - lb->front()->get_timestamp();
+      const uint64_t ticks_per_element = span / (occupancy - 1);
+      if (ticks_per_element == 0) {
+        return;
+      }
+      m_ticks_per_element.store(ticks_per_element, std::memory_order_relaxed);
+      auto size_for = [&](uint64_t age) {
+        const double depth = static_cast<double>(age / ticks_per_element + 1) * m_headroom / m_retained_fraction;
+        return std::clamp(static_cast<std::size_t>(depth), m_min_size, m_capacity);
+      };
+
+      std::size_t target = std::max(m_target, size_for(m_interval_max_age.load(std::memory_order_relaxed)));
+      const auto now = std::chrono::steady_clock::now();
+      if (now - m_interval_start >= m_interval) {
+        m_history[m_intervals++ % m_history.size()] = m_interval_max_age.exchange(0, std::memory_order_relaxed);
+        m_interval_start = now;
+        if (m_intervals >= m_history.size()) {
+          target = size_for(*std::max_element(m_history.begin(), m_history.end()));
+        }
+      }
+      if (target != m_target) {
+        m_target = target;
+        lb->set_active_size(target);
+        m_target_published.store(target, std::memory_order_relaxed);
+        m_resizes.fetch_add(1, std::memory_order_relaxed);
+      }
+      // While a shrink is pending the buffer still wraps at the old size, but has to empty below the new one
+      this->m_pop_limit_size = static_cast<decltype(this->m_pop_limit_size)>(
+        this->m_pop_limit_pct * std::min(lb->active_size(), m_target));
+    }
+  }
+
+  bool m_enabled = false;
+  std::size_t m_capacity = 0;
+  std::size_t m_min_size = 0;
+  float m_headroom = 1.f;
+  float m_retained_fraction = 1.f;
+  std::chrono::steady_clock::duration m_interval{ 0 };
+
+  // Cleanup thread
+  std::vector<uint64_t> m_history; ///< Deepest age of the last intervals
+  std::size_t m_intervals = 0;
+  std::chrono::steady_clock::time_point m_interval_start;
+  std::size_t m_target = 0;
+
+  std::atomic<uint64_t> m_interval_max_age{ 0 };
+  std::atomic<std::size_t> m_target_published{ 0 };
+  std::atomic<uint64_t> m_ticks_per_element{ 0 };
+  std::atomic<uint64_t> m_resizes{ 0 };
+  std::atomic<uint64_t> m_released_bytes{ 0 };
+  LogLinearHistogram<> m_age_ticks;
+
+  std::mutex m_recording_mutex;
+  std::shared_ptr<void> m_recording_hold; ///< SizeHold from a record command to the first cleanup after it
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_ADAPTIVEREQUESTHANDLERMODEL_HPP_
@@ -0,0 +1,345 @@
+/**
+ * @file BatchedDataHandlingModel.hpp DataHandlingModel draining its raw input in batches
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_BATCHEDDATAHANDLINGMODEL_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_BATCHEDDATAHANDLINGMODEL_HPP_
+
+#include "fdreadoutmodules/FDReadoutModulesIssues.hpp"
+#include "fdreadoutmodules/concepts/ReadoutCommandConcept.hpp"
+#include "fdreadoutmodules/dal/BatchedDataHandlerConf.hpp"
+#include "fdreadoutmodules/models/InstrumentedLatencyBufferModel.hpp"
+#include "fdreadoutmodules/models/InstrumentedRequestHandlerModel.hpp"
+#include "fdreadoutmodules/models/ProfiledFrameProcessor.hpp"
+#include "fdreadoutmodules/models/RingRecordingLatencyBufferModel.hpp"
+#include "fdreadoutmodules/opmon/batched_ingest_info.pb.h"
+#include "fdreadoutmodules/opmon/frame_processor_task_info.pb.h"
+#include "fdreadoutmodules/utils/RatePacer.hpp"
+
+#include "appmodel/DataHandlerConf.hpp"
+#include "appmodel/DataHandlerModule.hpp"
+#include "iomanager/IOManager.hpp"
+#include "iomanager/Receiver.hpp"
+#include "logging/Logging.hpp"
+
+#include "datahandlinglibs/DataHandlingIssues.hpp"
+#include "datahandlinglibs/models/DataHandlingModel.hpp"
+#include "datahandlinglibs/utils/ReusableThread.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief DataHandlingModel taking the superchunks already queued on its raw input in batches.
+ *
+ * The base model handles every superchunk in its own receiver callback: preprocessing, one latency buffer
+ * write with its release store, postprocessing. With a BatchedDataHandlerConf of ingest_batch_size above
+ * 1, the callback is replaced at start by a thread that blocks for one superchunk and then takes up to
+ * ingest_batch_size - 1 more without waiting. Each batch is preprocessed in one pass, written to the
+ * latency buffer with one write_batch() where the buffer supports it, so that a queue publishes it with
+ * one store of its write index, and then postprocessed. A batch only forms when superchunks queue up, so
+ * at low rates the latency is that of the callback. Raw data handed over by a DataMoveCallback does
+ * not go through the receiver and is not batched.
+ *
+ * Superchunks are received into slots kept across batches and moved from there into the latency buffer,
+ * so they are copied no more often than by the callback. The payload and overwrite counters of the base
+ * model are kept up by the batches, next to the batching metrics.
+ *
+ * As the ReadoutCommandConcept of the link, it configures the task profiling of a ProfiledFrameProcessor,
+ * whose task profiles are published with the model, freezes the ring of a RingRecordingLatencyBufferModel
+ * and forwards the end of a recording reported by an InstrumentedRequestHandlerModel. The opmon info of
+ * the latency buffer layers that have a publish_opmon() is published with the model as well.
+ */
+template<class ReadoutType, class RequestHandlerType, class LatencyBufferType, class RawDataProcessorType>
+class BatchedDataHandlingModel
+  : public datahandlinglibs::DataHandlingModel<ReadoutType, RequestHandlerType, LatencyBufferType, RawDataProcessorType>
+  , public ReadoutCommandConcept
+{
+public:
+  using inherited =
+    datahandlinglibs::DataHandlingModel<ReadoutType, RequestHandlerType, LatencyBufferType, RawDataProcessorType>;
+
+  // Superchunks are moved to the latency buffer from their slots and postprocessed from them afterwards
+  static_assert(std::is_trivially_copyable_v<ReadoutType>, "Batched ingest needs trivially copyable elements");
+  // Slots are constructed again over the previous batch without being destroyed
+  static_assert(std::is_trivially_destructible_v<std::optional<ReadoutType>>, "Slots must be trivially destructible");
+
+  static constexpr std::chrono::milliseconds receive_timeout{ 100 };
+
+  explicit BatchedDataHandlingModel(std::atomic<bool>& run_marker)
+    : inherited(run_marker)
+    , m_run_marker(run_marker)
+    , m_consumer_thread(0)
+  {}
+
+  void init(const appmodel::DataHandlerModule* modconf) override
+  {
+    inherited::init(modconf);
+    TscClock::calibrate();
+    m_name = modconf->UID();
+    m_batch_size = 1;
+    auto batched_conf = modconf->get_module_configuration()->cast<dal::BatchedDataHandlerConf>();
+    if (batched_conf == nullptr || batched_conf->get_ingest_batch_size() <= 1) {
+      return;
+    }
+    for (auto input : modconf->get_inputs()) {
+      if (input->get_data_type() == "DataRequest") {
+        continue;
+      }
+      try {
+        m_raw_receiver = get_iom_receiver<ReadoutType>(input->UID());
+      } catch (const ers::Issue& excpt) {
+        throw datahandlinglibs::GenericResourceQueueError(ERS_HERE, input->UID(), m_name, excpt);
+      }
+    }
+    if (m_raw_receiver == nullptr) {
+      return;
+    }
+    m_batch_size = batched_conf->get_ingest_batch_size();
+    m_slots = std::vector<std::optional<ReadoutType>>(m_batch_size);
+    m_batch.reserve(m_batch_size);
+    TLOG() << m_name << ": raw input drained in batches of up to " << m_batch_size << " superchunks";
+  }
+
+  void start(const nlohmann::json& args) override
+  {
+    inherited::start(args);
+    if (m_batch_size <= 1) {
+      return;
+    }
+    // Joins the callback of the base model, so the latency buffer keeps a single writer
+    m_raw_receiver->remove_callback();
+    m_consumer_thread.set_name(m_name, 0);
+    m_consumer_thread.set_work(&BatchedDataHandlingModel::run_consume, this);
+  }
+
+  void stop(const nlohmann::json& args) override
+  {
+    if (m_batch_size > 1) {
+      while (!m_consumer_thread.get_readiness()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+    }
+    inherited::stop(args);
+  }
+
+  bool freeze_ring() override
+  {
+    if constexpr (detail::has_ring_recording<LatencyBufferType>::value) {
+      return this->m_latency_buffer_impl != nullptr && this->m_latency_buffer_impl->freeze_ring();
+    } else {
+      return false;
+    }
+  }
+
+  bool on_recording_done(std::function<void()> done) override
+  {
+    if constexpr (detail::has_recording_listener<RequestHandlerType>::value) {
+      if (this->m_request_handler_impl == nullptr) {
+        return false;
+      }
+      this->m_request_handler_impl->on_recording_done(std::move(done));
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  bool profile_processor(uint32_t sample_every, const std::string& trace_file) override
+  {
+    if constexpr (detail::has_task_profiler<RawDataProcessorType>::value) {
+      auto& profiler = this->m_raw_processor_impl->profiler();
+      if (!profiler.enable(sample_every, trace_file)) {
+        ers::warning(ProcessorProfilingError(ERS_HERE, m_name, "cannot open trace file " + trace_file));
+      }
+      TLOG() << m_name << ": frame processor tasks "
+             << (sample_every > 0 ? "timed once every " + std::to_string(sample_every) + " calls" : "not timed")
+             << (trace_file.empty() || sample_every == 0 ? "" : ", traced to " + trace_file);
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+protected:
+  void generate_opmon_data() override
+  {
+    inherited::generate_opmon_data();
+    if constexpr (detail::has_task_profiler<RawDataProcessorType>::value) {
+      publish_task_profiles();
+    }
+    if constexpr (detail::has_opmon_info<LatencyBufferType>::value) {
+      if (this->m_latency_buffer_impl != nullptr) {
+        this->m_latency_buffer_impl->publish_opmon([this](auto&& info) { this->publish(std::move(info)); });
+      }
+    }
+    if (m_batch_size <= 1) {
+      return;
+    }
+    opmon::BatchedIngestInfo info;
+    const uint64_t elements = m_elements.exchange(0, std::memory_order_relaxed);
+    const uint64_t batches = m_batches.exchange(0, std::memory_order_relaxed);
+    info.set_elements_received(elements);
+    info.set_batches(batches);
+    if (batches > 0) {
+      info.set_batch_size_avg(static_cast<double>(elements) / batches);
+    }
+    info.set_batch_size_max(m_batch_size_max.exchange(0, std::memory_order_relaxed));
+    info.set_write_failures(m_write_failures.exchange(0, std::memory_order_relaxed));
+    const uint64_t preprocess_ns = m_preprocess_ns.exchange(0, std::memory_order_relaxed);
+    const uint64_t ingest_ns = m_ingest_ns.exchange(0, std::memory_order_relaxed);
+    if (elements > 0) {
+      info.set_preprocess_ns_per_element(static_cast<double>(preprocess_ns) / elements);
+      info.set_ingest_ns_per_element(static_cast<double>(ingest_ns) / elements);
+    }
+    info.set_receive_timeouts(m_receive_timeouts.exchange(0, std::memory_order_relaxed));
+    this->publish(std::move(info));
+  }
+
+private:
+  void publish_task_profiles()
+  {
+    auto& profiler = this->m_raw_processor_impl->profiler();
+    const uint32_t sample_every = profiler.sample_every();
+    const double ns_per_tick = TscClock::ns_per_tick();
+    profiler.for_each_task([&](TaskProfile& task) {
+      const auto interval = task.interval();
+      if (sample_every == 0 && interval.samples == 0) {
+        return;
+      }
+      opmon::FrameProcessorTaskInfo info;
+      info.set_superchunks(interval.calls);
+      info.set_frames(interval.frames);
+      info.set_samples(interval.samples);
+      if (interval.sampled_frames > 0) {
+        const double ticks_per_frame = static_cast<double>(interval.ticks) / interval.sampled_frames;
+        info.set_cycles_per_frame(ticks_per_frame);
+        info.set_ns_per_frame(ticks_per_frame * ns_per_tick);
+      }
+      info.set_cycles_max(static_cast<double>(interval.max_ticks));
+      if (task.waits_for_input() && interval.gaps > 0 && interval.samples > 0) {
+        const double gap = static_cast<double>(interval.gap_ticks) / interval.gaps;
+        const double busy = static_cast<double>(interval.ticks) / interval.samples;
+        info.set_blocked_fraction(gap / (gap + busy));
+        info.set_blocked_ms(gap * interval.calls * ns_per_tick / 1e6);
+      }
+      info.set_trace_samples_dropped(interval.trace_dropped);
+      info.set_sample_every(sample_every);
+      this->publish(std::move(info), { { "task", task.name() } });
+    });
+    profiler.flush_trace();
+  }
+
+  void run_consume()
+  {
+    while (m_run_marker.load(std::memory_order_relaxed)) {
+      // Block for the first superchunk of a batch, then take whatever is already queued
+      m_batch.clear();
+      if (!receive_into(0, receive_timeout)) {
+        m_receive_timeouts.fetch_add(1, std::memory_order_relaxed);
+        ++this->m_rawq_timeout_count;
+        continue;
+      }
+      while (m_batch.size() < m_batch_size && receive_into(m_batch.size(), std::chrono::milliseconds(0))) {
+      }
+      process_batch();
+    }
+  }
+
+  /**
+   * @brief Receives a superchunk into slot and appends it to the batch.
+   *
+   * The slot is constructed from the returned optional itself, which C++17 guarantees to do without a
+   * copy, where an assignment would copy the superchunk once more.
+   */
+  bool receive_into(std::size_t slot, std::chrono::milliseconds timeout)
+  {
+    auto* received = new (&m_slots[slot]) std::optional<ReadoutType>(m_raw_receiver->try_receive(timeout));
+    if (!received->has_value()) {
+      return false;
+    }
+    m_batch.push_back(&received->value());
+    return true;
+  }
+
+  void process_batch()
+  {
+    const std::size_t count = m_batch.size();
+    const int64_t start = TscClock::now_ns();
+    for (auto* element : m_batch) {
+      this->m_raw_processor_impl->preprocess_item(element);
+    }
+    const int64_t preprocessed = TscClock::now_ns();
+
+    std::size_t written = 0;
+    if constexpr (detail::has_write_batch<LatencyBufferType, ReadoutType>::value) {
+      written = this->m_latency_buffer_impl->write_batch(m_batch.data(), count);
+    } else {
+      for (auto* element : m_batch) {
+        written += this->m_latency_buffer_impl->write(std::move(*element)) ? 1 : 0;
+      }
+    }
+    // The base model postprocesses after a failed write too; the moved from elements are unchanged
+    for (const auto* element : m_batch) {
+      this->m_raw_processor_impl->postprocess_item(element);
+    }
+    const int64_t done = TscClock::now_ns();
+
+    m_elements.fetch_add(count, std::memory_order_relaxed);
+    m_batches.fetch_add(1, std::memory_order_relaxed);
+    if (count > m_batch_size_max.load(std::memory_order_relaxed)) {
+      m_batch_size_max.store(static_cast<uint32_t>(count), std::memory_order_relaxed);
+    }
+    if (written < count) {
+      m_write_failures.fetch_add(count - written, std::memory_order_relaxed);
+      this->m_num_payloads_overwritten += count - written;
+    }
+    // Counters of the base model, published with its own opmon
+    this->m_num_payloads += count;
+    this->m_sum_payloads += count;
+    this->m_stats_packet_count += count;
+    m_preprocess_ns.fetch_add(static_cast<uint64_t>(std::max<int64_t>(preprocessed - start, 0)),
+                              std::memory_order_relaxed);
+    m_ingest_ns.fetch_add(static_cast<uint64_t>(std::max<int64_t>(done - start, 0)), std::memory_order_relaxed);
+  }
+
+  std::atomic<bool>& m_run_marker;
+  std::string m_name;
+  std::size_t m_batch_size = 1;
+  std::shared_ptr<iomanager::ReceiverConcept<ReadoutType>> m_raw_receiver;
+  datahandlinglibs::ReusableThread m_consumer_thread;
+  std::vector<std::optional<ReadoutType>> m_slots; ///< Consumer thread, one per superchunk of a batch
+  std::vector<ReadoutType*> m_batch;               ///< Consumer thread, the received ones of m_slots
+
+  // Written by the consumer thread, reset by the opmon thread
+  std::atomic<uint64_t> m_elements{ 0 };
+  std::atomic<uint64_t> m_batches{ 0 };
+  std::atomic<uint32_t> m_batch_size_max{ 0 };
+  std::atomic<uint64_t> m_write_failures{ 0 };
+  std::atomic<uint64_t> m_preprocess_ns{ 0 };
+  std::atomic<uint64_t> m_ingest_ns{ 0 };
+  std::atomic<uint64_t> m_receive_timeouts{ 0 };
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_BATCHEDDATAHANDLINGMODEL_HPP_
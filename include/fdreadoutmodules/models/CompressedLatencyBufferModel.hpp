@@ -0,0 +1,461 @@
+/**
+ * @file CompressedLatencyBufferModel.hpp Latency buffer keeping WIBEth elements compressed
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_COMPRESSEDLATENCYBUFFERMODEL_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_COMPRESSEDLATENCYBUFFERMODEL_HPP_
+
+#include "datahandlinglibs/concepts/LatencyBufferConcept.hpp"
+
+#include "fdreadoutmodules/dal/CompressedLatencyBufferConf.hpp"
+#include "fdreadoutmodules/opmon/compressed_latency_buffer_info.pb.h"
+#include "fdreadoutmodules/utils/FrameLayout.hpp"
+#include "fdreadoutmodules/utils/MemoryPlacement.hpp"
+#include "fdreadoutmodules/utils/RatePacer.hpp"
+#include "fdreadoutmodules/utils/SingleWriterCounter.hpp"
+#include "fdreadoutmodules/utils/WIBEthAdcCodec.hpp"
+
+#include "appmodel/LatencyBuffer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Latency buffer storing every element compressed with WIBEthAdcCodec, for more seconds of
+ * history in the same memory.
+ *
+ * - Elements are encoded into a ring of bytes, the arena, and indexed by a ring of entries holding
+ *   their timestamp and position. write() must be called from a single producer thread; it evicts
+ *   the oldest elements whose bytes it is about to overwrite.
+ * - copy_window() decodes only the frames overlapping the requested window, from any thread. The
+ *   index of the oldest element acts as a sequence lock: a read that raced with the eviction of its
+ *   element is detected and discarded.
+ * - Elements must arrive in timestamp order, as for the fixed rate queue.
+ * - back() is a raw copy of the newest element, so that the processor post-processing it does not
+ *   pay a decode; front() and the iterators decode into private buffers.
+ * - pop() and flush() must not run concurrently with write().
+ * - publish_opmon() publishes the compression ratio and the encoding cost since its previous call.
+ */
+template<class ReadoutType>
+class CompressedLatencyBufferModel : public datahandlinglibs::LatencyBufferConcept<ReadoutType>
+{
+  using FrameType = typename ReadoutType::FrameType;
+  static_assert(std::is_same_v<FrameType, WIBEthAdcCodec::Frame>, "Only WIBEth frames have a codec");
+  static_assert(std::is_trivially_copyable_v<ReadoutType> && sizeof(ReadoutType) % sizeof(FrameType) == 0,
+                "Elements must be plain arrays of frames");
+
+public:
+  static constexpr std::size_t frames_per_element = sizeof(ReadoutType) / sizeof(FrameType);
+  static constexpr std::size_t max_element_bytes = frames_per_element * WIBEthAdcCodec::max_encoded_size;
+
+  //! Snapshot of the content, for monitoring
+  struct CompressionStats
+  {
+    uint64_t arena_bytes = 0;
+    uint64_t stored_bytes = 0;    ///< Arena bytes used by the retained elements
+    uint64_t retained_bytes = 0;  ///< Raw size of the retained elements
+    uint64_t retained_ticks = 0;  ///< Timestamps covered by the retained elements
+    uint64_t frames_encoded = 0;  ///< Since construction
+    uint64_t raw_frames = 0;      ///< Frames stored uncompressed as they would not shrink, since construction
+    uint64_t encode_ns = 0;       ///< Since construction
+  };
+
+  class Iterator
+  {
+  public:
+    Iterator() = default;
+    Iterator(const CompressedLatencyBufferModel* lb, uint64_t seq)
+      : m_lb(lb)
+      , m_seq(seq)
+      , m_element(std::make_shared<ReadoutType>())
+    {
+      settle();
+    }
+
+    bool good() const { return m_lb != nullptr; }
+    const ReadoutType& operator*() const { return *m_element; }
+    const ReadoutType* operator->() const { return m_element.get(); }
+    Iterator& operator++()
+    {
+      ++m_seq;
+      settle();
+      return *this;
+    }
+    bool operator==(const Iterator& other) const
+    {
+      return m_lb == other.m_lb && (m_lb == nullptr || m_seq == other.m_seq);
+    }
+    bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+  private:
+    //! Decodes the element at m_seq, skipping ahead past evicted ones, or becomes the end iterator
+    void settle()
+    {
+      while (m_lb != nullptr) {
+        if (m_seq >= m_lb->m_head.load(std::memory_order_acquire)) {
+          m_lb = nullptr;
+          m_element.reset();
+          return;
+        }
+        m_seq = std::max(m_seq, m_lb->m_tail.load(std::memory_order_acquire));
+        if (m_lb->decode_element(m_seq, *m_element)) {
+          return;
+        }
+      }
+    }
+
+    const CompressedLatencyBufferModel* m_lb = nullptr;
+    uint64_t m_seq = 0;
+    std::shared_ptr<ReadoutType> m_element; // Shared by copies, decoded once per position
+  };
+
+  CompressedLatencyBufferModel()
+    : m_frame_ticks(find_frame_layout("WIBEthFrame")->tick_step)
+  {}
+
+  void conf(const appmodel::LatencyBuffer* cfg) override
+  {
+    TscClock::calibrate();
+    auto compressed_conf = cfg->cast<dal::CompressedLatencyBufferConf>();
+    const std::size_t mb = compressed_conf ? compressed_conf->get_compressed_size_mb() : 0;
+    allocate(cfg->get_size(), mb * 1024 * 1024);
+    const int node = cfg->get_numa_aware() ? static_cast<int>(cfg->get_numa_node()) : -1;
+    prepare_memory([this, node]() {
+      if (node >= 0) {
+        bind_to_numa_node(m_arena.get(), m_arena_bytes, node);
+        bind_to_numa_node(m_entries.get(), m_capacity * sizeof(Entry), node);
+      }
+      prefault_pages(m_arena.get(), m_arena_bytes, 0);
+      prefault_pages(m_entries.get(), m_capacity * sizeof(Entry), 0);
+    });
+  }
+
+  void scrap(const nlohmann::json& /*args*/) override
+  {
+    flush();
+    m_arena.reset();
+    m_entries.reset();
+    m_newest.reset();
+    m_arena_bytes = 0;
+    m_capacity = 0;
+  }
+
+  /**
+   * @brief Sets up the arena for size elements.
+   * @param arena_bytes Arena size, 0 for the memory size raw elements would take
+   */
+  void allocate_memory(std::size_t size, std::size_t arena_bytes = 0) { allocate(size, arena_bytes); }
+
+  std::size_t occupancy() const override
+  {
+    return m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_relaxed);
+  }
+
+  bool write(ReadoutType&& element) override
+  {
+    if (!m_arena) {
+      return false;
+    }
+    const int64_t start = TscClock::now_ns();
+    *m_newest = std::move(element);
+
+    // Elements never wrap around the end of the arena
+    uint64_t position = m_write_position;
+    const std::size_t offset = position % m_arena_bytes;
+    if (offset + max_element_bytes > m_arena_bytes) {
+      position += m_arena_bytes - offset;
+    }
+    evict_before(position + max_element_bytes);
+
+    uint8_t* out = m_arena.get() + position % m_arena_bytes;
+    const FrameType* frames = m_newest->begin();
+    std::size_t bytes = 0;
+    uint64_t raw_frames = 0;
+    for (std::size_t i = 0; i < frames_per_element; ++i) {
+      const std::size_t n = m_codec.encode(frames[i], out + bytes);
+      raw_frames += n == WIBEthAdcCodec::max_encoded_size;
+      bytes += n;
+    }
+
+    const uint64_t timestamp = m_newest->get_timestamp();
+    m_entries[m_head_local % m_capacity] = Entry{ timestamp, position, static_cast<uint32_t>(bytes) };
+    m_write_position = position + bytes;
+    if (m_head_local == m_tail_local) {
+      m_oldest_timestamp.store(timestamp, std::memory_order_relaxed);
+    }
+    m_newest_timestamp.store(timestamp + frames_per_element * m_frame_ticks - 1, std::memory_order_relaxed);
+    m_head.store(++m_head_local, std::memory_order_release);
+    m_stored_bytes.store(m_write_position - m_entries[m_tail_local % m_capacity].position, std::memory_order_relaxed);
+
+    m_frames_encoded.add(frames_per_element);
+    m_raw_frames.add(raw_frames);
+    m_encode_ns.add(static_cast<uint64_t>(std::max<int64_t>(TscClock::now_ns() - start, 0)));
+    return true;
+  }
+
+  //! Elements are only retrieved by window, see copy_window()
+  bool read(ReadoutType& /*element*/) override { return false; }
+
+  //! Decoded oldest element, valid until the next call from the same thread
+  const ReadoutType* front() override
+  {
+    thread_local std::unique_ptr<ReadoutType> scratch;
+    if (!scratch) {
+      scratch = std::make_unique<ReadoutType>();
+    }
+    while (occupancy() > 0) {
+      if (decode_element(m_tail.load(std::memory_order_acquire), *scratch)) {
+        return scratch.get();
+      }
+    }
+    return nullptr;
+  }
+
+  const ReadoutType* back() override { return occupancy() > 0 ? m_newest.get() : nullptr; }
+
+  void pop(std::size_t amount) override
+  {
+    const uint64_t tail = m_tail_local + std::min<uint64_t>(amount, m_head_local - m_tail_local);
+    set_tail(tail);
+  }
+
+  void flush() override { set_tail(m_head_local); }
+
+  Iterator begin() const
+  {
+    return occupancy() > 0 ? Iterator(this, m_tail.load(std::memory_order_acquire)) : end();
+  }
+  Iterator end() const { return Iterator(); }
+
+  //! First element holding frames at or after the timestamp of element
+  Iterator lower_bound(ReadoutType& element, bool /*with_errors*/ = false) const
+  {
+    const uint64_t head = m_head.load(std::memory_order_acquire);
+    const uint64_t tail = m_tail.load(std::memory_order_acquire);
+    return tail < head ? Iterator(this, first_overlapping(element.get_timestamp(), tail, head)) : end();
+  }
+
+  //! Timestamp of the oldest element; meaningless while occupancy() is 0
+  uint64_t oldest_timestamp() const { return m_oldest_timestamp.load(std::memory_order_acquire); }
+
+  //! Last timestamp covered by the newest element
+  uint64_t newest_timestamp() const { return m_newest_timestamp.load(std::memory_order_acquire); }
+
+  /**
+   * @brief Decodes the frames covering part of [begin, end) and appends them to out, in order.
+   *
+   * Frames outside the window are skipped without being decoded.
+   * @return false if elements of the window were evicted while they were being read
+   */
+  bool copy_window(uint64_t begin, uint64_t end, std::vector<FrameType>& out) const
+  {
+    const uint64_t head = m_head.load(std::memory_order_acquire);
+    const uint64_t tail = m_tail.load(std::memory_order_acquire);
+    if (end <= begin || tail >= head) {
+      return true;
+    }
+    bool intact = true;
+    for (uint64_t seq = first_overlapping(begin, tail, head); seq < head; ++seq) {
+      const Entry entry = m_entries[seq % m_capacity];
+      if (entry.timestamp >= end) {
+        // Past the window, unless the entry was recycled under us
+        std::atomic_thread_fence(std::memory_order_acquire);
+        intact = intact && m_tail.load(std::memory_order_relaxed) <= seq;
+        break;
+      }
+      const std::size_t before = out.size();
+      const uint8_t* in = m_arena.get() + entry.position % m_arena_bytes;
+      const uint8_t* const last = in + std::min<std::size_t>(entry.bytes, max_element_bytes);
+      for (std::size_t i = 0; i < frames_per_element && in != nullptr; ++i) {
+        if (last - in < static_cast<std::ptrdiff_t>(s_header_bytes)) {
+          in = nullptr;
+          break;
+        }
+        const uint64_t ts = m_codec.peek_timestamp(in);
+        if (ts < end && ts + m_frame_ticks > begin) {
+          out.emplace_back();
+          in = m_codec.decode(in, last, out.back());
+        } else {
+          in = WIBEthAdcCodec::skip(in, last);
+        }
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (in == nullptr || m_tail.load(std::memory_order_relaxed) > seq) {
+        out.resize(before);
+        intact = false;
+      }
+    }
+    return intact;
+  }
+
+  CompressionStats compression_stats() const
+  {
+    CompressionStats stats;
+    const std::size_t elements = occupancy();
+    stats.arena_bytes = m_arena_bytes;
+    stats.stored_bytes = elements > 0 ? m_stored_bytes.load(std::memory_order_relaxed) : 0;
+    stats.retained_bytes = elements * sizeof(ReadoutType);
+    stats.retained_ticks = elements > 0 ? newest_timestamp() + 1 - oldest_timestamp() : 0;
+    stats.frames_encoded = m_frames_encoded.load();
+    stats.raw_frames = m_raw_frames.load();
+    stats.encode_ns = m_encode_ns.load();
+    return stats;
+  }
+
+  //! Opmon thread: passes a CompressedLatencyBufferInfo to publish
+  template<class Publish>
+  void publish_opmon(const Publish& publish)
+  {
+    auto stats = compression_stats();
+    opmon::CompressedLatencyBufferInfo info;
+    info.set_arena_bytes(stats.arena_bytes);
+    info.set_stored_bytes(stats.stored_bytes);
+    if (stats.stored_bytes > 0) {
+      info.set_compression_ratio(static_cast<double>(stats.retained_bytes) / stats.stored_bytes);
+    }
+    info.set_retained_ticks(stats.retained_ticks);
+    info.set_raw_frames(stats.raw_frames - m_last_raw_frames);
+    if (stats.frames_encoded > m_last_frames_encoded) {
+      info.set_encode_ns_per_frame(static_cast<double>(stats.encode_ns - m_last_encode_ns) /
+                                   (stats.frames_encoded - m_last_frames_encoded));
+    }
+    m_last_raw_frames = stats.raw_frames;
+    m_last_frames_encoded = stats.frames_encoded;
+    m_last_encode_ns = stats.encode_ns;
+    publish(std::move(info));
+  }
+
+private:
+  struct Entry
+  {
+    uint64_t timestamp; ///< Of the first frame
+    uint64_t position;  ///< Arena offset, counted without wrapping
+    uint32_t bytes;
+  };
+
+  // Format byte and header, where the timestamp of an encoded frame is read
+  static constexpr std::size_t s_header_bytes = 1 + offsetof(FrameType, adc_words);
+
+  // Smallest encoded frame: format byte, header and one width byte per sample
+  static constexpr std::size_t s_min_frame_bytes = s_header_bytes + 64;
+
+  void allocate(std::size_t size, std::size_t arena_bytes)
+  {
+    flush();
+    m_arena_bytes = std::max(arena_bytes > 0 ? arena_bytes : size * sizeof(ReadoutType), 2 * max_element_bytes);
+    // One entry per element the arena can hold at best, so that the index never limits retention
+    m_capacity = m_arena_bytes / (frames_per_element * s_min_frame_bytes) + 1;
+    m_arena.reset(new uint8_t[m_arena_bytes]);
+    m_entries.reset(new Entry[m_capacity]);
+    m_newest = std::make_unique<ReadoutType>();
+  }
+
+  //! Producer only: evicts the elements starting less than one lap of the arena before end
+  void evict_before(uint64_t end)
+  {
+    uint64_t tail = m_tail_local;
+    while (tail < m_head_local) {
+      const Entry& oldest = m_entries[tail % m_capacity];
+      if (m_head_local - tail < m_capacity && oldest.position + m_arena_bytes >= end) {
+        break;
+      }
+      ++tail;
+    }
+    if (tail != m_tail_local) {
+      set_tail(tail);
+    }
+  }
+
+  //! Producer only: the elements before tail are gone; readers of them notice before any overwrite
+  void set_tail(uint64_t tail)
+  {
+    m_tail_local = tail;
+    m_tail.store(tail, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    if (tail < m_head_local) {
+      const Entry& oldest = m_entries[tail % m_capacity];
+      m_oldest_timestamp.store(oldest.timestamp, std::memory_order_release);
+      m_stored_bytes.store(m_write_position - oldest.position, std::memory_order_relaxed);
+    }
+  }
+
+  //! First element in [tail, head) whose frames reach timestamp, head if none does
+  uint64_t first_overlapping(uint64_t timestamp, uint64_t tail, uint64_t head) const
+  {
+    const uint64_t element_ticks = frames_per_element * m_frame_ticks;
+    uint64_t lo = tail;
+    uint64_t hi = head;
+    while (lo < hi) {
+      const uint64_t mid = lo + (hi - lo) / 2;
+      if (m_entries[mid % m_capacity].timestamp + element_ticks > timestamp) {
+        hi = mid;
+      } else {
+        lo = mid + 1;
+      }
+    }
+    // Entries read above may have been recycled; the ones still retained were read correctly
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return std::max(lo, m_tail.load(std::memory_order_relaxed));
+  }
+
+  //! Decodes element seq into element; false if it was evicted before or while being read
+  bool decode_element(uint64_t seq, ReadoutType& element) const
+  {
+    const Entry entry = m_entries[seq % m_capacity];
+    const uint8_t* in = m_arena.get() + entry.position % m_arena_bytes;
+    const uint8_t* const last = in + std::min<std::size_t>(entry.bytes, max_element_bytes);
+    FrameType* frames = element.begin();
+    for (std::size_t i = 0; i < frames_per_element && in != nullptr; ++i) {
+      in = m_codec.decode(in, last, frames[i]);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return in != nullptr && m_tail.load(std::memory_order_relaxed) <= seq;
+  }
+
+  // Configuration
+  WIBEthAdcCodec m_codec;
+  const uint64_t m_frame_ticks;
+  std::size_t m_arena_bytes = 0;
+  std::size_t m_capacity = 0;
+
+  // Storage
+  std::unique_ptr<uint8_t[]> m_arena;
+  std::unique_ptr<Entry[]> m_entries;
+  std::unique_ptr<ReadoutType> m_newest;
+
+  // Producer state
+  uint64_t m_head_local = 0;
+  uint64_t m_tail_local = 0;
+  uint64_t m_write_position = 0;
+  SingleWriterCounter m_frames_encoded;
+  SingleWriterCounter m_raw_frames;
+  SingleWriterCounter m_encode_ns;
+
+  // Published to readers
+  std::atomic<uint64_t> m_head{ 0 };
+  std::atomic<uint64_t> m_tail{ 0 };
+  std::atomic<uint64_t> m_oldest_timestamp{ 0 };
+  std::atomic<uint64_t> m_newest_timestamp{ 0 };
+  std::atomic<uint64_t> m_stored_bytes{ 0 };
+
+  // Only touched by the opmon thread
+  uint64_t m_last_raw_frames = 0;
+  uint64_t m_last_frames_encoded = 0;
+  uint64_t m_last_encode_ns = 0;
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_COMPRESSEDLATENCYBUFFERMODEL_HPP_
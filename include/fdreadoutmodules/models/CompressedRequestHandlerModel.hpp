@@ -0,0 +1,34 @@
+/**
+ * @file CompressedRequestHandlerModel.hpp Request handler for CompressedLatencyBufferModel
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_COMPRESSEDREQUESTHANDLERMODEL_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_COMPRESSEDREQUESTHANDLERMODEL_HPP_
+
+#include "fdreadoutmodules/models/WindowCopyRequestHandlerModel.hpp"
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Serves DataRequests from a CompressedLatencyBufferModel.
+ *
+ * Only the frames overlapping the window are decoded, into the per-thread buffer that the fragment
+ * is built from. Recording goes through the generic iterator path, which decodes one element at a time.
+ */
+template<class ReadoutType, class LatencyBufferType>
+class CompressedRequestHandlerModel
+  : public WindowCopyRequestHandlerModel<ReadoutType, LatencyBufferType, typename ReadoutType::FrameType>
+{
+public:
+  using inherited = WindowCopyRequestHandlerModel<ReadoutType, LatencyBufferType, typename ReadoutType::FrameType>;
+  using inherited::inherited;
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_COMPRESSEDREQUESTHANDLERMODEL_HPP_
@@ -0,0 +1,346 @@
+/**
+ * @file DeferredRequestHandlerModel.hpp Request handler decorator waking deferred requests on data arrival
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_DEFERREDREQUESTHANDLERMODEL_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_DEFERREDREQUESTHANDLERMODEL_HPP_
+
+#include "fdreadoutmodules/models/InstrumentedLatencyBufferModel.hpp"
+#include "fdreadoutmodules/opmon/deferred_request_info.pb.h"
+#include "fdreadoutmodules/utils/LogLinearHistogram.hpp"
+#include "fdreadoutmodules/utils/TimerWheel.hpp"
+
+#include "appmodel/DataHandlerConf.hpp"
+#include "appmodel/DataHandlerModule.hpp"
+#include "appmodel/RequestHandler.hpp"
+#include "dfmessages/DataRequest.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace detail {
+template<class LB, class = void>
+struct has_write_listener : std::false_type
+{};
+template<class LB>
+struct has_write_listener<
+  LB,
+  std::void_t<decltype(std::declval<LB&>().set_write_listener(std::declval<LatencyBufferWriteListener*>()))>>
+  : std::true_type
+{};
+template<class LB, class = void>
+struct has_newest_timestamp : std::false_type
+{};
+template<class LB>
+struct has_newest_timestamp<LB, std::void_t<decltype(std::declval<const LB&>().newest_timestamp())>> : std::true_type
+{};
+} // namespace detail
+
+/**
+ * @brief Wraps a request handler model, parking the DataRequests whose window ends after the newest data
+ * until a write to the latency buffer completes it.
+ *
+ * The default handler serves such a request, finds it incomplete, and re-checks it from a waiting list
+ * every millisecond. Here it is not served at all on arrival: it goes to a TimerWheel keyed on its
+ * window end, which the InstrumentedLatencyBufferModel advances with the timestamp of every element
+ * written, so the request is issued from the consumer thread by the write that completes its window.
+ * Writes before that compare one timestamp. After request_timeout_ms a request is issued anyway, from a
+ * thread sleeping until the next deadline, and at stop all parked requests are. Retries and requests
+ * to an empty buffer take the path of the wrapped handler.
+ */
+template<class ReadoutType, class RequestHandlerType>
+class DeferredRequestHandlerModel
+  : public RequestHandlerType
+  , public LatencyBufferWriteListener
+{
+public:
+  using inherited = RequestHandlerType;
+  using inherited::inherited;
+
+  ~DeferredRequestHandlerModel() { stop_expiry(); }
+
+  void conf(const appmodel::DataHandlerModule* modconf) override
+  {
+    inherited::conf(modconf);
+    m_timeout = std::chrono::milliseconds(
+      modconf->get_module_configuration()->get_request_handler()->get_request_timeout_ms());
+    if constexpr (detail::has_write_listener<std::decay_t<decltype(*this->m_latency_buffer)>>::value) {
+      this->m_latency_buffer->set_write_listener(this);
+      m_enabled = m_timeout.count() > 0;
+    }
+  }
+
+  void scrap(const nlohmann::json& args) override
+  {
+    if constexpr (detail::has_write_listener<std::decay_t<decltype(*this->m_latency_buffer)>>::value) {
+      this->m_latency_buffer->set_write_listener(nullptr);
+    }
+    m_enabled = false;
+    inherited::scrap(args);
+  }
+
+  void start(const nlohmann::json& args) override
+  {
+    inherited::start(args);
+    if (m_enabled) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_running = true;
+      m_expiry_thread = std::thread(&DeferredRequestHandlerModel::expire_requests, this);
+    }
+  }
+
+  void stop(const nlohmann::json& args) override
+  {
+    stop_expiry();
+    std::vector<dfmessages::DataRequest> parked;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (auto& [id, request] : m_pending) {
+        parked.push_back(std::move(request.request));
+      }
+      m_pending.clear();
+      m_deadlines.clear();
+      m_wheel.reset(m_wheel.now());
+      m_wake_at.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+    }
+    // Served with whatever has arrived, as the wrapped handler does with its waiting list at stop
+    for (auto& dr : parked) {
+      inherited::issue_request(std::move(dr), true);
+    }
+    inherited::stop(args);
+  }
+
+  void issue_request(dfmessages::DataRequest dr, bool is_retry = false) override
+  {
+    if (!is_retry && park(dr)) {
+      return;
+    }
+    inherited::issue_request(std::move(dr), is_retry);
+  }
+
+protected:
+  void generate_opmon_data() override
+  {
+    inherited::generate_opmon_data();
+    if (!m_enabled) {
+      return;
+    }
+    opmon::DeferredRequestInfo info;
+    info.set_requests_deferred(m_deferred.exchange(0, std::memory_order_relaxed));
+    info.set_requests_woken(m_woken.exchange(0, std::memory_order_relaxed));
+    info.set_requests_timed_out(m_timed_out.exchange(0, std::memory_order_relaxed));
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      info.set_requests_waiting(static_cast<uint32_t>(m_pending.size()));
+    }
+    auto wait = m_wait_us.snapshot_and_reset();
+    info.set_wait_p50_ms(wait.percentile(0.50) / 1000.);
+    info.set_wait_p99_ms(wait.percentile(0.99) / 1000.);
+    info.set_wait_max_ms(wait.max / 1000.);
+    auto wake = m_wake_ns.snapshot_and_reset();
+    info.set_wake_latency_p50_us(wake.percentile(0.50) / 1000.);
+    info.set_wake_latency_p99_us(wake.percentile(0.99) / 1000.);
+    info.set_wake_latency_max_us(wake.max / 1000.);
+    this->publish(std::move(info));
+  }
+
+  // Consumer thread of the DataHandlingModel, once the newest timestamp reaches the earliest window end
+  void on_written(uint64_t timestamp) override
+  {
+    const auto written_at = std::chrono::steady_clock::now();
+    std::vector<dfmessages::DataRequest> ready;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      release(timestamp, written_at, ready);
+    }
+    issue(ready, written_at);
+  }
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  struct Parked
+  {
+    dfmessages::DataRequest request;
+    clock::time_point since;
+  };
+
+  // Returns false if the request has to be served now
+  bool park(const dfmessages::DataRequest& dr)
+  {
+    const uint64_t end = dr.request_information.window_end;
+    std::vector<dfmessages::DataRequest> ready;
+    const auto now = clock::now();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_running) {
+        return false;
+      }
+      uint64_t newest = 0;
+      if (!newest_timestamp(newest) || end <= newest) {
+        return false;
+      }
+      if (m_pending.empty()) {
+        m_wheel.reset(newest);
+      }
+      const uint64_t id = m_next_id++;
+      if (!m_wheel.insert(end, id)) {
+        return false;
+      }
+      m_pending.emplace(id, Parked{ dr, now });
+      if (m_deadlines.empty()) {
+        m_expiry_cv.notify_one();
+      }
+      m_deadlines.emplace_back(now + m_timeout, id);
+      m_deferred.fetch_add(1, std::memory_order_relaxed);
+      m_wake_at.store(m_wheel.next_due(), std::memory_order_relaxed);
+
+      // A write between reading the newest timestamp and lowering m_wake_at did not see this request
+      newest_timestamp(newest);
+      release(newest, now, ready);
+    }
+    issue(ready, now);
+    return true;
+  }
+
+  /**
+   * @brief Request thread. Buffers that rewrite their newest element in place, like the compressed one,
+   * publish its timestamp apart, as back() may not be read while the consumer writes.
+   * @return false if the buffer is empty
+   */
+  bool newest_timestamp(uint64_t& newest)
+  {
+    auto& lb = *this->m_latency_buffer;
+    if constexpr (detail::has_newest_timestamp<std::decay_t<decltype(lb)>>::value) {
+      if (lb.occupancy() == 0) {
+        return false;
+      }
+      newest = lb.newest_timestamp();
+      return true;
+    } else {
+      auto back = lb.back();
+      if (back == nullptr) {
+        return false;
+      }
+      newest = back->get_timestamp();
+      return true;
+    }
+  }
+
+  // Requires m_mutex
+  void release(uint64_t newest, clock::time_point now, std::vector<dfmessages::DataRequest>& ready)
+  {
+    m_expired.clear();
+    m_wheel.advance(newest, m_expired);
+    for (auto id : m_expired) {
+      auto it = m_pending.find(id);
+      if (it == m_pending.end()) {
+        continue; // Timed out before
+      }
+      m_wait_us.record(
+        static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - it->second.since).count()));
+      ready.push_back(std::move(it->second.request));
+      m_pending.erase(it);
+    }
+    m_wake_at.store(m_wheel.next_due(), std::memory_order_relaxed);
+  }
+
+  void issue(std::vector<dfmessages::DataRequest>& ready, clock::time_point written_at)
+  {
+    for (auto& dr : ready) {
+      inherited::issue_request(std::move(dr), true);
+      m_wake_ns.record(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - written_at).count()));
+    }
+    m_woken.fetch_add(ready.size(), std::memory_order_relaxed);
+  }
+
+  // Expiry thread: deadlines are in arrival order since all requests wait for the same timeout
+  void expire_requests()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_running) {
+      if (m_deadlines.empty()) {
+        m_expiry_cv.wait(lock);
+        continue;
+      }
+      const auto now = clock::now();
+      if (now < m_deadlines.front().first) {
+        m_expiry_cv.wait_until(lock, m_deadlines.front().first);
+        continue;
+      }
+      std::vector<dfmessages::DataRequest> expired;
+      while (!m_deadlines.empty() && m_deadlines.front().first <= now) {
+        auto it = m_pending.find(m_deadlines.front().second);
+        m_deadlines.pop_front();
+        if (it != m_pending.end()) {
+          expired.push_back(std::move(it->second.request));
+          m_pending.erase(it);
+        }
+      }
+      if (m_pending.empty()) {
+        // Drops the wheel entries of the requests that timed out
+        m_wheel.reset(m_wheel.now());
+        m_wake_at.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+      }
+      lock.unlock();
+      for (auto& dr : expired) {
+        inherited::issue_request(std::move(dr), true);
+      }
+      m_timed_out.fetch_add(expired.size(), std::memory_order_relaxed);
+      lock.lock();
+    }
+  }
+
+  void stop_expiry()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_running = false;
+    }
+    m_expiry_cv.notify_one();
+    if (m_expiry_thread.joinable()) {
+      m_expiry_thread.join();
+    }
+  }
+
+  std::chrono::milliseconds m_timeout{ 0 };
+  bool m_enabled = false;
+
+  std::mutex m_mutex;
+  bool m_running = false;
+  TimerWheel m_wheel;
+  std::unordered_map<uint64_t, Parked> m_pending;
+  std::deque<std::pair<clock::time_point, uint64_t>> m_deadlines;
+  std::vector<uint64_t> m_expired;
+  uint64_t m_next_id = 0;
+  std::condition_variable m_expiry_cv;
+  std::thread m_expiry_thread;
+
+  std::atomic<uint64_t> m_deferred{ 0 };
+  std::atomic<uint64_t> m_woken{ 0 };
+  std::atomic<uint64_t> m_timed_out{ 0 };
+  LogLinearHistogram<> m_wait_us;
+  LogLinearHistogram<> m_wake_ns;
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_DEFERREDREQUESTHANDLERMODEL_HPP_
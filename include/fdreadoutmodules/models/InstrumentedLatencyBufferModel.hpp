@@ -0,0 +1,170 @@
+/**
+ * @file InstrumentedLatencyBufferModel.hpp Latency buffer decorator collecting ingest statistics
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_INSTRUMENTEDLATENCYBUFFERMODEL_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_INSTRUMENTEDLATENCYBUFFERMODEL_HPP_
+
+#include "fdreadoutmodules/utils/SingleWriterCounter.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace detail {
+template<class LB, class ReadoutType, class = void>
+struct has_write_batch : std::false_type
+{};
+template<class LB, class ReadoutType>
+struct has_write_batch<
+  LB,
+  ReadoutType,
+  std::void_t<decltype(std::declval<LB&>().write_batch(std::declval<ReadoutType* const*>(), std::size_t{}))>>
+  : std::true_type
+{};
+} // namespace detail
+
+/**
+ * @brief Statistics of the producer side of a latency buffer.
+ *
+ * The counters are written by the consumer thread of the DataHandlingModel only. The high-water mark is
+ * also restarted by the monitoring thread, so it is raised with a compare-exchange instead.
+ */
+struct LatencyBufferIngestMetrics
+{
+  SingleWriterCounter frames_written;
+  SingleWriterCounter write_failures;
+  alignas(64) std::atomic<uint64_t> occupancy_hwm{ 0 };
+};
+
+/**
+ * @brief Told about the elements written to an InstrumentedLatencyBufferModel, on the consumer thread.
+ *
+ * Only timestamps from m_wake_at on reach on_written(), so that a listener waiting for a later
+ * timestamp costs the write one relaxed load.
+ */
+class LatencyBufferWriteListener
+{
+public:
+  virtual ~LatencyBufferWriteListener() = default;
+
+  void written(uint64_t timestamp)
+  {
+    if (timestamp >= m_wake_at.load(std::memory_order_relaxed)) {
+      on_written(timestamp);
+    }
+  }
+
+protected:
+  virtual void on_written(uint64_t timestamp) = 0;
+
+  std::atomic<uint64_t> m_wake_at{ std::numeric_limits<uint64_t>::max() };
+};
+
+/**
+ * @brief Wraps any latency buffer model and counts writes on its hot path.
+ *
+ * The decorator is a drop-in replacement for LatencyBufferType in the DataHandlingModel and request
+ * handler template arguments. It adds two relaxed stores per frame and no locked instruction, and
+ * passes the timestamp of every element written to a LatencyBufferWriteListener if one is set.
+ * write_batch() counts and notifies once per batch, and writes element by element if the wrapped
+ * model has no write_batch() of its own.
+ */
+template<class ReadoutType, class LatencyBufferType>
+class InstrumentedLatencyBufferModel : public LatencyBufferType
+{
+public:
+  using inherited = LatencyBufferType;
+  using inherited::inherited;
+
+  bool write(ReadoutType&& element) override
+  {
+    const uint64_t timestamp = m_listener ? element.get_timestamp() : 0;
+    if (!inherited::write(std::move(element))) {
+      m_metrics.write_failures.add();
+      return false;
+    }
+    m_metrics.frames_written.add();
+    raise_occupancy_hwm(this->occupancy());
+    if (m_listener) {
+      m_listener->written(timestamp);
+    }
+    return true;
+  }
+
+  /**
+   * @brief Writes count elements, moving from the pointed ones; the elements stay readable afterwards, as
+   * the readout types are trivially copyable.
+   * @return Elements written
+   */
+  std::size_t write_batch(ReadoutType* const* elements, std::size_t count)
+  {
+    if (count == 0) {
+      return 0;
+    }
+    std::size_t written = 0;
+    uint64_t newest = 0;
+    if constexpr (detail::has_write_batch<inherited, ReadoutType>::value) {
+      written = inherited::write_batch(elements, count);
+      if (written > 0) {
+        newest = elements[written - 1]->get_timestamp();
+      }
+    } else {
+      // Not a queue: a failed write does not mean the next one fails
+      for (std::size_t i = 0; i < count; ++i) {
+        const uint64_t timestamp = elements[i]->get_timestamp();
+        if (inherited::write(std::move(*elements[i]))) {
+          newest = timestamp;
+          ++written;
+        }
+      }
+    }
+    m_metrics.frames_written.add(written);
+    if (written < count) {
+      m_metrics.write_failures.add(count - written);
+    }
+    raise_occupancy_hwm(this->occupancy());
+    if (m_listener && written > 0) {
+      m_listener->written(newest);
+    }
+    return written;
+  }
+
+  //! Set before the consumer thread starts writing, e.g. at conf
+  void set_write_listener(LatencyBufferWriteListener* listener) { m_listener = listener; }
+
+  const LatencyBufferIngestMetrics& ingest_metrics() const { return m_metrics; }
+
+  //! Restart the high-water mark from the current occupancy (monitoring thread)
+  uint64_t exchange_occupancy_hwm()
+  {
+    return m_metrics.occupancy_hwm.exchange(this->occupancy(), std::memory_order_relaxed);
+  }
+
+private:
+  // Consumer thread: a plain load in the common case, where the occupancy is below the mark
+  void raise_occupancy_hwm(uint64_t occupancy)
+  {
+    uint64_t hwm = m_metrics.occupancy_hwm.load(std::memory_order_relaxed);
+    while (occupancy > hwm &&
+           !m_metrics.occupancy_hwm.compare_exchange_weak(hwm, occupancy, std::memory_order_relaxed)) {
+    }
+  }
+
+  LatencyBufferIngestMetrics m_metrics;
+  LatencyBufferWriteListener* m_listener = nullptr;
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_INSTRUMENTEDLATENCYBUFFERMODEL_HPP_
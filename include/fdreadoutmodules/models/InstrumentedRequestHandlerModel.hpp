@@ -0,0 +1,230 @@
+/**
+ * @file InstrumentedRequestHandlerModel.hpp Request handler decorator publishing per-link performance
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_INSTRUMENTEDREQUESTHANDLERMODEL_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_INSTRUMENTEDREQUESTHANDLERMODEL_HPP_
+
+#include "fdreadoutmodules/opmon/link_performance_info.pb.h"
+#include "fdreadoutmodules/utils/LogLinearHistogram.hpp"
+
+#include "dfmessages/DataRequest.hpp"
+#include "logging/Logging.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace detail {
+template<class LB, class = void>
+struct has_ingest_metrics : std::false_type
+{};
+template<class LB>
+struct has_ingest_metrics<LB, std::void_t<decltype(std::declval<LB&>().exchange_occupancy_hwm())>> : std::true_type
+{};
+
+template<class RH, class = void>
+struct has_recording_listener : std::false_type
+{};
+template<class RH>
+struct has_recording_listener<RH, std::void_t<decltype(std::declval<RH&>().on_recording_done(nullptr))>>
+  : std::true_type
+{};
+} // namespace detail
+
+/**
+ * @brief Wraps a request handler model, timing every DataRequest it serves.
+ *
+ * Service time and fragment size go to lock-free histograms that the request handling threads fill
+ * concurrently. On every opmon cycle the histograms are drained and published, together with the
+ * ingest statistics of the latency buffer when it is an InstrumentedLatencyBufferModel.
+ *
+ * As the outermost request handler of every model, it also reports the end of a recording started by
+ * record(): the cleanup pass checks the recording thread of the handler and calls on_recording_done().
+ */
+template<class ReadoutType, class RequestHandlerType>
+class InstrumentedRequestHandlerModel : public RequestHandlerType
+{
+public:
+  using inherited = RequestHandlerType;
+  using RequestResult = typename inherited::RequestResult;
+  using ResultCode = typename inherited::ResultCode;
+  using inherited::inherited;
+
+  void issue_request(dfmessages::DataRequest dr, bool is_retry = false) override
+  {
+    if (is_retry) {
+      // A request still waiting for its data was counted as deferred on its first attempt
+      std::lock_guard<std::mutex> lock(m_retries_mutex);
+      m_retries.insert(request_key(dr));
+      m_retries_pending.store(m_retries.size(), std::memory_order_relaxed);
+    }
+    inherited::issue_request(std::move(dr), is_retry);
+  }
+
+  //! Any thread: done is called once by the cleanup thread when the recording thread is idle, null cancels
+  void on_recording_done(std::function<void()> done)
+  {
+    std::lock_guard<std::mutex> lock(m_recording_mutex);
+    m_recording_done = std::move(done);
+  }
+
+  void cleanup_check() override
+  {
+    inherited::cleanup_check();
+    std::function<void()> done;
+    {
+      std::lock_guard<std::mutex> lock(m_recording_mutex);
+      if (m_recording_done && this->m_recording_thread.get_readiness()) {
+        done = std::move(m_recording_done);
+        m_recording_done = nullptr;
+      }
+    }
+    if (done) {
+      done();
+    }
+  }
+
+  void stop(const nlohmann::json& args) override
+  {
+    inherited::stop(args);
+    // The cleanup thread is gone: a recording ending now is not reported
+    on_recording_done(nullptr);
+  }
+
+protected:
+  RequestResult data_request(dfmessages::DataRequest dr) override
+  {
+    const bool retry = m_retries_pending.load(std::memory_order_relaxed) > 0 && take_retry(dr);
+    auto start = std::chrono::steady_clock::now();
+    auto result = inherited::data_request(std::move(dr));
+    auto service_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    switch (result.result_code) {
+      case ResultCode::kFound:
+        m_requests_served.fetch_add(1, std::memory_order_relaxed);
+        break;
+      case ResultCode::kTooOld:
+        m_requests_late.fetch_add(1, std::memory_order_relaxed);
+        break;
+      case ResultCode::kNotYetArrived:
+        // Parked and re-issued later: the final attempt is the one that gets timed
+        if (!retry) {
+          m_requests_deferred.fetch_add(1, std::memory_order_relaxed);
+        }
+        return result;
+      default:
+        m_requests_dropped.fetch_add(1, std::memory_order_relaxed);
+        break;
+    }
+    m_service_ns.record(static_cast<uint64_t>(service_ns));
+    if (result.fragment) {
+      m_fragment_bytes.record(result.fragment->get_size());
+    }
+    return result;
+  }
+
+  void generate_opmon_data() override
+  {
+    inherited::generate_opmon_data();
+
+    opmon::LinkPerformanceInfo info;
+    auto now = std::chrono::steady_clock::now();
+    double interval_ms = std::chrono::duration<double, std::milli>(now - m_last_publication).count();
+    m_last_publication = now;
+
+    auto& lb = this->m_latency_buffer;
+    if (lb) {
+      if constexpr (detail::has_ingest_metrics<std::decay_t<decltype(*lb)>>::value) {
+        const auto& im = lb->ingest_metrics();
+        uint64_t written = im.frames_written.load();
+        uint64_t failures = im.write_failures.load();
+        info.set_frames_ingested(written - m_last_frames_written);
+        info.set_lb_write_failures(failures - m_last_write_failures);
+        if (interval_ms > 0.) {
+          info.set_frame_ingest_rate_khz((written - m_last_frames_written) / interval_ms);
+        }
+        m_last_frames_written = written;
+        m_last_write_failures = failures;
+        info.set_lb_occupancy_hwm(lb->exchange_occupancy_hwm());
+      } else {
+        info.set_lb_occupancy_hwm(lb->occupancy());
+      }
+      info.set_lb_occupancy(lb->occupancy());
+    }
+
+    info.set_requests_served(m_requests_served.exchange(0, std::memory_order_relaxed));
+    info.set_requests_late(m_requests_late.exchange(0, std::memory_order_relaxed));
+    info.set_requests_dropped(m_requests_dropped.exchange(0, std::memory_order_relaxed));
+    info.set_requests_deferred(m_requests_deferred.exchange(0, std::memory_order_relaxed));
+
+    auto latency = m_service_ns.snapshot_and_reset();
+    info.set_request_latency_p50_us(latency.percentile(0.50) / 1000.);
+    info.set_request_latency_p99_us(latency.percentile(0.99) / 1000.);
+    info.set_request_latency_max_us(latency.max / 1000.);
+
+    auto sizes = m_fragment_bytes.snapshot_and_reset();
+    info.set_fragment_bytes(sizes.sum);
+    info.set_fragment_size_avg(sizes.mean());
+    info.set_fragment_size_p99(sizes.percentile(0.99));
+    info.set_fragment_size_max(sizes.max);
+
+    this->publish(std::move(info));
+  }
+
+private:
+  using request_key_t = std::tuple<uint64_t, uint64_t, uint64_t>;
+
+  static request_key_t request_key(const dfmessages::DataRequest& dr)
+  {
+    return { dr.request_number, dr.trigger_number, dr.request_information.window_begin };
+  }
+
+  //! Whether dr was re-issued as a retry, forgetting it
+  bool take_retry(const dfmessages::DataRequest& dr)
+  {
+    std::lock_guard<std::mutex> lock(m_retries_mutex);
+    const bool retry = m_retries.erase(request_key(dr)) > 0;
+    m_retries_pending.store(m_retries.size(), std::memory_order_relaxed);
+    return retry;
+  }
+
+  LogLinearHistogram<> m_service_ns;
+  LogLinearHistogram<> m_fragment_bytes;
+  std::atomic<uint64_t> m_requests_served{ 0 };
+  std::atomic<uint64_t> m_requests_late{ 0 };
+  std::atomic<uint64_t> m_requests_dropped{ 0 };
+  std::atomic<uint64_t> m_requests_deferred{ 0 };
+
+  std::mutex m_recording_mutex;
+  std::function<void()> m_recording_done;
+
+  // Requests re-issued by issue_request(dr, true) and not yet served
+  std::mutex m_retries_mutex;
+  std::set<request_key_t> m_retries;
+  std::atomic<std::size_t> m_retries_pending{ 0 };
+
+  // Only touched by the opmon thread
+  std::chrono::steady_clock::time_point m_last_publication{ std::chrono::steady_clock::now() };
+  uint64_t m_last_frames_written{ 0 };
+  uint64_t m_last_write_failures{ 0 };
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_INSTRUMENTEDREQUESTHANDLERMODEL_HPP_
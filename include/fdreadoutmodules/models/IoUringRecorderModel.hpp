@@ -0,0 +1,169 @@
+/**
+ * @file IoUringRecorderModel.hpp Recorder model writing through io_uring
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_IOURINGRECORDERMODEL_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_IOURINGRECORDERMODEL_HPP_
+
+#include "appmodel/DataRecorderConf.hpp"
+#include "appmodel/DataRecorderModule.hpp"
+#include "confmodel/Connection.hpp"
+#include "iomanager/IOManager.hpp"
+#include "logging/Logging.hpp"
+
+#include "datahandlinglibs/DataHandlingIssues.hpp"
+#include "datahandlinglibs/ReadoutLogging.hpp"
+#include "datahandlinglibs/concepts/RecorderConcept.hpp"
+#include "datahandlinglibs/utils/ReusableThread.hpp"
+
+#include "fdreadoutmodules/FDReadoutModulesIssues.hpp"
+#include "fdreadoutmodules/dal/DataRecorderIoUringConf.hpp"
+#include "fdreadoutmodules/opmon/async_recorder_info.pb.h"
+#include "fdreadoutmodules/utils/IoUringFileWriter.hpp"
+#include "fdreadoutmodules/utils/TimestampIndex.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Records the raw input of one link with several asynchronous writes in flight.
+ *
+ * Drop-in alternative to datahandlinglibs::RecorderModel: the receiving thread only copies each element
+ * into a staging buffer of the IoUringFileWriter and never waits for the disk unless all buffers are
+ * in flight.
+ */
+template<class ReadoutType>
+class IoUringRecorderModel : public datahandlinglibs::RecorderConcept
+{
+public:
+  explicit IoUringRecorderModel(std::string name)
+    : m_work_thread(0)
+    , m_name(std::move(name))
+  {}
+
+  void init(const appmodel::DataRecorderModule* conf) override
+  {
+    try {
+      m_data_receiver = get_iom_receiver<ReadoutType>(conf->get_inputs()[0]->UID());
+    } catch (const ers::Issue& excpt) {
+      throw datahandlinglibs::GenericResourceQueueError(ERS_HERE, "raw_recording", m_name, excpt);
+    }
+    m_conf = conf->get_configuration();
+    auto uring_conf = m_conf->cast<dal::DataRecorderIoUringConf>();
+    m_queue_depth = uring_conf->get_queue_depth();
+    m_index_stride = uring_conf->get_index_stride();
+  }
+
+  void do_conf(const nlohmann::json& /*args*/) override
+  {
+    m_writer.open(
+      m_conf->get_output_file(), m_conf->get_streaming_buffer_size(), m_queue_depth, m_conf->get_use_o_direct());
+    m_bytes_accepted = 0;
+    if (m_index_stride > 0) {
+      m_index.open(m_conf->get_output_file(), sizeof(ReadoutType), m_index_stride);
+    }
+    TLOG() << m_name << ": Recording to " << m_conf->get_output_file() << " with " << m_queue_depth << " writes of "
+           << m_conf->get_streaming_buffer_size() << " bytes in flight";
+  }
+
+  void do_scrap(const nlohmann::json& /*args*/) override
+  {
+    m_writer.close();
+    m_index.close();
+  }
+
+  void do_start(const nlohmann::json& /*args*/) override
+  {
+    m_packets_processed = 0;
+    m_last_bytes_written = m_writer.bytes_written();
+    m_last_publication = std::chrono::steady_clock::now();
+    m_run_marker.store(true);
+    m_work_thread.set_name("recording", 0);
+    m_work_thread.set_work(&IoUringRecorderModel<ReadoutType>::do_work, this);
+  }
+
+  void do_stop(const nlohmann::json& /*args*/) override
+  {
+    m_run_marker.store(false);
+    while (!m_work_thread.get_readiness()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+protected:
+  void generate_opmon_data() override
+  {
+    opmon::AsyncRecorderInfo info;
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - m_last_publication).count();
+    uint64_t written = m_writer.bytes_written();
+    info.set_packets_recorded(m_packets_processed.exchange(0));
+    info.set_bytes_written(written - m_last_bytes_written);
+    if (seconds > 0.) {
+      info.set_write_throughput_mbs((written - m_last_bytes_written) / seconds / 1e6);
+    }
+    info.set_queue_depth(m_writer.inflight());
+    info.set_max_queue_depth(m_queue_depth);
+    info.set_buffer_stalls(m_writer.stalls());
+    info.set_write_errors(m_writer.errors());
+    m_last_bytes_written = written;
+    m_last_publication = now;
+    publish(std::move(info));
+  }
+
+private:
+  void do_work()
+  {
+    while (m_run_marker.load(std::memory_order_relaxed)) {
+      auto element = m_data_receiver->try_receive(std::chrono::milliseconds(100));
+      if (!element) {
+        continue;
+      }
+      if (m_index.is_open()) {
+        m_index.add(element->get_timestamp(), m_bytes_accepted);
+      }
+      m_bytes_accepted += sizeof(ReadoutType);
+      if (!m_writer.write(reinterpret_cast<const char*>(&(*element)), sizeof(ReadoutType))) { // NOLINT
+        ers::error(AsyncWriterError(ERS_HERE, m_conf->get_output_file(), "recording stopped after write errors"));
+        break;
+      }
+      m_packets_processed.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // Queue
+  using source_t = dunedaq::iomanager::ReceiverConcept<ReadoutType>;
+  std::shared_ptr<source_t> m_data_receiver;
+
+  // Internal
+  const appmodel::DataRecorderConf* m_conf = nullptr;
+  unsigned m_queue_depth = 0;
+  uint32_t m_index_stride = 0;
+  IoUringFileWriter m_writer;
+  TimestampIndexWriter m_index;
+  uint64_t m_bytes_accepted = 0;
+
+  // Threading
+  datahandlinglibs::ReusableThread m_work_thread;
+  std::atomic<bool> m_run_marker{ false };
+
+  // Stats
+  std::atomic<uint64_t> m_packets_processed{ 0 };
+  uint64_t m_last_bytes_written = 0;
+  std::chrono::steady_clock::time_point m_last_publication;
+  std::string m_name;
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_IOURINGRECORDERMODEL_HPP_
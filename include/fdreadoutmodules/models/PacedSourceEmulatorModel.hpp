@@ -0,0 +1,247 @@
+/**
+ * @file PacedSourceEmulatorModel.hpp Source emulator with precise, batched pacing
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_PACEDSOURCEEMULATORMODEL_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_PACEDSOURCEEMULATORMODEL_HPP_
+
+#include "fdreadoutmodules/opmon/emulator_pacing_info.pb.h"
+#include "fdreadoutmodules/utils/LogLinearHistogram.hpp"
+#include "fdreadoutmodules/utils/RatePacer.hpp"
+#include "fdreadoutmodules/utils/SharedInputFile.hpp"
+#include "fdreadoutmodules/utils/SingleWriterCounter.hpp"
+
+#include "appmodel/DataMoveCallbackConf.hpp"
+#include "appmodel/StreamEmulationParameters.hpp"
+#include "iomanager/IOManager.hpp"
+#include "iomanager/Sender.hpp"
+#include "logging/Logging.hpp"
+
+#include "datahandlinglibs/DataHandlingIssues.hpp"
+#include "datahandlinglibs/concepts/SourceEmulatorConcept.hpp"
+#include "datahandlinglibs/utils/ReusableThread.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+//! Shape of an emulated frame stream, resolved per link by FDFakeReaderModule
+struct EmulatedStreamParameters
+{
+  uint64_t time_tick_diff = 0; // DAQ clock ticks between consecutive frames
+  double dropout_rate = 0.;    // Fraction of elements that are not sent
+  double frame_error_rate = 0.;
+  double rate_khz = 0.;        // Elements per ms
+  uint16_t frames_per_tick = 1;
+  uint32_t batch_size = 1;     // Elements released per pacing deadline
+  bool spin = true;            // Busy-wait the last stretch before each deadline
+  PageBacking input_backing = PageBacking::kDefault;
+};
+
+/**
+ * @brief Replays a raw data file like SourceEmulatorModel, paced by a RatePacer.
+ *
+ * The file is a SharedInputFile, mapped once for all links replaying it; each link only rewrites the
+ * timestamps of its private copy of the element being sent. Elements are released in batches of
+ * batch_size at deadlines spaced batch_size / rate apart, the lateness of every batch with respect to its
+ * deadline is recorded and published together with the achieved rate. Frame errors are not injected.
+ */
+template<class ReadoutType>
+class PacedSourceEmulatorModel : public datahandlinglibs::SourceEmulatorConcept
+{
+public:
+  using sink_t = iomanager::SenderConcept<ReadoutType>;
+
+  static constexpr uint64_t clock_frequency_hz = 62500000;
+  static constexpr std::chrono::milliseconds send_timeout{ 1 };
+
+  PacedSourceEmulatorModel(std::string name, std::atomic<bool>& run_marker, const EmulatedStreamParameters& params)
+    : m_name(std::move(name))
+    , m_run_marker(run_marker)
+    , m_params(params)
+    , m_producer_thread(0)
+  {
+    m_params.batch_size = std::max<uint32_t>(m_params.batch_size, 1);
+    m_params.frames_per_tick = std::max<uint16_t>(m_params.frames_per_tick, 1);
+  }
+
+  void set_sender(const std::string& conn_name) override
+  {
+    if (!m_sender) {
+      m_sender = iomanager::IOManager::get()->get_sender<ReadoutType>(conn_name);
+    }
+  }
+
+  void conf(const appmodel::DataMoveCallbackConf* /*link_conf*/,
+            const appmodel::StreamEmulationParameters* emu_params) override
+  {
+    if (m_is_configured) {
+      TLOG_DEBUG(5) << "This emulator is already configured!";
+      return;
+    }
+    TscClock::calibrate();
+    try {
+      m_input = SharedInputFile::open(emu_params->get_data_file_name(),
+                                      sizeof(ReadoutType),
+                                      emu_params->get_input_file_size_limit(),
+                                      m_params.input_backing);
+    } catch (const ers::Issue& ex) {
+      ers::fatal(ex);
+      throw datahandlinglibs::ConfigurationError(ERS_HERE, m_name, "", ex);
+    }
+    m_t0_now = emu_params->get_set_t0();
+
+    // Precomputed dropout pattern, as in SourceEmulatorModel
+    const std::size_t population = std::max<std::size_t>(emu_params->get_random_population_size(), 1);
+    m_dropouts.assign(population, true);
+    if (m_params.dropout_rate > 0.) {
+      std::mt19937 mt(population);
+      std::bernoulli_distribution keep(1. - m_params.dropout_rate);
+      for (std::size_t i = 0; i < population; ++i) {
+        m_dropouts[i] = keep(mt);
+      }
+    }
+
+    TLOG() << m_name << ": " << (m_params.spin ? "precise" : "sleeping") << " pacing at " << m_params.rate_khz
+           << " kHz in batches of " << m_params.batch_size << ", " << (TscClock::uses_tsc() ? "TSC" : "steady_clock")
+           << " time base, " << m_input->num_elements() << " elements of input on " << to_string(m_input->backing())
+           << " pages, loaded in " << m_input->load_us() << " us";
+    m_is_configured = true;
+  }
+
+  void scrap(const nlohmann::json& /*args*/) override
+  {
+    m_input.reset();
+    m_is_configured = false;
+  }
+
+  bool is_configured() override { return m_is_configured; }
+
+  void start(const nlohmann::json& /*args*/) override
+  {
+    m_elements_sent.reset();
+    m_elements_dropped.reset();
+    m_send_timeouts.reset();
+    m_slips.store(0, std::memory_order_relaxed);
+    m_last_elements_sent = 0;
+    m_last_publication = std::chrono::steady_clock::now();
+    m_producer_thread.set_name(m_name, 0);
+    m_producer_thread.set_work(&PacedSourceEmulatorModel<ReadoutType>::run_produce, this);
+  }
+
+  void stop(const nlohmann::json& /*args*/) override
+  {
+    while (!m_producer_thread.get_readiness()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+protected:
+  void generate_opmon_data() override
+  {
+    opmon::EmulatorPacingInfo info;
+    auto now = std::chrono::steady_clock::now();
+    double interval_ms = std::chrono::duration<double, std::milli>(now - m_last_publication).count();
+    m_last_publication = now;
+
+    uint64_t sent = m_elements_sent.load();
+    info.set_target_rate_khz(m_params.rate_khz);
+    if (interval_ms > 0.) {
+      info.set_achieved_rate_khz((sent - m_last_elements_sent) / interval_ms);
+    }
+    info.set_elements_sent(sent - m_last_elements_sent);
+    m_last_elements_sent = sent;
+    info.set_elements_dropped(m_elements_dropped.load());
+    info.set_send_timeouts(m_send_timeouts.load());
+    info.set_slips(m_slips.load(std::memory_order_relaxed));
+    info.set_batch_size(m_params.batch_size);
+    info.set_tsc_clock(TscClock::uses_tsc());
+
+    auto lateness = m_lateness_ns.snapshot_and_reset();
+    info.set_jitter_p50_ns(lateness.percentile(0.50));
+    info.set_jitter_p99_ns(lateness.percentile(0.99));
+    info.set_jitter_max_ns(lateness.max);
+    publish(std::move(info));
+  }
+
+private:
+  void run_produce()
+  {
+    const std::size_t num_elem = m_input->num_elements();
+    ReadoutType payload;
+    const uint64_t tick_step = m_params.time_tick_diff * payload.get_num_frames() / m_params.frames_per_tick;
+    uint64_t timestamp = 0;
+    if (m_t0_now) {
+      auto since_epoch = std::chrono::system_clock::now().time_since_epoch();
+      timestamp = std::chrono::duration_cast<std::chrono::microseconds>(since_epoch).count() *
+                  (clock_frequency_hz / 1000000);
+    }
+
+    std::size_t offset = 0;
+    std::size_t dropout_index = 0;
+    RatePacer pacer;
+    pacer.start(m_params.rate_khz * 1000., m_params.spin);
+    while (m_run_marker.load(std::memory_order_relaxed)) {
+      m_lateness_ns.record(static_cast<uint64_t>(std::max<int64_t>(pacer.wait(m_params.batch_size), 0)));
+      for (uint32_t i = 0; i < m_params.batch_size; ++i) {
+        if (m_dropouts[dropout_index]) {
+          std::memcpy(static_cast<void*>(&payload), m_input->element(offset), sizeof(ReadoutType));
+          payload.fake_timestamps(timestamp, m_params.time_tick_diff);
+          try {
+            m_sender->send(std::move(payload), send_timeout);
+            m_elements_sent.add();
+          } catch (const ers::Issue&) {
+            m_send_timeouts.add();
+          }
+        } else {
+          m_elements_dropped.add();
+        }
+        dropout_index = (dropout_index + 1) % m_dropouts.size();
+        offset = (offset + 1) % num_elem;
+        timestamp += tick_step;
+      }
+      m_slips.store(pacer.slips(), std::memory_order_relaxed);
+    }
+  }
+
+  std::string m_name;
+  std::atomic<bool>& m_run_marker;
+  EmulatedStreamParameters m_params;
+  bool m_is_configured = false;
+  bool m_t0_now = false;
+
+  std::shared_ptr<sink_t> m_sender;
+  std::shared_ptr<const SharedInputFile> m_input;
+  std::vector<bool> m_dropouts;
+  datahandlinglibs::ReusableThread m_producer_thread;
+
+  // Written by the producer thread only
+  SingleWriterCounter m_elements_sent;
+  SingleWriterCounter m_elements_dropped;
+  SingleWriterCounter m_send_timeouts;
+  std::atomic<uint64_t> m_slips{ 0 };
+  LogLinearHistogram<> m_lateness_ns;
+
+  // Only touched by the opmon thread
+  std::chrono::steady_clock::time_point m_last_publication{ std::chrono::steady_clock::now() };
+  uint64_t m_last_elements_sent{ 0 };
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_PACEDSOURCEEMULATORMODEL_HPP_
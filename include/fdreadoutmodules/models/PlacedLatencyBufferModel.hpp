@@ -0,0 +1,172 @@
+/**
+ * @file PlacedLatencyBufferModel.hpp Latency buffer decorator controlling page backing and NUMA placement
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_PLACEDLATENCYBUFFERMODEL_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_PLACEDLATENCYBUFFERMODEL_HPP_
+
+#include "fdreadoutmodules/FDReadoutModulesIssues.hpp"
+#include "fdreadoutmodules/dal/HugePageLatencyBufferConf.hpp"
+#include "fdreadoutmodules/opmon/latency_buffer_placement_info.pb.h"
+#include "fdreadoutmodules/utils/MemoryPlacement.hpp"
+
+#include "appmodel/LatencyBuffer.hpp"
+#include "logging/Logging.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include <utility>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Wraps an IterableQueueModel based latency buffer and places its storage at conf time.
+ *
+ * With a HugePageLatencyBufferConf the storage is either advised for transparent huge pages or
+ * replaced by a hugetlb mapping bound to the configured NUMA node, then optionally prefaulted so
+ * that the first seconds of a run take no page fault. The base allocation is kept untouched for the
+ * base model to release, and costs no physical memory as long as preallocation is off. The placement
+ * is published by publish_opmon().
+ * With any other LatencyBuffer configuration it behaves as the wrapped model.
+ */
+template<class ReadoutType, class LatencyBufferType>
+class PlacedLatencyBufferModel : public LatencyBufferType
+{
+public:
+  using inherited = LatencyBufferType;
+  using inherited::inherited;
+
+  ~PlacedLatencyBufferModel() { release_region(); }
+
+  void conf(const appmodel::LatencyBuffer* cfg) override
+  {
+    release_region();
+    inherited::conf(cfg);
+    prepare_memory([this, cfg]() { place(cfg); });
+  }
+
+  void scrap(const nlohmann::json& args) override
+  {
+    release_region();
+    inherited::scrap(args);
+  }
+
+  /**
+   * @brief Consumer thread. Moves as many of the pointed elements as there are free slots into the queue
+   * and publishes them with one store of the write index.
+   * @return Elements written, the first ones of the array
+   */
+  std::size_t write_batch(ReadoutType* const* elements, std::size_t count)
+  {
+    const std::size_t size = this->size_;
+    const std::size_t write = this->writeIndex_.load(std::memory_order_relaxed);
+    const std::size_t read = this->readIndex_.load(std::memory_order_acquire);
+    const std::size_t n = std::min(count, (read + size - write - 1) % size);
+    for (std::size_t i = 0, slot = write; i < n; ++i, slot = slot + 1 == size ? 0 : slot + 1) {
+      new (&this->records_[slot]) ReadoutType(std::move(*elements[i]));
+    }
+    this->writeIndex_.store(static_cast<decltype(this->writeIndex_.load())>((write + n) % size),
+                            std::memory_order_release);
+    return n;
+  }
+
+  MemoryPlacement memory_placement() const
+  {
+    std::lock_guard<std::mutex> lock(m_placement_mutex);
+    return m_placement;
+  }
+
+  //! Opmon thread: passes a LatencyBufferPlacementInfo to publish
+  template<class Publish>
+  void publish_opmon(const Publish& publish)
+  {
+    auto placement = memory_placement();
+    opmon::LatencyBufferPlacementInfo info;
+    info.set_page_backing(to_string(placement.backing));
+    info.set_requested_numa_node(placement.requested_node);
+    info.set_majority_numa_node(placement.majority_node);
+    info.set_local_fraction(placement.local_fraction);
+    info.set_buffer_bytes(placement.bytes);
+    info.set_huge_page_bytes(placement.huge_page_bytes);
+    info.set_prefault_us(placement.prefault_us);
+    publish(std::move(info));
+  }
+
+private:
+  void place(const appmodel::LatencyBuffer* cfg)
+  {
+    auto hp_conf = cfg->cast<dal::HugePageLatencyBufferConf>();
+    PageBacking backing = hp_conf ? parse_page_backing(hp_conf->get_page_backing()) : PageBacking::kDefault;
+    const bool prefault = hp_conf ? hp_conf->get_prefault() : false;
+    const int node = cfg->get_numa_aware() ? static_cast<int>(cfg->get_numa_node()) : -1;
+    const std::size_t bytes = sizeof(ReadoutType) * this->size_;
+    std::size_t page_size = 0;
+
+    if (backing == PageBacking::kHugeTLB2M || backing == PageBacking::kHugeTLB1G) {
+      if (m_region.map(bytes, backing, node)) {
+        m_base_records = this->records_;
+        this->records_ = static_cast<ReadoutType*>(m_region.data());
+        page_size = m_region.page_size();
+      } else {
+        ers::warning(HugePagesUnavailable(ERS_HERE, to_string(backing), bytes, std::strerror(errno)));
+        backing = PageBacking::kTransparent;
+      }
+    }
+    if (backing == PageBacking::kTransparent) {
+      advise_transparent_huge_pages(this->records_, bytes);
+    }
+    if (!m_region.data() && node >= 0) {
+      bind_to_numa_node(this->records_, bytes, node);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (prefault) {
+      prefault_pages(this->records_, bytes, page_size);
+    }
+    auto placement = query_memory_placement(this->records_, bytes, node);
+    placement.backing = backing;
+    placement.prefault_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    TLOG() << "Latency buffer of " << bytes << " bytes: " << to_string(backing) << " backing, "
+           << placement.huge_page_bytes << " bytes on huge pages, " << placement.local_fraction * 100.
+           << "% of sampled pages on node " << (node >= 0 ? node : placement.majority_node)
+           << (prefault ? ", prefaulted in " + std::to_string(placement.prefault_us) + " us" : "");
+
+    std::lock_guard<std::mutex> lock(m_placement_mutex);
+    m_placement = placement;
+  }
+
+  void release_region()
+  {
+    if (m_region.data() == nullptr) {
+      return;
+    }
+    // Elements must not outlive the storage they were constructed in
+    this->flush();
+    this->records_ = m_base_records;
+    m_base_records = nullptr;
+    m_region.unmap();
+  }
+
+  HugePageRegion m_region;
+  ReadoutType* m_base_records = nullptr;
+
+  mutable std::mutex m_placement_mutex;
+  MemoryPlacement m_placement;
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_PLACEDLATENCYBUFFERMODEL_HPP_
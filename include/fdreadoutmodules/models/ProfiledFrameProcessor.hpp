@@ -0,0 +1,114 @@
+/**
+ * @file ProfiledFrameProcessor.hpp Frame processor decorator timing its pre- and post-processing tasks
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_PROFILEDFRAMEPROCESSOR_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_PROFILEDFRAMEPROCESSOR_HPP_
+
+#include "fdreadoutmodules/utils/TaskProfiler.hpp"
+
+#include "appmodel/DataHandlerModule.hpp"
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace detail {
+template<class P, class = void>
+struct has_task_profiler : std::false_type
+{};
+template<class P>
+struct has_task_profiler<P, std::void_t<decltype(std::declval<P&>().profiler())>> : std::true_type
+{};
+} // namespace detail
+
+//! Task names of a processor without a table of its own: tasks are named by kind and index
+struct IndexedTaskNames
+{
+  static constexpr std::array<const char*, 0> preprocess{};
+  static constexpr std::array<const char*, 0> postprocess{};
+};
+
+/**
+ * @brief Wraps a TaskRawDataProcessorModel based frame processor, giving each of its tasks a TaskProfile.
+ *
+ * Every task registered by the wrapped processor is replaced by a call through its profile. TaskNames
+ * lists the names of the tasks in the order the processor registers them, in its preprocess and
+ * postprocess arrays; tasks beyond them are named preprocess_<n> or postprocess_<n>. Post-processing
+ * tasks run on their own threads fed from a queue, so the time between their calls counts as blocked.
+ * Until profiler().enable() is called the tasks are only counted.
+ */
+template<class ReadoutType, class ProcessorType, class TaskNames = IndexedTaskNames>
+class ProfiledFrameProcessor : public ProcessorType
+{
+public:
+  using inherited = ProcessorType;
+  using inherited::inherited;
+
+  void conf(const appmodel::DataHandlerModule* modconf) override
+  {
+    inherited::conf(modconf);
+    m_profiler.set_name(modconf->UID());
+    wrap_tasks();
+  }
+
+  void start(const nlohmann::json& args) override
+  {
+    // Before the post-processing threads pick their tasks up
+    wrap_tasks();
+    inherited::start(args);
+  }
+
+  void scrap(const nlohmann::json& args) override
+  {
+    inherited::scrap(args);
+    // The wrappers point to the profiles dropped below; the processor registers its tasks again at conf
+    this->m_preprocess_functions.clear();
+    this->m_post_process_functions.clear();
+    m_profiler.clear_tasks();
+    m_wrapped_preprocess = 0;
+    m_wrapped_postprocess = 0;
+  }
+
+  ProcessorProfiler& profiler() { return m_profiler; }
+
+private:
+  template<std::size_t N>
+  static std::string task_name(const std::array<const char*, N>& names, const char* kind, std::size_t index)
+  {
+    return index < N ? std::string(names[index]) : std::string(kind) + "_" + std::to_string(index);
+  }
+
+  void wrap_tasks()
+  {
+    for (; m_wrapped_preprocess < this->m_preprocess_functions.size(); ++m_wrapped_preprocess) {
+      auto& task = this->m_preprocess_functions[m_wrapped_preprocess];
+      TaskProfile* profile =
+        m_profiler.add_task(task_name(TaskNames::preprocess, "preprocess", m_wrapped_preprocess), false);
+      task = [profile, wrapped = std::move(task)](ReadoutType* item) { profile->run(wrapped, item); };
+    }
+    for (; m_wrapped_postprocess < this->m_post_process_functions.size(); ++m_wrapped_postprocess) {
+      auto& task = this->m_post_process_functions[m_wrapped_postprocess];
+      TaskProfile* profile =
+        m_profiler.add_task(task_name(TaskNames::postprocess, "postprocess", m_wrapped_postprocess), true);
+      task = [profile, wrapped = std::move(task)](const ReadoutType* item) { profile->run(wrapped, item); };
+    }
+  }
+
+  ProcessorProfiler m_profiler;
+  std::size_t m_wrapped_preprocess = 0;
+  std::size_t m_wrapped_postprocess = 0;
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_PROFILEDFRAMEPROCESSOR_HPP_
@@ -0,0 +1,464 @@
+/**
+ * @file RingRecordingLatencyBufferModel.hpp Latency buffer decorator streaming cleaned up elements to disk
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_RINGRECORDINGLATENCYBUFFERMODEL_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_RINGRECORDINGLATENCYBUFFERMODEL_HPP_
+
+#include "fdreadoutmodules/FDReadoutModulesIssues.hpp"
+#include "fdreadoutmodules/dal/DataRecorderIoUringConf.hpp"
+#include "fdreadoutmodules/dal/RingRecordingLatencyBufferConf.hpp"
+#include "fdreadoutmodules/opmon/ring_recording_info.pb.h"
+#include "fdreadoutmodules/utils/RingSegmentWriter.hpp"
+#include "fdreadoutmodules/utils/SingleWriterCounter.hpp"
+
+#include "appmodel/DataRecorderConf.hpp"
+#include "appmodel/LatencyBuffer.hpp"
+#include "datahandlinglibs/utils/ReusableThread.hpp"
+#include "logging/Logging.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace detail {
+template<class LB, class = void>
+struct has_ring_recording : std::false_type
+{};
+template<class LB>
+struct has_ring_recording<LB, std::void_t<decltype(std::declval<LB&>().freeze_ring())>> : std::true_type
+{};
+
+//! Latency buffer layers publishing their own opmon info through publish_opmon(publish)
+template<class LB, class = void>
+struct has_opmon_info : std::false_type
+{};
+template<class LB>
+struct has_opmon_info<LB, std::void_t<decltype(std::declval<LB&>().publish_opmon(nullptr))>> : std::true_type
+{};
+} // namespace detail
+
+/**
+ * @brief State of the ring recording of a latency buffer.
+ *
+ * Counters run since the latency buffer was constructed.
+ */
+struct RingRecordingStats
+{
+  uint64_t elements_spilled = 0;  ///< Copied out of the buffer by the writer after cleanup
+  uint64_t elements_dropped = 0;  ///< Cleaned up without reaching the disk
+  uint64_t fallbacks = 0;         ///< Times the staging limit was exceeded and kept elements dropped
+  uint64_t bytes_written = 0;     ///< Handed to the file writer
+  uint64_t writer_stalls = 0;     ///< Waits of the file writer for a free buffer
+  uint64_t write_errors = 0;
+  std::size_t staging_capacity = 0;  ///< Cleaned up elements that can be kept for the writer
+  std::size_t staging_occupancy = 0; ///< Cleaned up elements kept for the writer
+  uint64_t retained_ticks = 0;    ///< Timestamps covered by the ring on disk
+  unsigned segments = 0;
+  unsigned frozen_sets = 0;
+  bool paused = false;
+  bool freeze_pending = false;
+};
+
+/**
+ * @brief Wraps an IterableQueueModel based latency buffer and streams what cleanup pops to a ring of files.
+ *
+ * With a RingRecordingLatencyBufferConf, pop() keeps the elements it is asked to drop in the buffer,
+ * hidden from occupancy(), for a writer thread that copies them out in small chunks, outside cleanup,
+ * into the segments of a RingSegmentWriter, so the disk holds the ring_size_mb of data that left the
+ * buffer last. The next pop() releases what has been copied. Cleanup never waits for the disk and at
+ * most for one chunk: when more elements are kept than the staging size, at most an eighth of the
+ * buffer, the oldest are dropped down to half of it, so that a slow disk yields a few long gaps rather
+ * than many short ones.
+ *
+ * freeze_ring() notes the newest timestamp in the buffer. Spilling goes on until that timestamp has
+ * been written, including the elements still in the buffer when it is flushed, then the ring is sealed
+ * and kept on disk and a new ring starts. publish_opmon() publishes the ring after the info of the
+ * wrapped model. With any other LatencyBuffer configuration it behaves as the wrapped model.
+ */
+template<class ReadoutType, class LatencyBufferType>
+class RingRecordingLatencyBufferModel : public LatencyBufferType
+{
+public:
+  using inherited = LatencyBufferType;
+  using inherited::inherited;
+
+  ~RingRecordingLatencyBufferModel() { stop_ring(); }
+
+  void conf(const appmodel::LatencyBuffer* cfg) override
+  {
+    stop_ring();
+    inherited::conf(cfg);
+    auto ring_conf = cfg->cast<dal::RingRecordingLatencyBufferConf>();
+    if (ring_conf != nullptr) {
+      start_ring(ring_conf);
+    }
+  }
+
+  void scrap(const nlohmann::json& args) override
+  {
+    stop_ring();
+    inherited::scrap(args);
+  }
+
+  //! Elements not kept for the writer
+  std::size_t occupancy() const override
+  {
+    const std::size_t kept = m_kept.load(std::memory_order_acquire);
+    const std::size_t occupancy = inherited::occupancy();
+    return occupancy > kept ? occupancy - kept : 0;
+  }
+
+  void pop(std::size_t amount) override
+  {
+    std::lock_guard<std::mutex> lock(m_keep_mutex);
+    release_copied();
+    if (m_spilling.load(std::memory_order_relaxed)) {
+      keep(amount);
+    } else {
+      // Also what a writer stopped by errors left behind
+      drop(m_kept.load(std::memory_order_relaxed));
+      inherited::pop(amount);
+    }
+  }
+
+  void flush() override
+  {
+    if (m_spilling.load(std::memory_order_relaxed)) {
+      // Called at stop: the elements newer than a pending freeze would otherwise never be recorded
+      if (m_freeze_timestamp.load(std::memory_order_acquire) != 0) {
+        std::lock_guard<std::mutex> lock(m_keep_mutex);
+        release_copied();
+        keep(inherited::occupancy() - m_kept.load(std::memory_order_relaxed));
+      }
+      while (m_spilling.load(std::memory_order_relaxed)) {
+        {
+          std::lock_guard<std::mutex> lock(m_keep_mutex);
+          if (m_copied == m_kept.load(std::memory_order_relaxed)) {
+            break;
+          }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+    std::lock_guard<std::mutex> lock(m_keep_mutex);
+    release_copied();
+    drop(m_kept.load(std::memory_order_relaxed));
+    inherited::flush();
+  }
+
+  /**
+   * @brief Keep the ring once the newest element currently buffered has been written (any thread).
+   * @return false if no ring is being recorded
+   */
+  bool freeze_ring()
+  {
+    if (!m_spilling.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    uint64_t newest = 1;
+    if (this->occupancy() > 0) {
+      newest = std::max<uint64_t>(this->back()->get_timestamp(), 1);
+    }
+    // A second freeze before the first completes extends it
+    uint64_t pending = m_freeze_timestamp.load(std::memory_order_relaxed);
+    while (pending < newest && !m_freeze_timestamp.compare_exchange_weak(pending, newest)) {
+    }
+    TLOG() << "Ring recording to " << m_settings.prefix << " freezes at timestamp " << newest;
+    return true;
+  }
+
+  RingRecordingStats ring_recording_stats() const
+  {
+    RingRecordingStats stats;
+    stats.elements_spilled = m_elements_spilled.load();
+    stats.elements_dropped = m_elements_dropped.load();
+    stats.fallbacks = m_fallbacks.load();
+    stats.bytes_written = m_segments.bytes_written();
+    stats.writer_stalls = m_segments.stalls();
+    stats.write_errors = m_segments.errors();
+    stats.staging_capacity = m_staging_capacity.load(std::memory_order_relaxed);
+    stats.staging_occupancy = m_kept.load(std::memory_order_relaxed);
+    stats.retained_ticks = m_segments.retained_ticks();
+    stats.segments = m_segments.segments();
+    stats.frozen_sets = m_segments.sealed_sets();
+    stats.paused = m_paused.load(std::memory_order_relaxed);
+    stats.freeze_pending = m_freeze_timestamp.load(std::memory_order_relaxed) != 0;
+    return stats;
+  }
+
+  //! Opmon thread: passes a RingRecordingInfo to publish while a ring is or was recorded
+  template<class Publish>
+  void publish_opmon(const Publish& publish)
+  {
+    if constexpr (detail::has_opmon_info<inherited>::value) {
+      inherited::publish_opmon(publish);
+    }
+    auto now = std::chrono::steady_clock::now();
+    const double interval_ms = std::chrono::duration<double, std::milli>(now - m_last_publication).count();
+    m_last_publication = now;
+    auto stats = ring_recording_stats();
+    if (stats.staging_capacity > 0 || stats.frozen_sets > 0) {
+      opmon::RingRecordingInfo info;
+      info.set_elements_spilled(stats.elements_spilled - m_last_elements_spilled);
+      info.set_elements_dropped(stats.elements_dropped - m_last_elements_dropped);
+      info.set_fallbacks(stats.fallbacks - m_last_fallbacks);
+      if (interval_ms > 0.) {
+        info.set_write_throughput_mbs((stats.bytes_written - m_last_bytes_written) / interval_ms / 1e3);
+      }
+      if (stats.staging_capacity > 0) {
+        info.set_staging_occupancy(static_cast<double>(stats.staging_occupancy) / stats.staging_capacity);
+      }
+      info.set_paused(stats.paused);
+      info.set_retained_ticks(stats.retained_ticks);
+      info.set_segments(stats.segments);
+      info.set_frozen_sets(stats.frozen_sets);
+      info.set_freeze_pending(stats.freeze_pending);
+      info.set_writer_stalls(stats.writer_stalls);
+      info.set_write_errors(stats.write_errors);
+      publish(std::move(info));
+    }
+    m_last_elements_spilled = stats.elements_spilled;
+    m_last_elements_dropped = stats.elements_dropped;
+    m_last_fallbacks = stats.fallbacks;
+    m_last_bytes_written = stats.bytes_written;
+  }
+
+private:
+  void start_ring(const dal::RingRecordingLatencyBufferConf* ring_conf)
+  {
+    const appmodel::DataRecorderConf* recorder = ring_conf->get_recorder();
+    constexpr uint64_t mb = 1024 * 1024;
+    m_settings = RingSegmentWriter::Settings();
+    m_settings.prefix = recorder->get_output_file();
+    m_settings.element_size = sizeof(ReadoutType);
+    m_settings.segment_bytes = std::max<uint64_t>(ring_conf->get_segment_size_mb(), 1) * mb;
+    m_settings.max_segments = static_cast<unsigned>(ring_conf->get_ring_size_mb() * mb / m_settings.segment_bytes);
+    m_settings.buffer_size = recorder->get_streaming_buffer_size();
+    m_settings.use_o_direct = recorder->get_use_o_direct();
+    if (auto uring_conf = recorder->cast<dal::DataRecorderIoUringConf>(); uring_conf != nullptr) {
+      m_settings.queue_depth = uring_conf->get_queue_depth();
+      m_settings.index_stride = uring_conf->get_index_stride();
+    }
+
+    // Kept elements share the buffer with the margin cleanup leaves for the producer
+    const std::size_t staging = ring_conf->get_staging_size_mb() * mb / sizeof(ReadoutType);
+    m_staging_capacity = std::max<std::size_t>(std::min<std::size_t>(staging, this->size_ / 8), 2);
+    m_chunk.assign(copy_chunk, ReadoutType());
+    m_kept = 0;
+    m_copied = 0;
+    m_next.reset();
+    m_paused = false;
+    m_freeze_timestamp = 0;
+    m_last_dropped_timestamp = 0;
+    m_last_written_timestamp = 0;
+    m_segments.open(m_settings);
+
+    TLOG() << "Ring recording to " << m_settings.prefix << ": " << m_settings.max_segments << " segments of "
+           << m_settings.segment_bytes / mb << " MB, " << m_staging_capacity.load() << " elements of staging";
+    m_ring_running = true;
+    m_spilling = true;
+    m_writer_thread.set_name("ringrec", 0);
+    m_writer_thread.set_work(&RingRecordingLatencyBufferModel::drain, this);
+  }
+
+  void stop_ring()
+  {
+    if (!m_ring_running.load()) {
+      return;
+    }
+    m_spilling = false;
+    m_ring_running = false;
+    while (!m_writer_thread.get_readiness()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    m_segments.close();
+    // The buffer is flushed or about to be reconfigured: nothing kept is left to release
+    std::lock_guard<std::mutex> lock(m_keep_mutex);
+    m_staging_capacity = 0;
+    m_kept = 0;
+    m_copied = 0;
+    m_chunk.clear();
+    m_chunk.shrink_to_fit();
+    m_next.reset();
+  }
+
+  // The elements kept at the front of the buffer, m_kept of them, of which the writer has copied the first
+  // m_copied. The members below are called with m_keep_mutex held.
+
+  // Copied elements leave the buffer
+  void release_copied()
+  {
+    m_kept.fetch_sub(m_copied, std::memory_order_release);
+    inherited::pop(m_copied);
+    m_copied = 0;
+  }
+
+  // Keeps amount more elements for the writer, dropping the oldest kept ones beyond the staging capacity
+  void keep(std::size_t amount)
+  {
+    const std::size_t kept = m_kept.fetch_add(amount, std::memory_order_release) + amount;
+    const std::size_t capacity = m_staging_capacity.load(std::memory_order_relaxed);
+    const bool exceeded = kept > capacity;
+    if (exceeded) {
+      m_fallbacks.add();
+      drop(kept - capacity / 2);
+    }
+    m_paused.store(exceeded, std::memory_order_relaxed);
+  }
+
+  // Drops the oldest count kept elements, not copied yet
+  void drop(std::size_t count)
+  {
+    if (count == 0) {
+      return;
+    }
+    auto it = this->begin();
+    for (std::size_t i = 1; i < count; ++i) {
+      ++it;
+    }
+    // Dropped elements count as handled: a freeze completes even when the disk cannot keep up
+    m_last_dropped_timestamp.store(it->get_timestamp(), std::memory_order_release);
+    m_kept.fetch_sub(count, std::memory_order_release);
+    inherited::pop(count);
+    m_elements_dropped.add(count);
+    m_next.reset();
+  }
+
+  // Writer thread: copies the next kept elements to m_chunk
+  std::size_t copy_kept()
+  {
+    std::lock_guard<std::mutex> lock(m_keep_mutex);
+    const std::size_t kept = m_kept.load(std::memory_order_relaxed);
+    if (!m_next) {
+      m_next.emplace(this->begin());
+      for (std::size_t i = 0; i < m_copied; ++i) {
+        ++*m_next;
+      }
+    }
+    std::size_t count = 0;
+    for (; count < m_chunk.size() && m_copied < kept; ++count, ++m_copied) {
+      m_chunk[count] = **m_next;
+      ++*m_next;
+    }
+    if (m_copied == kept) {
+      // Past the kept elements the iterator may reach the end of the buffer
+      m_next.reset();
+    }
+    return count;
+  }
+
+  // Writer thread
+  void drain()
+  {
+    bool healthy = true;
+    while (true) {
+      const bool running = m_ring_running.load(std::memory_order_acquire);
+      const std::size_t count = copy_kept();
+      if (count == 0) {
+        seal_if_frozen(true);
+        if (!running) {
+          break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        continue;
+      }
+      for (std::size_t i = 0; i < count && healthy; ++i) {
+        const ReadoutType& element = m_chunk[i];
+        try {
+          healthy = m_segments.write(reinterpret_cast<const char*>(&element), element.get_timestamp()); // NOLINT
+        } catch (const ers::Issue& excpt) {
+          ers::error(excpt);
+          healthy = false;
+        }
+        m_last_written_timestamp = element.get_timestamp();
+      }
+      m_elements_spilled.add(count);
+      if (!healthy) {
+        ers::error(AsyncWriterError(ERS_HERE, m_settings.prefix, "ring recording stopped after write errors"));
+        m_spilling = false;
+        break;
+      }
+      seal_if_frozen(false);
+    }
+    // Whatever made it to disk before a freeze that could not complete is kept as well
+    if (m_freeze_timestamp.load(std::memory_order_acquire) != 0) {
+      seal();
+    }
+  }
+
+  void seal_if_frozen(bool drained)
+  {
+    const uint64_t freeze = m_freeze_timestamp.load(std::memory_order_acquire);
+    if (freeze == 0) {
+      return;
+    }
+    if (m_last_written_timestamp >= freeze ||
+        (drained && m_last_dropped_timestamp.load(std::memory_order_acquire) >= freeze)) {
+      seal();
+    }
+  }
+
+  void seal()
+  {
+    uint64_t freeze = m_freeze_timestamp.load(std::memory_order_acquire);
+    auto kept = m_segments.seal();
+    TLOG() << "Ring recording to " << m_settings.prefix << " frozen up to timestamp " << m_last_written_timestamp
+           << ", " << kept << " segments kept";
+    // A freeze issued meanwhile is for a later timestamp and applies to the new ring
+    m_freeze_timestamp.compare_exchange_strong(freeze, 0);
+  }
+
+  static constexpr std::size_t copy_chunk = 64;
+
+  RingSegmentWriter::Settings m_settings;
+  RingSegmentWriter m_segments;
+  std::atomic<std::size_t> m_staging_capacity{ 0 };
+
+  std::mutex m_keep_mutex; ///< Held by pop() and flush(), and by the writer while it copies a chunk
+  std::atomic<std::size_t> m_kept{ 0 };
+  std::size_t m_copied = 0;
+  std::optional<decltype(std::declval<LatencyBufferType&>().begin())> m_next; ///< First element not copied
+  std::vector<ReadoutType> m_chunk;                                           ///< Writer thread only
+
+  std::atomic<bool> m_spilling{ false };
+  std::atomic<bool> m_paused{ false };
+  std::atomic<uint64_t> m_freeze_timestamp{ 0 };
+  std::atomic<uint64_t> m_last_dropped_timestamp{ 0 };
+  uint64_t m_last_written_timestamp = 0; // Writer thread only
+
+  // Written with m_keep_mutex held
+  SingleWriterCounter m_elements_dropped;
+  SingleWriterCounter m_fallbacks;
+  // Written by the writer thread
+  SingleWriterCounter m_elements_spilled;
+
+  datahandlinglibs::ReusableThread m_writer_thread{ 0 };
+  std::atomic<bool> m_ring_running{ false };
+
+  // Only touched by the opmon thread
+  std::chrono::steady_clock::time_point m_last_publication{ std::chrono::steady_clock::now() };
+  uint64_t m_last_elements_spilled = 0;
+  uint64_t m_last_elements_dropped = 0;
+  uint64_t m_last_fallbacks = 0;
+  uint64_t m_last_bytes_written = 0;
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_RINGRECORDINGLATENCYBUFFERMODEL_HPP_
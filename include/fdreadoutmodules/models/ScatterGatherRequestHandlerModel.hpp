@@ -0,0 +1,293 @@
+/**
+ * @file ScatterGatherRequestHandlerModel.hpp Request handler building fragments from contiguous latency buffer runs
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_SCATTERGATHERREQUESTHANDLERMODEL_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_SCATTERGATHERREQUESTHANDLERMODEL_HPP_
+
+#include "datahandlinglibs/models/ZeroCopyRecordingRequestHandlerModel.hpp"
+
+#include "fdreadoutmodules/dal/CachingRequestHandlerConf.hpp"
+#include "fdreadoutmodules/opmon/fragment_cache_info.pb.h"
+#include "fdreadoutmodules/utils/FragmentCache.hpp"
+
+#include "appmodel/DataHandlerConf.hpp"
+#include "appmodel/DataHandlerModule.hpp"
+#include "appmodel/RequestHandler.hpp"
+#include "daqdataformats/Fragment.hpp"
+#include "dfmessages/DataRequest.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Serves DataRequests from a latency buffer that stores its elements in one array, such as the
+ * fixed rate and binary search queues.
+ *
+ * The default handler describes a window with one fragment piece per element, in a vector that grows
+ * with every request, and copies the pieces one by one. Here the frames of the window are gathered
+ * as runs of adjacent buffer memory, i.e. one run, or two when the window wraps around the end of the
+ * array, in a per-thread list. The fragment is then allocated once and filled with one copy per run,
+ * behind the header, which is the only part not taken from the buffer. The runs stay valid while they
+ * are copied because cleanup waits for running requests. Recording is inherited unchanged.
+ *
+ * With a CachingRequestHandlerConf, complete windows that overlap a recent request are also copied
+ * to a FragmentCache, widened to cover both, and later requests inside a cached window are copied
+ * from there without a lookup.
+ */
+template<class ReadoutType, class LatencyBufferType>
+class ScatterGatherRequestHandlerModel
+  : public datahandlinglibs::ZeroCopyRecordingRequestHandlerModel<ReadoutType, LatencyBufferType>
+{
+public:
+  using inherited = datahandlinglibs::ZeroCopyRecordingRequestHandlerModel<ReadoutType, LatencyBufferType>;
+  using RequestResult = typename inherited::RequestResult;
+  using ResultCode = typename inherited::ResultCode;
+  using FrameType = typename ReadoutType::FrameType;
+  using inherited::inherited;
+
+  static constexpr std::size_t frames_per_element = sizeof(ReadoutType) / sizeof(FrameType);
+
+  void conf(const appmodel::DataHandlerModule* modconf) override
+  {
+    inherited::conf(modconf);
+    auto cache_conf =
+      modconf->get_module_configuration()->get_request_handler()->cast<dal::CachingRequestHandlerConf>();
+    if (cache_conf != nullptr) {
+      m_cache.configure(cache_conf->get_cache_entries(), std::size_t{ cache_conf->get_cache_size_mb() } << 20);
+    } else {
+      m_cache.configure(0, 0);
+    }
+  }
+
+  void scrap(const nlohmann::json& args) override
+  {
+    m_cache.clear();
+    inherited::scrap(args);
+  }
+
+protected:
+  RequestResult data_request(dfmessages::DataRequest dr) override
+  {
+    RequestResult rres(ResultCode::kUnknown, dr);
+    auto frag_header = inherited::create_fragment_header(dr);
+    const uint64_t begin = dr.request_information.window_begin;
+    const uint64_t end = dr.request_information.window_end;
+    auto& lb = inherited::m_latency_buffer;
+
+    thread_local std::vector<std::pair<void*, std::size_t>> runs;
+    runs.clear();
+
+    if (m_cache.enabled()) {
+      if (auto entry = m_cache.find(begin, end)) {
+        slice(*entry, begin, end, runs);
+        rres.result_code = ResultCode::kFound;
+        rres.fragment = std::make_unique<daqdataformats::Fragment>(runs);
+        rres.fragment->set_header_fields(frag_header);
+        count_result(rres.result_code);
+        return rres;
+      }
+    }
+
+    uint64_t oldest = 0;
+    uint64_t newest = 0;
+    const std::size_t occupancy = lb->occupancy();
+    if (occupancy == 0) {
+      rres.result_code = ResultCode::kNotFound;
+    } else {
+      // Taken before gathering: data arriving meanwhile must not turn a partial window into a found one
+      oldest = lb->front()->get_timestamp();
+      newest = lb->back()->get_timestamp();
+      if (begin > newest) {
+        rres.result_code = ResultCode::kNotYetArrived;
+      } else if (end <= oldest) {
+        rres.result_code = ResultCode::kTooOld;
+      } else if (end > newest) {
+        // Filled as far as possible, for the last retry of the request
+        rres.result_code = ResultCode::kNotYetArrived;
+      } else if (begin < oldest) {
+        rres.result_code = ResultCode::kPartiallyOld;
+      } else {
+        rres.result_code = ResultCode::kFound;
+      }
+    }
+
+    uint64_t cache_begin = begin;
+    uint64_t cache_end = end;
+    if (rres.result_code == ResultCode::kFound && m_cache.enabled() &&
+        m_cache.admit(begin, end, cache_begin, cache_end)) {
+      // The widened window must be complete as well to be served to later requests
+      cache_begin = std::max(cache_begin, oldest);
+      cache_end = std::min(cache_end, newest);
+      // Checked before gathering: a window the cache would reject is not worth copying
+      if (estimated_bytes(cache_end - cache_begin, newest - oldest, occupancy) <= m_cache.max_bytes()) {
+        auto entry = std::make_shared<FragmentCache::Entry>();
+        entry->begin = cache_begin;
+        entry->end = cache_end;
+        gather(entry->begin, entry->end, runs);
+        std::size_t bytes = 0;
+        for (const auto& run : runs) {
+          bytes += run.second;
+        }
+        entry->payload.reserve(bytes);
+        for (const auto& run : runs) {
+          const char* bytes = static_cast<const char*>(run.first);
+          entry->payload.insert(entry->payload.end(), bytes, bytes + run.second);
+        }
+        runs.clear();
+        slice(*entry, begin, end, runs);
+        rres.fragment = std::make_unique<daqdataformats::Fragment>(runs);
+        rres.fragment->set_header_fields(frag_header);
+        m_cache.insert(std::move(entry));
+        count_result(rres.result_code);
+        return rres;
+      }
+    }
+    if (rres.result_code != ResultCode::kNotFound && rres.result_code != ResultCode::kTooOld && begin <= newest) {
+      gather(begin, end, runs);
+    }
+
+    if (runs.empty()) {
+      frag_header.error_bits |= (0x1 << static_cast<size_t>(daqdataformats::FragmentErrorBits::kDataNotFound));
+    } else if (rres.result_code != ResultCode::kFound) {
+      frag_header.error_bits |= (0x1 << static_cast<size_t>(daqdataformats::FragmentErrorBits::kIncomplete));
+    }
+    rres.fragment = std::make_unique<daqdataformats::Fragment>(runs);
+    rres.fragment->set_header_fields(frag_header);
+    count_result(rres.result_code);
+    return rres;
+  }
+
+  void generate_opmon_data() override
+  {
+    inherited::generate_opmon_data();
+    if (!m_cache.enabled()) {
+      return;
+    }
+    auto stats = m_cache.stats();
+    opmon::FragmentCacheInfo info;
+    const uint64_t lookups = stats.lookups - m_last_cache_stats.lookups;
+    const uint64_t hits = stats.exact_hits + stats.contained_hits - m_last_cache_stats.exact_hits -
+                          m_last_cache_stats.contained_hits;
+    info.set_lookups(lookups);
+    if (lookups > 0) {
+      info.set_hit_rate(static_cast<double>(hits) / lookups);
+    }
+    info.set_exact_hits(stats.exact_hits - m_last_cache_stats.exact_hits);
+    info.set_contained_hits(stats.contained_hits - m_last_cache_stats.contained_hits);
+    info.set_merged_windows(stats.merged - m_last_cache_stats.merged);
+    info.set_insertions(stats.insertions - m_last_cache_stats.insertions);
+    info.set_evictions(stats.evictions - m_last_cache_stats.evictions);
+    info.set_entries(stats.entries);
+    info.set_cached_bytes(stats.bytes);
+    m_last_cache_stats = stats;
+    this->publish(std::move(info));
+  }
+
+private:
+  // The request counters of the default handler; not yet arrived requests are left to its waiting list
+  void count_result(ResultCode code)
+  {
+    switch (code) {
+      case ResultCode::kFound:
+        ++this->m_num_requests_found;
+        break;
+      case ResultCode::kTooOld:
+      case ResultCode::kPartiallyOld:
+        ++this->m_num_requests_old_window;
+        break;
+      case ResultCode::kNotFound:
+        ++this->m_num_requests_bad;
+        break;
+      case ResultCode::kNotYetArrived:
+        break;
+      default:
+        ++this->m_num_requests_uncategorized;
+    }
+  }
+
+  // Bytes of the buffer covering span ticks, from the occupancy over the ticks between its oldest and
+  // newest element
+  static std::size_t estimated_bytes(uint64_t span, uint64_t buffered_ticks, std::size_t occupancy)
+  {
+    if (buffered_ticks == 0 || occupancy < 2) {
+      return sizeof(ReadoutType);
+    }
+    return static_cast<std::size_t>(static_cast<double>(span) * (occupancy - 1) * sizeof(ReadoutType) /
+                                    static_cast<double>(buffered_ticks));
+  }
+
+  // The frames of a cached window with begin <= timestamp < end, which are contiguous in its payload
+  static void slice(const FragmentCache::Entry& entry,
+                    uint64_t begin,
+                    uint64_t end,
+                    std::vector<std::pair<void*, std::size_t>>& runs)
+  {
+    auto* frames = reinterpret_cast<FrameType*>(const_cast<char*>(entry.payload.data())); // NOLINT
+    auto* last = frames + entry.payload.size() / sizeof(FrameType);
+    auto earlier = [](const FrameType& frame, uint64_t ts) { return frame.get_timestamp() < ts; };
+    auto* first = std::lower_bound(frames, last, begin, earlier);
+    last = std::lower_bound(first, last, end, earlier);
+    if (last > first) {
+      runs.emplace_back(static_cast<void*>(first), (last - first) * sizeof(FrameType));
+    }
+  }
+
+  // Appends the frames with begin <= timestamp < end, merging each with the previous run when adjacent
+  void gather(uint64_t begin, uint64_t end, std::vector<std::pair<void*, std::size_t>>& runs)
+  {
+    auto append = [&runs](FrameType* frames, std::size_t count) {
+      auto* bytes = reinterpret_cast<char*>(frames); // NOLINT
+      if (!runs.empty() && static_cast<char*>(runs.back().first) + runs.back().second == bytes) {
+        runs.back().second += count * sizeof(FrameType);
+      } else {
+        runs.emplace_back(bytes, count * sizeof(FrameType));
+      }
+    };
+
+    auto& lb = inherited::m_latency_buffer;
+    ReadoutType request_element;
+    request_element.set_first_timestamp(begin);
+    for (auto it = lb->lower_bound(request_element, false); it != lb->end(); ++it) {
+      ReadoutType& element = *it;
+      if (element.get_timestamp() >= end) {
+        break;
+      }
+      FrameType* frames = element.begin();
+      if (frames[0].get_timestamp() >= begin && frames[frames_per_element - 1].get_timestamp() < end) {
+        append(frames, frames_per_element);
+        continue;
+      }
+      // First or last element of the window: only the frames inside it
+      std::size_t first = 0;
+      while (first < frames_per_element && frames[first].get_timestamp() < begin) {
+        ++first;
+      }
+      std::size_t last = first;
+      while (last < frames_per_element && frames[last].get_timestamp() < end) {
+        ++last;
+      }
+      if (last > first) {
+        append(frames + first, last - first);
+      }
+    }
+  }
+
+  FragmentCache m_cache;
+  FragmentCache::Stats m_last_cache_stats; // Only touched by the opmon thread
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_SCATTERGATHERREQUESTHANDLERMODEL_HPP_
@@ -0,0 +1,369 @@
+/**
+ * @file TimestampBucketLatencyBufferModel.hpp Latency buffer of fixed-width timestamp buckets
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_TIMESTAMPBUCKETLATENCYBUFFERMODEL_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_TIMESTAMPBUCKETLATENCYBUFFERMODEL_HPP_
+
+#include "datahandlinglibs/concepts/LatencyBufferConcept.hpp"
+
+#include "fdreadoutmodules/dal/TimestampBucketLatencyBufferConf.hpp"
+#include "fdreadoutmodules/utils/MemoryPlacement.hpp"
+
+#include "appmodel/LatencyBuffer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Latency buffer for out-of-order data: a ring of buckets, each covering bucket_width ticks and
+ * holding up to capacity frames in arrival order.
+ *
+ * - write() is lock-free and must be called from a single producer thread. Frames older than the ring,
+ *   or arriving in a full bucket, are rejected.
+ * - When the ring advances, the buckets it wraps onto are expired in one step each, without any
+ *   cleanup pass contending with the producer.
+ * - copy_window() reads only the buckets overlapping the requested window, from any thread. Buckets
+ *   are guarded by a sequence number (their epoch), so a bucket recycled during a read is detected
+ *   and discarded.
+ * - pop() and flush() expire whole buckets and must not run concurrently with write().
+ *
+ * The iterator interface visits frames in bucket order only, not in timestamp order; it exists for
+ * the generic request handler code and is not used on the request path.
+ */
+template<class ReadoutType>
+class TimestampBucketLatencyBufferModel : public datahandlinglibs::LatencyBufferConcept<ReadoutType>
+{
+  static_assert(std::is_trivially_copyable_v<ReadoutType>,
+                "Frames are copied while their bucket may be recycled and must be trivially copyable");
+
+public:
+  static constexpr uint64_t default_bucket_width_ticks = 16384; ///< 262 us at 62.5 MHz
+  static constexpr uint32_t default_num_buckets = 8192;         ///< 2.1 s of retention at the default width
+
+  class Iterator
+  {
+  public:
+    Iterator() = default;
+    Iterator(const TimestampBucketLatencyBufferModel* lb, uint64_t epoch)
+      : m_lb(lb)
+      , m_epoch(epoch)
+    {
+      settle();
+    }
+
+    bool good() const { return m_lb != nullptr; }
+    const ReadoutType& operator*() const { return m_lb->frame(m_epoch, m_index); }
+    const ReadoutType* operator->() const { return &m_lb->frame(m_epoch, m_index); }
+    Iterator& operator++()
+    {
+      ++m_index;
+      settle();
+      return *this;
+    }
+    bool operator==(const Iterator& other) const
+    {
+      return m_lb == other.m_lb && (m_lb == nullptr || (m_epoch == other.m_epoch && m_index == other.m_index));
+    }
+    bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+  private:
+    //! Moves to the next existing frame, or becomes the end iterator
+    void settle()
+    {
+      if (m_lb == nullptr) {
+        return;
+      }
+      const uint64_t newest = m_lb->m_newest_epoch.load(std::memory_order_acquire);
+      while (m_epoch <= newest && m_index >= m_lb->count_of(m_epoch)) {
+        ++m_epoch;
+        m_index = 0;
+      }
+      if (m_epoch > newest) {
+        m_lb = nullptr;
+      }
+    }
+
+    const TimestampBucketLatencyBufferModel* m_lb = nullptr;
+    uint64_t m_epoch = 0;
+    uint32_t m_index = 0;
+  };
+
+  TimestampBucketLatencyBufferModel() = default;
+
+  void conf(const appmodel::LatencyBuffer* cfg) override
+  {
+    auto bucket_conf = cfg->cast<dal::TimestampBucketLatencyBufferConf>();
+    allocate(cfg->get_size(),
+             bucket_conf ? bucket_conf->get_bucket_width_ticks() : default_bucket_width_ticks,
+             bucket_conf ? bucket_conf->get_num_buckets() : default_num_buckets);
+    const std::size_t bytes = sizeof(ReadoutType) * m_num_buckets * m_capacity;
+    const int node = cfg->get_numa_aware() ? static_cast<int>(cfg->get_numa_node()) : -1;
+    prepare_memory([this, bytes, node]() {
+      if (node >= 0) {
+        bind_to_numa_node(m_frames.get(), bytes, node);
+      }
+      // Noise spikes land in buckets never touched before: fault them in now rather than during the run
+      prefault_pages(m_frames.get(), bytes, 0);
+    });
+  }
+
+  void scrap(const nlohmann::json& /*args*/) override
+  {
+    m_buckets.reset();
+    m_frames.reset();
+    m_num_buckets = 0;
+    m_capacity = 0;
+    m_occupancy.store(0);
+    m_started.store(false, std::memory_order_release);
+  }
+
+  //! Sets up default_num_buckets buckets of default_bucket_width_ticks sharing size frames
+  void allocate_memory(std::size_t size) { allocate(size, default_bucket_width_ticks, default_num_buckets); }
+
+  std::size_t occupancy() const override { return m_occupancy.load(std::memory_order_relaxed); }
+
+  bool write(ReadoutType&& element) override
+  {
+    const uint64_t epoch = element.get_timestamp() / m_width;
+    if (!m_started.load(std::memory_order_relaxed)) {
+      m_newest = epoch;
+      m_oldest = ring_start(epoch);
+      m_oldest_epoch.store(m_oldest, std::memory_order_release);
+      m_newest_epoch.store(m_newest, std::memory_order_release);
+      m_started.store(true, std::memory_order_release);
+    } else if (epoch > m_newest) {
+      advance_to(epoch);
+    } else if (epoch < m_oldest) {
+      m_late_frames.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    Bucket& bucket = bucket_of(epoch);
+    if (bucket.epoch.load(std::memory_order_relaxed) != epoch) {
+      // Inside the ring but not written since the ring moved over it
+      recycle(bucket, epoch);
+    }
+    const uint32_t count = bucket.count.load(std::memory_order_relaxed);
+    if (count >= m_capacity) {
+      m_bucket_overflows.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    ReadoutType* slot = &m_frames[slot_of(epoch) * m_capacity + count];
+    *slot = std::move(element);
+    bucket.count.store(count + 1, std::memory_order_release);
+    m_last_written.store(slot, std::memory_order_release);
+    m_occupancy.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  //! Frames are only retrieved by window, see copy_window()
+  bool read(ReadoutType& /*element*/) override { return false; }
+
+  const ReadoutType* front() override
+  {
+    Iterator it = begin();
+    return it.good() ? &(*it) : nullptr;
+  }
+
+  const ReadoutType* back() override { return m_last_written.load(std::memory_order_acquire); }
+
+  //! Expires whole buckets, oldest first, until at least amount frames are gone
+  void pop(std::size_t amount) override
+  {
+    std::size_t removed = 0;
+    while (m_started.load(std::memory_order_relaxed) && removed < amount && m_oldest <= m_newest) {
+      Bucket& bucket = bucket_of(m_oldest);
+      if (bucket.epoch.load(std::memory_order_relaxed) == m_oldest) {
+        removed += bucket.count.load(std::memory_order_relaxed);
+        recycle(bucket, s_no_epoch);
+      }
+      ++m_oldest;
+      m_oldest_epoch.store(m_oldest, std::memory_order_release);
+    }
+  }
+
+  void flush() override
+  {
+    if (!m_started.load(std::memory_order_relaxed)) {
+      return;
+    }
+    for (uint32_t i = 0; i < m_num_buckets; ++i) {
+      recycle(m_buckets[i], s_no_epoch);
+    }
+    m_last_written.store(nullptr, std::memory_order_release);
+    m_started.store(false, std::memory_order_release);
+    m_newest_epoch.store(0, std::memory_order_release);
+    m_oldest_epoch.store(1, std::memory_order_release);
+  }
+
+  Iterator begin() const
+  {
+    return m_started.load(std::memory_order_acquire) ? Iterator(this, m_oldest_epoch.load(std::memory_order_acquire))
+                                                      : end();
+  }
+  Iterator end() const { return Iterator(); }
+
+  //! First frame of the bucket containing the timestamp of element, or of the oldest bucket if it is older
+  Iterator lower_bound(ReadoutType& element, bool /*with_errors*/ = false) const
+  {
+    if (!m_started.load(std::memory_order_acquire)) {
+      return end();
+    }
+    return Iterator(this, std::max(element.get_timestamp() / m_width, m_oldest_epoch.load(std::memory_order_acquire)));
+  }
+
+  //! First timestamp still covered by the ring; meaningless while occupancy() is 0
+  uint64_t oldest_timestamp() const { return m_oldest_epoch.load(std::memory_order_acquire) * m_width; }
+
+  //! Last timestamp covered by the newest bucket
+  uint64_t newest_timestamp() const { return (m_newest_epoch.load(std::memory_order_acquire) + 1) * m_width - 1; }
+
+  /**
+   * @brief Appends copies of the frames with begin <= timestamp < end to out, in bucket order.
+   * @return false if the ring moved over part of the window while it was being read
+   */
+  bool copy_window(uint64_t begin, uint64_t end, std::vector<ReadoutType>& out) const
+  {
+    if (end <= begin || !m_buckets) {
+      return true;
+    }
+    const uint64_t newest = m_newest_epoch.load(std::memory_order_acquire);
+    const uint64_t first = std::max(begin / m_width, m_oldest_epoch.load(std::memory_order_acquire));
+    const uint64_t last = std::min((end - 1) / m_width, newest);
+    bool intact = true;
+    for (uint64_t epoch = first; epoch <= last; ++epoch) {
+      const Bucket& bucket = bucket_of(epoch);
+      if (bucket.epoch.load(std::memory_order_acquire) != epoch) {
+        continue;
+      }
+      const uint32_t count = bucket.count.load(std::memory_order_acquire);
+      const std::size_t before = out.size();
+      const ReadoutType* frames = &m_frames[slot_of(epoch) * m_capacity];
+      for (uint32_t i = 0; i < count; ++i) {
+        ReadoutType frame = frames[i];
+        const uint64_t ts = frame.get_timestamp();
+        if (ts >= begin && ts < end) {
+          out.push_back(frame);
+        }
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (bucket.epoch.load(std::memory_order_relaxed) != epoch) {
+        out.resize(before);
+        intact = false;
+      }
+    }
+    return intact;
+  }
+
+  uint64_t bucket_width() const { return m_width; }
+  uint32_t num_buckets() const { return m_num_buckets; }
+  uint32_t bucket_capacity() const { return m_capacity; }
+  uint64_t late_frames() const { return m_late_frames.load(std::memory_order_relaxed); }
+  uint64_t bucket_overflows() const { return m_bucket_overflows.load(std::memory_order_relaxed); }
+
+private:
+  static constexpr uint64_t s_no_epoch = std::numeric_limits<uint64_t>::max();
+
+  struct alignas(64) Bucket
+  {
+    std::atomic<uint64_t> epoch{ s_no_epoch }; ///< Bucket number (timestamp / width) of the content
+    std::atomic<uint32_t> count{ 0 };
+  };
+
+  void allocate(std::size_t size, uint64_t width, uint32_t num_buckets)
+  {
+    m_width = std::max<uint64_t>(width, 1);
+    m_num_buckets = std::max<uint32_t>(num_buckets, 1);
+    m_capacity = static_cast<uint32_t>(std::max<std::size_t>((size + m_num_buckets - 1) / m_num_buckets, 1));
+    m_buckets.reset(new Bucket[m_num_buckets]);
+    m_frames.reset(new ReadoutType[static_cast<std::size_t>(m_num_buckets) * m_capacity]);
+    m_occupancy.store(0);
+    m_last_written.store(nullptr, std::memory_order_release);
+    m_started.store(false, std::memory_order_release);
+    m_newest_epoch.store(0, std::memory_order_release);
+    m_oldest_epoch.store(1, std::memory_order_release);
+  }
+
+  std::size_t slot_of(uint64_t epoch) const { return static_cast<std::size_t>(epoch % m_num_buckets); }
+  Bucket& bucket_of(uint64_t epoch) { return m_buckets[slot_of(epoch)]; }
+  const Bucket& bucket_of(uint64_t epoch) const { return m_buckets[slot_of(epoch)]; }
+
+  uint32_t count_of(uint64_t epoch) const
+  {
+    const Bucket& bucket = bucket_of(epoch);
+    return bucket.epoch.load(std::memory_order_acquire) == epoch ? bucket.count.load(std::memory_order_acquire) : 0;
+  }
+
+  const ReadoutType& frame(uint64_t epoch, uint32_t index) const
+  {
+    return m_frames[slot_of(epoch) * m_capacity + index];
+  }
+
+  uint64_t ring_start(uint64_t newest) const { return newest + 1 >= m_num_buckets ? newest + 1 - m_num_buckets : 0; }
+
+  //! Producer only: makes epoch the newest bucket, expiring the buckets the ring wraps onto
+  void advance_to(uint64_t epoch)
+  {
+    const uint64_t start = ring_start(epoch);
+    for (uint64_t e = std::max(m_newest + 1, start); e <= epoch; ++e) {
+      recycle(bucket_of(e), e);
+    }
+    m_newest = epoch;
+    m_oldest = std::max(m_oldest, start);
+    m_oldest_epoch.store(m_oldest, std::memory_order_release);
+    m_newest_epoch.store(m_newest, std::memory_order_release);
+  }
+
+  //! Producer only: empties a bucket and assigns it to epoch, readers of the old content notice
+  void recycle(Bucket& bucket, uint64_t epoch)
+  {
+    const uint64_t old_epoch = bucket.epoch.load(std::memory_order_relaxed);
+    const uint32_t dropped = bucket.count.load(std::memory_order_relaxed);
+    bucket.epoch.store(s_no_epoch, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bucket.count.store(0, std::memory_order_relaxed);
+    if (old_epoch != s_no_epoch && dropped > 0) {
+      m_occupancy.fetch_sub(dropped, std::memory_order_relaxed);
+    }
+    bucket.epoch.store(epoch, std::memory_order_release);
+  }
+
+  // Configuration
+  uint64_t m_width = default_bucket_width_ticks;
+  uint32_t m_num_buckets = 0;
+  uint32_t m_capacity = 0;
+
+  // Storage
+  std::unique_ptr<Bucket[]> m_buckets;
+  std::unique_ptr<ReadoutType[]> m_frames;
+
+  // Producer state
+  uint64_t m_newest = 0;
+  uint64_t m_oldest = 0;
+
+  // Published to readers
+  std::atomic<bool> m_started{ false };
+  std::atomic<const ReadoutType*> m_last_written{ nullptr };
+  std::atomic<uint64_t> m_newest_epoch{ 0 };
+  std::atomic<uint64_t> m_oldest_epoch{ 1 };
+  std::atomic<std::size_t> m_occupancy{ 0 };
+  std::atomic<uint64_t> m_late_frames{ 0 };
+  std::atomic<uint64_t> m_bucket_overflows{ 0 };
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_TIMESTAMPBUCKETLATENCYBUFFERMODEL_HPP_
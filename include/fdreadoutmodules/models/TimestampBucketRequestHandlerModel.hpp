@@ -0,0 +1,45 @@
+/**
+ * @file TimestampBucketRequestHandlerModel.hpp Request handler for TimestampBucketLatencyBufferModel
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_TIMESTAMPBUCKETREQUESTHANDLERMODEL_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_TIMESTAMPBUCKETREQUESTHANDLERMODEL_HPP_
+
+#include "fdreadoutmodules/models/WindowCopyRequestHandlerModel.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Serves DataRequests from a TimestampBucketLatencyBufferModel.
+ *
+ * Only the buckets overlapping the window are read, and the frames found are sorted by timestamp
+ * before they go into the fragment, as the skip list used to deliver them.
+ */
+template<class ReadoutType, class LatencyBufferType>
+class TimestampBucketRequestHandlerModel
+  : public WindowCopyRequestHandlerModel<ReadoutType, LatencyBufferType, ReadoutType>
+{
+public:
+  using inherited = WindowCopyRequestHandlerModel<ReadoutType, LatencyBufferType, ReadoutType>;
+  using inherited::inherited;
+
+protected:
+  void order_copy(std::vector<ReadoutType>& copy) override
+  {
+    std::sort(copy.begin(), copy.end(), [](const ReadoutType& a, const ReadoutType& b) {
+      return a.get_timestamp() < b.get_timestamp();
+    });
+  }
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_TIMESTAMPBUCKETREQUESTHANDLERMODEL_HPP_
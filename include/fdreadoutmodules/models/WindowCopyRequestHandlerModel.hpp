@@ -0,0 +1,119 @@
+/**
+ * @file WindowCopyRequestHandlerModel.hpp Request handler for latency buffers copying out request windows
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_WINDOWCOPYREQUESTHANDLERMODEL_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_WINDOWCOPYREQUESTHANDLERMODEL_HPP_
+
+#include "datahandlinglibs/models/DefaultRequestHandlerModel.hpp"
+
+#include "daqdataformats/Fragment.hpp"
+#include "dfmessages/DataRequest.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Serves DataRequests from a latency buffer that copies the data of a window out itself.
+ *
+ * The buffer provides occupancy(), oldest_timestamp(), newest_timestamp() and
+ * copy_window(begin, end, std::vector<CopiedType>&), returning false if the window lost data while it
+ * was copied. The copy goes into a per-thread buffer that the fragment is built from, after
+ * order_copy(). Such buffers evict elements as they write, so there is no cleanup pass.
+ */
+template<class ReadoutType, class LatencyBufferType, class CopiedType>
+class WindowCopyRequestHandlerModel
+  : public datahandlinglibs::DefaultRequestHandlerModel<ReadoutType, LatencyBufferType>
+{
+public:
+  using inherited = datahandlinglibs::DefaultRequestHandlerModel<ReadoutType, LatencyBufferType>;
+  using RequestResult = typename inherited::RequestResult;
+  using ResultCode = typename inherited::ResultCode;
+  using inherited::inherited;
+
+  void cleanup_check() override {}
+
+protected:
+  //! Request thread: puts the copied window in the order of the fragment
+  virtual void order_copy(std::vector<CopiedType>& /* copy */) {}
+
+  RequestResult data_request(dfmessages::DataRequest dr) override
+  {
+    RequestResult rres(ResultCode::kUnknown, dr);
+    auto frag_header = inherited::create_fragment_header(dr);
+    const uint64_t begin = dr.request_information.window_begin;
+    const uint64_t end = dr.request_information.window_end;
+    auto& lb = inherited::m_latency_buffer;
+
+    thread_local std::vector<CopiedType> copy;
+    copy.clear();
+
+    // Taken before copying: data arriving meanwhile must not turn a partial window into a found one
+    const uint64_t newest = lb->newest_timestamp();
+    if (lb->occupancy() == 0) {
+      rres.result_code = ResultCode::kNotYetArrived;
+    } else if (end <= lb->oldest_timestamp()) {
+      rres.result_code = ResultCode::kTooOld;
+    } else {
+      bool intact = lb->copy_window(begin, end, copy);
+      if (end > newest) {
+        // Filled as far as possible, for the last retry of the request
+        rres.result_code = ResultCode::kNotYetArrived;
+      } else if (!intact || begin < lb->oldest_timestamp()) {
+        rres.result_code = ResultCode::kPartiallyOld;
+      } else {
+        rres.result_code = ResultCode::kFound;
+      }
+    }
+    order_copy(copy);
+
+    std::vector<std::pair<void*, size_t>> pieces;
+    if (!copy.empty()) {
+      pieces.emplace_back(static_cast<void*>(copy.data()), copy.size() * sizeof(CopiedType));
+    } else {
+      frag_header.error_bits |= (0x1 << static_cast<size_t>(daqdataformats::FragmentErrorBits::kDataNotFound));
+    }
+    if (rres.result_code != ResultCode::kFound && !copy.empty()) {
+      frag_header.error_bits |= (0x1 << static_cast<size_t>(daqdataformats::FragmentErrorBits::kIncomplete));
+    }
+    rres.fragment = std::make_unique<daqdataformats::Fragment>(pieces);
+    rres.fragment->set_header_fields(frag_header);
+    count_result(rres.result_code);
+    return rres;
+  }
+
+private:
+  // The request counters of the default handler; not yet arrived requests are left to its waiting list
+  void count_result(ResultCode code)
+  {
+    switch (code) {
+      case ResultCode::kFound:
+        ++this->m_num_requests_found;
+        break;
+      case ResultCode::kTooOld:
+      case ResultCode::kPartiallyOld:
+        ++this->m_num_requests_old_window;
+        break;
+      case ResultCode::kNotFound:
+        ++this->m_num_requests_bad;
+        break;
+      case ResultCode::kNotYetArrived:
+        break;
+      default:
+        ++this->m_num_requests_uncategorized;
+    }
+  }
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_MODELS_WINDOWCOPYREQUESTHANDLERMODEL_HPP_
@@ -0,0 +1,44 @@
+/**
+ * @file CpuFeatures.hpp Run-time detection of the instruction set extensions of the host
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_CPUFEATURES_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_CPUFEATURES_HPP_
+
+#include <string>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+enum class IsaLevel
+{
+  kScalar = 0,
+  kAVX2 = 1,
+  kAVX512 = 2 ///< AVX-512 F, BW and VL
+};
+
+/**
+ * @brief Highest level supported by both the CPU and this build, ignoring any cap.
+ */
+IsaLevel
+host_isa_level();
+
+/**
+ * @brief Highest level supported by both the CPU (CPUID) and this build.
+ *
+ * The environment variable FDREADOUTMODULES_MAX_ISA (scalar, avx2, avx512) caps the result, which
+ * allows to compare the code paths on a single host.
+ */
+IsaLevel
+detect_isa_level();
+
+std::string
+to_string(IsaLevel level);
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_CPUFEATURES_HPP_
@@ -0,0 +1,96 @@
+/**
+ * @file FragmentCache.hpp Bounded cache of recently served readout windows
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_FRAGMENTCACHE_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_FRAGMENTCACHE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Keeps the payload of complete readout windows, so that a window inside one of them is copied
+ * from the cache instead of being looked up in the latency buffer again.
+ *
+ * A window is only worth caching if others overlap it, which a single request cannot tell. Recently
+ * looked up windows are therefore remembered, and admit() lets a window in once it overlaps one of
+ * them, widened to their union so that one lookup covers both. Entries are evicted least recently used
+ * first, by count and by bytes. All members are thread-safe.
+ */
+class FragmentCache
+{
+public:
+  struct Entry
+  {
+    uint64_t begin;
+    uint64_t end;
+    std::vector<char> payload;
+  };
+
+  //! Counters since construction
+  struct Stats
+  {
+    uint64_t lookups = 0;
+    uint64_t exact_hits = 0;     ///< Same window as a cached one
+    uint64_t contained_hits = 0; ///< Inside a larger cached window
+    uint64_t merged = 0;         ///< Windows admitted widened to an overlapping recent window
+    uint64_t insertions = 0;
+    uint64_t evictions = 0;
+    std::size_t entries = 0;
+    std::size_t bytes = 0;
+  };
+
+  void configure(std::size_t max_entries, std::size_t max_bytes);
+  void clear();
+  bool enabled() const { return m_max_entries > 0; }
+  //! Largest entry insert() accepts
+  std::size_t max_bytes() const { return m_max_bytes; }
+
+  //! A cached entry covering [begin, end), or nullptr. Counts as a lookup.
+  std::shared_ptr<const Entry> find(uint64_t begin, uint64_t end);
+
+  /**
+   * @brief Whether [begin, end) should be cached once looked up.
+   * @param[out] merged_begin, merged_end The window to look up instead, covering the recent overlapping one
+   */
+  bool admit(uint64_t begin, uint64_t end, uint64_t& merged_begin, uint64_t& merged_end);
+
+  void insert(std::shared_ptr<const Entry> entry);
+
+  Stats stats() const;
+
+private:
+  struct Slot
+  {
+    std::shared_ptr<const Entry> entry;
+    uint64_t last_use;
+  };
+  struct Window
+  {
+    uint64_t begin;
+    uint64_t end;
+  };
+
+  mutable std::mutex m_mutex;
+  std::size_t m_max_entries = 0;
+  std::size_t m_max_bytes = 0;
+  std::vector<Slot> m_slots;
+  std::vector<Window> m_recent; ///< Ring of recently looked up windows
+  std::size_t m_recent_next = 0;
+  uint64_t m_clock = 0;
+  Stats m_stats;
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_FRAGMENTCACHE_HPP_
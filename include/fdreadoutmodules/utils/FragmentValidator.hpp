@@ -0,0 +1,75 @@
+/**
+ * @file FragmentValidator.hpp Vectorized checks of the fragments produced by the data handlers
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_FRAGMENTVALIDATOR_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_FRAGMENTVALIDATOR_HPP_
+
+#include "fdreadoutmodules/kernels/FrameKernels.hpp"
+#include "fdreadoutmodules/utils/FrameLayout.hpp"
+#include "fdreadoutmodules/utils/LogLinearHistogram.hpp"
+#include "fdreadoutmodules/utils/SingleWriterCounter.hpp"
+
+#include "daqdataformats/Fragment.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Checks fragments of every type FDDataHandlerModule produces, with the frame kernels.
+ *
+ * For each fragment the payload must be a whole number of frames, every frame must overlap the
+ * requested window and timestamps must not decrease. For fixed rate streams (WIBEth, DAPHNEStream)
+ * timestamps must advance by exactly one step and a complete fragment must hold as many frames as
+ * the window covers. Error flags of the frame headers are counted where the layout knows them. Only
+ * one fragment in sample_every is checked. Counters are cumulative and written by the validating
+ * thread only, the cost of each check is recorded in a histogram.
+ */
+class FragmentValidator
+{
+public:
+  struct Counters
+  {
+    SingleWriterCounter fragments_validated;
+    SingleWriterCounter fragments_skipped;
+    SingleWriterCounter frames_checked;
+    SingleWriterCounter empty_fragments;
+    SingleWriterCounter unknown_type;
+    SingleWriterCounter size_mismatches;
+    SingleWriterCounter frames_outside_window;
+    SingleWriterCounter timestamp_gaps;
+    SingleWriterCounter timestamp_reversals;
+    SingleWriterCounter frame_count_mismatches;
+    SingleWriterCounter incomplete_fragments;
+    SingleWriterCounter frame_error_bits;
+  };
+
+  explicit FragmentValidator(uint32_t sample_every = 1);
+
+  //! Validates the fragment, or only counts it when it is not sampled
+  void validate(const daqdataformats::Fragment& fragment);
+
+  const Counters& counters() const { return m_counters; }
+  LogLinearHistogram<>& cost_ns() { return m_cost_ns; }
+  const FrameKernels& kernels() const { return m_kernels; }
+
+private:
+  void check(const daqdataformats::Fragment& fragment, const FrameLayout& layout);
+
+  const FrameKernels& m_kernels;
+  uint32_t m_sample_every;
+  uint64_t m_seen = 0;
+  Counters m_counters;
+  LogLinearHistogram<> m_cost_ns;
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_FRAGMENTVALIDATOR_HPP_
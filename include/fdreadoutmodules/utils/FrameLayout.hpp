@@ -0,0 +1,62 @@
+/**
+ * @file FrameLayout.hpp Position of timestamps and error flags in the far detector frame formats
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_FRAMELAYOUT_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_FRAMELAYOUT_HPP_
+
+#include "daqdataformats/FragmentHeader.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+//! One error flag of a frame header, within the error word of its FrameLayout
+struct ErrorFlag
+{
+  std::string name;
+  uint64_t mask = 0;
+};
+
+/**
+ * @brief Where the timestamp and error flags of one frame format are, and how its timestamps advance.
+ *
+ * Offsets are found by applying the setters of fddetdataformats to a zeroed frame, so the bit field
+ * layout is not duplicated here. The frame kernels read the words at these offsets.
+ */
+struct FrameLayout
+{
+  daqdataformats::fragment_type_t fragment_type = 0;
+  std::string name;           ///< Data type name, e.g. WIBEthFrame
+  std::size_t frame_size = 0;
+  std::size_t timestamp_offset = 0;
+  std::size_t error_offset = 0;
+  uint64_t error_mask = 0;    ///< All error flags within the word at error_offset, 0 when none are known
+  std::vector<ErrorFlag> error_flags;
+  uint64_t tick_step = 0;     ///< Ticks between consecutive frames
+  bool fixed_step = false;    ///< Every frame is exactly tick_step after the previous one
+};
+
+//! Layouts of the frame formats written by FDDataHandlerModule
+const std::vector<FrameLayout>&
+frame_layouts();
+
+//! nullptr if the fragment type has no known layout
+const FrameLayout*
+find_frame_layout(daqdataformats::fragment_type_t fragment_type);
+
+//! nullptr if the data type has no known layout
+const FrameLayout*
+find_frame_layout(const std::string& name);
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_FRAMELAYOUT_HPP_
@@ -0,0 +1,99 @@
+/**
+ * @file IoUringFileWriter.hpp Asynchronous O_DIRECT file writer based on io_uring
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_IOURINGFILEWRITER_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_IOURINGFILEWRITER_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct io_uring;
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Streams data to a file with several aligned writes in flight.
+ *
+ * Data is copied into one of queue_depth staging buffers. A full buffer is submitted to the kernel as a
+ * single write at its file offset and the caller continues in the next free buffer, so the calling thread
+ * only blocks when every buffer is still in flight. Buffers are page aligned so that the file can be
+ * opened with O_DIRECT. Not thread-safe: one writer thread per file, statistics may be read from anywhere.
+ */
+class IoUringFileWriter
+{
+public:
+  static constexpr std::size_t alignment = 4096;
+
+  IoUringFileWriter();
+  ~IoUringFileWriter();
+
+  IoUringFileWriter(const IoUringFileWriter&) = delete;
+  IoUringFileWriter& operator=(const IoUringFileWriter&) = delete;
+  IoUringFileWriter(IoUringFileWriter&&) = delete;
+  IoUringFileWriter& operator=(IoUringFileWriter&&) = delete;
+
+  /**
+   * @brief Open (truncate) the output file and set up the submission ring.
+   * @param buffer_size Size of each staging buffer, rounded up to the alignment
+   * @param queue_depth Number of staging buffers, i.e. maximum writes in flight
+   */
+  void open(const std::string& filename, std::size_t buffer_size, unsigned queue_depth, bool use_o_direct);
+
+  //! Append size bytes. Returns false if a previous write failed.
+  bool write(const char* data, std::size_t size);
+
+  //! Flush the partially filled buffer, wait for all writes and close the file
+  void close();
+
+  bool is_open() const { return m_fd >= 0; }
+  const std::string& filename() const { return m_filename; }
+
+  // Statistics
+  uint64_t bytes_written() const { return m_bytes_written.load(std::memory_order_relaxed); }
+  unsigned inflight() const { return m_inflight.load(std::memory_order_relaxed); }
+  uint64_t stalls() const { return m_stalls.load(std::memory_order_relaxed); }
+  uint64_t errors() const { return m_errors.load(std::memory_order_relaxed); }
+
+private:
+  struct Buffer
+  {
+    char* data = nullptr;
+    std::size_t fill = 0;
+    std::size_t submitted = 0;
+  };
+
+  void submit(unsigned index, std::size_t size);
+  void reap(bool wait);
+  void acquire_buffer();
+  void release_buffers();
+
+  std::string m_filename;
+  int m_fd = -1;
+  int m_open_flags = 0;
+  std::unique_ptr<io_uring> m_ring;
+  std::size_t m_buffer_size = 0;
+  std::vector<Buffer> m_buffers;
+  std::vector<unsigned> m_free;
+  unsigned m_current = 0;
+  uint64_t m_file_offset = 0;
+  bool m_submit_failed = false; ///< The ring refused a write, later ones are dropped
+
+  std::atomic<uint64_t> m_bytes_written{ 0 };
+  std::atomic<unsigned> m_inflight{ 0 };
+  std::atomic<uint64_t> m_stalls{ 0 };
+  std::atomic<uint64_t> m_errors{ 0 };
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_IOURINGFILEWRITER_HPP_
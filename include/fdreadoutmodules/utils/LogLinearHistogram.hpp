@@ -0,0 +1,121 @@
+/**
+ * @file LogLinearHistogram.hpp Lock-free HDR-style histogram for hot-path sampling
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_LOGLINEARHISTOGRAM_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_LOGLINEARHISTOGRAM_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Log-linear bucketed histogram with fixed relative precision.
+ *
+ * Every power of two is split into 2^SubBucketBits linear sub-buckets, so the relative binning error is
+ * bounded by 2^-SubBucketBits. Recording is a relaxed fetch_add on one bucket: any number of threads may
+ * record concurrently while the monitoring thread drains the histogram with snapshot_and_reset().
+ */
+template<unsigned SubBucketBits = 4, unsigned MaxValueBits = 48>
+class LogLinearHistogram
+{
+  static_assert(SubBucketBits > 0 && SubBucketBits < MaxValueBits && MaxValueBits <= 64,
+                "Invalid LogLinearHistogram geometry");
+
+public:
+  static constexpr std::size_t sub_buckets = std::size_t(1) << SubBucketBits;
+  static constexpr std::size_t num_buckets = (MaxValueBits - SubBucketBits + 1) * sub_buckets;
+
+  struct Snapshot
+  {
+    std::array<uint64_t, num_buckets> counts{};
+    uint64_t entries = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    double mean() const { return entries ? static_cast<double>(sum) / entries : 0.; }
+
+    //! Upper edge of the bucket holding the requested quantile (q in [0,1])
+    uint64_t percentile(double q) const
+    {
+      if (entries == 0) {
+        return 0;
+      }
+      uint64_t target = static_cast<uint64_t>(q * static_cast<double>(entries));
+      if (target >= entries) {
+        target = entries - 1;
+      }
+      uint64_t seen = 0;
+      for (std::size_t i = 0; i < num_buckets; ++i) {
+        seen += counts[i];
+        if (seen > target) {
+          uint64_t upper = bucket_upper_bound(i);
+          return upper < max ? upper : max;
+        }
+      }
+      return max;
+    }
+  };
+
+  void record(uint64_t value) noexcept
+  {
+    m_counts[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+    uint64_t prev = m_max.load(std::memory_order_relaxed);
+    while (value > prev && !m_max.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {
+    }
+  }
+
+  //! Drain all buckets into a snapshot. Concurrent records land either in this or in the next snapshot.
+  Snapshot snapshot_and_reset() noexcept
+  {
+    Snapshot snap;
+    for (std::size_t i = 0; i < num_buckets; ++i) {
+      snap.counts[i] = m_counts[i].exchange(0, std::memory_order_relaxed);
+      snap.entries += snap.counts[i];
+    }
+    snap.sum = m_sum.exchange(0, std::memory_order_relaxed);
+    snap.max = m_max.exchange(0, std::memory_order_relaxed);
+    return snap;
+  }
+
+  static constexpr std::size_t bucket_index(uint64_t value) noexcept
+  {
+    if (value < sub_buckets) {
+      return static_cast<std::size_t>(value);
+    }
+    const unsigned msb = 63 - static_cast<unsigned>(__builtin_clzll(value));
+    if (msb >= MaxValueBits) {
+      return num_buckets - 1;
+    }
+    const unsigned shift = msb - SubBucketBits;
+    return (shift + 1) * sub_buckets + ((value >> shift) & (sub_buckets - 1));
+  }
+
+  static constexpr uint64_t bucket_upper_bound(std::size_t index) noexcept
+  {
+    if (index < sub_buckets) {
+      return index;
+    }
+    const unsigned shift = static_cast<unsigned>(index / sub_buckets) - 1;
+    const uint64_t mantissa = (index % sub_buckets) + sub_buckets;
+    return ((mantissa + 1) << shift) - 1;
+  }
+
+private:
+  std::array<std::atomic<uint64_t>, num_buckets> m_counts{};
+  std::atomic<uint64_t> m_sum{ 0 };
+  std::atomic<uint64_t> m_max{ 0 };
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_LOGLINEARHISTOGRAM_HPP_
@@ -0,0 +1,125 @@
+/**
+ * @file MemoryPlacement.hpp Huge page backing, NUMA binding and prefaulting of large buffers
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_MEMORYPLACEMENT_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_MEMORYPLACEMENT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+enum class PageBacking
+{
+  kDefault,     ///< Base pages as allocated by the buffer model
+  kTransparent, ///< Base allocation, advised for transparent huge pages
+  kHugeTLB2M,   ///< Dedicated mapping from the 2 MB hugetlb pool
+  kHugeTLB1G    ///< Dedicated mapping from the 1 GB hugetlb pool
+};
+
+//! Accepts the enum names of the OKS schema: Default, Transparent, HugeTLB2M, HugeTLB1G
+PageBacking
+parse_page_backing(const std::string& name);
+
+std::string
+to_string(PageBacking backing);
+
+/**
+ * @brief Anonymous mapping backed by hugetlb pages, optionally bound to a NUMA node.
+ */
+class HugePageRegion
+{
+public:
+  HugePageRegion() = default;
+  ~HugePageRegion() { unmap(); }
+
+  HugePageRegion(const HugePageRegion&) = delete;
+  HugePageRegion& operator=(const HugePageRegion&) = delete;
+  HugePageRegion(HugePageRegion&&) = delete;
+  HugePageRegion& operator=(HugePageRegion&&) = delete;
+
+  /**
+   * @brief Maps at least bytes from the pool of backing, rounded up to the huge page size.
+   * @return false if the pool cannot provide the pages; errno is left as set by the kernel
+   */
+  bool map(std::size_t bytes, PageBacking backing, int numa_node);
+  void unmap();
+
+  void* data() const { return m_data; }
+  std::size_t size() const { return m_size; }
+  std::size_t page_size() const { return m_page_size; }
+
+private:
+  void* m_data = nullptr;
+  std::size_t m_size = 0;
+  std::size_t m_page_size = 0;
+};
+
+//! Asks for transparent huge pages on the 2 MB aligned part of the range
+void
+advise_transparent_huge_pages(void* data, std::size_t bytes);
+
+//! Moves the range to numa_node and keeps future faults there. No-op without libnuma.
+void
+bind_to_numa_node(void* data, std::size_t bytes, int numa_node);
+
+//! Writes one byte per page so that the whole range is backed before it is used
+void
+prefault_pages(void* data, std::size_t bytes, std::size_t page_size);
+
+/**
+ * @brief Runs step, the mapping, binding or prefaulting of a configured buffer, or hands it to the
+ * defer_memory_preparation() running on this thread.
+ */
+void
+prepare_memory(std::function<void()> step);
+
+/**
+ * @brief Runs configure and returns the steps it passed to prepare_memory() instead of running them, in
+ * order. The buffers configured must not be used before the steps have run, on any thread.
+ */
+std::vector<std::function<void()>>
+defer_memory_preparation(const std::function<void()>& configure);
+
+/**
+ * @brief Gives the pages entirely inside the range back to the kernel with MADV_DONTNEED; they read as
+ * zero and are faulted in again when touched.
+ * @param page_size Alignment of the release, the huge page size for huge page backed ranges (0: base page)
+ * @return Bytes released
+ */
+std::size_t
+release_pages(void* data, std::size_t bytes, std::size_t page_size);
+
+/**
+ * @brief Where the pages of a buffer actually are, as reported by the kernel.
+ */
+struct MemoryPlacement
+{
+  PageBacking backing = PageBacking::kDefault; ///< Backing that was achieved, after any fallback
+  int requested_node = -1;
+  int majority_node = -1;       ///< Node holding most of the sampled pages, -1 if unknown
+  double local_fraction = 0.;   ///< Sampled pages on requested_node (on majority_node if none was requested)
+  std::size_t bytes = 0;
+  std::size_t huge_page_bytes = 0; ///< Bytes of the mappings of the buffer backed by huge pages
+  uint64_t prefault_us = 0;
+};
+
+/**
+ * @brief Samples up to max_samples pages of the range with move_pages(2) and reads the huge page
+ * usage of the mappings containing it from /proc/self/smaps.
+ */
+MemoryPlacement
+query_memory_placement(const void* data, std::size_t bytes, int requested_node, std::size_t max_samples = 4096);
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_MEMORYPLACEMENT_HPP_
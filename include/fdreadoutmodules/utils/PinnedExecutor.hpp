@@ -0,0 +1,119 @@
+/**
+ * @file PinnedExecutor.hpp Fixed set of worker threads bound to given CPUs
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_PINNEDEXECUTOR_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_PINNEDEXECUTOR_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Parses a CPU list in the format of /sys/devices/system/cpu/online, e.g. "0-11,24-35".
+ * @throws std::invalid_argument on malformed input
+ */
+std::vector<int>
+parse_cpu_list(const std::string& list);
+
+/**
+ * @brief Fixed number of workers running posted tasks in order, either on a given worker or on any.
+ *
+ * The executor is only there to pin: every worker is bound to the CPUs of its NUMA node among the CPUs
+ * given to start(), and prefers memory of that node. Threads created from inside a task inherit this
+ * binding, which is how the threads of the data handling models created and started on a worker end up
+ * on the cores assigned to a multi-link handler. The tasks themselves are one-off run control work; the
+ * periodic work of a link stays on the threads of its model.
+ */
+class PinnedExecutor
+{
+public:
+  using task_t = std::function<void()>;
+
+  PinnedExecutor() = default;
+  ~PinnedExecutor() { stop(); }
+
+  PinnedExecutor(const PinnedExecutor&) = delete;
+  PinnedExecutor& operator=(const PinnedExecutor&) = delete;
+  PinnedExecutor(PinnedExecutor&&) = delete;
+  PinnedExecutor& operator=(PinnedExecutor&&) = delete;
+
+  /**
+   * @brief Starts the workers.
+   * @param num_workers Number of workers, 0 for one per CPU
+   * @param cpus CPUs to run on; if empty, the CPUs of numa_node, or no binding if numa_node < 0
+   * @param numa_node Preferred NUMA node when cpus is empty
+   * @param name Thread name prefix, at most 12 characters are used
+   */
+  void start(std::size_t num_workers, std::vector<int> cpus, int numa_node, const std::string& name);
+
+  //! Runs all queued tasks, then joins the workers
+  void stop();
+
+  std::size_t size() const { return m_workers.size(); }
+
+  //! Queues a task for the first idle worker. Exceptions thrown by the task are counted and dropped.
+  void post(task_t task);
+
+  //! Queues a task for worker % size(), so that it runs with the binding of that worker
+  void post(task_t task, std::size_t worker);
+
+  //! Queues a callable like post() and returns a future to its result or exception
+  template<class Function, class... Worker>
+  std::future<std::invoke_result_t<Function>> submit(Function&& function, Worker... worker)
+  {
+    auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Function>()>>(
+      std::forward<Function>(function));
+    auto future = task->get_future();
+    post([task]() { (*task)(); }, worker...);
+    return future;
+  }
+
+  struct Stats
+  {
+    uint64_t executed = 0; ///< Tasks run since start
+    uint64_t failed = 0;   ///< Posted tasks that threw
+    std::size_t queued = 0;
+  };
+  Stats stats() const;
+
+private:
+  struct Worker
+  {
+    std::deque<task_t> tasks; ///< Tasks for this worker only
+    std::vector<int> cpus;
+    int node = -1;
+    std::thread thread;
+  };
+
+  void run(std::size_t index, const std::string& name);
+
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  mutable std::mutex m_mutex; ///< Protects the task queues and m_stop
+  std::condition_variable m_wake;
+  std::deque<task_t> m_tasks; ///< Tasks for any worker
+  bool m_stop = false;
+  std::atomic<uint64_t> m_executed{ 0 };
+  std::atomic<uint64_t> m_failed{ 0 };
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_PINNEDEXECUTOR_HPP_
@@ -0,0 +1,75 @@
+/**
+ * @file RatePacer.hpp Sub-microsecond pacing of a periodic producer
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_RATEPACER_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_RATEPACER_HPP_
+
+#include <cstdint>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Nanosecond clock read from the TSC when it is invariant, from steady_clock otherwise.
+ *
+ * The TSC frequency is calibrated once per process against steady_clock, which takes 20 ms. Users call
+ * calibrate() when they are configured, so that the first reading on a hot path does not pay for it.
+ */
+class TscClock
+{
+public:
+  //! Calibrates the TSC unless already done
+  static void calibrate();
+  static int64_t now_ns();
+  static bool uses_tsc();
+
+  //! Raw TSC reading, steady_clock ns without an invariant TSC
+  static uint64_t ticks();
+  //! Nanoseconds per unit of ticks()
+  static double ns_per_tick();
+};
+
+/**
+ * @brief Paces elements at a fixed rate, in batches.
+ *
+ * Element k is due at start + k / rate. wait() blocks until the first element of the next batch is
+ * due: it sleeps while the deadline is far and busy-waits the last stretch, so batches leave within
+ * well below a microsecond of their deadline on an idle core. A producer that falls behind by more
+ * than max_lag_ns is re-anchored instead of bursting to catch up; such events are counted as slips.
+ * Without spinning the pacer only sleeps, trading the sub-microsecond accuracy for an idle core.
+ */
+class RatePacer
+{
+public:
+  static constexpr int64_t spin_window_ns = 200000;
+  static constexpr int64_t max_lag_ns = 100000000;
+
+  //! Anchors the schedule at the current time
+  void start(double rate_hz, bool spin = true);
+
+  /**
+   * @brief Waits until the next batch of n elements is due.
+   * @return How late the batch is released with respect to its deadline, in ns
+   */
+  int64_t wait(uint64_t n);
+
+  uint64_t slips() const { return m_slips; }
+  double rate_hz() const { return m_rate_hz; }
+
+private:
+  double m_rate_hz = 0.;
+  double m_period_ns = 0.;
+  bool m_spin = true;
+  int64_t m_start_ns = 0;
+  uint64_t m_next_element = 0;
+  uint64_t m_slips = 0;
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_RATEPACER_HPP_
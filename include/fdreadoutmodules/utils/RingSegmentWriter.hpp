@@ -0,0 +1,116 @@
+/**
+ * @file RingSegmentWriter.hpp Ring of raw data files on local disk
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_RINGSEGMENTWRITER_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_RINGSEGMENTWRITER_HPP_
+
+#include "fdreadoutmodules/utils/IoUringFileWriter.hpp"
+#include "fdreadoutmodules/utils/TimestampIndex.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Keeps the last max_segments segments of a raw element stream on disk.
+ *
+ * Elements go to <prefix>.ring.<seq>, a new segment being started once the current one holds
+ * segment_bytes; beyond max_segments the oldest segment and its timestamp index are deleted. seal()
+ * renames the segments on disk to <prefix>.freeze.<first timestamp>.<seq>, where the ring no longer
+ * deletes them, and the next element starts a new ring. Every segment gets a timestamp index sidecar.
+ * Not thread-safe: one writer thread, statistics may be read from anywhere.
+ */
+class RingSegmentWriter
+{
+public:
+  struct Settings
+  {
+    std::string prefix;
+    std::size_t element_size = 0;
+    uint64_t segment_bytes = 0;
+    unsigned max_segments = 2;
+    std::size_t buffer_size = 0; ///< Staging buffer of the IoUringFileWriter
+    unsigned queue_depth = 8;
+    bool use_o_direct = false;
+    uint32_t index_stride = TimestampIndexWriter::default_stride;
+  };
+
+  RingSegmentWriter() = default;
+  ~RingSegmentWriter() { close(); }
+
+  RingSegmentWriter(const RingSegmentWriter&) = delete;
+  RingSegmentWriter& operator=(const RingSegmentWriter&) = delete;
+
+  //! Start a new ring, deleting the ring segments a previous one left with the same prefix
+  void open(const Settings& settings);
+
+  //! Append one element. Returns false if a write failed.
+  bool write(const char* element, uint64_t timestamp);
+
+  /**
+   * @brief Close the current segment and move the ring out of the rotation.
+   * @return Number of segments kept, 0 if nothing was written since the previous seal
+   */
+  std::size_t seal();
+
+  //! Close the current segment; its files stay in place
+  void close();
+
+  bool is_open() const { return m_open; }
+
+  // Statistics
+  //! Bytes handed to the file writers since construction
+  uint64_t bytes_written() const { return m_bytes_accepted.load(std::memory_order_relaxed); }
+  uint64_t stalls() const { return m_closed_stalls.load(std::memory_order_relaxed) + m_writer.stalls(); }
+  uint64_t errors() const { return m_closed_errors.load(std::memory_order_relaxed) + m_writer.errors(); }
+  //! Timestamps covered by the segments of the current ring
+  uint64_t retained_ticks() const
+  {
+    uint64_t oldest = m_oldest_timestamp.load(std::memory_order_relaxed);
+    uint64_t newest = m_newest_timestamp.load(std::memory_order_relaxed);
+    return newest > oldest ? newest - oldest : 0;
+  }
+  unsigned segments() const { return m_segment_count.load(std::memory_order_relaxed); }
+  unsigned sealed_sets() const { return m_sealed_sets.load(std::memory_order_relaxed); }
+
+private:
+  struct Segment
+  {
+    std::string filename;
+    uint64_t first_timestamp;
+  };
+
+  void start_segment(uint64_t timestamp);
+  void finish_segment();
+  void delete_oldest_segment();
+
+  Settings m_settings;
+  bool m_open = false;
+  IoUringFileWriter m_writer;
+  TimestampIndexWriter m_index;
+  std::deque<Segment> m_segments;
+  uint64_t m_segment_fill = 0;
+  uint64_t m_sequence = 0;
+
+  std::atomic<uint64_t> m_bytes_accepted{ 0 };
+  std::atomic<uint64_t> m_closed_stalls{ 0 };
+  std::atomic<uint64_t> m_closed_errors{ 0 };
+  std::atomic<uint64_t> m_oldest_timestamp{ 0 };
+  std::atomic<uint64_t> m_newest_timestamp{ 0 };
+  std::atomic<unsigned> m_segment_count{ 0 };
+  std::atomic<unsigned> m_sealed_sets{ 0 };
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_RINGSEGMENTWRITER_HPP_
@@ -0,0 +1,72 @@
+/**
+ * @file SharedInputFile.hpp Read-only emulator input, mapped once per process
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_SHAREDINPUTFILE_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_SHAREDINPUTFILE_HPP_
+
+#include "fdreadoutmodules/utils/MemoryPlacement.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Whole elements of a raw data file, mapped read-only and shared by all users.
+ *
+ * open() returns the instance already mapped for the same file, element size, size limit and page
+ * backing if one is alive, so all emulated links of a data type replay the same pages. With default
+ * backing the file itself is mapped and populated, sharing the page cache; with huge page backing it
+ * is read once into an anonymous huge page mapping, falling back to transparent huge pages when the
+ * hugetlb pool is exhausted.
+ */
+class SharedInputFile
+{
+public:
+  /**
+   * @brief Maps up to size_limit bytes (0 for no limit) of path, truncated to whole elements.
+   * @throws EmulatorInputError if the file cannot be read or holds no complete element
+   */
+  static std::shared_ptr<const SharedInputFile>
+  open(const std::string& path, std::size_t element_size, std::size_t size_limit, PageBacking backing);
+
+  ~SharedInputFile();
+
+  SharedInputFile(const SharedInputFile&) = delete;
+  SharedInputFile& operator=(const SharedInputFile&) = delete;
+  SharedInputFile(SharedInputFile&&) = delete;
+  SharedInputFile& operator=(SharedInputFile&&) = delete;
+
+  const uint8_t* data() const { return m_data; }
+  std::size_t size() const { return m_size; }
+  std::size_t num_elements() const { return m_size / m_element_size; }
+  const uint8_t* element(std::size_t i) const { return m_data + i * m_element_size; }
+  //! Backing achieved, after any fallback
+  PageBacking backing() const { return m_backing; }
+  //! Wall time spent mapping and populating the file
+  uint64_t load_us() const { return m_load_us; }
+
+private:
+  SharedInputFile() = default;
+  void load(const std::string& path, std::size_t element_size, std::size_t size_limit, PageBacking backing);
+
+  const uint8_t* m_data = nullptr;
+  std::size_t m_size = 0;
+  std::size_t m_element_size = 1;
+  std::size_t m_mapped_bytes = 0;
+  PageBacking m_backing = PageBacking::kDefault;
+  uint64_t m_load_us = 0;
+  std::unique_ptr<HugePageRegion> m_huge_pages;
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_SHAREDINPUTFILE_HPP_
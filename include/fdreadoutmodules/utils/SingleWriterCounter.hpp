@@ -0,0 +1,49 @@
+/**
+ * @file SingleWriterCounter.hpp Counter updated by one thread and read by many
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_SINGLEWRITERCOUNTER_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_SINGLEWRITERCOUNTER_HPP_
+
+#include <atomic>
+#include <cstdint>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief 64-bit counter owned by a single writer thread.
+ *
+ * Updates are a relaxed load/store pair instead of a locked read-modify-write, which keeps the
+ * consumer hot path free of bus-locking instructions. Readers always observe a torn-free value.
+ */
+class alignas(64) SingleWriterCounter
+{
+public:
+  void add(uint64_t n = 1) noexcept
+  {
+    m_value.store(m_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  //! Raise the stored value to v if it is larger (high-water mark)
+  void raise_to(uint64_t v) noexcept
+  {
+    if (v > m_value.load(std::memory_order_relaxed)) {
+      m_value.store(v, std::memory_order_relaxed);
+    }
+  }
+
+  void reset(uint64_t v = 0) noexcept { m_value.store(v, std::memory_order_relaxed); }
+  uint64_t load() const noexcept { return m_value.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint64_t> m_value{ 0 };
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_SINGLEWRITERCOUNTER_HPP_
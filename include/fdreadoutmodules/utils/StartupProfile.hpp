@@ -0,0 +1,118 @@
+/**
+ * @file StartupProfile.hpp Timing of the run control transitions of a module and the startup pool
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_STARTUPPROFILE_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_STARTUPPROFILE_HPP_
+
+#include "fdreadoutmodules/opmon/startup_timing_info.pb.h"
+#include "fdreadoutmodules/utils/PinnedExecutor.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Pool shared by all modules of the application for the preparation of their links, started on
+ * first use with FDREADOUTMODULES_STARTUP_THREADS workers (default: the number of CPUs, at most 8).
+ * @return nullptr if FDREADOUTMODULES_STARTUP_THREADS is 0, preparations then run inline
+ */
+PinnedExecutor*
+startup_pool();
+
+/**
+ * @brief Wall time of the init, conf and start of one module, and of the link preparations it hands to
+ * the startup pool.
+ *
+ * The transitions are timed by Timer scopes on the command thread. Preparations run on a pool worker and
+ * record how long they waited for it and how long they ran; the time conf then blocks on them is kept
+ * apart, so that prepare_total_ms - conf_wait_ms is what running them off the command thread saved.
+ */
+class StartupProfile
+{
+public:
+  //! Stores the time elapsed between its construction and destruction in target
+  class Timer
+  {
+  public:
+    explicit Timer(std::atomic<uint64_t>& target)
+      : m_target(target)
+      , m_begin(std::chrono::steady_clock::now())
+    {}
+    ~Timer() { m_target.store(elapsed_us(m_begin), std::memory_order_relaxed); }
+
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+  private:
+    std::atomic<uint64_t>& m_target;
+    std::chrono::steady_clock::time_point m_begin;
+  };
+
+  std::atomic<uint64_t> init_us{ 0 };
+  std::atomic<uint64_t> conf_us{ 0 };
+  std::atomic<uint64_t> conf_wait_us{ 0 };
+  std::atomic<uint64_t> start_us{ 0 };
+
+  /**
+   * @brief Runs function on the startup pool, or inline if it is disabled, timing it.
+   * @return Future to the result of function or to the exception it threw
+   */
+  template<class Function>
+  std::future<std::invoke_result_t<Function>> prepare(Function&& function)
+  {
+    using result_t = std::invoke_result_t<Function>;
+    const auto queued = std::chrono::steady_clock::now();
+    auto task = std::make_shared<std::packaged_task<result_t()>>(
+      [this, queued, function = std::forward<Function>(function)]() mutable -> result_t {
+        // Recorded when the preparation ends, also by throwing
+        struct Record
+        {
+          StartupProfile& profile;
+          uint64_t queued_us;
+          std::chrono::steady_clock::time_point begin;
+          ~Record() { profile.add_preparation(queued_us, elapsed_us(begin)); }
+        } record{ *this, elapsed_us(queued), std::chrono::steady_clock::now() };
+        return function();
+      });
+    auto future = task->get_future();
+    if (auto pool = startup_pool()) {
+      pool->post([task]() { (*task)(); });
+    } else {
+      (*task)();
+    }
+    return future;
+  }
+
+  //! Any thread
+  opmon::StartupTimingInfo info() const;
+
+private:
+  static uint64_t elapsed_us(std::chrono::steady_clock::time_point since)
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - since).count();
+  }
+
+  void add_preparation(uint64_t queued_us, uint64_t prepare_us);
+
+  std::atomic<uint64_t> m_prepared{ 0 };
+  std::atomic<uint64_t> m_prepare_max_us{ 0 };
+  std::atomic<uint64_t> m_prepare_total_us{ 0 };
+  std::atomic<uint64_t> m_queued_max_us{ 0 };
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_STARTUPPROFILE_HPP_
@@ -0,0 +1,194 @@
+/**
+ * @file TaskProfiler.hpp Sampled timing of the tasks of a frame processor
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_TASKPROFILER_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_TASKPROFILER_HPP_
+
+#include "fdreadoutmodules/utils/RatePacer.hpp"
+#include "fdreadoutmodules/utils/SingleWriterCounter.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Counts the calls of one task and times one call in sample_every, on the thread running it.
+ *
+ * A call that is not sampled costs the counter updates and a countdown. For a task fed from a queue by
+ * its own thread, the gap between the end of the call before a sampled one and the start of the sampled
+ * one is taken as time blocked waiting for input. Sampled calls can also be queued for a trace file,
+ * in a ring that the profiler drains; samples that find it full are dropped.
+ */
+class TaskProfile
+{
+public:
+  struct Sample
+  {
+    int64_t time_ns;
+    uint64_t ticks;
+    uint32_t tid;
+    int32_t cpu;
+  };
+
+  //! Deltas since the previous call of interval(), monitoring thread only
+  struct Interval
+  {
+    uint64_t calls = 0;
+    uint64_t frames = 0;
+    uint64_t samples = 0;
+    uint64_t sampled_frames = 0;
+    uint64_t ticks = 0;
+    uint64_t max_ticks = 0;
+    uint64_t gaps = 0;
+    uint64_t gap_ticks = 0;
+    uint64_t trace_dropped = 0;
+  };
+
+  static constexpr std::size_t trace_capacity = 4096;
+
+  TaskProfile(std::string name, bool waits_for_input, const std::atomic<uint32_t>& sample_every,
+              const std::atomic<bool>& tracing)
+    : m_name(std::move(name))
+    , m_waits_for_input(waits_for_input)
+    , m_sample_every(sample_every)
+    , m_tracing(tracing)
+  {}
+
+  const std::string& name() const { return m_name; }
+  bool waits_for_input() const { return m_waits_for_input; }
+
+  //! Task thread: runs task(item), timing the call if it is due
+  template<class Task, class Item>
+  void run(const Task& task, Item* item)
+  {
+    const uint64_t frames = item->get_num_frames();
+    m_calls.add();
+    m_frames.add(frames);
+    const uint32_t every = m_sample_every.load(std::memory_order_relaxed);
+    if (every == 0 || ++m_since_sample < every) {
+      task(item);
+      if (m_waits_for_input && every != 0 && m_since_sample + 1 == every) {
+        m_previous_end = TscClock::ticks();
+      }
+      return;
+    }
+    m_since_sample = 0;
+    const uint64_t begin = TscClock::ticks();
+    task(item);
+    const uint64_t end = TscClock::ticks();
+    record(begin, end, frames);
+  }
+
+  Interval interval();
+
+  //! Monitoring thread: moves the queued trace samples to out
+  void drain_trace(std::vector<Sample>& out);
+
+private:
+  void record(uint64_t begin, uint64_t end, uint64_t frames);
+
+  std::string m_name;
+  bool m_waits_for_input;
+  const std::atomic<uint32_t>& m_sample_every;
+  const std::atomic<bool>& m_tracing;
+
+  // Task thread
+  uint32_t m_since_sample = 0;
+  uint64_t m_previous_end = 0;
+
+  SingleWriterCounter m_calls;
+  SingleWriterCounter m_frames;
+  SingleWriterCounter m_samples;
+  SingleWriterCounter m_sampled_frames;
+  SingleWriterCounter m_ticks;
+  alignas(64) std::atomic<uint64_t> m_max_ticks{ 0 }; ///< Raised by the task thread, taken by interval()
+  SingleWriterCounter m_gaps;
+  SingleWriterCounter m_gap_ticks;
+  SingleWriterCounter m_trace_dropped;
+
+  std::array<Sample, trace_capacity> m_trace;
+  std::atomic<std::size_t> m_trace_head{ 0 }; ///< Next sample written, by the task thread
+  std::atomic<std::size_t> m_trace_tail{ 0 }; ///< Next sample read, by the monitoring thread
+
+  Interval m_last; ///< Totals at the previous interval()
+};
+
+/**
+ * @brief The TaskProfiles of the tasks of one frame processor, and their common settings.
+ *
+ * Profiling is off until enable() sets a sampling period; it can be changed and disabled at any time.
+ * With a trace file, every sampled call is appended to it by flush_trace() in the text format of
+ * `perf script`, one sample per call with the task as symbol and its TSC ticks as period, so that it
+ * can be merged with the output of perf itself.
+ */
+class ProcessorProfiler
+{
+public:
+  explicit ProcessorProfiler(std::string name = "")
+    : m_name(std::move(name))
+  {}
+  ~ProcessorProfiler();
+
+  void set_name(const std::string& name) { m_name = name; }
+
+  //! Before the tasks run, e.g. at conf. The profile lives as long as the profiler.
+  TaskProfile* add_task(const std::string& name, bool waits_for_input);
+
+  //! Once the tasks no longer run, e.g. at scrap: writes their queued samples and drops their profiles
+  void clear_tasks();
+
+  /**
+   * @brief Any thread.
+   * @param sample_every Time one call in sample_every, 0 disables profiling
+   * @param trace_file Append sampled calls to this file, none if empty
+   * @return false if the trace file cannot be opened; profiling is enabled all the same
+   */
+  bool enable(uint32_t sample_every, const std::string& trace_file);
+  void disable() { enable(0, ""); }
+
+  uint32_t sample_every() const { return m_sample_every.load(std::memory_order_relaxed); }
+
+  //! Monitoring thread
+  template<class Function>
+  void for_each_task(Function&& f)
+  {
+    std::lock_guard<std::mutex> lock(m_tasks_mutex);
+    for (auto& task : m_tasks) {
+      f(*task);
+    }
+  }
+
+  //! Monitoring thread: writes the queued samples to the trace file, if any
+  void flush_trace();
+
+private:
+  void flush_trace_locked();
+
+  std::string m_name;
+  std::mutex m_tasks_mutex;
+  std::vector<std::unique_ptr<TaskProfile>> m_tasks;
+  std::atomic<uint32_t> m_sample_every{ 0 };
+  std::atomic<bool> m_tracing{ false };
+
+  std::mutex m_trace_mutex;
+  std::ofstream m_trace_file;
+  std::vector<TaskProfile::Sample> m_trace_buffer;
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_TASKPROFILER_HPP_
@@ -0,0 +1,97 @@
+/**
+ * @file TimeSyncMonitor.hpp Readout lag, clock drift and jitter of TimeSync sources
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_TIMESYNCMONITOR_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_TIMESYNCMONITOR_HPP_
+
+#include "fdreadoutmodules/utils/LogLinearHistogram.hpp"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Tracks, per TimeSync source, how far the newest data trails the wall clock of the source.
+ *
+ * A data handler sends TimeSyncs carrying the DAQ time of its newest data and its own wall clock.
+ * Their difference is the readout lag: it grows when the link falls behind. Between two
+ * publications the lag is fitted linearly against the source wall clock; the slope is the drift
+ * of the host clock with respect to the timing system and the RMS residual the jitter. The delay
+ * between the source wall clock and the local one at reception is tracked separately, so a slow
+ * transport is not mistaken for readout lag. Recording costs a map lookup and a few arithmetic
+ * operations under an uncontended mutex.
+ */
+class TimeSyncMonitor
+{
+public:
+  struct Summary
+  {
+    uint64_t messages = 0;      ///< Since construction or clear()
+    uint64_t sequence_gaps = 0; ///< Missing sequence numbers since construction or clear()
+    uint64_t lag_negative = 0;  ///< DAQ time ahead of the source wall clock, since construction or clear()
+    int64_t last_lag_ns = 0;
+    LogLinearHistogram<>::Snapshot lag_ns;            ///< Since the previous summary
+    double delivery_delay_mean_ns = 0.;               ///< Since the previous summary
+    double drift_ppm = 0.;                            ///< Since the previous summary, 0 below 3 messages
+    double jitter_ns = 0.;                            ///< Since the previous summary, 0 below 3 messages
+  };
+
+  explicit TimeSyncMonitor(uint64_t clock_frequency_hz = 62500000);
+
+  /**
+   * @brief Accounts one TimeSync.
+   * @param system_time_ns Wall clock of the source when it was sent
+   * @param now_ns Local wall clock at reception
+   */
+  void record(uint32_t source, uint64_t daq_time, int64_t system_time_ns, uint64_t sequence_number, int64_t now_ns);
+
+  //! Summary of every source seen, restarting the per-interval statistics
+  std::vector<std::pair<uint32_t, Summary>> summarize();
+
+  //! Forgets all sources
+  void clear();
+
+private:
+  struct Source
+  {
+    uint64_t messages = 0;
+    uint64_t sequence_gaps = 0;
+    uint64_t lag_negative = 0;
+    uint64_t last_sequence = 0;
+    int64_t last_lag_ns = 0;
+    LogLinearHistogram<> lag_ns;
+
+    // Per interval: delivery delay and least squares fit of lag against source time, both relative
+    // to the first message of the interval to keep the sums small
+    uint64_t interval_messages = 0;
+    double delivery_sum_ns = 0.;
+    int64_t x0_ns = 0;
+    int64_t y0_ns = 0;
+    double sx = 0., sy = 0., sxx = 0., sxy = 0., syy = 0.;
+  };
+
+  //! Exact for any DAQ time: whole seconds and the remainder are converted separately
+  uint64_t ticks_to_ns(uint64_t ticks) const
+  {
+    constexpr uint64_t ns_per_s = 1000000000;
+    return ticks / m_clock_frequency_hz * ns_per_s + ticks % m_clock_frequency_hz * ns_per_s / m_clock_frequency_hz;
+  }
+
+  uint64_t m_clock_frequency_hz;
+  std::mutex m_mutex;
+  std::map<uint32_t, Source> m_sources;
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_TIMESYNCMONITOR_HPP_
@@ -0,0 +1,72 @@
+/**
+ * @file TimerWheel.hpp Hierarchical timer wheel keyed on DAQ timestamps
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_TIMERWHEEL_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_TIMERWHEEL_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Holds ids until the DAQ time passes their key.
+ *
+ * Level l has 64 slots of 64^l ticks each, for 36 bits of timestamp; keys further away wait in an overflow
+ * list. An id is stored in the lowest level whose slot differs from the current time, and moves down a
+ * level whenever the time passes its slot, so advancing costs one step per occupied slot passed and not
+ * per tick, whatever the jump. A bitmap per level finds occupied slots, and with it the earliest key.
+ * Not thread-safe.
+ */
+class TimerWheel
+{
+public:
+  static constexpr unsigned slot_bits = 6;
+  static constexpr unsigned levels = 6;
+
+  //! Current time, the largest time passed to advance()
+  uint64_t now() const { return m_now; }
+  std::size_t size() const { return m_size; }
+
+  //! Drop all ids and restart at time now
+  void reset(uint64_t now);
+
+  //! @return false, and keeps nothing, if key is not in the future
+  bool insert(uint64_t key, uint64_t id);
+
+  //! Moves the time forward to now and appends the ids with key <= now to expired
+  void advance(uint64_t now, std::vector<uint64_t>& expired);
+
+  //! Lower bound on the smallest key held, exact below level 1; UINT64_MAX when empty
+  uint64_t next_due() const;
+
+private:
+  static constexpr std::size_t slots = std::size_t(1) << slot_bits;
+
+  struct Item
+  {
+    uint64_t key;
+    uint64_t id;
+  };
+
+  void place(const Item& item);
+
+  uint64_t m_now = 0;
+  std::size_t m_size = 0;
+  std::array<std::array<std::vector<Item>, slots>, levels> m_slots;
+  std::array<uint64_t, levels> m_occupied{};
+  std::vector<Item> m_overflow;
+  std::vector<Item> m_moving; ///< Items taken out of passed slots, kept to reuse its capacity
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_TIMERWHEEL_HPP_
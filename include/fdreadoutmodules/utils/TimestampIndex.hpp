@@ -0,0 +1,143 @@
+/**
+ * @file TimestampIndex.hpp Sparse timestamp index stored next to recorded raw files
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_TIMESTAMPINDEX_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_TIMESTAMPINDEX_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * Sidecar layout (little endian), stored as <data file>.tsidx:
+ *   char[8]  magic "FDTSIDX1"
+ *   uint32   element size in bytes
+ *   uint32   stride, i.e. elements between two entries
+ *   { uint64 timestamp, uint64 byte offset } per entry, in file order
+ *
+ * Entries point to element boundaries. Timestamps are expected to be non-decreasing between entries,
+ * which holds for raw data recorded from a link.
+ */
+struct TimestampIndexEntry
+{
+  uint64_t timestamp;
+  uint64_t offset;
+};
+
+class TimestampIndexWriter
+{
+public:
+  static constexpr uint32_t default_stride = 1024;
+
+  TimestampIndexWriter() = default;
+  ~TimestampIndexWriter() { close(); }
+
+  TimestampIndexWriter(const TimestampIndexWriter&) = delete;
+  TimestampIndexWriter& operator=(const TimestampIndexWriter&) = delete;
+
+  //! Raises a TimestampIndexUnavailable warning and stays closed if the sidecar cannot be written
+  void open(const std::string& data_file, uint32_t element_size, uint32_t stride = default_stride);
+  void close();
+  //! False when indexing is disabled for the current file, also after a failed write
+  bool is_open() const { return m_stream.is_open(); }
+
+  //! Called for every element in file order; keeps one entry per stride
+  void add(uint64_t timestamp, uint64_t offset)
+  {
+    if (m_countdown-- == 0) {
+      append(timestamp, offset);
+      m_countdown = m_stride - 1;
+    }
+  }
+
+  //! Unconditionally store one entry
+  void append(uint64_t timestamp, uint64_t offset);
+
+  uint32_t stride() const { return m_stride; }
+
+private:
+  void check_stream();
+
+  std::string m_sidecar;
+  std::ofstream m_stream;
+  uint32_t m_stride = default_stride;
+  uint32_t m_countdown = 0;
+};
+
+/**
+ * @brief Read side of the sidecar: maps a timestamp window to the byte range of the data file covering it.
+ */
+class TimestampIndex
+{
+public:
+  struct ByteRange
+  {
+    uint64_t begin;
+    uint64_t end; ///< exclusive, clamped to the data file size
+  };
+
+  static std::string sidecar_name(const std::string& data_file) { return data_file + ".tsidx"; }
+
+  //! Load the sidecar of data_file. Returns false if it is missing or malformed.
+  bool load(const std::string& data_file);
+
+  /**
+   * @brief Smallest indexed byte range containing every element with begin <= timestamp < end.
+   *
+   * The range starts at the last entry not after begin and stops at the first entry after end, so
+   * at most 2 * stride elements outside the window are included.
+   */
+  ByteRange locate(uint64_t begin, uint64_t end) const;
+
+  //! Read the raw bytes of locate(begin, end) from the data file
+  std::vector<char> read_window(uint64_t begin, uint64_t end) const;
+
+  /**
+   * @brief Read the elements of a recorded file whose timestamp falls in [begin, end).
+   */
+  template<class ReadoutType>
+  std::vector<ReadoutType> read_elements(uint64_t begin, uint64_t end) const;
+
+  const std::vector<TimestampIndexEntry>& entries() const { return m_entries; }
+  uint32_t element_size() const { return m_element_size; }
+  uint32_t stride() const { return m_stride; }
+  uint64_t file_size() const { return m_file_size; }
+
+private:
+  std::string m_data_file;
+  uint32_t m_element_size = 0;
+  uint32_t m_stride = 0;
+  uint64_t m_file_size = 0;
+  std::vector<TimestampIndexEntry> m_entries;
+};
+
+/**
+ * @brief Build the sidecar of an already recorded file by probing one element per stride.
+ *
+ * Recordings made directly from latency buffer memory may start with a partial element, so the first
+ * element boundary is located by looking for three consecutive elements with increasing timestamps.
+ * The cost is one small read per stride elements instead of a scan of the whole file. Setting abort
+ * stops the build and removes the partial sidecar.
+ */
+template<class ReadoutType>
+bool
+build_timestamp_index(const std::string& data_file,
+                      uint32_t stride = TimestampIndexWriter::default_stride,
+                      const std::atomic<bool>* abort = nullptr);
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#include "detail/TimestampIndex.hxx"
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_TIMESTAMPINDEX_HPP_
@@ -0,0 +1,68 @@
+/**
+ * @file WIBEthAdcCodec.hpp Lossless delta and bit plane coding of WIBEth frames
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_WIBETHADCCODEC_HPP_
+#define FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_WIBETHADCCODEC_HPP_
+
+#include "fdreadoutmodules/kernels/FrameKernels.hpp"
+
+#include "fddetdataformats/WIBEthFrame.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Compresses WIBEth frames one by one, so that any frame can be decoded on its own.
+ *
+ * The headers are kept as they are. Each of the 64 time samples of a frame holds 64 channels of
+ * 14 bits; every channel is replaced by its difference to the previous sample, zigzag coded, and
+ * the 64 differences are stored as bit planes, only as many as the largest of them needs. Quiet
+ * channels take 4 to 6 planes of 8 bytes per sample instead of 112 bytes. A frame that would not
+ * shrink is stored raw.
+ *
+ * Encoded frame: a format byte (0 raw, 1 coded), the frame header, then for a coded frame one
+ * width byte and width planes per sample.
+ */
+class WIBEthAdcCodec
+{
+public:
+  using Frame = fddetdataformats::WIBEthFrame;
+
+  //! Bound on the bytes encode() writes for one frame
+  static constexpr std::size_t max_encoded_size = sizeof(Frame) + 1;
+
+  WIBEthAdcCodec();
+
+  //! Encodes frame into out, which must have room for max_encoded_size bytes; returns the bytes written
+  std::size_t encode(const Frame& frame, uint8_t* out) const;
+
+  /**
+   * @brief Decodes the frame starting at in, reading nothing at or beyond end.
+   * @return Start of the next encoded frame, nullptr if the input is malformed
+   */
+  const uint8_t* decode(const uint8_t* in, const uint8_t* end, Frame& frame) const;
+
+  //! Start of the next encoded frame without decoding this one, nullptr if the input is malformed
+  static const uint8_t* skip(const uint8_t* in, const uint8_t* end);
+
+  //! Timestamp of the encoded frame starting at in, read from its header
+  uint64_t peek_timestamp(const uint8_t* in) const;
+
+  const FrameKernels& kernels() const { return m_kernels; }
+
+private:
+  const FrameKernels& m_kernels;
+  std::size_t m_timestamp_offset;
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_INCLUDE_FDREADOUTMODULES_UTILS_WIBETHADCCODEC_HPP_
@@ -0,0 +1,100 @@
+/**
+ * @file TimestampIndex.hxx TimestampIndex template member and build_timestamp_index definitions
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+template<class ReadoutType>
+std::vector<ReadoutType>
+TimestampIndex::read_elements(uint64_t begin, uint64_t end) const
+{
+  std::vector<ReadoutType> elements;
+  if (m_element_size != sizeof(ReadoutType)) {
+    return elements;
+  }
+  auto bytes = read_window(begin, end);
+  ReadoutType element;
+  for (std::size_t pos = 0; pos + sizeof(ReadoutType) <= bytes.size(); pos += sizeof(ReadoutType)) {
+    std::memcpy(&element, bytes.data() + pos, sizeof(ReadoutType));
+    uint64_t ts = element.get_timestamp();
+    if (ts >= end) {
+      break;
+    }
+    if (ts >= begin) {
+      elements.push_back(element);
+    }
+  }
+  return elements;
+}
+
+template<class ReadoutType>
+bool
+build_timestamp_index(const std::string& data_file, uint32_t stride, const std::atomic<bool>* abort)
+{
+  constexpr std::size_t element_size = sizeof(ReadoutType);
+  std::ifstream in(data_file, std::ios::binary | std::ios::ate);
+  if (!in.is_open()) {
+    return false;
+  }
+  const uint64_t file_size = static_cast<uint64_t>(in.tellg());
+  if (file_size < element_size) {
+    return false;
+  }
+
+  // Locate the first element boundary: O_DIRECT recordings start at a page boundary of the buffer
+  std::vector<char> head(static_cast<std::size_t>(std::min<uint64_t>(file_size, 4096 + 3 * element_size)));
+  in.seekg(0);
+  in.read(head.data(), static_cast<std::streamsize>(head.size()));
+  uint64_t first = 0;
+  ReadoutType probe[3];
+  for (std::size_t c = 0; c < std::min<std::size_t>(element_size, 4096) && c + 3 * element_size <= head.size();
+       c += sizeof(uint64_t)) {
+    for (std::size_t i = 0; i < 3; ++i) {
+      std::memcpy(&probe[i], head.data() + c + i * element_size, element_size);
+    }
+    uint64_t t0 = probe[0].get_timestamp();
+    uint64_t t1 = probe[1].get_timestamp();
+    uint64_t t2 = probe[2].get_timestamp();
+    if (t0 != 0 && t0 < t1 && t1 < t2 && t2 - t0 < (uint64_t(1) << 32)) {
+      first = c;
+      break;
+    }
+  }
+
+  TimestampIndexWriter writer;
+  writer.open(data_file, static_cast<uint32_t>(element_size), stride);
+  if (!writer.is_open()) {
+    return false;
+  }
+  ReadoutType element;
+  const uint64_t step = static_cast<uint64_t>(stride) * element_size;
+  for (uint64_t offset = first; offset + element_size <= file_size; offset += step) {
+    if (abort != nullptr && *abort) {
+      // A partial sidecar would still load
+      writer.close();
+      std::remove(TimestampIndex::sidecar_name(data_file).c_str());
+      return false;
+    }
+    in.seekg(static_cast<std::streamoff>(offset));
+    in.read(reinterpret_cast<char*>(&element), element_size); // NOLINT
+    if (!in) {
+      break;
+    }
+    writer.append(element.get_timestamp(), offset);
+  }
+  const bool written = writer.is_open();
+  writer.close();
+  return written;
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
@@ -5,19 +5,23 @@
  * Licensing/copyright details are in the COPYING file that you should have
  * received with this code.
  */
-#include "fdreadoutlibs/DUNEWIBSuperChunkTypeAdapter.hpp"
 #include "fdreadoutlibs/DUNEWIBEthTypeAdapter.hpp"
 #include "fdreadoutlibs/TDEFrameTypeAdapter.hpp"
+#include "fdreadoutlibs/TDEEthTypeAdapter.hpp"
 #include "fdreadoutlibs/DAPHNESuperChunkTypeAdapter.hpp"
+#include "fdreadoutlibs/DAPHNEStreamSuperChunkTypeAdapter.hpp"
 
 #include "datahandlinglibs/ReadoutLogging.hpp"
 #include "datahandlinglibs/models/RecorderModel.hpp"
-#include "datahandlinglibs/opmon/datahandling_info.pb.h"
+
+#include "fdreadoutmodules/dal/DataRecorderIoUringConf.hpp"
+#include "fdreadoutmodules/models/IoUringRecorderModel.hpp"
+#include "fdreadoutmodules/utils/TimestampIndex.hpp"
 
 #include "DataRecorderModule.hpp"
-#include "appfwk/DAQModuleHelper.hpp"
 
-//#include "appfwk/cmd/Nljs.hpp"
+#include "appmodel/DataRecorderModule.hpp"
+#include "confmodel/Connection.hpp"
 #include "logging/Logging.hpp"
 #include "datahandlinglibs/DataHandlingIssues.hpp"
 #include <string>
@@ -25,6 +29,13 @@
 using namespace dunedaq::datahandlinglibs::logging;
 
 namespace dunedaq {
+
+DUNE_DAQ_TYPESTRING(dunedaq::fdreadoutlibs::types::DUNEWIBEthTypeAdapter, "WIBEthFrame")
+DUNE_DAQ_TYPESTRING(dunedaq::fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter, "PDSFrame")
+DUNE_DAQ_TYPESTRING(dunedaq::fdreadoutlibs::types::DAPHNEStreamSuperChunkTypeAdapter, "PDSStreamFrame")
+DUNE_DAQ_TYPESTRING(dunedaq::fdreadoutlibs::types::TDEFrameTypeAdapter, "TDEFrame")
+DUNE_DAQ_TYPESTRING(dunedaq::fdreadoutlibs::types::TDEEthTypeAdapter, "TDEEthFrame")
+
 namespace fdreadoutmodules {
 
 DataRecorderModule::DataRecorderModule(const std::string& name)
@@ -36,65 +47,85 @@ DataRecorderModule::DataRecorderModule(const std::string& name)
   register_command("stop_trigger_sources", &DataRecorderModule::do_stop);
 }
 
+template<class ReadoutType>
+std::shared_ptr<datahandlinglibs::RecorderConcept>
+DataRecorderModule::make_recorder(bool use_io_uring)
+{
+  if (use_io_uring) {
+    return std::make_shared<IoUringRecorderModel<ReadoutType>>(get_name());
+  }
+  m_index_builder = [](const std::string& file) { return build_timestamp_index<ReadoutType>(file); };
+  return std::make_shared<datahandlinglibs::RecorderModel<ReadoutType>>(get_name());
+}
+
 void
-DataRecorderModule::init(const data_t& args)
+DataRecorderModule::init(std::shared_ptr<appfwk::ModuleConfiguration> cfg)
 {
+  TLOG_DEBUG(TLVL_ENTER_EXIT_METHODS) << get_name() << ": Entering init() method";
+  auto mdal = cfg->module<appmodel::DataRecorderModule>(get_name());
+  if (mdal == nullptr) {
+    throw datahandlinglibs::GenericConfigurationError(ERS_HERE, "No DataRecorderModule named " + get_name());
+  }
+  if (mdal->get_inputs().size() != 1) {
+    throw datahandlinglibs::GenericConfigurationError(
+      ERS_HERE, "Expected a single raw_recording input, " + std::to_string(mdal->get_inputs().size()) + " specified");
+  }
   try {
     // Acquire input connection and its DataType
-    auto ci = appfwk::connection_index(args, {"raw_recording"});
-    auto datatypes = dunedaq::iomanager::IOManager::get()->get_datatypes(ci["raw_recording"]);
-    if (datatypes.size() != 1) {
-    ers::error(dunedaq::datahandlinglibs::GenericConfigurationError(ERS_HERE,
-      "Multiple raw_recording queues specified! Expected only a single raw_dtance!"));
-    }
-    std::string raw_dt{ *datatypes.begin() };
-    TLOG() << "Choosing specializations for RecorderModel with raw_recording"
-           << " [uid:" << ci["raw_recording"] << " , data_type:" << raw_dt << ']';
-
-    // IF WIB2
-    if (raw_dt.find("WIB2Frame") != std::string::npos) {
-      TLOG_DEBUG(TLVL_WORK_STEPS) << "Creating recorder for wib2";
-      recorder.reset(new datahandlinglibs::RecorderModel<fdreadoutlibs::types::DUNEWIBSuperChunkTypeAdapter>(get_name()));
-      recorder->init(args);
-      return;
-    }
+    auto input = mdal->get_inputs()[0];
+    m_output_file = mdal->get_configuration()->get_output_file();
+    std::string raw_dt = input->get_data_type();
+    bool use_io_uring = mdal->get_configuration()->cast<dal::DataRecorderIoUringConf>() != nullptr;
+    TLOG() << "Choosing specializations for " << (use_io_uring ? "IoUringRecorderModel" : "RecorderModel")
+           << " with raw_recording [uid:" << input->UID() << " , data_type:" << raw_dt << ']';
 
     // IF WIBEth
     if (raw_dt.find("WIBEthFrame") != std::string::npos) {
       TLOG_DEBUG(TLVL_WORK_STEPS) << "Creating recorder for wibeth";
-      recorder.reset(new datahandlinglibs::RecorderModel<fdreadoutlibs::types::DUNEWIBEthTypeAdapter>(get_name()));
-      recorder->init(args);
-      return;
+      recorder = make_recorder<fdreadoutlibs::types::DUNEWIBEthTypeAdapter>(use_io_uring);
     }
 
     // IF PDS
-    if (raw_dt.find("PDSFrame") != std::string::npos) {
+    else if (raw_dt.find("PDSFrame") != std::string::npos) {
       TLOG_DEBUG(TLVL_WORK_STEPS) << "Creating recorder for pds";
-      recorder.reset(new datahandlinglibs::RecorderModel<fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter>(get_name()));
-      recorder->init(args);
-      return;
+      recorder = make_recorder<fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter>(use_io_uring);
+    }
+
+    // IF PDSStream
+    else if (raw_dt.find("PDSStreamFrame") != std::string::npos) {
+      TLOG_DEBUG(TLVL_WORK_STEPS) << "Creating recorder for pds stream";
+      recorder = make_recorder<fdreadoutlibs::types::DAPHNEStreamSuperChunkTypeAdapter>(use_io_uring);
     }
 
     // IF TDE
-    if (raw_dt.find("TDEFrame") != std::string::npos) {
+    else if (raw_dt.find("TDEFrame") != std::string::npos) {
       TLOG_DEBUG(TLVL_WORK_STEPS) << "Creating recorder for tde";
-      recorder.reset(new datahandlinglibs::RecorderModel<fdreadoutlibs::types::TDEFrameTypeAdapter>(get_name()));
-      recorder->init(args);
-      return;
+      recorder = make_recorder<fdreadoutlibs::types::TDEFrameTypeAdapter>(use_io_uring);
+    }
+
+    // IF TDEEth
+    else if (raw_dt.find("TDEEthFrame") != std::string::npos) {
+      TLOG_DEBUG(TLVL_WORK_STEPS) << "Creating recorder for tdeeth";
+      recorder = make_recorder<fdreadoutlibs::types::TDEEthTypeAdapter>(use_io_uring);
+    }
+
+    else {
+      throw datahandlinglibs::DataRecorderConfigurationError(ERS_HERE, "Could not create DataRecorderModule of type " + raw_dt);
+    }
+
+    // Compressed recordings have no fixed element stride to index
+    if (mdal->get_configuration()->get_compression_algorithm() != "None") {
+      m_index_builder = nullptr;
     }
- 
 
-    throw datahandlinglibs::DataRecorderConfigurationError(ERS_HERE, "Could not create DataRecorderModule of type " + raw_dt);
+    register_node("recorder", recorder);
+    recorder->init(mdal);
 
   } catch (const ers::Issue& excpt) {
-    throw datahandlinglibs::DataRecorderModuleResourceQueueError(ERS_HERE, "Could not initialize queue", "raw_recording", "");
+    throw datahandlinglibs::DataRecorderModuleResourceQueueError(
+      ERS_HERE, "Could not initialize queue", "raw_recording", "", excpt);
   }
-}
-
-void
-DataRecorderModule::get_info(opmonlib::InfoCollector& ci, int level)
-{
-  recorder->get_info(ci, level);
+  TLOG_DEBUG(TLVL_ENTER_EXIT_METHODS) << get_name() << ": Exiting init() method";
 }
 
 void
@@ -107,6 +138,9 @@ void
 DataRecorderModule::do_scrap(const data_t& args)
 {
   recorder->do_scrap(args);
+  if (m_index_builder && !m_index_builder(m_output_file)) {
+    TLOG() << get_name() << ": Could not build the timestamp index of " << m_output_file;
+  }
 }
 
 void
@@ -10,16 +10,11 @@
 #define FDREADOUTMODULES_PLUGINS_DATARECORDER_HPP_
 
 #include "appfwk/DAQModule.hpp"
-#include "utilities/WorkerThread.hpp"
+#include "appfwk/ModuleConfiguration.hpp"
 
 #include "datahandlinglibs/concepts/RecorderConcept.hpp"
-#include "datahandlinglibs/recorderconfig/Structs.hpp"
-#include "datahandlinglibs/utils/BufferedFileWriter.hpp"
-#include "datahandlinglibs/utils/ReusableThread.hpp"
 
-#include <atomic>
-#include <fstream>
-#include <iostream>
+#include <functional>
 #include <memory>
 #include <string>
 
@@ -36,19 +31,25 @@ public:
   DataRecorderModule(DataRecorderModule&&) = delete;
   DataRecorderModule& operator=(DataRecorderModule&&) = delete;
 
-  void init(const nlohmann::json& obj) override;
-protected:
-  void generate_opmon_data() override;
+  void init(std::shared_ptr<appfwk::ModuleConfiguration> cfg) override;
+
 private:
   // Commands
-  void do_conf(const nlohmann::json& obj);
-  void do_scrap(const nlohmann::json& obj);
-  void do_start(const nlohmann::json& obj);
-  void do_stop(const nlohmann::json& obj);
+  void do_conf(const data_t& args);
+  void do_scrap(const data_t& args);
+  void do_start(const data_t& args);
+  void do_stop(const data_t& args);
+
+  template<class ReadoutType>
+  std::shared_ptr<datahandlinglibs::RecorderConcept> make_recorder(bool use_io_uring);
 
   std::shared_ptr<datahandlinglibs::RecorderConcept> recorder;
+
+  // Builds the timestamp index of recorders that cannot write it while recording
+  std::function<bool(const std::string&)> m_index_builder;
+  std::string m_output_file;
 };
-} // namespace datahandlinglibs
+} // namespace fdreadoutmodules
 } // namespace dunedaq
 
 #endif // FDREADOUTMODULES_PLUGINS_DATARECORDER_HPP_
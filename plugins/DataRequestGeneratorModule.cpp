@@ -0,0 +1,288 @@
+/**
+ * @file DataRequestGeneratorModule.cpp DataRequestGeneratorModule implementation
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "DataRequestGeneratorModule.hpp"
+
+#include "fdreadoutmodules/dal/DataRequestGeneratorModule.hpp"
+#include "fdreadoutmodules/opmon/data_request_generator_info.pb.h"
+
+#include "confmodel/Connection.hpp"
+#include "dfmessages/Fragment_serialization.hpp"
+#include "iomanager/IOManager.hpp"
+#include "logging/Logging.hpp"
+
+#include "datahandlinglibs/DataHandlingIssues.hpp"
+#include "datahandlinglibs/ReadoutLogging.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+
+using namespace dunedaq::datahandlinglibs::logging;
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace {
+int64_t
+system_time_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch())
+    .count();
+}
+
+int64_t
+steady_time_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+} // namespace
+
+DataRequestGeneratorModule::DataRequestGeneratorModule(const std::string& name)
+  : DAQModule(name)
+  , m_work_thread(0)
+  , m_rng(std::random_device{}())
+  , m_send_time_ns(new std::atomic<int64_t>[s_send_time_slots])
+{
+  register_command("conf", &DataRequestGeneratorModule::do_conf);
+  register_command("start", &DataRequestGeneratorModule::do_start);
+  register_command("stop_trigger_sources", &DataRequestGeneratorModule::do_stop);
+}
+
+void
+DataRequestGeneratorModule::init(std::shared_ptr<appfwk::ModuleConfiguration> cfg)
+{
+  TLOG_DEBUG(TLVL_ENTER_EXIT_METHODS) << get_name() << ": Entering init() method";
+  auto mdal = cfg->module<dal::DataRequestGeneratorModule>(get_name());
+  if (mdal == nullptr) {
+    throw datahandlinglibs::GenericConfigurationError(ERS_HERE, "No DataRequestGeneratorModule named " + get_name());
+  }
+  m_conf = mdal->get_configuration();
+
+  try {
+    for (auto con : mdal->get_outputs()) {
+      if (con->get_data_type() == "DataRequest") {
+        m_request_senders.push_back(get_iom_sender<dfmessages::DataRequest>(con->UID()));
+      }
+    }
+    for (auto con : mdal->get_inputs()) {
+      if (con->get_data_type() == "Fragment") {
+        m_fragment_input = con->UID();
+      } else if (con->get_data_type() == "TimeSync") {
+        m_timesync_input = con->UID();
+      }
+    }
+  } catch (const ers::Issue& excpt) {
+    throw datahandlinglibs::GenericResourceQueueError(ERS_HERE, "DataRequest/Fragment", get_name(), excpt);
+  }
+
+  if (m_request_senders.empty() || m_fragment_input.empty()) {
+    throw datahandlinglibs::GenericConfigurationError(
+      ERS_HERE, "DataRequestGeneratorModule needs at least one DataRequest output and one Fragment input");
+  }
+  TLOG_DEBUG(TLVL_ENTER_EXIT_METHODS) << get_name() << ": Exiting init() method";
+}
+
+void
+DataRequestGeneratorModule::do_conf(const data_t& /* args */)
+{
+  m_poisson = m_conf->get_arrival_distribution() == "Poisson";
+  m_period_s = m_conf->get_request_rate_hz() > 0. ? 1. / m_conf->get_request_rate_hz() : 1.;
+  m_burst_period_s = m_conf->get_burst_rate_hz() > 0. ? 1. / m_conf->get_burst_rate_hz() : 0.;
+  m_burst_interval = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::duration<double>(m_conf->get_burst_interval_s()));
+  m_send_timeout = std::chrono::milliseconds(m_conf->get_send_timeout_ms());
+  m_deadline_ns = static_cast<int64_t>(m_conf->get_deadline_ms()) * 1000000;
+
+  TLOG() << get_name() << ": " << m_request_senders.size() << " targets, " << m_conf->get_request_rate_hz() << " Hz "
+         << m_conf->get_arrival_distribution() << " arrivals, window " << m_conf->get_window_width_ticks()
+         << " ticks ending " << m_conf->get_window_offset_ticks() << " ticks before now";
+}
+
+void
+DataRequestGeneratorModule::do_start(const data_t& args)
+{
+  m_run_number = args.value<daqdataformats::run_number_t>("run", 0);
+  m_next_trigger_number = 1;
+  m_total_sent = 0;
+  m_total_received = 0;
+  for (std::size_t i = 0; i < s_send_time_slots; ++i) {
+    m_send_time_ns[i].store(0, std::memory_order_relaxed);
+  }
+
+  get_iom_receiver<std::unique_ptr<daqdataformats::Fragment>>(m_fragment_input)
+    ->add_callback(std::bind(&DataRequestGeneratorModule::receive_fragment, this, std::placeholders::_1));
+  if (!m_timesync_input.empty()) {
+    get_iom_receiver<dfmessages::TimeSync>(m_timesync_input)
+      ->add_callback(std::bind(&DataRequestGeneratorModule::receive_timesync, this, std::placeholders::_1));
+  }
+
+  m_run_marker.store(true);
+  m_work_thread.set_work(&DataRequestGeneratorModule::do_work, this);
+}
+
+void
+DataRequestGeneratorModule::do_stop(const data_t& /* args */)
+{
+  m_run_marker.store(false);
+  while (!m_work_thread.get_readiness()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  // Give in-flight fragments the deadline to come back before detaching
+  std::this_thread::sleep_for(std::chrono::nanoseconds(m_deadline_ns));
+  get_iom_receiver<std::unique_ptr<daqdataformats::Fragment>>(m_fragment_input)->remove_callback();
+  if (!m_timesync_input.empty()) {
+    get_iom_receiver<dfmessages::TimeSync>(m_timesync_input)->remove_callback();
+  }
+}
+
+std::chrono::nanoseconds
+DataRequestGeneratorModule::next_interval(bool in_burst)
+{
+  double period = in_burst ? m_burst_period_s : m_period_s;
+  if (m_poisson) {
+    period = std::exponential_distribution<double>(1. / period)(m_rng);
+  }
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(period));
+}
+
+void
+DataRequestGeneratorModule::do_work()
+{
+  using clock = std::chrono::steady_clock;
+  const bool bursts_enabled = m_burst_interval.count() > 0 && m_conf->get_burst_size() > 0 && m_burst_period_s > 0.;
+  auto next_request = clock::now() + next_interval(false);
+  auto next_burst = bursts_enabled ? clock::now() + m_burst_interval : clock::time_point::max();
+  uint32_t burst_remaining = 0;
+
+  while (m_run_marker.load(std::memory_order_relaxed)) {
+    auto now = clock::now();
+    if (burst_remaining == 0 && now >= next_burst) {
+      TLOG_DEBUG(TLVL_WORK_STEPS) << get_name() << ": Starting burst of " << m_conf->get_burst_size() << " requests";
+      burst_remaining = m_conf->get_burst_size();
+      next_burst += m_burst_interval;
+      next_request = now;
+    }
+    if (now < next_request) {
+      // Wake up regularly so that stop is honoured with slow request rates
+      std::this_thread::sleep_until(std::min({ next_request, next_burst, now + std::chrono::milliseconds(100) }));
+      continue;
+    }
+    send_requests(current_daq_time());
+    const bool in_burst = burst_remaining > 0;
+    if (in_burst) {
+      --burst_remaining;
+    }
+    next_request += next_interval(in_burst);
+  }
+}
+
+void
+DataRequestGeneratorModule::send_requests(uint64_t timestamp)
+{
+  const uint64_t window_end = timestamp - m_conf->get_window_offset_ticks();
+  for (auto& sender : m_request_senders) {
+    dfmessages::DataRequest dr;
+    dr.trigger_number = m_next_trigger_number++;
+    dr.request_number = dr.trigger_number;
+    dr.sequence_number = 0;
+    dr.run_number = m_run_number;
+    dr.trigger_timestamp = timestamp;
+    dr.readout_type = dfmessages::ReadoutType::kLocalized;
+    dr.request_information.window_end = window_end;
+    dr.request_information.window_begin = window_end - m_conf->get_window_width_ticks();
+    dr.data_destination = m_fragment_input;
+
+    auto& slot = m_send_time_ns[dr.trigger_number % s_send_time_slots];
+    slot.store(steady_time_ns(), std::memory_order_relaxed);
+    try {
+      sender->send(std::move(dr), m_send_timeout);
+      m_requests_sent.fetch_add(1, std::memory_order_relaxed);
+      m_total_sent.fetch_add(1, std::memory_order_relaxed);
+    } catch (const ers::Issue&) {
+      slot.store(0, std::memory_order_relaxed);
+      m_send_failures.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+void
+DataRequestGeneratorModule::receive_fragment(std::unique_ptr<daqdataformats::Fragment>& fragment)
+{
+  const int64_t now = steady_time_ns();
+  const auto& header = fragment->get_header();
+  const int64_t sent = m_send_time_ns[header.trigger_number % s_send_time_slots].exchange(0, std::memory_order_relaxed);
+  if (sent == 0) {
+    m_fragments_unmatched.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  const int64_t latency = now - sent;
+  m_latency_ns.record(static_cast<uint64_t>(latency));
+  if (latency > m_deadline_ns) {
+    m_deadline_misses.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (fragment->get_data_size() == 0) {
+    m_fragments_empty.fetch_add(1, std::memory_order_relaxed);
+  }
+  m_fragment_bytes.fetch_add(fragment->get_size(), std::memory_order_relaxed);
+  m_fragments_received.fetch_add(1, std::memory_order_relaxed);
+  m_total_received.fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+DataRequestGeneratorModule::receive_timesync(dfmessages::TimeSync& timesync)
+{
+  m_last_system_time_ns.store(static_cast<int64_t>(timesync.system_time), std::memory_order_relaxed);
+  m_last_daq_time.store(timesync.daq_time, std::memory_order_relaxed);
+}
+
+uint64_t
+DataRequestGeneratorModule::current_daq_time() const
+{
+  const uint64_t freq = m_conf->get_clock_frequency_hz();
+  const int64_t now = system_time_ns();
+  const uint64_t daq_time = m_last_daq_time.load(std::memory_order_relaxed);
+  if (daq_time == 0) {
+    const uint64_t ns = static_cast<uint64_t>(now);
+    return (ns / 1000000000) * freq + (ns % 1000000000) * freq / 1000000000;
+  }
+  const int64_t elapsed = std::max<int64_t>(0, now - m_last_system_time_ns.load(std::memory_order_relaxed));
+  return daq_time + static_cast<uint64_t>(elapsed) * freq / 1000000000;
+}
+
+void
+DataRequestGeneratorModule::generate_opmon_data()
+{
+  opmon::DataRequestGeneratorInfo info;
+  info.set_requests_sent(m_requests_sent.exchange(0));
+  info.set_send_failures(m_send_failures.exchange(0));
+  info.set_fragments_received(m_fragments_received.exchange(0));
+  info.set_fragments_unmatched(m_fragments_unmatched.exchange(0));
+  info.set_fragments_empty(m_fragments_empty.exchange(0));
+  info.set_deadline_misses(m_deadline_misses.exchange(0));
+  info.set_fragment_bytes(m_fragment_bytes.exchange(0));
+  uint64_t sent = m_total_sent.load();
+  uint64_t received = m_total_received.load();
+  info.set_outstanding_requests(sent > received ? sent - received : 0);
+
+  auto latency = m_latency_ns.snapshot_and_reset();
+  info.set_latency_p50_us(latency.percentile(0.50) / 1000.);
+  info.set_latency_p90_us(latency.percentile(0.90) / 1000.);
+  info.set_latency_p99_us(latency.percentile(0.99) / 1000.);
+  info.set_latency_max_us(latency.max / 1000.);
+
+  publish(std::move(info));
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+DEFINE_DUNE_DAQ_MODULE(dunedaq::fdreadoutmodules::DataRequestGeneratorModule)
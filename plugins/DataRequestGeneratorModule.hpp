@@ -0,0 +1,107 @@
+/**
+ * @file DataRequestGeneratorModule.hpp Module that stresses request handlers with DataRequests
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_PLUGINS_DATAREQUESTGENERATORMODULE_HPP_
+#define FDREADOUTMODULES_PLUGINS_DATAREQUESTGENERATORMODULE_HPP_
+
+#include "appfwk/DAQModule.hpp"
+#include "appfwk/ModuleConfiguration.hpp"
+#include "daqdataformats/Fragment.hpp"
+#include "dfmessages/DataRequest.hpp"
+#include "dfmessages/TimeSync.hpp"
+#include "iomanager/Sender.hpp"
+
+#include "datahandlinglibs/utils/ReusableThread.hpp"
+
+#include "fdreadoutmodules/dal/DataRequestGeneratorConf.hpp"
+#include "fdreadoutmodules/utils/LogLinearHistogram.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+class DataRequestGeneratorModule : public dunedaq::appfwk::DAQModule
+{
+public:
+  explicit DataRequestGeneratorModule(const std::string& name);
+
+  DataRequestGeneratorModule(const DataRequestGeneratorModule&) = delete;
+  DataRequestGeneratorModule& operator=(const DataRequestGeneratorModule&) = delete;
+  DataRequestGeneratorModule(DataRequestGeneratorModule&&) = delete;
+  DataRequestGeneratorModule& operator=(DataRequestGeneratorModule&&) = delete;
+
+  void init(std::shared_ptr<appfwk::ModuleConfiguration> cfg) override;
+
+protected:
+  void generate_opmon_data() override;
+
+private:
+  // Commands
+  void do_conf(const data_t& args);
+  void do_start(const data_t& args);
+  void do_stop(const data_t& args);
+
+  void do_work();
+  void send_requests(uint64_t timestamp);
+  void receive_fragment(std::unique_ptr<daqdataformats::Fragment>& fragment);
+  void receive_timesync(dfmessages::TimeSync& timesync);
+  uint64_t current_daq_time() const;
+  std::chrono::nanoseconds next_interval(bool in_burst);
+
+  // Configuration
+  const dal::DataRequestGeneratorConf* m_conf = nullptr;
+  bool m_poisson = false;
+  double m_period_s = 0.;
+  double m_burst_period_s = 0.;
+  std::chrono::nanoseconds m_burst_interval{ 0 };
+  std::chrono::milliseconds m_send_timeout{ 0 };
+  int64_t m_deadline_ns = 0;
+
+  // Connections
+  using request_sender_t = iomanager::SenderConcept<dfmessages::DataRequest>;
+  std::vector<std::shared_ptr<request_sender_t>> m_request_senders;
+  std::string m_fragment_input;
+  std::string m_timesync_input;
+
+  // Threading
+  datahandlinglibs::ReusableThread m_work_thread;
+  std::atomic<bool> m_run_marker{ false };
+  std::mt19937_64 m_rng;
+  daqdataformats::run_number_t m_run_number = 0;
+
+  // DAQ time extrapolation from the last TimeSync
+  std::atomic<uint64_t> m_last_daq_time{ 0 };
+  std::atomic<int64_t> m_last_system_time_ns{ 0 };
+
+  // Outstanding requests: send time indexed by trigger number
+  static constexpr std::size_t s_send_time_slots = 1 << 16;
+  std::unique_ptr<std::atomic<int64_t>[]> m_send_time_ns;
+  uint64_t m_next_trigger_number = 1;
+
+  // Stats
+  LogLinearHistogram<> m_latency_ns;
+  std::atomic<uint64_t> m_requests_sent{ 0 };
+  std::atomic<uint64_t> m_send_failures{ 0 };
+  std::atomic<uint64_t> m_fragments_received{ 0 };
+  std::atomic<uint64_t> m_fragments_unmatched{ 0 };
+  std::atomic<uint64_t> m_fragments_empty{ 0 };
+  std::atomic<uint64_t> m_deadline_misses{ 0 };
+  std::atomic<uint64_t> m_fragment_bytes{ 0 };
+  std::atomic<uint64_t> m_total_sent{ 0 };
+  std::atomic<uint64_t> m_total_received{ 0 };
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_PLUGINS_DATAREQUESTGENERATORMODULE_HPP_
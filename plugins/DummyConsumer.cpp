@@ -7,7 +7,9 @@
  */
 #include "DummyConsumer.hpp"
 
-#include "appfwk/DAQModuleHelper.hpp"
+#include "fdreadoutmodules/dal/DummyConsumer.hpp"
+
+#include "confmodel/Connection.hpp"
 #include "logging/Logging.hpp"
 
 #include "datahandlinglibs/DataHandlingIssues.hpp"
@@ -15,6 +17,8 @@
 
 #include "fdreadoutmodules/opmon/dummy_consumer_info.pb.h"
 
+#include <algorithm>
+#include <optional>
 #include <string>
 
 namespace dunedaq {
@@ -33,22 +37,53 @@ DummyConsumer<T>::DummyConsumer(const std::string& name)
 
 template<class T>
 void
-DummyConsumer<T>::init(const data_t& args)
+DummyConsumer<T>::init(std::shared_ptr<appfwk::ModuleConfiguration> cfg)
 {
+  auto mdal = cfg->module<dal::DummyConsumer>(get_name());
+  if (mdal == nullptr) {
+    throw datahandlinglibs::GenericConfigurationError(ERS_HERE, "No DummyConsumer named " + get_name());
+  }
+  if (mdal->get_inputs().size() != 1) {
+    throw datahandlinglibs::GenericConfigurationError(
+      ERS_HERE, "Expected a single input, " + std::to_string(mdal->get_inputs().size()) + " specified");
+  }
+  const auto& uid = mdal->get_inputs()[0]->UID();
   try {
-    auto qi = appfwk::connection_index(args, { "input_queue" });
-    m_data_receiver = get_iom_receiver<T>(qi["input_queue"]);
+    m_data_receiver = get_iom_receiver<T>(uid);
   } catch (const ers::Issue& excpt) {
-    throw datahandlinglibs::GenericResourceQueueError(ERS_HERE, "input_queue", get_name(), excpt);
+    throw datahandlinglibs::GenericResourceQueueError(ERS_HERE, uid, get_name(), excpt);
   }
+  m_latency_probe = has_timestamp && mdal->get_latency_probe();
 }
 
 template<class T>
 void
-DummyConsumer<T>::generate_opmon_data() 
+DummyConsumer<T>::generate_opmon_data()
 {
   opmon::DummyConsumerInfo info;
-  info.set_packets_processed = m_packets_processed;
+  auto now = std::chrono::steady_clock::now();
+  double interval_ms = std::chrono::duration<double, std::milli>(now - m_last_publication).count();
+  m_last_publication = now;
+
+  uint64_t packets = m_packets_processed.load();
+  uint64_t batches = m_batches.load();
+  info.set_packets_processed(packets);
+  if (interval_ms > 0.) {
+    info.set_consumed_rate_khz((packets - m_last_packets_processed) / interval_ms);
+  }
+  if (batches > m_last_batches) {
+    info.set_batch_size_avg(static_cast<double>(packets - m_last_packets_processed) / (batches - m_last_batches));
+  }
+  m_last_packets_processed = packets;
+  m_last_batches = batches;
+
+  if (m_latency_probe) {
+    auto lag = m_lag_ns.snapshot_and_reset();
+    info.set_lag_p50_us(lag.percentile(0.50) / 1000.);
+    info.set_lag_p99_us(lag.percentile(0.99) / 1000.);
+    info.set_lag_max_us(lag.max / 1000.);
+    info.set_lag_negative(m_lag_negative.load());
+  }
 
   publish(std::move(info));
 }
@@ -57,7 +92,11 @@ template<class T>
 void
 DummyConsumer<T>::do_start(const data_t& /* args */)
 {
-  m_packets_processed = 0;
+  m_packets_processed.reset();
+  m_batches.reset();
+  m_lag_negative.reset();
+  m_last_packets_processed = 0;
+  m_last_batches = 0;
   m_run_marker.store(true);
   m_work_thread.set_work(&DummyConsumer::do_work, this);
 }
@@ -72,19 +111,56 @@ DummyConsumer<T>::do_stop(const data_t& /* args */)
   }
 }
 
+template<class T>
+void
+DummyConsumer<T>::probe_latency(const T& element, int64_t now_ns)
+{
+  uint64_t timestamp = 0;
+  if constexpr (detail::has_get_timestamp<T>::value) {
+    timestamp = element.get_timestamp();
+  } else if constexpr (detail::has_daq_time<T>::value) {
+    timestamp = element.daq_time;
+  } else if constexpr (detail::has_trigger_timestamp<T>::value) {
+    timestamp = element->get_trigger_timestamp();
+  }
+  // 62.5 MHz: one tick is 16 ns
+  const int64_t lag_ns = now_ns - static_cast<int64_t>(timestamp * (1000000000 / clock_frequency_hz));
+  if (lag_ns < 0) {
+    m_lag_negative.add();
+  } else {
+    m_lag_ns.record(static_cast<uint64_t>(lag_ns));
+  }
+}
+
 template<class T>
 void
 DummyConsumer<T>::do_work()
 {
-  T element;
   while (m_run_marker) {
-    try {
-      element = m_data_receiver->receive(std::chrono::milliseconds(100));
-      packet_callback(element);
-      m_packets_processed++;
-    } catch (const dunedaq::iomanager::TimeoutExpired& excpt) {
+    // Block for the first element of a batch, then take whatever is already queued
+    std::optional<T> element = m_data_receiver->try_receive(std::chrono::milliseconds(100));
+    if (!element) {
       continue;
     }
+    int64_t now_ns = 0;
+    if (m_latency_probe) {
+      now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch())
+                 .count();
+    }
+    std::size_t batch = 0;
+    do {
+      if (m_latency_probe) {
+        probe_latency(*element, now_ns);
+      }
+      packet_callback(*element);
+      ++batch;
+      if (batch == max_batch_size) {
+        break;
+      }
+      element = m_data_receiver->try_receive(std::chrono::milliseconds(0));
+    } while (element);
+    m_packets_processed.add(batch);
+    m_batches.add();
   }
 }
 
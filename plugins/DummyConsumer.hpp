@@ -10,20 +10,60 @@
 #define FDREADOUTMODULES_PLUGINS_DUMMYCONSUMER_HPP_
 
 #include "appfwk/DAQModule.hpp"
+#include "appfwk/ModuleConfiguration.hpp"
 #include "iomanager/IOManager.hpp"
 #include "dfmessages/TimeSync.hpp"
 
 #include "datahandlinglibs/utils/ReusableThread.hpp"
 
+#include "fdreadoutmodules/utils/LogLinearHistogram.hpp"
+#include "fdreadoutmodules/utils/SingleWriterCounter.hpp"
+
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <type_traits>
+#include <utility>
 
 namespace dunedaq {
 namespace fdreadoutmodules {
 
+namespace detail {
+template<class T, class = void>
+struct has_get_timestamp : std::false_type
+{};
+template<class T>
+struct has_get_timestamp<T, std::void_t<decltype(std::declval<const T&>().get_timestamp())>> : std::true_type
+{};
+
+template<class T, class = void>
+struct has_daq_time : std::false_type
+{};
+template<class T>
+struct has_daq_time<T, std::void_t<decltype(std::declval<const T&>().daq_time)>> : std::true_type
+{};
+
+template<class T, class = void>
+struct has_trigger_timestamp : std::false_type
+{};
+template<class T>
+struct has_trigger_timestamp<T, std::void_t<decltype(std::declval<const T&>()->get_trigger_timestamp())>>
+  : std::true_type
+{};
+} // namespace detail
+
+/**
+ * @brief Receives elements from a queue and hands them to packet_callback().
+ *
+ * The queue is drained in batches of up to max_batch_size elements, with counters updated once per
+ * batch. With latency_probe set in its configuration, the DAQ timestamp of every element that carries
+ * one (frames, TimeSyncs, Fragments) is compared with the DAQ time derived from the wall clock, and
+ * the lag distribution is published.
+ */
 template<class T>
 class DummyConsumer : public dunedaq::appfwk::DAQModule
 {
@@ -35,7 +75,12 @@ public:
   DummyConsumer(DummyConsumer&&) = delete;
   DummyConsumer& operator=(DummyConsumer&&) = delete;
 
-  void init(const nlohmann::json& obj) override;
+  void init(std::shared_ptr<appfwk::ModuleConfiguration> cfg) override;
+
+  static constexpr std::size_t max_batch_size = 1024;
+  static constexpr uint64_t clock_frequency_hz = 62500000;
+  static constexpr bool has_timestamp = detail::has_get_timestamp<T>::value || detail::has_daq_time<T>::value ||
+                                        detail::has_trigger_timestamp<T>::value;
 
 protected:
   virtual void packet_callback(T& /*packet*/) {}
@@ -46,6 +91,7 @@ private:
   void do_start(const nlohmann::json& obj);
   void do_stop(const nlohmann::json& obj);
   void do_work();
+  void probe_latency(const T& element, int64_t now_ns);
 
   // Queue
   using source_t = dunedaq::iomanager::ReceiverConcept<T>;
@@ -55,8 +101,18 @@ private:
   datahandlinglibs::ReusableThread m_work_thread;
   std::atomic<bool> m_run_marker;
 
-  // Stats
-  std::atomic<int> m_packets_processed{ 0 };
+  bool m_latency_probe = false;
+
+  // Stats, written by the work thread only
+  SingleWriterCounter m_packets_processed;
+  SingleWriterCounter m_batches;
+  SingleWriterCounter m_lag_negative;
+  LogLinearHistogram<> m_lag_ns;
+
+  // Only touched by the opmon thread
+  std::chrono::steady_clock::time_point m_last_publication{ std::chrono::steady_clock::now() };
+  uint64_t m_last_packets_processed{ 0 };
+  uint64_t m_last_batches{ 0 };
 };
 
 } // namespace fdreadoutmodules
@@ -1,47 +1,306 @@
 /**
- * @file ErroredFrameConsumer.cpp Module that consumes frames with errors from a queue
+ * @file ErroredFrameConsumer.cpp ErroredFrameConsumer implementation
  *
  * This is part of the DUNE DAQ , copyright 2020.
- * Licencing/copyright details are in the COPYING file that you should have
- * recieved with this code.
- * */
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "ErroredFrameConsumer.hpp"
 
-#include "DummyConsumer.cpp"
-#include "DummyConsumer.hpp"
-#include "fddetdataformats/WIBFrame.hpp"
+#include "fdreadoutmodules/dal/ErroredFrameConsumer.hpp"
+#include "fdreadoutmodules/opmon/errored_frame_info.pb.h"
+#include "fdreadoutmodules/utils/RatePacer.hpp"
+
+#include "confmodel/Connection.hpp"
+#include "iomanager/IOManager.hpp"
 #include "logging/Logging.hpp"
+
+#include "datahandlinglibs/DataHandlingIssues.hpp"
 #include "datahandlinglibs/ReadoutLogging.hpp"
 
-#include <bitset>
+#include "fdreadoutlibs/DUNEWIBEthTypeAdapter.hpp"
+#include "fdreadoutlibs/TDEEthTypeAdapter.hpp"
 
-#include <memory>
+#include <algorithm>
+#include <optional>
 #include <string>
+#include <thread>
+#include <utility>
+
+using namespace dunedaq::datahandlinglibs::logging;
 
 namespace dunedaq {
 
-    DUNE_DAQ_TYPESTRING(fddetdataformats::WIBFrame, "WIBFrame")
+DUNE_DAQ_TYPESTRING(dunedaq::fdreadoutlibs::types::DUNEWIBEthTypeAdapter, "WIBEthFrame")
+DUNE_DAQ_TYPESTRING(dunedaq::fdreadoutlibs::types::TDEEthTypeAdapter, "TDEEthFrame")
 
 namespace fdreadoutmodules {
 
-class ErroredFrameConsumer : public DummyConsumer<fddetdataformats::WIBFrame>
+ErroredFrameConsumer::ErroredFrameConsumer(const std::string& name)
+  : DAQModule(name)
+  , m_kernels(frame_kernels())
+{
+  register_command("start", &ErroredFrameConsumer::do_start);
+  register_command("stop_trigger_sources", &ErroredFrameConsumer::do_stop);
+}
+
+void
+ErroredFrameConsumer::init(std::shared_ptr<appfwk::ModuleConfiguration> cfg)
+{
+  TLOG_DEBUG(TLVL_ENTER_EXIT_METHODS) << get_name() << ": Entering init() method";
+  auto mdal = cfg->module<dal::ErroredFrameConsumer>(get_name());
+  if (mdal == nullptr) {
+    throw datahandlinglibs::GenericConfigurationError(ERS_HERE, "No ErroredFrameConsumer named " + get_name());
+  }
+  m_max_batch_size = std::max<uint32_t>(mdal->get_max_batch_size(), 1);
+  TscClock::calibrate();
+
+  for (auto con : mdal->get_inputs()) {
+    const std::string& data_type = con->get_data_type();
+    const FrameLayout* layout = find_frame_layout(data_type);
+    if (layout == nullptr || (data_type != "WIBEthFrame" && data_type != "TDEEthFrame")) {
+      throw datahandlinglibs::GenericConfigurationError(
+        ERS_HERE, "ErroredFrameConsumer cannot consume " + data_type + " from " + con->UID());
+    }
+    try {
+      if (data_type == "WIBEthFrame") {
+        get_iom_receiver<fdreadoutlibs::types::DUNEWIBEthTypeAdapter>(con->UID());
+      } else {
+        get_iom_receiver<fdreadoutlibs::types::TDEEthTypeAdapter>(con->UID());
+      }
+    } catch (const ers::Issue& excpt) {
+      throw datahandlinglibs::GenericResourceQueueError(ERS_HERE, con->UID(), get_name(), excpt);
+    }
+    if (layout->error_mask == 0) {
+      TLOG() << get_name() << ": no error flags are known for " << data_type << ", only frames are counted on "
+             << con->UID();
+    }
+    m_streams.push_back(std::make_unique<Stream>(con->UID(), data_type, layout));
+  }
+  if (m_streams.empty()) {
+    throw datahandlinglibs::GenericConfigurationError(ERS_HERE, "ErroredFrameConsumer needs at least one input");
+  }
+  TLOG() << get_name() << ": " << m_streams.size() << " inputs, batches of up to " << m_max_batch_size
+         << " elements, " << to_string(m_kernels.isa) << " frame kernels";
+  TLOG_DEBUG(TLVL_ENTER_EXIT_METHODS) << get_name() << ": Exiting init() method";
+}
+
+void
+ErroredFrameConsumer::do_start(const data_t& /* args */)
+{
+  for (auto& stream : m_streams) {
+    {
+      std::lock_guard<std::mutex> lk(stream->links_mutex);
+      stream->links.clear();
+    }
+    stream->elements.reset();
+    stream->frames.reset();
+    stream->batches.reset();
+    stream->cost_ns.reset();
+    stream->last_elements = 0;
+    stream->last_frames = 0;
+    stream->last_batches = 0;
+    stream->last_cost_ns = 0;
+  }
+  m_last_publication = std::chrono::steady_clock::now();
+  m_run_marker.store(true);
+
+  for (std::size_t i = 0; i < m_streams.size(); ++i) {
+    Stream* stream = m_streams[i].get();
+    stream->thread.set_name(get_name(), static_cast<int>(i));
+    if (stream->data_type == "WIBEthFrame") {
+      stream->thread.set_work(
+        &ErroredFrameConsumer::consume<fdreadoutlibs::types::DUNEWIBEthTypeAdapter>, this, stream);
+    } else {
+      stream->thread.set_work(&ErroredFrameConsumer::consume<fdreadoutlibs::types::TDEEthTypeAdapter>, this, stream);
+    }
+  }
+}
+
+void
+ErroredFrameConsumer::do_stop(const data_t& /* args */)
+{
+  m_run_marker.store(false);
+  for (auto& stream : m_streams) {
+    while (!stream->thread.get_readiness()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+}
+
+template<class ReadoutType>
+void
+ErroredFrameConsumer::consume(Stream* stream)
+{
+  auto receiver = get_iom_receiver<ReadoutType>(stream->uid);
+  PendingRun run;
+  LinkCounters* counters = nullptr;
+  while (m_run_marker) {
+    // Block for the first element of a batch, then take whatever is already queued
+    std::optional<ReadoutType> element = receiver->try_receive(std::chrono::milliseconds(100));
+    if (!element) {
+      continue;
+    }
+    const int64_t start = TscClock::now_ns();
+    uint32_t batch = 0;
+    uint64_t frames = 0;
+    do {
+      const std::size_t n = element->get_num_frames();
+      count_frames(*stream, element->begin(), n, run, counters);
+      frames += n;
+      if (++batch == m_max_batch_size) {
+        break;
+      }
+      element = receiver->try_receive(std::chrono::milliseconds(0));
+    } while (element);
+    flush(*stream, run, counters);
+
+    const auto cost = static_cast<uint64_t>(std::max<int64_t>(TscClock::now_ns() - start, 0));
+    stream->elements.add(batch);
+    stream->frames.add(frames);
+    stream->batches.add();
+    stream->cost_ns.add(cost);
+    stream->batch_cost_ns.record(cost);
+  }
+}
+
+template<class Frame>
+void
+ErroredFrameConsumer::count_frames(Stream& stream,
+                                   const Frame* frames,
+                                   std::size_t n,
+                                   PendingRun& run,
+                                   LinkCounters*& counters)
+{
+  const FrameLayout& layout = *stream.layout;
+  std::size_t i = 0;
+  while (i < n) {
+    const auto& first = frames[i].daq_header;
+    const uint32_t link = link_key(first.crate_id, first.slot_id, first.stream_id);
+    std::size_t j = i + 1;
+    while (j < n) {
+      const auto& next = frames[j].daq_header;
+      if (link_key(next.crate_id, next.slot_id, next.stream_id) != link) {
+        break;
+      }
+      ++j;
+    }
+    if (run.frames != 0 && run.link != link) {
+      flush(stream, run, counters);
+    }
+    run.link = link;
+    run.frames += j - i;
+    if (layout.error_mask != 0) {
+      m_kernels.accumulate_bits(reinterpret_cast<const char*>(frames + i) + layout.error_offset, // NOLINT
+                                sizeof(Frame),
+                                j - i,
+                                layout.error_mask,
+                                run.bits.data());
+    }
+    i = j;
+  }
+}
+
+void
+ErroredFrameConsumer::flush(Stream& stream, PendingRun& run, LinkCounters*& counters)
 {
-public:
-  explicit ErroredFrameConsumer(const std::string name)
-    : DummyConsumer<fddetdataformats::WIBFrame>(name)
-  {}
+  if (run.frames == 0) {
+    return;
+  }
+  if (counters == nullptr || counters->link != run.link) {
+    // Only this thread inserts, so the lookup needs no lock
+    auto it = stream.links.find(run.link);
+    if (it == stream.links.end()) {
+      std::lock_guard<std::mutex> lk(stream.links_mutex);
+      it = stream.links.emplace(run.link, std::make_unique<LinkCounters>(run.link)).first;
+    }
+    counters = it->second.get();
+  }
+  counters->frames.add(run.frames);
+  for (uint64_t mask = stream.layout->error_mask; mask != 0; mask &= mask - 1) {
+    const int bit = __builtin_ctzll(mask);
+    if (run.bits[bit] != 0) {
+      counters->bits[bit].add(run.bits[bit]);
+      run.bits[bit] = 0;
+    }
+  }
+  run.frames = 0;
+}
+
+void
+ErroredFrameConsumer::generate_opmon_data()
+{
+  auto now = std::chrono::steady_clock::now();
+  double interval_ms = std::chrono::duration<double, std::milli>(now - m_last_publication).count();
+  m_last_publication = now;
+
+  for (auto& stream : m_streams) {
+    const FrameLayout& layout = *stream->layout;
+    opmon::ErroredFrameConsumerInfo info;
+    uint64_t elements = stream->elements.load();
+    uint64_t frames = stream->frames.load();
+    uint64_t batches = stream->batches.load();
+    uint64_t cost_ns = stream->cost_ns.load();
+    info.set_elements_consumed(elements);
+    info.set_frames_consumed(frames);
+    if (interval_ms > 0.) {
+      info.set_consumed_rate_khz((frames - stream->last_frames) / interval_ms);
+    }
+    if (batches > stream->last_batches) {
+      info.set_batch_size_avg(static_cast<double>(elements - stream->last_elements) / (batches - stream->last_batches));
+    }
+    if (frames > stream->last_frames) {
+      info.set_ns_per_frame(static_cast<double>(cost_ns - stream->last_cost_ns) / (frames - stream->last_frames));
+    }
+    info.set_batch_cost_p99_us(stream->batch_cost_ns.snapshot_and_reset().percentile(0.99) / 1000.);
+    stream->last_elements = elements;
+    stream->last_frames = frames;
+    stream->last_batches = batches;
+    stream->last_cost_ns = cost_ns;
+
+    std::lock_guard<std::mutex> lk(stream->links_mutex);
+    info.set_links(stream->links.size());
+    for (auto& [key, link] : stream->links) {
+      opmon::ErroredFrameLinkInfo link_info;
+      const uint32_t crate_id = key >> 12;
+      const uint32_t slot_id = (key >> 8) & 0xf;
+      const uint32_t stream_id = key & 0xff;
+      link_info.set_crate_id(crate_id);
+      link_info.set_slot_id(slot_id);
+      link_info.set_stream_id(stream_id);
 
-  void packet_callback(fddetdataformats::WIBFrame& packet) override
-  {
-    if (packet.get_wib_header()->wib_errors) {
-      m_error_count += std::bitset<16>(packet.get_wib_header()->wib_errors).count();
-      //      TLOG() << "bitset: " << std::bitset<16>(packet.get_wib_header()->wib_errors)
-      //          << " error count: " << m_error_count;
+      const uint64_t link_frames = link->frames.load();
+      uint64_t error_bits = 0;
+      for (uint64_t mask = layout.error_mask; mask != 0; mask &= mask - 1) {
+        error_bits += link->bits[__builtin_ctzll(mask)].load();
+      }
+      for (const auto& flag : layout.error_flags) {
+        uint64_t count = 0;
+        for (uint64_t mask = flag.mask; mask != 0; mask &= mask - 1) {
+          count += link->bits[__builtin_ctzll(mask)].load();
+        }
+        if (flag.name == "crc_err") {
+          link_info.set_crc_errors(count);
+        } else if (flag.name == "lol") {
+          link_info.set_loss_of_lock(count);
+        }
+      }
+      link_info.set_frames(link_frames);
+      link_info.set_error_bits(error_bits);
+      if (link_frames > link->last_frames) {
+        link_info.set_error_bits_per_frame(static_cast<double>(error_bits - link->last_error_bits) /
+                                           (link_frames - link->last_frames));
+      }
+      link->last_frames = link_frames;
+      link->last_error_bits = error_bits;
+      publish(std::move(link_info),
+              { { "link",
+                  std::to_string(crate_id) + "." + std::to_string(slot_id) + "." + std::to_string(stream_id) } });
     }
+    publish(std::move(info), { { "input", stream->uid } });
   }
+}
 
-private:
-  int m_error_count;
-};
 } // namespace fdreadoutmodules
 } // namespace dunedaq
 
@@ -0,0 +1,142 @@
+/**
+ * @file ErroredFrameConsumer.hpp Module that counts the error flags of WIBEth and TDEEth frames
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_PLUGINS_ERROREDFRAMECONSUMER_HPP_
+#define FDREADOUTMODULES_PLUGINS_ERROREDFRAMECONSUMER_HPP_
+
+#include "appfwk/DAQModule.hpp"
+#include "appfwk/ModuleConfiguration.hpp"
+
+#include "datahandlinglibs/utils/ReusableThread.hpp"
+
+#include "fdreadoutmodules/kernels/FrameKernels.hpp"
+#include "fdreadoutmodules/utils/FrameLayout.hpp"
+#include "fdreadoutmodules/utils/LogLinearHistogram.hpp"
+#include "fdreadoutmodules/utils/SingleWriterCounter.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Counts the header error flags of WIBEthFrame and TDEEthFrame streams, per link and per bit.
+ *
+ * Every input is drained by its own thread in batches of up to max_batch_size elements. The frames
+ * of an element are split into runs of the same link (crate, slot and stream of the DAQ header),
+ * and the error bits of each run are counted with the accumulate_bits frame kernel, so a link
+ * flooding error frames costs a few ns per frame. Per-link counters are published with the link
+ * as origin.
+ */
+class ErroredFrameConsumer : public dunedaq::appfwk::DAQModule
+{
+public:
+  explicit ErroredFrameConsumer(const std::string& name);
+
+  ErroredFrameConsumer(const ErroredFrameConsumer&) = delete;
+  ErroredFrameConsumer& operator=(const ErroredFrameConsumer&) = delete;
+  ErroredFrameConsumer(ErroredFrameConsumer&&) = delete;
+  ErroredFrameConsumer& operator=(ErroredFrameConsumer&&) = delete;
+
+  void init(std::shared_ptr<appfwk::ModuleConfiguration> cfg) override;
+
+protected:
+  void generate_opmon_data() override;
+
+private:
+  //! Counters of one link, written by the thread of its input only
+  struct LinkCounters
+  {
+    explicit LinkCounters(uint32_t link_)
+      : link(link_)
+    {}
+
+    const uint32_t link;
+    SingleWriterCounter frames;
+    std::array<SingleWriterCounter, 64> bits; // Frames with bit b of the error word set
+
+    // Only touched by the opmon thread
+    uint64_t last_frames = 0;
+    uint64_t last_error_bits = 0;
+  };
+
+  //! Frames of one link accumulated before they are added to its counters
+  struct PendingRun
+  {
+    uint32_t link = 0;
+    uint64_t frames = 0;
+    std::array<uint64_t, 64> bits{};
+  };
+
+  struct Stream
+  {
+    explicit Stream(std::string uid_, std::string data_type_, const FrameLayout* layout_)
+      : uid(std::move(uid_))
+      , data_type(std::move(data_type_))
+      , layout(layout_)
+      , thread(0)
+    {}
+
+    std::string uid;
+    std::string data_type;
+    const FrameLayout* layout;
+    datahandlinglibs::ReusableThread thread;
+
+    std::mutex links_mutex; // Guards insertions into links against the opmon thread
+    std::map<uint32_t, std::unique_ptr<LinkCounters>> links;
+
+    // Written by the thread of the input only
+    SingleWriterCounter elements;
+    SingleWriterCounter frames;
+    SingleWriterCounter batches;
+    SingleWriterCounter cost_ns;
+    LogLinearHistogram<> batch_cost_ns;
+
+    // Only touched by the opmon thread
+    uint64_t last_elements = 0;
+    uint64_t last_frames = 0;
+    uint64_t last_batches = 0;
+    uint64_t last_cost_ns = 0;
+  };
+
+  // Commands
+  void do_start(const data_t& args);
+  void do_stop(const data_t& args);
+
+  template<class ReadoutType>
+  void consume(Stream* stream);
+
+  template<class Frame>
+  void count_frames(Stream& stream, const Frame* frames, std::size_t n, PendingRun& run, LinkCounters*& counters);
+
+  void flush(Stream& stream, PendingRun& run, LinkCounters*& counters);
+
+  static uint32_t link_key(uint32_t crate_id, uint32_t slot_id, uint32_t stream_id)
+  {
+    return (crate_id << 12) | (slot_id << 8) | stream_id;
+  }
+
+  const FrameKernels& m_kernels;
+  uint32_t m_max_batch_size = 256;
+  std::vector<std::unique_ptr<Stream>> m_streams;
+  std::atomic<bool> m_run_marker{ false };
+  std::chrono::steady_clock::time_point m_last_publication{ std::chrono::steady_clock::now() };
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_PLUGINS_ERROREDFRAMECONSUMER_HPP_
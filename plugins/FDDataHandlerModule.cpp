@@ -15,28 +15,27 @@
 #include "datahandlinglibs/DataHandlingIssues.hpp"
 #include "datahandlinglibs/ReadoutLogging.hpp"
 #include "datahandlinglibs/concepts/DataHandlingConcept.hpp"
-#include "datahandlinglibs/models/BinarySearchQueueModel.hpp"
-#include "datahandlinglibs/models/DefaultRequestHandlerModel.hpp"
-#include "datahandlinglibs/models/EmptyFragmentRequestHandlerModel.hpp"
-#include "datahandlinglibs/models/FixedRateQueueModel.hpp"
-#include "datahandlinglibs/models/DataHandlingModel.hpp"
-#include "datahandlinglibs/models/ZeroCopyRecordingRequestHandlerModel.hpp"
-#include "datahandlinglibs/models/DefaultSkipListRequestHandler.hpp"
-#include "datahandlinglibs/models/SkipListLatencyBufferModel.hpp"
 
 #include "fdreadoutlibs/DUNEWIBEthTypeAdapter.hpp"
 #include "fdreadoutlibs/DAPHNESuperChunkTypeAdapter.hpp"
 #include "fdreadoutlibs/DAPHNEStreamSuperChunkTypeAdapter.hpp"
 #include "fdreadoutlibs/TDEFrameTypeAdapter.hpp"
+#include "fdreadoutlibs/TDEEthTypeAdapter.hpp"
 
-#include "fdreadoutlibs/daphne/DAPHNEFrameProcessor.hpp"
-#include "fdreadoutlibs/daphne/DAPHNEStreamFrameProcessor.hpp"
-#include "fdreadoutlibs/daphne/DAPHNEListRequestHandler.hpp"
-#include "fdreadoutlibs/wibeth/WIBEthFrameProcessor.hpp"
-#include "fdreadoutlibs/tde/TDEEthFrameProcessor.hpp"
+#include "fdreadoutmodules/ReadoutModelSpecializations.hpp"
+#include "fdreadoutmodules/kernels/FrameKernels.hpp"
+#include "fdreadoutmodules/opmon/kernel_dispatch_info.pb.h"
+#include "fdreadoutmodules/utils/CpuFeatures.hpp"
+#include "fdreadoutmodules/utils/MemoryPlacement.hpp"
+#include "fdreadoutmodules/utils/TimestampIndex.hpp"
 
+#include "appmodel/DataHandlerConf.hpp"
+#include "appmodel/DataHandlerModule.hpp"
+#include "appmodel/DataRecorderConf.hpp"
+#include "appmodel/RequestHandler.hpp"
 
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -58,11 +57,21 @@ FDDataHandlerModule::FDDataHandlerModule(const std::string& name)
   , RawDataHandlerBase(name)
 { 
 
-  inherited_mod::register_command("conf", &inherited_dlh::do_conf);
-  inherited_mod::register_command("scrap", &inherited_dlh::do_scrap);
-  inherited_mod::register_command("start", &inherited_dlh::do_start);
-  inherited_mod::register_command("stop_trigger_sources", &inherited_dlh::do_stop);
-  inherited_mod::register_command("record", &inherited_dlh::do_record);
+  inherited_mod::register_command("conf", &FDDataHandlerModule::do_conf);
+  inherited_mod::register_command("scrap", &FDDataHandlerModule::do_scrap);
+  inherited_mod::register_command("start", &FDDataHandlerModule::do_start);
+  inherited_mod::register_command("stop_trigger_sources", &FDDataHandlerModule::do_stop);
+  inherited_mod::register_command("record", &FDDataHandlerModule::do_record);
+  inherited_mod::register_command("freeze_ring", &FDDataHandlerModule::do_freeze_ring);
+  inherited_mod::register_command("profile_processor", &FDDataHandlerModule::do_profile_processor);
+}
+
+FDDataHandlerModule::~FDDataHandlerModule()
+{
+  if (m_prepared.valid()) {
+    m_prepared.wait();
+  }
+  stop_indexing();
 }
 
 void
@@ -70,84 +79,177 @@ FDDataHandlerModule::init(std::shared_ptr<appfwk::ModuleConfiguration> cfg)
 {
 
   TLOG_DEBUG(TLVL_ENTER_EXIT_METHODS) << get_name() << ": Entering init() method";
+  StartupProfile::Timer timer(m_startup.init_us);
   inherited_dlh::init(cfg);
+
+  // Select the frame kernels once, before any processing thread can call them
+  m_host_isa = host_isa_level();
+  m_selected_isa = frame_kernels().isa;
+  TLOG() << get_name() << ": Frame kernels use the " << to_string(m_selected_isa) << " code path (host supports "
+         << to_string(m_host_isa) << ')';
   TLOG_DEBUG(TLVL_ENTER_EXIT_METHODS) << get_name() << ": Exiting init() method";
 }
 
-  
- void
- FDDataHandlerModule::generate_opmon_data()
- {
- }
+void
+FDDataHandlerModule::generate_opmon_data()
+{
+  // Per-link performance metrics are published by the instrumented request handler of the readout model,
+  // which is registered below this module in the opmon tree.
+  opmon::KernelDispatchInfo info;
+  info.set_isa(to_string(m_selected_isa));
+  info.set_avx2_supported(m_host_isa >= IsaLevel::kAVX2);
+  info.set_avx512_supported(m_host_isa >= IsaLevel::kAVX512);
+  info.set_capped(m_selected_isa < m_host_isa);
+  publish(std::move(info));
+  publish(m_startup.info());
+}
 
-std::shared_ptr<datahandlinglibs::DataHandlingConcept>
-FDDataHandlerModule::create_readout(const appmodel::DataHandlerModule* modconf, std::atomic<bool>& run_marker)
+void
+FDDataHandlerModule::do_conf(const data_t& args)
 {
-  namespace rol = dunedaq::datahandlinglibs;
-  namespace fdl = dunedaq::fdreadoutlibs;
-  namespace fdt = dunedaq::fdreadoutlibs::types;
-  
+  StartupProfile::Timer timer(m_startup.conf_us);
+  if (m_prepared.valid()) {
+    StartupProfile::Timer wait_timer(m_startup.conf_wait_us);
+    m_prepared.get();
+  }
+  inherited_dlh::do_conf(args);
+  auto timing = m_startup.info();
+  TLOG() << get_name() << ": readout model initialized in " << timing.prepare_max_ms() << " ms, conf waited "
+         << timing.conf_wait_ms() << " ms for it";
+}
 
-  // Acquire DataType  
-  std::string raw_dt = modconf->get_module_configuration()->get_input_data_type();
-  TLOG() << "Choosing specializations for DataHandlingModel with data_type:" << raw_dt << ']';
+void
+FDDataHandlerModule::do_scrap(const data_t& args)
+{
+  if (m_prepared.valid()) {
+    m_prepared.wait();
+  }
+  stop_indexing();
+  inherited_dlh::do_scrap(args);
+}
 
-  // IF WIBEth
-  if (raw_dt.find("WIBEthFrame") != std::string::npos) {
-    TLOG_DEBUG(TLVL_WORK_STEPS) << "Creating readout for an Ethernet DUNE-WIB";
-    auto readout_model = std::make_shared<
-      rol::DataHandlingModel<fdt::DUNEWIBEthTypeAdapter,
-			     rol::ZeroCopyRecordingRequestHandlerModel<fdt::DUNEWIBEthTypeAdapter,
-								       rol::FixedRateQueueModel<fdt::DUNEWIBEthTypeAdapter>>,
-			     rol::FixedRateQueueModel<fdt::DUNEWIBEthTypeAdapter>,
-			     fdl::WIBEthFrameProcessor>>(run_marker);
-    register_node("WIBEthFrameProcessor", readout_model);
-    readout_model->init(modconf);
-    return readout_model;
+void
+FDDataHandlerModule::do_start(const data_t& args)
+{
+  StartupProfile::Timer timer(m_startup.start_us);
+  inherited_dlh::do_start(args);
+}
+
+void
+FDDataHandlerModule::do_stop(const data_t& args)
+{
+  inherited_dlh::do_stop(args);
+  stop_indexing();
+}
+
+void
+FDDataHandlerModule::do_record(const data_t& args)
+{
+  inherited_dlh::do_record(args);
+  if (!m_index_builder || m_recording_file.empty() || m_readout_commands == nullptr) {
+    return;
   }
-  
-  // IF TDEEth
-  if (raw_dt.find("TDEEthFrame") != std::string::npos) {
-    TLOG_DEBUG(TLVL_WORK_STEPS) << "Creating readout for an Ethernet TDEEth";
-    auto readout_model = 
-      std::make_unique<rol::DataHandlingModel<
-        fdt::TDEEthTypeAdapter,
-        rol::ZeroCopyRecordingRequestHandlerModel<fdt::TDEEthTypeAdapter, rol::FixedRateQueueModel<fdt::TDEEthTypeAdapter>>,
-        rol::FixedRateQueueModel<fdt::TDEEthTypeAdapter>,
-        fdl::TDEEthFrameProcessor
-      >>(run_marker);
-    readout_model->init(modconf);
-    return readout_model;
+
+  // The file of a previous recording is rewritten by this one
+  stop_indexing();
+  m_index_abort = false;
+  const bool reported = m_readout_commands->on_recording_done([this]() {
+    std::lock_guard<std::mutex> lock(m_index_mutex);
+    if (m_index_abort) {
+      return;
+    }
+    m_index_thread = std::thread([this]() {
+      if (!m_index_builder(m_recording_file, &m_index_abort) && !m_index_abort) {
+        TLOG() << get_name() << ": Could not build the timestamp index of " << m_recording_file;
+      }
+    });
+  });
+  if (!reported) {
+    TLOG() << get_name() << ": No timestamp index for " << m_recording_file
+           << ", the readout model does not report the end of recordings";
   }
+}
 
-  // IF PDS Frame using skiplist
-  if (raw_dt.find("PDSFrame") != std::string::npos) {
-    TLOG_DEBUG(TLVL_WORK_STEPS) << "Creating readout for a PDS DAPHNE using SkipList LB";
-    auto readout_model =
-      std::make_shared<rol::DataHandlingModel<fdt::DAPHNESuperChunkTypeAdapter,
-                                         fdl::DAPHNEListRequestHandler,
-                                         rol::SkipListLatencyBufferModel<fdt::DAPHNESuperChunkTypeAdapter>,
-                                         fdl::DAPHNEFrameProcessor>>(run_marker);
-    register_node("PDSFrameProcessor", readout_model);
-    readout_model->init(modconf);
-    return readout_model;
+void
+FDDataHandlerModule::stop_indexing()
+{
+  std::thread index_thread;
+  {
+    std::lock_guard<std::mutex> lock(m_index_mutex);
+    m_index_abort = true;
+    index_thread = std::move(m_index_thread);
   }
+  if (m_readout_commands != nullptr) {
+    m_readout_commands->on_recording_done(nullptr);
+  }
+  if (index_thread.joinable()) {
+    index_thread.join();
+  }
+}
 
-  // IF PDS Stream Frame using SPSC LB
-  if (raw_dt.find("PDSStreamFrame") != std::string::npos) {
-    TLOG_DEBUG(TLVL_WORK_STEPS) << "Creating readout for a PDS DAPHNE stream mode using BinarySearchQueue LB";
-    auto readout_model = std::make_shared<
-      rol::DataHandlingModel<fdt::DAPHNEStreamSuperChunkTypeAdapter,
-                        rol::DefaultRequestHandlerModel<fdt::DAPHNEStreamSuperChunkTypeAdapter,
-                                                        rol::BinarySearchQueueModel<fdt::DAPHNEStreamSuperChunkTypeAdapter>>,
-                        rol::BinarySearchQueueModel<fdt::DAPHNEStreamSuperChunkTypeAdapter>,
-                        fdl::DAPHNEStreamFrameProcessor>>(run_marker);
-    register_node("PDSStreamFrameProcessor", readout_model);
-    readout_model->init(modconf);
-    return readout_model;
+void
+FDDataHandlerModule::do_freeze_ring(const data_t& /* args */)
+{
+  if (m_readout_commands == nullptr || !m_readout_commands->freeze_ring()) {
+    TLOG() << get_name() << ": freeze_ring ignored, the latency buffer does not record a ring";
   }
+}
+
+void
+FDDataHandlerModule::do_profile_processor(const data_t& args)
+{
+  const auto sample_every = args.value<uint32_t>("sample_every", 0);
+  const auto trace_file = args.value<std::string>("trace_file", "");
+  if (m_readout_commands == nullptr || !m_readout_commands->profile_processor(sample_every, trace_file)) {
+    TLOG() << get_name() << ": profile_processor ignored, the frame processor is not profiled";
+  }
+}
+
+template<class Specialization>
+std::shared_ptr<datahandlinglibs::DataHandlingConcept>
+FDDataHandlerModule::make_readout(const appmodel::DataHandlerModule* modconf, std::atomic<bool>& run_marker)
+{
+  auto recorder_conf = modconf->get_module_configuration()->get_request_handler()->get_data_recorder();
+  if (recorder_conf != nullptr) {
+    m_recording_file = recorder_conf->get_output_file();
+    m_index_builder = [](const std::string& file, const std::atomic<bool>* abort) {
+      return build_timestamp_index<typename Specialization::readout_t>(
+        file, TimestampIndexWriter::default_stride, abort);
+    };
+  }
+
+  // Mapping and touching the buffers of the model takes most of the startup time: it runs on the startup
+  // pool, overlapping with the init of the other modules, and is waited for at conf.
+  auto readout_model = std::make_shared<typename Specialization::model_t>(run_marker);
+  auto memory_steps = defer_memory_preparation([&]() { readout_model->init(modconf); });
+  register_node(Specialization::node_name, readout_model);
+  if (!memory_steps.empty()) {
+    m_prepared = m_startup
+                   .prepare([readout_model, steps = std::move(memory_steps)]() {
+                     for (auto& step : steps) {
+                       step();
+                     }
+                   })
+                   .share();
+  }
+  return readout_model;
+}
+
+std::shared_ptr<datahandlinglibs::DataHandlingConcept>
+FDDataHandlerModule::create_readout(const appmodel::DataHandlerModule* modconf, std::atomic<bool>& run_marker)
+{
+  // Acquire DataType  
+  std::string raw_dt = modconf->get_module_configuration()->get_input_data_type();
+  TLOG() << "Choosing specializations for DataHandlingModel with data_type:" << raw_dt << ']';
 
-  return nullptr;
+  auto readout = specializations::with_specialization(modconf, [&](auto spec) {
+    using Specialization = decltype(spec);
+    TLOG_DEBUG(TLVL_WORK_STEPS) << "Creating readout for " << Specialization::data_type << " using "
+                                << Specialization::node_name;
+    return make_readout<Specialization>(modconf, run_marker);
+  });
+  m_readout_commands = std::dynamic_pointer_cast<ReadoutCommandConcept>(readout);
+  return readout;
 }
 
 } // namespace fdreadoutmodules
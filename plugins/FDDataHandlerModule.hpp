@@ -12,7 +12,17 @@
 
 #include "datahandlinglibs/RawDataHandlerBase.hpp"
 
+#include "fdreadoutmodules/concepts/ReadoutCommandConcept.hpp"
+#include "fdreadoutmodules/utils/CpuFeatures.hpp"
+#include "fdreadoutmodules/utils/StartupProfile.hpp"
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 
 namespace dunedaq {
 namespace fdreadoutmodules {
@@ -28,6 +38,7 @@ public:
    * @param name Instance name for this FDDataHandlerModule instance
    */
   explicit FDDataHandlerModule(const std::string& name);
+  ~FDDataHandlerModule();
 
   FDDataHandlerModule(const FDDataHandlerModule&) = delete;            ///< FDDataHandlerModule is not copy-constructible
   FDDataHandlerModule& operator=(const FDDataHandlerModule&) = delete; ///< FDDataHandlerModule is not copy-assignable
@@ -40,6 +51,44 @@ public:
   create_readout(const appmodel::DataHandlerModule* modconf, std::atomic<bool>& run_marker) override;
 protected:
   void generate_opmon_data() override;
+
+private:
+  //! Waits for the memory of the readout model to be prepared on the startup pool, rethrowing its failure
+  void do_conf(const data_t& args);
+  void do_scrap(const data_t& args);
+  void do_start(const data_t& args);
+  void do_stop(const data_t& args);
+  //! Records as the request handler does, then indexes the file when the model reports the recording done
+  void do_record(const data_t& args);
+  //! Keep the ring recorded by a RingRecordingLatencyBufferConf, e.g. on a supernova burst trigger
+  void do_freeze_ring(const data_t& args);
+  //! Time the tasks of the frame processor: {"sample_every": N, "trace_file": path}, N = 0 stops
+  void do_profile_processor(const data_t& args);
+
+  template<class Specialization>
+  std::shared_ptr<datahandlinglibs::DataHandlingConcept>
+  make_readout(const appmodel::DataHandlerModule* modconf, std::atomic<bool>& run_marker);
+
+  //! Aborts and joins the index build of the previous recording, at record, stop and scrap
+  void stop_indexing();
+
+  // Timestamp index of files written by the record command
+  std::function<bool(const std::string&, const std::atomic<bool>*)> m_index_builder;
+  std::string m_recording_file;
+  std::mutex m_index_mutex; ///< Protects m_index_thread, started from a thread of the model
+  std::thread m_index_thread;
+  std::atomic<bool> m_index_abort{ false };
+
+  // Memory preparation of the readout model, running on the startup pool from create_readout() to conf
+  std::shared_future<void> m_prepared;
+  StartupProfile m_startup;
+
+  // The readout model, null if it has no commands beyond DataHandlingConcept
+  std::shared_ptr<ReadoutCommandConcept> m_readout_commands;
+
+  // Instruction set of the frame kernels
+  IsaLevel m_host_isa{ IsaLevel::kScalar };
+  IsaLevel m_selected_isa{ IsaLevel::kScalar };
 };
 
 } // namespace fdreadoutmodules
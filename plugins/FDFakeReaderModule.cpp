@@ -15,7 +15,9 @@
 #include "datahandlinglibs/DataHandlingIssues.hpp"
 //#include "datahandlinglibs/sourceemulatorconfig/Nljs.hpp"
 #include "datahandlinglibs/models/SourceEmulatorModel.hpp"
+#include "appmodel/DataReaderConf.hpp"
 #include "appmodel/DataReaderModule.hpp"
+#include "fdreadoutmodules/dal/LinkEmulationProfile.hpp"
 
 //#include "fdreadoutlibs/DUNEWIBSuperChunkTypeAdapter.hpp"
 #include "fdreadoutlibs/DUNEWIBEthTypeAdapter.hpp"
@@ -24,6 +26,7 @@
 #include "fdreadoutlibs/TDEFrameTypeAdapter.hpp"
 #include "fdreadoutlibs/TDEEthTypeAdapter.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <fstream>
 #include <iomanip>
@@ -51,9 +54,9 @@ FDFakeReaderModule::FDFakeReaderModule(const std::string& name)
   : DAQModule(name)
   , FakeCardReaderBase(name)
 {
-  inherited_mod::register_command("conf", &inherited_fcr::do_conf);
+  inherited_mod::register_command("conf", &FDFakeReaderModule::do_conf);
   inherited_mod::register_command("scrap", &inherited_fcr::do_scrap);
-  inherited_mod::register_command("start", &inherited_fcr::do_start);
+  inherited_mod::register_command("start", &FDFakeReaderModule::do_start);
   inherited_mod::register_command("stop_trigger_sources", &inherited_fcr::do_stop);
 }
 
@@ -61,31 +64,159 @@ void
 FDFakeReaderModule::init(std::shared_ptr<appfwk::ModuleConfiguration> cfg)
 {
   TLOG_DEBUG(TLVL_ENTER_EXIT_METHODS) << get_name() << ": Entering init() method";
+  StartupProfile::Timer timer(m_startup.init_us);
+  // The profiles must be known before the base class creates the emulators
+  auto mdal = cfg->module<appmodel::DataReaderModule>(get_name());
+  if (mdal != nullptr && mdal->get_configuration() != nullptr &&
+      mdal->get_configuration()->get_emulation_conf() != nullptr) {
+    m_emulation_conf = mdal->get_configuration()->get_emulation_conf()->cast<dal::FDStreamEmulationParameters>();
+  }
   inherited_fcr::init(cfg);
   TLOG_DEBUG(TLVL_ENTER_EXIT_METHODS) << get_name() << ": Exiting init() method";
 }
 
+void
+FDFakeReaderModule::generate_opmon_data()
+{
+  // Per-link pacing is published by the emulators, registered below this module
+  publish(m_startup.info());
+}
+
+void
+FDFakeReaderModule::do_conf(const data_t& args)
+{
+  StartupProfile::Timer timer(m_startup.conf_us);
+  std::vector<std::shared_ptr<const SharedInputFile>> inputs;
+  {
+    StartupProfile::Timer wait_timer(m_startup.conf_wait_us);
+    for (auto& prefetched : m_prefetched_inputs) {
+      try {
+        inputs.push_back(prefetched.get());
+      } catch (const ers::Issue& ex) {
+        // Reported by the conf of the emulator, which opens the file again
+        TLOG_DEBUG(TLVL_WORK_STEPS) << get_name() << ": Could not load emulator input ahead of conf: " << ex.what();
+      }
+    }
+    m_prefetched_inputs.clear();
+  }
+  // inputs keeps the files mapped until the emulators hold them
+  inherited_fcr::do_conf(args);
+  auto timing = m_startup.info();
+  TLOG() << get_name() << ": inputs of " << timing.links_prepared() << " links loaded ahead of conf in "
+         << timing.prepare_total_ms() << " ms, conf waited " << timing.conf_wait_ms() << " ms for them";
+}
+
+void
+FDFakeReaderModule::do_start(const data_t& args)
+{
+  StartupProfile::Timer timer(m_startup.start_us);
+  inherited_fcr::do_start(args);
+}
+
+const dal::LinkEmulationProfile*
+FDFakeReaderModule::find_profile(const std::string& q_id, const std::string& raw_dt) const
+{
+  if (m_emulation_conf == nullptr) {
+    return nullptr;
+  }
+  for (auto profile : m_emulation_conf->get_link_profiles()) {
+    const auto& links = profile->get_links();
+    if (std::find(links.begin(), links.end(), q_id) != links.end()) {
+      return profile;
+    }
+  }
+  for (auto profile : m_emulation_conf->get_link_profiles()) {
+    if (profile->get_links().empty() && profile->get_data_type() == raw_dt) {
+      return profile;
+    }
+  }
+  return nullptr;
+}
+
+template<class ReadoutType>
 std::shared_ptr<datahandlinglibs::SourceEmulatorConcept>
-FDFakeReaderModule::create_source_emulator(std::string q_id, std::atomic<bool>& run_marker)
+FDFakeReaderModule::make_source_emulator(const std::string& q_id,
+                                         std::atomic<bool>& run_marker,
+                                         const std::string& raw_dt,
+                                         EmulatedStreamParameters params)
 {
-  //! Values suitable to emulation
+  std::string pacing = "RateLimiter";
+  if (auto profile = find_profile(q_id, raw_dt)) {
+    if (profile->get_rate_khz() > 0.) {
+      params.rate_khz = profile->get_rate_khz();
+    }
+    if (profile->get_time_tick_diff() > 0) {
+      params.time_tick_diff = profile->get_time_tick_diff();
+    }
+    if (profile->get_frames_per_tick() > 0) {
+      params.frames_per_tick = profile->get_frames_per_tick();
+    }
+    if (profile->get_dropout_rate() >= 0.) {
+      params.dropout_rate = profile->get_dropout_rate();
+    }
+    params.frame_error_rate = profile->get_frame_error_rate();
+    params.batch_size = profile->get_batch_size();
+    pacing = profile->get_pacing();
+    params.spin = pacing == "Precise";
+    TLOG() << "Emulation profile " << profile->UID() << " applied to " << q_id;
+  }
+  TLOG() << q_id << ": " << params.rate_khz << " kHz, " << params.time_tick_diff << " ticks between frames, "
+         << params.frames_per_tick << " frames per tick, dropout rate " << params.dropout_rate << ", "
+         << pacing << " pacing";
 
-  static constexpr int daphne_time_tick_diff = 16;
-  static constexpr double daphne_dropout_rate = 0.9;
-  static constexpr double daphne_rate_khz = 200.0;
-  static constexpr int daphne_frames_per_tick = 1;
+  std::shared_ptr<datahandlinglibs::SourceEmulatorConcept> source_emu_model;
+  if (pacing != "RateLimiter") {
+    if (params.frame_error_rate > 0.) {
+      throw datahandlinglibs::GenericConfigurationError(
+        ERS_HERE, q_id + ": frame errors are not emulated with " + pacing + " pacing, frame_error_rate must be 0");
+    }
+    if (m_emulation_conf != nullptr) {
+      params.input_backing = parse_page_backing(m_emulation_conf->get_input_page_backing());
+      // Loaded on the startup pool, concurrently with the other data types and modules; the emulator finds it
+      // already mapped at conf, provided it is configured with the same emulation parameters
+      m_prefetched_inputs.push_back(m_startup.prepare([path = m_emulation_conf->get_data_file_name(),
+                                                       size_limit = m_emulation_conf->get_input_file_size_limit(),
+                                                       backing = params.input_backing]() {
+        return SharedInputFile::open(path, sizeof(ReadoutType), size_limit, backing);
+      }));
+    }
+    source_emu_model = std::make_shared<PacedSourceEmulatorModel<ReadoutType>>(q_id, run_marker, params);
+  } else {
+    source_emu_model = std::make_shared<datahandlinglibs::SourceEmulatorModel<ReadoutType>>(q_id,
+                                                                                           run_marker,
+                                                                                           params.time_tick_diff,
+                                                                                           params.dropout_rate,
+                                                                                           params.frame_error_rate,
+                                                                                           params.rate_khz,
+                                                                                           params.frames_per_tick);
+  }
+  register_node(q_id, source_emu_model);
+  return source_emu_model;
+}
 
-  static constexpr int wibeth_time_tick_diff = 32*64;
-  static constexpr double wibeth_dropout_rate = 0.0;
-  static constexpr double wibeth_rate_khz = 30.5176;
-  static constexpr int wibeth_frames_per_tick = 1;
+std::shared_ptr<datahandlinglibs::SourceEmulatorConcept>
+FDFakeReaderModule::create_source_emulator(std::string q_id, std::atomic<bool>& run_marker)
+{
+  //! Nominal values of each data type, overridden by the link emulation profiles
+
+  EmulatedStreamParameters daphne;
+  daphne.time_tick_diff = 16;
+  daphne.dropout_rate = 0.9;
+  daphne.rate_khz = 200.0;
+  daphne.frames_per_tick = 1;
 
-  static constexpr int tde_time_tick_diff = dunedaq::fddetdataformats::ticks_between_adc_samples*dunedaq::fddetdataformats::tot_adc16_samples;
-  static constexpr double tde_dropout_rate = 0.0;
-  static constexpr double tde_rate_khz = 62500./tde_time_tick_diff;
-  static constexpr int tde_frames_per_tick = dunedaq::fddetdataformats::n_channels_per_amc;
+  EmulatedStreamParameters wibeth;
+  wibeth.time_tick_diff = 32 * 64;
+  wibeth.dropout_rate = 0.0;
+  wibeth.rate_khz = 30.5176;
+  wibeth.frames_per_tick = 1;
 
-  static constexpr double emu_frame_error_rate = 0.0;
+  EmulatedStreamParameters tde;
+  tde.time_tick_diff =
+    dunedaq::fddetdataformats::ticks_between_adc_samples * dunedaq::fddetdataformats::tot_adc16_samples;
+  tde.dropout_rate = 0.0;
+  tde.rate_khz = 62500. / tde.time_tick_diff;
+  tde.frames_per_tick = dunedaq::fddetdataformats::n_channels_per_amc;
 
   auto datatypes = dunedaq::iomanager::IOManager::get()->get_datatypes(q_id);
   if (datatypes.size() != 1) {
@@ -99,60 +230,34 @@ FDFakeReaderModule::create_source_emulator(std::string q_id, std::atomic<bool>&
   // IF WIBETH
   if (raw_dt.find("WIBEthFrame") != std::string::npos) {
     TLOG_DEBUG(TLVL_WORK_STEPS) << "Creating fake wibeth link";
-    auto source_emu_model =
-      std::make_shared<datahandlinglibs::SourceEmulatorModel<fdreadoutlibs::types::DUNEWIBEthTypeAdapter>>(
-        q_id, run_marker, wibeth_time_tick_diff, wibeth_dropout_rate, emu_frame_error_rate, wibeth_rate_khz, wibeth_frames_per_tick);
-    register_node(q_id, source_emu_model);
-    return source_emu_model;
+    return make_source_emulator<fdreadoutlibs::types::DUNEWIBEthTypeAdapter>(q_id, run_marker, raw_dt, wibeth);
   }
 
   // IF PDS
   if (raw_dt.find("PDSFrame") != std::string::npos) {
     TLOG_DEBUG(TLVL_WORK_STEPS) << "Creating fake pds link";
-    auto source_emu_model =
-      std::make_shared<datahandlinglibs::SourceEmulatorModel<fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter>>(
-        q_id, run_marker, daphne_time_tick_diff, daphne_dropout_rate, emu_frame_error_rate, daphne_rate_khz, daphne_frames_per_tick);
-      register_node(q_id, source_emu_model);
-      return source_emu_model;
+    return make_source_emulator<fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter>(q_id, run_marker, raw_dt, daphne);
   }
 
   // IF PDSStream
   if (raw_dt.find("PDSStreamFrame") != std::string::npos) {
     TLOG_DEBUG(TLVL_WORK_STEPS) << "Creating fake pds stream link";
-    auto source_emu_model =
-      std::make_shared<datahandlinglibs::SourceEmulatorModel<fdreadoutlibs::types::DAPHNEStreamSuperChunkTypeAdapter>>(
-        q_id, run_marker, daphne_time_tick_diff, daphne_dropout_rate, emu_frame_error_rate, daphne_rate_khz, daphne_frames_per_tick);
-      register_node(q_id, source_emu_model);
-    return source_emu_model;
+    return make_source_emulator<fdreadoutlibs::types::DAPHNEStreamSuperChunkTypeAdapter>(
+      q_id, run_marker, raw_dt, daphne);
   }
 
   // IF TDE
   if (raw_dt.find("TDEFrame") != std::string::npos) {
     TLOG_DEBUG(TLVL_WORK_STEPS) << "Creating fake tde link";
-    auto source_emu_model =
-      std::make_shared<datahandlinglibs::SourceEmulatorModel<fdreadoutlibs::types::TDEFrameTypeAdapter>>(
-        q_id, run_marker, tde_time_tick_diff, tde_dropout_rate, emu_frame_error_rate, tde_rate_khz, tde_frames_per_tick);
-      register_node(q_id, source_emu_model);
-    return source_emu_model;
+    return make_source_emulator<fdreadoutlibs::types::TDEFrameTypeAdapter>(q_id, run_marker, raw_dt, tde);
   }
 
   // IF TDEEth
   if (raw_dt.find("TDEEthFrame") != std::string::npos) {
     TLOG_DEBUG(TLVL_WORK_STEPS) << "Creating fake tde link";
-    auto source_emu_model =
-      std::make_shared<datahandlinglibs::SourceEmulatorModel<fdreadoutlibs::types::TDEEthTypeAdapter>>(
-        q_id,
-        run_marker,
-        tde_time_tick_diff,
-        tde_dropout_rate,
-        emu_frame_error_rate,
-        tde_rate_khz,
-        tde_frames_per_tick);
-    register_node(q_id, source_emu_model);
-    return source_emu_model;
+    return make_source_emulator<fdreadoutlibs::types::TDEEthTypeAdapter>(q_id, run_marker, raw_dt, tde);
   }
 
-
   return nullptr;
 }
 
@@ -17,7 +17,14 @@
 
 #include "datahandlinglibs/FakeCardReaderBase.hpp"
 
+#include "fdreadoutmodules/dal/FDStreamEmulationParameters.hpp"
+#include "fdreadoutmodules/models/PacedSourceEmulatorModel.hpp"
+#include "fdreadoutmodules/utils/StartupProfile.hpp"
+
+#include <future>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace dunedaq {
 namespace fdreadoutmodules {
@@ -44,6 +51,29 @@ public:
   std::shared_ptr<datahandlinglibs::SourceEmulatorConcept>
   create_source_emulator(std::string qi, std::atomic<bool>& run_marker) override;
 
+protected:
+  void generate_opmon_data() override;
+
+private:
+  //! Waits for the inputs loaded on the startup pool, which the emulators then find already mapped
+  void do_conf(const data_t& args);
+  void do_start(const data_t& args);
+
+  //! Profile of the link: the first one listing it, else the first one for its data type
+  const dal::LinkEmulationProfile* find_profile(const std::string& q_id, const std::string& raw_dt) const;
+
+  template<class ReadoutType>
+  std::shared_ptr<datahandlinglibs::SourceEmulatorConcept> make_source_emulator(const std::string& q_id,
+                                                                                std::atomic<bool>& run_marker,
+                                                                                const std::string& raw_dt,
+                                                                                EmulatedStreamParameters params);
+
+  // Set when the emulation parameters carry per-link profiles
+  const dal::FDStreamEmulationParameters* m_emulation_conf = nullptr;
+
+  // Inputs of the Sleep and Precise links, loaded on the startup pool from create_source_emulator() to conf
+  std::vector<std::future<std::shared_ptr<const SharedInputFile>>> m_prefetched_inputs;
+  StartupProfile m_startup;
 };
 
 } // namespace fdreadoutmodules
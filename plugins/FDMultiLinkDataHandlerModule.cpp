@@ -0,0 +1,222 @@
+/**
+ * @file FDMultiLinkDataHandlerModule.cpp FDMultiLinkDataHandlerModule implementation
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "FDMultiLinkDataHandlerModule.hpp"
+
+#include "fdreadoutmodules/dal/FDMultiLinkDataHandlerModule.hpp"
+#include "fdreadoutmodules/dal/MultiLinkDataHandlerConf.hpp"
+#include "fdreadoutmodules/opmon/multi_link_handler_info.pb.h"
+
+#include "logging/Logging.hpp"
+
+#include "datahandlinglibs/DataHandlingIssues.hpp"
+#include "datahandlinglibs/ReadoutLogging.hpp"
+
+#include "fdreadoutlibs/DAPHNEStreamSuperChunkTypeAdapter.hpp"
+#include "fdreadoutlibs/DAPHNESuperChunkTypeAdapter.hpp"
+#include "fdreadoutlibs/DUNEWIBEthTypeAdapter.hpp"
+#include "fdreadoutlibs/TDEEthTypeAdapter.hpp"
+
+#include "fdreadoutmodules/ReadoutModelSpecializations.hpp"
+
+#include "appmodel/DataHandlerConf.hpp"
+#include "appmodel/DataHandlerModule.hpp"
+
+#include <exception>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace dunedaq::datahandlinglibs::logging;
+
+namespace dunedaq {
+
+DUNE_DAQ_TYPESTRING(dunedaq::fdreadoutlibs::types::DUNEWIBEthTypeAdapter, "WIBEthFrame")
+DUNE_DAQ_TYPESTRING(dunedaq::fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter, "PDSFrame")
+DUNE_DAQ_TYPESTRING(dunedaq::fdreadoutlibs::types::DAPHNEStreamSuperChunkTypeAdapter, "PDSStreamFrame")
+DUNE_DAQ_TYPESTRING(dunedaq::fdreadoutlibs::types::TDEEthTypeAdapter, "TDEEthFrame")
+
+namespace fdreadoutmodules {
+
+FDMultiLinkDataHandlerModule::FDMultiLinkDataHandlerModule(const std::string& name)
+  : DAQModule(name)
+{
+  register_command("conf", &FDMultiLinkDataHandlerModule::do_conf);
+  register_command("scrap", &FDMultiLinkDataHandlerModule::do_scrap);
+  register_command("start", &FDMultiLinkDataHandlerModule::do_start);
+  register_command("stop_trigger_sources", &FDMultiLinkDataHandlerModule::do_stop);
+  register_command("record", &FDMultiLinkDataHandlerModule::do_record);
+  register_command("freeze_ring", &FDMultiLinkDataHandlerModule::do_freeze_ring);
+  register_command("profile_processor", &FDMultiLinkDataHandlerModule::do_profile_processor);
+}
+
+FDMultiLinkDataHandlerModule::~FDMultiLinkDataHandlerModule()
+{
+  m_executor.stop();
+}
+
+void
+FDMultiLinkDataHandlerModule::init(std::shared_ptr<appfwk::ModuleConfiguration> cfg)
+{
+  TLOG_DEBUG(TLVL_ENTER_EXIT_METHODS) << get_name() << ": Entering init() method";
+  auto mdal = cfg->module<dal::FDMultiLinkDataHandlerModule>(get_name());
+  if (mdal == nullptr) {
+    throw datahandlinglibs::GenericConfigurationError(ERS_HERE, "No FDMultiLinkDataHandlerModule named " + get_name());
+  }
+  auto conf = mdal->get_configuration();
+
+  std::vector<int> cpus;
+  try {
+    cpus = parse_cpu_list(conf->get_cpu_list());
+  } catch (const std::exception& excpt) {
+    throw datahandlinglibs::GenericConfigurationError(ERS_HERE,
+                                                      "Invalid cpu_list " + conf->get_cpu_list() + ": " + excpt.what());
+  }
+  m_executor.start(conf->get_worker_threads(), cpus, conf->get_numa_node(), get_name());
+  TLOG() << get_name() << ": Started " << m_executor.size() << " pinned workers for " << mdal->get_links().size()
+         << " links";
+
+  // Models are created on the worker of their link, so that the threads they start inherit its binding
+  std::vector<std::future<std::shared_ptr<datahandlinglibs::DataHandlingConcept>>> readouts;
+  for (std::size_t i = 0; i < mdal->get_links().size(); ++i) {
+    const appmodel::DataHandlerModule* modconf = mdal->get_links()[i];
+    readouts.push_back(m_executor.submit(
+      [this, modconf]() -> std::shared_ptr<datahandlinglibs::DataHandlingConcept> {
+        return specializations::with_specialization(modconf, [&](auto spec) {
+          using Specialization = decltype(spec);
+          TLOG_DEBUG(TLVL_WORK_STEPS) << "Creating readout of " << modconf->UID() << " for "
+                                      << Specialization::data_type;
+          auto readout_model = std::make_shared<typename Specialization::model_t>(m_run_marker);
+          readout_model->init(modconf);
+          return std::static_pointer_cast<datahandlinglibs::DataHandlingConcept>(readout_model);
+        });
+      },
+      i));
+  }
+
+  for (std::size_t i = 0; i < readouts.size(); ++i) {
+    const appmodel::DataHandlerModule* modconf = mdal->get_links()[i];
+    auto readout = readouts[i].get();
+    if (readout == nullptr) {
+      throw datahandlinglibs::GenericConfigurationError(
+        ERS_HERE, "Unsupported data type " + modconf->get_module_configuration()->get_input_data_type() + " of link " +
+                    modconf->UID());
+    }
+    register_node(modconf->UID(), readout);
+    m_links.push_back({ modconf->UID(), readout, std::dynamic_pointer_cast<ReadoutCommandConcept>(readout) });
+  }
+  TLOG_DEBUG(TLVL_ENTER_EXIT_METHODS) << get_name() << ": Exiting init() method";
+}
+
+void
+FDMultiLinkDataHandlerModule::for_each_link(
+  const std::string& command,
+  const std::function<void(datahandlinglibs::DataHandlingConcept&)>& command_fn)
+{
+  std::vector<std::future<void>> done;
+  for (std::size_t i = 0; i < m_links.size(); ++i) {
+    auto readout = m_links[i].readout;
+    done.push_back(m_executor.submit([readout, &command_fn]() { command_fn(*readout); }, i));
+  }
+
+  std::exception_ptr first_failure;
+  for (std::size_t i = 0; i < done.size(); ++i) {
+    try {
+      done[i].get();
+    } catch (...) {
+      TLOG() << get_name() << ": " << command << " failed for link " << m_links[i].uid;
+      if (!first_failure) {
+        first_failure = std::current_exception();
+      }
+    }
+  }
+  if (first_failure) {
+    std::rethrow_exception(first_failure);
+  }
+}
+
+void
+FDMultiLinkDataHandlerModule::do_conf(const data_t& args)
+{
+  for_each_link("conf", [&](datahandlinglibs::DataHandlingConcept& readout) { readout.conf(args); });
+  TLOG() << get_name() << ": configured " << m_links.size() << " links";
+}
+
+void
+FDMultiLinkDataHandlerModule::do_scrap(const data_t& args)
+{
+  for_each_link("scrap", [&](datahandlinglibs::DataHandlingConcept& readout) { readout.scrap(args); });
+}
+
+void
+FDMultiLinkDataHandlerModule::do_start(const data_t& args)
+{
+  m_run_marker.store(true);
+  for_each_link("start", [&](datahandlinglibs::DataHandlingConcept& readout) { readout.start(args); });
+  TLOG() << get_name() << ": started " << m_links.size() << " links";
+}
+
+void
+FDMultiLinkDataHandlerModule::do_stop(const data_t& args)
+{
+  m_run_marker.store(false);
+  for_each_link("stop", [&](datahandlinglibs::DataHandlingConcept& readout) { readout.stop(args); });
+  TLOG() << get_name() << ": stopped " << m_links.size() << " links";
+}
+
+void
+FDMultiLinkDataHandlerModule::do_record(const data_t& args)
+{
+  for_each_link("record", [&](datahandlinglibs::DataHandlingConcept& readout) { readout.record(args); });
+}
+
+void
+FDMultiLinkDataHandlerModule::do_freeze_ring(const data_t& /* args */)
+{
+  // Only notes a timestamp per link, no need for the workers
+  for (auto& link : m_links) {
+    if (link.commands == nullptr || !link.commands->freeze_ring()) {
+      TLOG() << get_name() << ": freeze_ring ignored for link " << link.uid << ", it records no ring";
+    }
+  }
+}
+
+void
+FDMultiLinkDataHandlerModule::do_profile_processor(const data_t& args)
+{
+  // Only switches the profiling of each link, no need for the workers
+  const auto sample_every = args.value<uint32_t>("sample_every", 0);
+  const auto trace_file = args.value<std::string>("trace_file", "");
+  for (auto& link : m_links) {
+    const std::string link_trace_file = trace_file.empty() ? trace_file : trace_file + "." + link.uid;
+    if (link.commands == nullptr || !link.commands->profile_processor(sample_every, link_trace_file)) {
+      TLOG() << get_name() << ": profile_processor ignored for link " << link.uid << ", it is not profiled";
+    }
+  }
+}
+
+void
+FDMultiLinkDataHandlerModule::generate_opmon_data()
+{
+  // Per-link metrics are published by the readout models, registered below this module by link UID
+  auto stats = m_executor.stats();
+  opmon::MultiLinkHandlerInfo info;
+  info.set_links(m_links.size());
+  info.set_pool_threads(m_executor.size());
+  info.set_tasks_executed(stats.executed - m_last_stats.executed);
+  info.set_tasks_failed(stats.failed - m_last_stats.failed);
+  info.set_tasks_queued(stats.queued);
+  m_last_stats = stats;
+  publish(std::move(info));
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+DEFINE_DUNE_DAQ_MODULE(dunedaq::fdreadoutmodules::FDMultiLinkDataHandlerModule)
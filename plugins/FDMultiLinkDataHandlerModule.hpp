@@ -0,0 +1,83 @@
+/**
+ * @file FDMultiLinkDataHandlerModule.hpp FarDetector readout of several links sharing one worker pool
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_PLUGINS_FDMULTILINKDATAHANDLERMODULE_HPP_
+#define FDREADOUTMODULES_PLUGINS_FDMULTILINKDATAHANDLERMODULE_HPP_
+
+#include "appfwk/DAQModule.hpp"
+#include "appfwk/ModuleConfiguration.hpp"
+
+#include "datahandlinglibs/concepts/DataHandlingConcept.hpp"
+
+#include "fdreadoutmodules/concepts/ReadoutCommandConcept.hpp"
+#include "fdreadoutmodules/utils/PinnedExecutor.hpp"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Handles the links listed in its configuration, each with the same DataHandlingModel that
+ * FDDataHandlerModule would create for it. The models are created and their commands run on the
+ * workers of a PinnedExecutor bound to the configured CPUs, each link always on the same worker, so
+ * every thread a model creates is confined to those CPUs and its buffers are allocated on their NUMA
+ * node. The executor does nothing but this pinning: the links run with the threads of their models.
+ */
+class FDMultiLinkDataHandlerModule : public dunedaq::appfwk::DAQModule
+{
+public:
+  explicit FDMultiLinkDataHandlerModule(const std::string& name);
+  ~FDMultiLinkDataHandlerModule();
+
+  FDMultiLinkDataHandlerModule(const FDMultiLinkDataHandlerModule&) = delete;
+  FDMultiLinkDataHandlerModule& operator=(const FDMultiLinkDataHandlerModule&) = delete;
+  FDMultiLinkDataHandlerModule(FDMultiLinkDataHandlerModule&&) = delete;
+  FDMultiLinkDataHandlerModule& operator=(FDMultiLinkDataHandlerModule&&) = delete;
+
+  void init(std::shared_ptr<appfwk::ModuleConfiguration> cfg) override;
+
+protected:
+  void generate_opmon_data() override;
+
+private:
+  // Commands
+  void do_conf(const data_t& args);
+  void do_scrap(const data_t& args);
+  void do_start(const data_t& args);
+  void do_stop(const data_t& args);
+  void do_record(const data_t& args);
+  void do_freeze_ring(const data_t& args);
+  void do_profile_processor(const data_t& args);
+
+  //! Runs command on every link in parallel on its worker, rethrowing the first failure once all are done
+  void for_each_link(const std::string& command,
+                     const std::function<void(datahandlinglibs::DataHandlingConcept&)>& command_fn);
+
+  struct Link
+  {
+    std::string uid;
+    std::shared_ptr<datahandlinglibs::DataHandlingConcept> readout;
+    std::shared_ptr<ReadoutCommandConcept> commands; ///< The same model, null if it has no such commands
+  };
+  std::vector<Link> m_links;
+
+  PinnedExecutor m_executor;
+  std::atomic<bool> m_run_marker{ false };
+
+  // Executor counters at the previous publication
+  PinnedExecutor::Stats m_last_stats;
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_PLUGINS_FDMULTILINKDATAHANDLERMODULE_HPP_
@@ -14,9 +14,11 @@
 #include "DummyConsumer.hpp"
 #include "DummyConsumer.cpp"
 #include "daqdataformats/Fragment.hpp"
-#include "fddetdataformats/WIBFrame.hpp"
-#include "fddetdataformats/DAPHNEFrame.hpp"
+#include "dfmessages/Fragment_serialization.hpp"
 
+#include "fdreadoutmodules/dal/FragmentConsumer.hpp"
+#include "fdreadoutmodules/opmon/fragment_validation_info.pb.h"
+#include "fdreadoutmodules/utils/FragmentValidator.hpp"
 
 #include <memory>
 #include <string>
@@ -29,64 +31,66 @@ namespace fdreadoutmodules {
 class FragmentConsumer : public DummyConsumer<std::unique_ptr<dunedaq::daqdataformats::Fragment>>
 {
 public:
+  using inherited = DummyConsumer<std::unique_ptr<dunedaq::daqdataformats::Fragment>>;
+
   explicit FragmentConsumer(const std::string name)
     : DummyConsumer<std::unique_ptr<dunedaq::daqdataformats::Fragment>>(name)
   {}
 
+  void init(std::shared_ptr<appfwk::ModuleConfiguration> cfg) override
+  {
+    inherited::init(cfg);
+    // Validate one fragment in validation_sample_every, 0 disables validation
+    auto mdal = cfg->module<dal::FragmentConsumer>(get_name());
+    const uint32_t sample_every = mdal != nullptr ? mdal->get_validation_sample_every() : 1;
+    m_validate = sample_every > 0;
+    m_validator = std::make_unique<FragmentValidator>(sample_every);
+    TLOG() << get_name() << ": fragment validation " << (m_validate ? "enabled" : "disabled") << ", "
+           << to_string(m_validator->kernels().isa) << " kernels";
+  }
+
   void packet_callback(std::unique_ptr<dunedaq::daqdataformats::Fragment>& packet) override
   {
-    dunedaq::daqdataformats::FragmentHeader header = packet->get_header();
-    TLOG_DEBUG(TLVL_WORK_STEPS) << header;
-    validate(*packet.get());
+    TLOG_DEBUG(TLVL_WORK_STEPS) << packet->get_header();
+    if (m_validate) {
+      m_validator->validate(*packet);
+    }
   }
 
-  // Only does wib and daphne validation for now
-  void validate(dunedaq::daqdataformats::Fragment& fragment)
+protected:
+  void generate_opmon_data() override
   {
-    return;
-    if (fragment.get_size() - sizeof(daqdataformats::FragmentHeader) == 0) {
-      TLOG() << "Encountered empty fragment";
+    inherited::generate_opmon_data();
+    if (!m_validate) {
       return;
-    } else if ((fragment.get_header().fragment_type ==
-                static_cast<daqdataformats::fragment_type_t>(daqdataformats::FragmentType::kProtoWIB)) ||
-               (static_cast<fddetdataformats::WIBFrame*>(fragment.get_data())->get_wib_header()->sof == 0)) {
-      int num_frames = (fragment.get_size() - sizeof(daqdataformats::FragmentHeader)) / sizeof(fddetdataformats::WIBFrame);
-      auto window_begin = fragment.get_header().window_begin;
-      auto window_end = fragment.get_header().window_end;
-
-      fddetdataformats::WIBFrame* first_frame = static_cast<fddetdataformats::WIBFrame*>(fragment.get_data());
-      fddetdataformats::WIBFrame* last_frame = reinterpret_cast<fddetdataformats::WIBFrame*>( // NOLINT
-        static_cast<char*>(fragment.get_data()) + (num_frames - 1) * sizeof(fddetdataformats::WIBFrame));                          // NOLINT
-
-      if (!((first_frame->get_timestamp() >= window_begin) && (first_frame->get_timestamp() < window_begin + 25))) {
-        TLOG() << "First fragment not correctly aligned";
-      }
-      if (!((last_frame->get_timestamp() < window_end) && (last_frame->get_timestamp() >= window_end - 25))) {
-        TLOG() << "Last fragment not correctly aligned";
-      }
-
-      for (int i = 0; i < num_frames; ++i) {
-        fddetdataformats::WIBFrame* frame = reinterpret_cast<fddetdataformats::WIBFrame*>( // NOLINT
-          static_cast<char*>(fragment.get_data()) + (i * sizeof(fddetdataformats::WIBFrame)));
-        if (frame->get_timestamp() < fragment.get_header().window_begin ||
-            frame->get_timestamp() >= fragment.get_header().window_end) {
-          TLOG() << "Fragment validation encountered frame not fitting the requested window";
-        }
-      }
-    } else if (fragment.get_header().fragment_type ==
-               static_cast<daqdataformats::fragment_type_t>(daqdataformats::FragmentType::kDAPHNE)) {
-      int num_frames = (fragment.get_size() - sizeof(daqdataformats::FragmentHeader)) / 584;
-
-      for (int i = 0; i < num_frames; ++i) {
-        fddetdataformats::DAPHNEFrame* frame = reinterpret_cast<fddetdataformats::DAPHNEFrame*>( // NOLINT
-          static_cast<char*>(fragment.get_data()) + (i * 584));
-        if (frame->get_timestamp() < fragment.get_header().window_begin ||
-            frame->get_timestamp() >= fragment.get_header().window_end) {
-          TLOG() << "Fragment validation encountered fragment not fitting the requested window";
-        }
-      }
     }
+
+    const auto& c = m_validator->counters();
+    opmon::FragmentValidationInfo info;
+    info.set_fragments_validated(c.fragments_validated.load());
+    info.set_fragments_skipped(c.fragments_skipped.load());
+    info.set_frames_checked(c.frames_checked.load());
+    info.set_empty_fragments(c.empty_fragments.load());
+    info.set_unknown_type(c.unknown_type.load());
+    info.set_size_mismatches(c.size_mismatches.load());
+    info.set_frames_outside_window(c.frames_outside_window.load());
+    info.set_timestamp_gaps(c.timestamp_gaps.load());
+    info.set_timestamp_reversals(c.timestamp_reversals.load());
+    info.set_frame_count_mismatches(c.frame_count_mismatches.load());
+    info.set_incomplete_fragments(c.incomplete_fragments.load());
+    info.set_frame_error_bits(c.frame_error_bits.load());
+
+    auto cost = m_validator->cost_ns().snapshot_and_reset();
+    info.set_cost_mean_ns(cost.mean());
+    info.set_cost_p99_ns(cost.percentile(0.99));
+    info.set_cost_max_ns(cost.max);
+    info.set_isa(to_string(m_validator->kernels().isa));
+    publish(std::move(info));
   }
+
+private:
+  bool m_validate = true;
+  std::unique_ptr<FragmentValidator> m_validator;
 };
 
 } // namespace fdreadoutmodules
@@ -1,5 +1,5 @@
 /**
- * @file TimeSyncConsumer.cpp Module that consumes TimeSync's from a queue
+ * @file TimeSyncConsumer.cpp Module that monitors the TimeSync's of the data handlers
  *
  * This is part of the DUNE DAQ , copyright 2020.
  * Licensing/copyright details are in the COPYING file that you should have
@@ -10,4 +10,77 @@
 #include "DummyConsumer.cpp"
 #include "dfmessages/TimeSync.hpp"
 
-DEFINE_DUNE_DAQ_MODULE(dunedaq::fdreadoutmodules::DummyConsumer<dunedaq::dfmessages::TimeSync>)
+#include "fdreadoutmodules/dal/TimeSyncConsumer.hpp"
+#include "fdreadoutmodules/opmon/timesync_monitor_info.pb.h"
+#include "fdreadoutmodules/utils/TimeSyncMonitor.hpp"
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+/**
+ * @brief Publishes readout lag, clock drift and jitter of every TimeSync source it receives.
+ *
+ * Readout lag is how far the newest data of a data handler trails its wall clock, the first sign
+ * of a link falling behind.
+ */
+class TimeSyncConsumer : public DummyConsumer<dfmessages::TimeSync>
+{
+public:
+  using inherited = DummyConsumer<dfmessages::TimeSync>;
+
+  explicit TimeSyncConsumer(const std::string name)
+    : DummyConsumer<dfmessages::TimeSync>(name)
+  {}
+
+  void init(std::shared_ptr<appfwk::ModuleConfiguration> cfg) override
+  {
+    inherited::init(cfg);
+    auto mdal = cfg->module<dal::TimeSyncConsumer>(get_name());
+    m_monitor =
+      std::make_unique<TimeSyncMonitor>(mdal != nullptr ? mdal->get_clock_frequency_hz() : clock_frequency_hz);
+  }
+
+  void packet_callback(dfmessages::TimeSync& packet) override
+  {
+    const int64_t now_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+    m_monitor->record(packet.source_pid,
+                      packet.daq_time,
+                      static_cast<int64_t>(packet.system_time),
+                      packet.sequence_number,
+                      now_ns);
+  }
+
+protected:
+  void generate_opmon_data() override
+  {
+    inherited::generate_opmon_data();
+    for (const auto& [source, summary] : m_monitor->summarize()) {
+      opmon::TimeSyncSourceInfo info;
+      info.set_messages(summary.messages);
+      info.set_sequence_gaps(summary.sequence_gaps);
+      info.set_lag_negative(summary.lag_negative);
+      info.set_readout_lag_us(summary.last_lag_ns / 1000.);
+      info.set_readout_lag_p50_us(summary.lag_ns.percentile(0.50) / 1000.);
+      info.set_readout_lag_p99_us(summary.lag_ns.percentile(0.99) / 1000.);
+      info.set_readout_lag_max_us(summary.lag_ns.max / 1000.);
+      info.set_delivery_delay_us(summary.delivery_delay_mean_ns / 1000.);
+      info.set_drift_ppm(summary.drift_ppm);
+      info.set_jitter_us(summary.jitter_ns / 1000.);
+      publish(std::move(info), { { "source", std::to_string(source) } });
+    }
+  }
+
+private:
+  std::unique_ptr<TimeSyncMonitor> m_monitor;
+};
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+DEFINE_DUNE_DAQ_MODULE(dunedaq::fdreadoutmodules::TimeSyncConsumer)
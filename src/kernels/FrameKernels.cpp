@@ -0,0 +1,99 @@
+/**
+ * @file FrameKernels.cpp Scalar frame kernels and run-time selection
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/kernels/FrameKernels.hpp"
+
+#include "ScalarFrameKernels.hpp"
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+namespace kernels {
+
+namespace {
+std::size_t
+count_step_violations(const char* base, std::size_t stride, std::size_t n, uint64_t step, std::size_t* first_gap)
+{
+  if (first_gap != nullptr) {
+    *first_gap = n;
+  }
+  return n < 2 ? 0 : scalar::count_step_violations(base, stride, 1, n, step, first_gap);
+}
+
+std::size_t
+count_outside_window(const char* base, std::size_t stride, std::size_t n, uint64_t begin, uint64_t end)
+{
+  return scalar::count_outside_window(base, stride, 0, n, begin, end);
+}
+
+uint64_t
+popcount_masked(const char* base, std::size_t stride, std::size_t n, uint64_t mask)
+{
+  return scalar::popcount_masked(base, stride, 0, n, mask);
+}
+
+void
+accumulate_bits(const char* base, std::size_t stride, std::size_t n, uint64_t mask, uint64_t* counts)
+{
+  scalar::accumulate_bits(base, stride, 0, n, mask, counts);
+}
+
+std::size_t
+count_decreasing(const char* base, std::size_t stride, std::size_t n)
+{
+  return n < 2 ? 0 : scalar::count_decreasing(base, stride, 1, n);
+}
+
+void
+pack_bitplanes(const uint16_t* values, unsigned width, uint64_t* planes)
+{
+  for (unsigned b = 0; b < width; ++b) {
+    planes[b] = 0;
+  }
+  scalar::pack_bitplanes(values, width, 0, planes);
+}
+
+void
+unpack_bitplanes(const uint64_t* planes, unsigned width, uint16_t* values)
+{
+  for (std::size_t i = 0; i < 64; ++i) {
+    values[i] = 0;
+  }
+  scalar::unpack_bitplanes(planes, width, 0, values);
+}
+} // namespace
+
+const FrameKernels scalar_frame_kernels{ IsaLevel::kScalar,   count_step_violations, count_outside_window,
+                                         popcount_masked,     accumulate_bits,       count_decreasing,
+                                         pack_bitplanes,      unpack_bitplanes };
+
+} // namespace kernels
+
+const FrameKernels&
+frame_kernels_for(IsaLevel level)
+{
+#ifdef WITH_ISA_DISPATCH
+  if (level >= IsaLevel::kAVX512) {
+    return kernels::avx512_frame_kernels;
+  }
+  if (level >= IsaLevel::kAVX2) {
+    return kernels::avx2_frame_kernels;
+  }
+#else
+  (void)level;
+#endif
+  return kernels::scalar_frame_kernels;
+}
+
+const FrameKernels&
+frame_kernels()
+{
+  static const FrameKernels& selected = frame_kernels_for(detect_isa_level());
+  return selected;
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
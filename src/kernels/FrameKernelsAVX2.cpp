@@ -0,0 +1,196 @@
+/**
+ * @file FrameKernelsAVX2.cpp AVX2 frame kernels, compiled with -mavx2 only for this translation unit
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/kernels/FrameKernels.hpp"
+
+#ifdef WITH_ISA_DISPATCH
+
+#include "ScalarFrameKernels.hpp"
+
+#include <immintrin.h>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+namespace kernels {
+
+namespace {
+constexpr std::size_t lanes = 4;
+
+inline __m256i
+lane_offsets(std::size_t stride)
+{
+  return _mm256_set_epi64x(static_cast<long long>(3 * stride), // NOLINT
+                           static_cast<long long>(2 * stride), // NOLINT
+                           static_cast<long long>(stride),     // NOLINT
+                           0);
+}
+
+inline __m256i
+gather(const char* base, std::size_t stride, std::size_t i, __m256i offsets)
+{
+  return _mm256_i64gather_epi64(reinterpret_cast<const long long*>(base + i * stride), offsets, 1); // NOLINT
+}
+
+inline unsigned
+lane_mask(__m256i v)
+{
+  return static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(v)));
+}
+
+std::size_t
+count_step_violations(const char* base, std::size_t stride, std::size_t n, uint64_t step, std::size_t* first_gap)
+{
+  if (first_gap != nullptr) {
+    *first_gap = n;
+  }
+  if (n < 2) {
+    return 0;
+  }
+  const __m256i offsets = lane_offsets(stride);
+  const __m256i vstep = _mm256_set1_epi64x(static_cast<long long>(step)); // NOLINT
+  std::size_t violations = 0;
+  std::size_t i = 1;
+  for (; i + lanes <= n; i += lanes) {
+    __m256i diff = _mm256_sub_epi64(gather(base, stride, i, offsets), gather(base, stride, i - 1, offsets));
+    unsigned bad = ~lane_mask(_mm256_cmpeq_epi64(diff, vstep)) & 0xF;
+    if (bad != 0) {
+      if (violations == 0 && first_gap != nullptr) {
+        *first_gap = i + static_cast<std::size_t>(__builtin_ctz(bad));
+      }
+      violations += static_cast<std::size_t>(__builtin_popcount(bad));
+    }
+  }
+  return violations + scalar::count_step_violations(base, stride, i, n, step, first_gap);
+}
+
+std::size_t
+count_outside_window(const char* base, std::size_t stride, std::size_t n, uint64_t begin, uint64_t end)
+{
+  // AVX2 only has signed 64-bit compares: flip the sign bit to compare unsigned values
+  const __m256i sign = _mm256_set1_epi64x(static_cast<long long>(0x8000000000000000ULL)); // NOLINT
+  const __m256i vbegin = _mm256_set1_epi64x(static_cast<long long>(begin ^ 0x8000000000000000ULL)); // NOLINT
+  const __m256i vend = _mm256_set1_epi64x(static_cast<long long>(end ^ 0x8000000000000000ULL));     // NOLINT
+  const __m256i offsets = lane_offsets(stride);
+  std::size_t outside = 0;
+  std::size_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    __m256i w = _mm256_xor_si256(gather(base, stride, i, offsets), sign);
+    __m256i below = _mm256_cmpgt_epi64(vbegin, w);
+    __m256i inside_end = _mm256_cmpgt_epi64(vend, w);
+    __m256i not_inside_end = _mm256_xor_si256(inside_end, _mm256_set1_epi64x(-1));
+    outside += static_cast<std::size_t>(__builtin_popcount(lane_mask(_mm256_or_si256(below, not_inside_end))));
+  }
+  return outside + scalar::count_outside_window(base, stride, i, n, begin, end);
+}
+
+uint64_t
+popcount_masked(const char* base, std::size_t stride, std::size_t n, uint64_t mask)
+{
+  const __m256i lut =
+    _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+  const __m256i vmask = _mm256_set1_epi64x(static_cast<long long>(mask)); // NOLINT
+  const __m256i offsets = lane_offsets(stride);
+  __m256i acc = _mm256_setzero_si256();
+  std::size_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    __m256i v = _mm256_and_si256(gather(base, stride, i, offsets), vmask);
+    __m256i lo = _mm256_and_si256(v, low_nibble);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble);
+    __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo), _mm256_shuffle_epi8(lut, hi));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+  }
+  alignas(32) uint64_t parts[lanes];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(parts), acc); // NOLINT
+  return parts[0] + parts[1] + parts[2] + parts[3] + scalar::popcount_masked(base, stride, i, n, mask);
+}
+
+void
+accumulate_bits(const char* base, std::size_t stride, std::size_t n, uint64_t mask, uint64_t* counts)
+{
+  // Error words are almost always zero: skip whole groups with one test
+  const __m256i vmask = _mm256_set1_epi64x(static_cast<long long>(mask)); // NOLINT
+  const __m256i offsets = lane_offsets(stride);
+  std::size_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    __m256i v = gather(base, stride, i, offsets);
+    if (!_mm256_testz_si256(v, vmask)) {
+      scalar::accumulate_bits(base, stride, i, i + lanes, mask, counts);
+    }
+  }
+  scalar::accumulate_bits(base, stride, i, n, mask, counts);
+}
+
+std::size_t
+count_decreasing(const char* base, std::size_t stride, std::size_t n)
+{
+  if (n < 2) {
+    return 0;
+  }
+  const __m256i sign = _mm256_set1_epi64x(static_cast<long long>(0x8000000000000000ULL)); // NOLINT
+  const __m256i offsets = lane_offsets(stride);
+  std::size_t decreasing = 0;
+  std::size_t i = 1;
+  for (; i + lanes <= n; i += lanes) {
+    __m256i cur = _mm256_xor_si256(gather(base, stride, i, offsets), sign);
+    __m256i prev = _mm256_xor_si256(gather(base, stride, i - 1, offsets), sign);
+    decreasing += static_cast<std::size_t>(__builtin_popcount(lane_mask(_mm256_cmpgt_epi64(prev, cur))));
+  }
+  return decreasing + scalar::count_decreasing(base, stride, i, n);
+}
+
+void
+pack_bitplanes(const uint16_t* values, unsigned width, uint64_t* planes)
+{
+  const __m256i* v = reinterpret_cast<const __m256i*>(values); // NOLINT
+  const __m256i v0 = _mm256_loadu_si256(v);
+  const __m256i v1 = _mm256_loadu_si256(v + 1);
+  const __m256i v2 = _mm256_loadu_si256(v + 2);
+  const __m256i v3 = _mm256_loadu_si256(v + 3);
+  for (unsigned b = 0; b < width; ++b) {
+    // Bit b to the sign bit of each 16-bit lane, then signed saturation keeps it in the byte lanes
+    const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(15 - b));
+    __m256i lo = _mm256_packs_epi16(_mm256_sll_epi16(v0, shift), _mm256_sll_epi16(v1, shift));
+    __m256i hi = _mm256_packs_epi16(_mm256_sll_epi16(v2, shift), _mm256_sll_epi16(v3, shift));
+    // packs interleaves the 128-bit halves of its operands
+    lo = _mm256_permute4x64_epi64(lo, 0xD8);
+    hi = _mm256_permute4x64_epi64(hi, 0xD8);
+    planes[b] = static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(lo))) |
+                (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(hi))) << 32);
+  }
+}
+
+void
+unpack_bitplanes(const uint64_t* planes, unsigned width, uint16_t* values)
+{
+  const __m256i lane_bits = _mm256_setr_epi16(
+    0x1, 0x2, 0x4, 0x8, 0x10, 0x20, 0x40, 0x80, 0x100, 0x200, 0x400, 0x800, 0x1000, 0x2000, 0x4000, -0x8000);
+  __m256i acc[4] = { _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256() };
+  for (unsigned b = 0; b < width; ++b) {
+    const __m256i bit = _mm256_set1_epi16(static_cast<short>(1U << b)); // NOLINT
+    for (unsigned k = 0; k < 4; ++k) {
+      const __m256i chunk = _mm256_set1_epi16(static_cast<short>(planes[b] >> (16 * k))); // NOLINT
+      const __m256i set = _mm256_cmpeq_epi16(_mm256_and_si256(chunk, lane_bits), lane_bits);
+      acc[k] = _mm256_or_si256(acc[k], _mm256_and_si256(set, bit));
+    }
+  }
+  __m256i* out = reinterpret_cast<__m256i*>(values); // NOLINT
+  for (unsigned k = 0; k < 4; ++k) {
+    _mm256_storeu_si256(out + k, acc[k]);
+  }
+}
+} // namespace
+
+const FrameKernels avx2_frame_kernels{ IsaLevel::kAVX2,   count_step_violations, count_outside_window,
+                                       popcount_masked,   accumulate_bits,       count_decreasing,
+                                       pack_bitplanes,    unpack_bitplanes };
+
+} // namespace kernels
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // WITH_ISA_DISPATCH
@@ -0,0 +1,182 @@
+/**
+ * @file FrameKernelsAVX512.cpp AVX-512 frame kernels, compiled with -mavx512f/bw/vl only for this translation unit
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/kernels/FrameKernels.hpp"
+
+#ifdef WITH_ISA_DISPATCH
+
+#include "ScalarFrameKernels.hpp"
+
+#include <immintrin.h>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+namespace kernels {
+
+namespace {
+constexpr std::size_t lanes = 8;
+
+inline __m512i
+lane_offsets(std::size_t stride)
+{
+  auto s = static_cast<long long>(stride); // NOLINT
+  return _mm512_set_epi64(7 * s, 6 * s, 5 * s, 4 * s, 3 * s, 2 * s, s, 0);
+}
+
+// The masked and zero-sourced forms throughout keep GCC from warning about the _mm512_undefined_* sources of
+// the plain intrinsics
+inline __m512i
+gather(const char* base, std::size_t stride, std::size_t i, __m512i offsets)
+{
+  return _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), static_cast<__mmask8>(0xff), offsets,
+                                     reinterpret_cast<const long long*>(base + i * stride), 1); // NOLINT
+}
+
+inline uint64_t
+reduce_add(__m512i v)
+{
+  alignas(64) uint64_t sums[lanes];
+  _mm512_store_si512(sums, v);
+  uint64_t total = 0;
+  for (auto sum : sums) {
+    total += sum;
+  }
+  return total;
+}
+
+std::size_t
+count_step_violations(const char* base, std::size_t stride, std::size_t n, uint64_t step, std::size_t* first_gap)
+{
+  if (first_gap != nullptr) {
+    *first_gap = n;
+  }
+  if (n < 2) {
+    return 0;
+  }
+  const __m512i offsets = lane_offsets(stride);
+  const __m512i vstep = _mm512_set1_epi64(static_cast<long long>(step)); // NOLINT
+  std::size_t violations = 0;
+  std::size_t i = 1;
+  for (; i + lanes <= n; i += lanes) {
+    __m512i diff = _mm512_sub_epi64(gather(base, stride, i, offsets), gather(base, stride, i - 1, offsets));
+    __mmask8 bad = _mm512_cmpneq_epu64_mask(diff, vstep);
+    if (bad != 0) {
+      if (violations == 0 && first_gap != nullptr) {
+        *first_gap = i + static_cast<std::size_t>(__builtin_ctz(bad));
+      }
+      violations += static_cast<std::size_t>(__builtin_popcount(bad));
+    }
+  }
+  return violations + scalar::count_step_violations(base, stride, i, n, step, first_gap);
+}
+
+std::size_t
+count_outside_window(const char* base, std::size_t stride, std::size_t n, uint64_t begin, uint64_t end)
+{
+  const __m512i vbegin = _mm512_set1_epi64(static_cast<long long>(begin)); // NOLINT
+  const __m512i vend = _mm512_set1_epi64(static_cast<long long>(end));     // NOLINT
+  const __m512i offsets = lane_offsets(stride);
+  std::size_t outside = 0;
+  std::size_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    __m512i w = gather(base, stride, i, offsets);
+    __mmask8 out = _mm512_cmplt_epu64_mask(w, vbegin) | _mm512_cmpge_epu64_mask(w, vend);
+    outside += static_cast<std::size_t>(__builtin_popcount(out));
+  }
+  return outside + scalar::count_outside_window(base, stride, i, n, begin, end);
+}
+
+uint64_t
+popcount_masked(const char* base, std::size_t stride, std::size_t n, uint64_t mask)
+{
+  // Nibble lookup with AVX512BW: VPOPCNTQ is not available on every AVX-512 host
+  const __m128i nibble_counts = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m512i lut = _mm512_maskz_broadcast_i32x4(static_cast<__mmask16>(0xffff), nibble_counts);
+  const __m512i low_nibble = _mm512_set1_epi8(0x0f);
+  const __m512i vmask = _mm512_set1_epi64(static_cast<long long>(mask)); // NOLINT
+  const __m512i offsets = lane_offsets(stride);
+  __m512i acc = _mm512_setzero_si512();
+  std::size_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    __m512i v = _mm512_and_si512(gather(base, stride, i, offsets), vmask);
+    __m512i lo = _mm512_and_si512(v, low_nibble);
+    __m512i hi = _mm512_and_si512(_mm512_srli_epi16(v, 4), low_nibble);
+    __m512i cnt = _mm512_add_epi8(_mm512_shuffle_epi8(lut, lo), _mm512_shuffle_epi8(lut, hi));
+    acc = _mm512_add_epi64(acc, _mm512_sad_epu8(cnt, _mm512_setzero_si512()));
+  }
+  return reduce_add(acc) + scalar::popcount_masked(base, stride, i, n, mask);
+}
+
+void
+accumulate_bits(const char* base, std::size_t stride, std::size_t n, uint64_t mask, uint64_t* counts)
+{
+  const __m512i vmask = _mm512_set1_epi64(static_cast<long long>(mask)); // NOLINT
+  const __m512i offsets = lane_offsets(stride);
+  std::size_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    __mmask8 flagged = _mm512_test_epi64_mask(gather(base, stride, i, offsets), vmask);
+    while (flagged != 0) {
+      std::size_t lane = static_cast<std::size_t>(__builtin_ctz(flagged));
+      scalar::accumulate_bits(base, stride, i + lane, i + lane + 1, mask, counts);
+      flagged = static_cast<__mmask8>(flagged & (flagged - 1));
+    }
+  }
+  scalar::accumulate_bits(base, stride, i, n, mask, counts);
+}
+
+std::size_t
+count_decreasing(const char* base, std::size_t stride, std::size_t n)
+{
+  if (n < 2) {
+    return 0;
+  }
+  const __m512i offsets = lane_offsets(stride);
+  std::size_t decreasing = 0;
+  std::size_t i = 1;
+  for (; i + lanes <= n; i += lanes) {
+    __mmask8 down = _mm512_cmplt_epu64_mask(gather(base, stride, i, offsets), gather(base, stride, i - 1, offsets));
+    decreasing += static_cast<std::size_t>(__builtin_popcount(down));
+  }
+  return decreasing + scalar::count_decreasing(base, stride, i, n);
+}
+
+void
+pack_bitplanes(const uint16_t* values, unsigned width, uint64_t* planes)
+{
+  const __m512i lo = _mm512_loadu_si512(values);
+  const __m512i hi = _mm512_loadu_si512(values + 32);
+  for (unsigned b = 0; b < width; ++b) {
+    const __m512i bit = _mm512_set1_epi16(static_cast<short>(1U << b)); // NOLINT
+    planes[b] = static_cast<uint64_t>(_mm512_test_epi16_mask(lo, bit)) |
+                (static_cast<uint64_t>(_mm512_test_epi16_mask(hi, bit)) << 32);
+  }
+}
+
+void
+unpack_bitplanes(const uint64_t* planes, unsigned width, uint16_t* values)
+{
+  __m512i lo = _mm512_setzero_si512();
+  __m512i hi = _mm512_setzero_si512();
+  for (unsigned b = 0; b < width; ++b) {
+    const __m512i bit = _mm512_set1_epi16(static_cast<short>(1U << b)); // NOLINT
+    lo = _mm512_mask_mov_epi16(lo, static_cast<__mmask32>(planes[b]), _mm512_or_si512(lo, bit));
+    hi = _mm512_mask_mov_epi16(hi, static_cast<__mmask32>(planes[b] >> 32), _mm512_or_si512(hi, bit));
+  }
+  _mm512_storeu_si512(values, lo);
+  _mm512_storeu_si512(values + 32, hi);
+}
+} // namespace
+
+const FrameKernels avx512_frame_kernels{ IsaLevel::kAVX512, count_step_violations, count_outside_window,
+                                         popcount_masked,   accumulate_bits,       count_decreasing,
+                                         pack_bitplanes,    unpack_bitplanes };
+
+} // namespace kernels
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // WITH_ISA_DISPATCH
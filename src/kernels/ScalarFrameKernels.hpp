@@ -0,0 +1,125 @@
+/**
+ * @file ScalarFrameKernels.hpp Portable frame kernels, also used for the tails of the vector variants
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FDREADOUTMODULES_SRC_KERNELS_SCALARFRAMEKERNELS_HPP_
+#define FDREADOUTMODULES_SRC_KERNELS_SCALARFRAMEKERNELS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+namespace kernels {
+namespace scalar {
+
+inline uint64_t
+load_word(const char* p)
+{
+  uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// Frames [from, n), comparing frame i with frame i-1; from >= 1
+inline std::size_t
+count_step_violations(const char* base, std::size_t stride, std::size_t from, std::size_t n, uint64_t step,
+                      std::size_t* first_gap)
+{
+  std::size_t violations = 0;
+  uint64_t prev = load_word(base + (from - 1) * stride);
+  for (std::size_t i = from; i < n; ++i) {
+    uint64_t cur = load_word(base + i * stride);
+    if (cur - prev != step) {
+      if (violations++ == 0 && first_gap != nullptr && *first_gap > i) {
+        *first_gap = i;
+      }
+    }
+    prev = cur;
+  }
+  return violations;
+}
+
+inline std::size_t
+count_outside_window(const char* base, std::size_t stride, std::size_t from, std::size_t n, uint64_t begin,
+                     uint64_t end)
+{
+  std::size_t outside = 0;
+  for (std::size_t i = from; i < n; ++i) {
+    uint64_t w = load_word(base + i * stride);
+    outside += (w < begin || w >= end) ? 1 : 0;
+  }
+  return outside;
+}
+
+inline uint64_t
+popcount_masked(const char* base, std::size_t stride, std::size_t from, std::size_t n, uint64_t mask)
+{
+  uint64_t bits = 0;
+  for (std::size_t i = from; i < n; ++i) {
+    bits += static_cast<uint64_t>(__builtin_popcountll(load_word(base + i * stride) & mask));
+  }
+  return bits;
+}
+
+inline void
+accumulate_bits(const char* base, std::size_t stride, std::size_t from, std::size_t n, uint64_t mask, uint64_t* counts)
+{
+  for (std::size_t i = from; i < n; ++i) {
+    uint64_t w = load_word(base + i * stride) & mask;
+    while (w != 0) {
+      ++counts[__builtin_ctzll(w)];
+      w &= w - 1;
+    }
+  }
+}
+
+// Frames [from, n), comparing frame i with frame i-1; from >= 1
+inline std::size_t
+count_decreasing(const char* base, std::size_t stride, std::size_t from, std::size_t n)
+{
+  std::size_t decreasing = 0;
+  uint64_t prev = load_word(base + (from - 1) * stride);
+  for (std::size_t i = from; i < n; ++i) {
+    uint64_t cur = load_word(base + i * stride);
+    decreasing += cur < prev ? 1 : 0;
+    prev = cur;
+  }
+  return decreasing;
+}
+
+// Values [from, 64) of each plane
+inline void
+pack_bitplanes(const uint16_t* values, unsigned width, std::size_t from, uint64_t* planes)
+{
+  for (unsigned b = 0; b < width; ++b) {
+    uint64_t plane = 0;
+    for (std::size_t i = from; i < 64; ++i) {
+      plane |= static_cast<uint64_t>((values[i] >> b) & 1U) << i;
+    }
+    planes[b] |= plane;
+  }
+}
+
+// Values [from, 64), which must be zero on entry
+inline void
+unpack_bitplanes(const uint64_t* planes, unsigned width, std::size_t from, uint16_t* values)
+{
+  for (unsigned b = 0; b < width; ++b) {
+    const uint64_t plane = planes[b];
+    for (std::size_t i = from; i < 64; ++i) {
+      values[i] |= static_cast<uint16_t>(((plane >> i) & 1U) << b);
+    }
+  }
+}
+
+} // namespace scalar
+} // namespace kernels
+} // namespace fdreadoutmodules
+} // namespace dunedaq
+
+#endif // FDREADOUTMODULES_SRC_KERNELS_SCALARFRAMEKERNELS_HPP_
@@ -0,0 +1,58 @@
+/**
+ * @file CpuFeatures.cpp Run-time ISA detection
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/utils/CpuFeatures.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+IsaLevel
+host_isa_level()
+{
+  IsaLevel level = IsaLevel::kScalar;
+#if defined(__x86_64__) && defined(WITH_ISA_DISPATCH)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("popcnt")) {
+    level = IsaLevel::kAVX2;
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl")) {
+      level = IsaLevel::kAVX512;
+    }
+  }
+#endif
+  return level;
+}
+
+IsaLevel
+detect_isa_level()
+{
+  IsaLevel level = host_isa_level();
+  if (const char* cap = std::getenv("FDREADOUTMODULES_MAX_ISA")) {
+    std::string value(cap);
+    IsaLevel max_level = value == "scalar" ? IsaLevel::kScalar : value == "avx2" ? IsaLevel::kAVX2 : IsaLevel::kAVX512;
+    level = std::min(level, max_level);
+  }
+  return level;
+}
+
+std::string
+to_string(IsaLevel level)
+{
+  switch (level) {
+    case IsaLevel::kAVX2:
+      return "avx2";
+    case IsaLevel::kAVX512:
+      return "avx512";
+    default:
+      return "scalar";
+  }
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
@@ -0,0 +1,116 @@
+/**
+ * @file FragmentCache.cpp FragmentCache implementation
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/utils/FragmentCache.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace {
+// Windows remembered for admission, per cache entry
+constexpr std::size_t kRecentPerEntry = 4;
+} // namespace
+
+void
+FragmentCache::configure(std::size_t max_entries, std::size_t max_bytes)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_max_entries = max_entries;
+  m_max_bytes = max_bytes;
+  m_slots.clear();
+  m_recent.assign(max_entries * kRecentPerEntry, Window{ 0, 0 });
+  m_recent_next = 0;
+  m_stats.entries = 0;
+  m_stats.bytes = 0;
+}
+
+void
+FragmentCache::clear()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_slots.clear();
+  std::fill(m_recent.begin(), m_recent.end(), Window{ 0, 0 });
+  m_stats.entries = 0;
+  m_stats.bytes = 0;
+}
+
+std::shared_ptr<const FragmentCache::Entry>
+FragmentCache::find(uint64_t begin, uint64_t end)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  ++m_stats.lookups;
+  for (auto& slot : m_slots) {
+    if (slot.entry->begin <= begin && end <= slot.entry->end) {
+      slot.last_use = ++m_clock;
+      ++(slot.entry->begin == begin && slot.entry->end == end ? m_stats.exact_hits : m_stats.contained_hits);
+      return slot.entry;
+    }
+  }
+  return nullptr;
+}
+
+bool
+FragmentCache::admit(uint64_t begin, uint64_t end, uint64_t& merged_begin, uint64_t& merged_end)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  merged_begin = begin;
+  merged_end = end;
+  if (m_recent.empty()) {
+    return false;
+  }
+  bool overlap = false;
+  for (const auto& window : m_recent) {
+    if (window.begin < end && begin < window.end) {
+      merged_begin = std::min(merged_begin, window.begin);
+      merged_end = std::max(merged_end, window.end);
+      overlap = true;
+    }
+  }
+  m_recent[m_recent_next] = Window{ begin, end };
+  m_recent_next = (m_recent_next + 1) % m_recent.size();
+  if (overlap && (merged_begin != begin || merged_end != end)) {
+    ++m_stats.merged;
+  }
+  return overlap;
+}
+
+void
+FragmentCache::insert(std::shared_ptr<const Entry> entry)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const std::size_t size = entry->payload.size();
+  if (m_max_entries == 0 || size > m_max_bytes) {
+    return;
+  }
+  while (!m_slots.empty() && (m_slots.size() == m_max_entries || m_stats.bytes + size > m_max_bytes)) {
+    auto oldest = std::min_element(
+      m_slots.begin(), m_slots.end(), [](const Slot& a, const Slot& b) { return a.last_use < b.last_use; });
+    m_stats.bytes -= oldest->entry->payload.size();
+    *oldest = std::move(m_slots.back());
+    m_slots.pop_back();
+    ++m_stats.evictions;
+  }
+  m_stats.bytes += size;
+  m_slots.push_back(Slot{ std::move(entry), ++m_clock });
+  m_stats.entries = m_slots.size();
+  ++m_stats.insertions;
+}
+
+FragmentCache::Stats
+FragmentCache::stats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Stats stats = m_stats;
+  stats.entries = m_slots.size();
+  return stats;
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
@@ -0,0 +1,118 @@
+/**
+ * @file FragmentValidator.cpp FragmentValidator implementation
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/utils/FragmentValidator.hpp"
+
+#include "fdreadoutmodules/utils/RatePacer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace {
+
+// a / b rounded towards minus infinity, b > 0
+int64_t
+floor_div(int64_t a, int64_t b)
+{
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// Timestamps congruent to residue modulo step in [lo, hi)
+uint64_t
+grid_points(int64_t lo, int64_t hi, int64_t residue, int64_t step)
+{
+  if (hi <= lo) {
+    return 0;
+  }
+  return static_cast<uint64_t>(floor_div(hi - 1 - residue, step) - floor_div(lo - 1 - residue, step));
+}
+
+} // namespace
+
+FragmentValidator::FragmentValidator(uint32_t sample_every)
+  : m_kernels(frame_kernels())
+  , m_sample_every(std::max<uint32_t>(sample_every, 1))
+{
+  TscClock::calibrate();
+}
+
+void
+FragmentValidator::validate(const daqdataformats::Fragment& fragment)
+{
+  if (m_seen++ % m_sample_every != 0) {
+    m_counters.fragments_skipped.add();
+    return;
+  }
+  const int64_t start = TscClock::now_ns();
+  const FrameLayout* layout = find_frame_layout(fragment.get_header().fragment_type);
+  if (layout == nullptr) {
+    m_counters.unknown_type.add();
+  } else {
+    check(fragment, *layout);
+  }
+  m_counters.fragments_validated.add();
+  m_cost_ns.record(static_cast<uint64_t>(std::max<int64_t>(TscClock::now_ns() - start, 0)));
+}
+
+void
+FragmentValidator::check(const daqdataformats::Fragment& fragment, const FrameLayout& layout)
+{
+  const auto& header = fragment.get_header();
+  const std::size_t payload = fragment.get_size() - sizeof(daqdataformats::FragmentHeader);
+  if (header.error_bits != 0) {
+    m_counters.incomplete_fragments.add();
+  }
+  if (payload == 0) {
+    m_counters.empty_fragments.add();
+    return;
+  }
+  if (payload % layout.frame_size != 0) {
+    m_counters.size_mismatches.add();
+  }
+  const std::size_t n = payload / layout.frame_size;
+  const char* frames = static_cast<const char*>(fragment.get_data());
+  const char* ts_base = frames + layout.timestamp_offset;
+  m_counters.frames_checked.add(n);
+
+  // A frame belongs to the window if the ticks it covers overlap it
+  const uint64_t begin = header.window_begin;
+  const uint64_t end = header.window_end;
+  const uint64_t lo = begin > layout.tick_step ? begin - layout.tick_step + 1 : 0;
+  m_counters.frames_outside_window.add(m_kernels.count_outside_window(ts_base, layout.frame_size, n, lo, end));
+  m_counters.timestamp_reversals.add(m_kernels.count_decreasing(ts_base, layout.frame_size, n));
+
+  if (layout.fixed_step && layout.tick_step > 0) {
+    std::size_t first_gap = n;
+    m_counters.timestamp_gaps.add(
+      m_kernels.count_step_violations(ts_base, layout.frame_size, n, layout.tick_step, &first_gap));
+
+    if (header.error_bits == 0 && end > begin) {
+      // Frames on the grid of the first frame: at least those starting inside the window, at most
+      // those overlapping it
+      uint64_t first_ts = 0;
+      std::memcpy(&first_ts, ts_base, sizeof(first_ts));
+      const auto step = static_cast<int64_t>(layout.tick_step);
+      const auto residue = static_cast<int64_t>(first_ts % layout.tick_step);
+      const uint64_t min_frames =
+        grid_points(static_cast<int64_t>(begin), static_cast<int64_t>(end), residue, step);
+      const uint64_t max_frames = grid_points(static_cast<int64_t>(lo), static_cast<int64_t>(end), residue, step);
+      if (n < min_frames || n > max_frames) {
+        m_counters.frame_count_mismatches.add();
+      }
+    }
+  }
+  if (layout.error_mask != 0) {
+    m_counters.frame_error_bits.add(
+      m_kernels.popcount_masked(frames + layout.error_offset, layout.frame_size, n, layout.error_mask));
+  }
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
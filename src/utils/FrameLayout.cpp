@@ -0,0 +1,160 @@
+/**
+ * @file FrameLayout.cpp Frame layouts of the far detector formats
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/utils/FrameLayout.hpp"
+
+#include "fdreadoutlibs/DAPHNEStreamSuperChunkTypeAdapter.hpp"
+#include "fdreadoutlibs/DAPHNESuperChunkTypeAdapter.hpp"
+#include "fdreadoutlibs/DUNEWIBEthTypeAdapter.hpp"
+#include "fdreadoutlibs/TDEEthTypeAdapter.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace {
+
+//! A zeroed frame the setter has been applied to
+template<class Frame, class Setter>
+std::vector<uint64_t>
+apply_to_zero(Setter&& setter)
+{
+  std::vector<uint64_t> storage((sizeof(Frame) + 7) / 8, 0);
+  setter(*reinterpret_cast<Frame*>(storage.data())); // NOLINT
+  return storage;
+}
+
+//! Finds the 64-bit word the setter writes to; false if it writes outside a single word
+template<class Frame, class Setter>
+bool
+locate_word(Setter&& setter, std::size_t& offset, uint64_t& mask)
+{
+  auto storage = apply_to_zero<Frame>(setter);
+  const auto* bytes = reinterpret_cast<const unsigned char*>(storage.data()); // NOLINT
+  std::size_t first = sizeof(Frame);
+  std::size_t last = 0;
+  for (std::size_t i = 0; i < sizeof(Frame); ++i) {
+    if (bytes[i] != 0) {
+      first = std::min(first, i);
+      last = i;
+    }
+  }
+  if (first == sizeof(Frame) || sizeof(Frame) < sizeof(uint64_t)) {
+    return false;
+  }
+  offset = std::min(first, sizeof(Frame) - sizeof(uint64_t));
+  if (last >= offset + sizeof(uint64_t)) {
+    return false;
+  }
+  std::memcpy(&mask, bytes + offset, sizeof(mask));
+  return true;
+}
+
+//! Bits the setter sets in the word at offset
+template<class Frame, class Setter>
+uint64_t
+word_mask(Setter&& setter, std::size_t offset)
+{
+  auto storage = apply_to_zero<Frame>(setter);
+  uint64_t mask = 0;
+  std::memcpy(&mask, reinterpret_cast<const unsigned char*>(storage.data()) + offset, sizeof(mask)); // NOLINT
+  return mask;
+}
+
+template<class Adapter>
+FrameLayout
+make_layout(const std::string& name, bool fixed_step)
+{
+  using frame_t = typename Adapter::FrameType;
+  FrameLayout layout;
+  layout.fragment_type = static_cast<daqdataformats::fragment_type_t>(Adapter::fragment_type);
+  layout.name = name;
+  layout.frame_size = sizeof(frame_t);
+  layout.tick_step = Adapter::expected_tick_difference;
+  layout.fixed_step = fixed_step;
+  uint64_t ts_mask = 0;
+  locate_word<frame_t>([](frame_t& f) { f.set_timestamp(std::numeric_limits<uint64_t>::max()); },
+                       layout.timestamp_offset,
+                       ts_mask);
+  return layout;
+}
+
+// Frames with a WIBEth style header carrying CRC error and loss of lock flags
+template<class Frame, class = void>
+struct has_link_error_flags : std::false_type
+{};
+
+template<class Frame>
+struct has_link_error_flags<
+  Frame,
+  std::void_t<decltype(std::declval<Frame&>().header.crc_err = 1), decltype(std::declval<Frame&>().header.lol = 1)>>
+  : std::true_type
+{};
+
+//! CRC error and loss of lock flags of the WIBEth style headers, none for other formats
+template<class Frame>
+void
+add_link_error_flags(FrameLayout& layout)
+{
+  if constexpr (has_link_error_flags<Frame>::value) {
+    auto both = [](Frame& f) {
+      f.header.crc_err = 1;
+      f.header.lol = 1;
+    };
+    if (!locate_word<Frame>(both, layout.error_offset, layout.error_mask)) {
+      layout.error_mask = 0;
+      return;
+    }
+    layout.error_flags.push_back(
+      { "crc_err", word_mask<Frame>([](Frame& f) { f.header.crc_err = 1; }, layout.error_offset) });
+    layout.error_flags.push_back({ "lol", word_mask<Frame>([](Frame& f) { f.header.lol = 1; }, layout.error_offset) });
+  }
+}
+
+} // namespace
+
+const std::vector<FrameLayout>&
+frame_layouts()
+{
+  static const std::vector<FrameLayout> s_layouts = [] {
+    std::vector<FrameLayout> v;
+    v.push_back(make_layout<fdreadoutlibs::types::DUNEWIBEthTypeAdapter>("WIBEthFrame", true));
+    add_link_error_flags<fddetdataformats::WIBEthFrame>(v.back());
+    v.push_back(make_layout<fdreadoutlibs::types::DAPHNEStreamSuperChunkTypeAdapter>("PDSStreamFrame", true));
+    // Self-triggered and per-channel data: ordered, but not evenly spaced
+    v.push_back(make_layout<fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter>("PDSFrame", false));
+    v.push_back(make_layout<fdreadoutlibs::types::TDEEthTypeAdapter>("TDEEthFrame", false));
+    add_link_error_flags<fddetdataformats::TDEEthFrame>(v.back());
+    return v;
+  }();
+  return s_layouts;
+}
+
+const FrameLayout*
+find_frame_layout(daqdataformats::fragment_type_t fragment_type)
+{
+  const auto& all = frame_layouts();
+  auto it = std::find_if(
+    all.begin(), all.end(), [fragment_type](const FrameLayout& l) { return l.fragment_type == fragment_type; });
+  return it == all.end() ? nullptr : &*it;
+}
+
+const FrameLayout*
+find_frame_layout(const std::string& name)
+{
+  const auto& all = frame_layouts();
+  auto it = std::find_if(all.begin(), all.end(), [&name](const FrameLayout& l) { return l.name == name; });
+  return it == all.end() ? nullptr : &*it;
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
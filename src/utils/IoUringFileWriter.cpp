@@ -0,0 +1,279 @@
+/**
+ * @file IoUringFileWriter.cpp IoUringFileWriter implementation
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/utils/IoUringFileWriter.hpp"
+#include "fdreadoutmodules/FDReadoutModulesIssues.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+
+#ifdef WITH_LIBURING_SUPPORT
+#include <liburing.h>
+#else
+struct io_uring
+{};
+#endif
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace {
+
+//! Submissions refused for lack of kernel resources are retried this many times before giving up
+constexpr int max_submit_retries = 100;
+
+} // namespace
+
+IoUringFileWriter::IoUringFileWriter() = default;
+
+IoUringFileWriter::~IoUringFileWriter()
+{
+  if (is_open()) {
+    try {
+      close();
+    } catch (const ers::Issue& excpt) {
+      ers::error(excpt);
+    }
+  }
+}
+
+#ifdef WITH_LIBURING_SUPPORT
+
+void
+IoUringFileWriter::open(const std::string& filename, std::size_t buffer_size, unsigned queue_depth, bool use_o_direct)
+{
+  if (is_open()) {
+    close();
+  }
+  m_filename = filename;
+  m_buffer_size = std::max(alignment, (buffer_size + alignment - 1) / alignment * alignment);
+  queue_depth = std::max(2u, queue_depth);
+
+  m_open_flags = O_CREAT | O_WRONLY | O_TRUNC | (use_o_direct ? O_DIRECT : 0);
+  m_fd = ::open(filename.c_str(), m_open_flags, 0644);
+  if (m_fd < 0) {
+    throw AsyncWriterError(ERS_HERE, filename, std::string("open failed: ") + std::strerror(errno));
+  }
+
+  m_ring = std::make_unique<io_uring>();
+  int ret = io_uring_queue_init(queue_depth, m_ring.get(), 0);
+  if (ret < 0) {
+    ::close(m_fd);
+    m_fd = -1;
+    throw AsyncWriterError(ERS_HERE, filename, std::string("io_uring_queue_init failed: ") + std::strerror(-ret));
+  }
+
+  m_buffers.resize(queue_depth);
+  m_free.clear();
+  for (unsigned i = 0; i < queue_depth; ++i) {
+    m_buffers[i].data = static_cast<char*>(std::aligned_alloc(alignment, m_buffer_size));
+    if (m_buffers[i].data == nullptr) {
+      release_buffers();
+      throw AsyncWriterError(ERS_HERE, filename, "cannot allocate staging buffers");
+    }
+    m_buffers[i].fill = 0;
+    m_free.push_back(i);
+  }
+  m_file_offset = 0;
+  m_submit_failed = false;
+  m_bytes_written = 0;
+  m_inflight = 0;
+  m_stalls = 0;
+  m_errors = 0;
+  acquire_buffer();
+}
+
+bool
+IoUringFileWriter::write(const char* data, std::size_t size)
+{
+  while (size > 0) {
+    Buffer& buf = m_buffers[m_current];
+    std::size_t chunk = std::min(size, m_buffer_size - buf.fill);
+    std::memcpy(buf.data + buf.fill, data, chunk);
+    buf.fill += chunk;
+    data += chunk;
+    size -= chunk;
+    if (buf.fill == m_buffer_size) {
+      submit(m_current, m_buffer_size);
+      acquire_buffer();
+    }
+  }
+  return m_errors.load(std::memory_order_relaxed) == 0;
+}
+
+void
+IoUringFileWriter::submit(unsigned index, std::size_t size)
+{
+  Buffer& buf = m_buffers[index];
+  if (m_submit_failed) {
+    // Nothing is queued behind a refused write: the rest of the file is lost
+    m_errors.fetch_add(1, std::memory_order_relaxed);
+    buf.fill = 0;
+    m_free.push_back(index);
+    return;
+  }
+  io_uring_sqe* sqe = io_uring_get_sqe(m_ring.get());
+  while (sqe == nullptr) {
+    // The submission queue is sized to the number of buffers, so a completion frees a slot
+    reap(true);
+    sqe = io_uring_get_sqe(m_ring.get());
+  }
+  buf.submitted = size;
+  io_uring_prep_write(sqe, m_fd, buf.data, static_cast<unsigned>(size), m_file_offset);
+  io_uring_sqe_set_data64(sqe, index);
+  int ret = io_uring_submit(m_ring.get());
+  for (int attempt = 0; (ret == -EAGAIN || ret == -EBUSY) && attempt < max_submit_retries; ++attempt) {
+    // Short of kernel resources: the write stays in the submission queue until a completion or a moment later
+    if (m_inflight.load(std::memory_order_relaxed) > 0) {
+      reap(true);
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ret = io_uring_submit(m_ring.get());
+  }
+  if (ret < 0) {
+    // Nothing will complete for this buffer: take it back, so that close() does not wait for it
+    m_submit_failed = true;
+    m_errors.fetch_add(1, std::memory_order_relaxed);
+    ers::error(AsyncWriterError(ERS_HERE, m_filename, std::string("io_uring_submit failed: ") + std::strerror(-ret)));
+    buf.fill = 0;
+    buf.submitted = 0;
+    m_free.push_back(index);
+    return;
+  }
+  m_file_offset += size;
+  m_inflight.fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+IoUringFileWriter::reap(bool wait)
+{
+  io_uring_cqe* cqe = nullptr;
+  int ret = wait ? io_uring_wait_cqe(m_ring.get(), &cqe) : io_uring_peek_cqe(m_ring.get(), &cqe);
+  while (ret == 0 && cqe != nullptr) {
+    auto index = static_cast<unsigned>(io_uring_cqe_get_data64(cqe));
+    Buffer& buf = m_buffers[index];
+    if (cqe->res < 0 || static_cast<std::size_t>(cqe->res) != buf.submitted) {
+      m_errors.fetch_add(1, std::memory_order_relaxed);
+      ers::error(AsyncWriterError(ERS_HERE,
+                                  m_filename,
+                                  cqe->res < 0 ? std::string("write failed: ") + std::strerror(-cqe->res)
+                                               : std::string("short write")));
+    } else {
+      m_bytes_written.fetch_add(buf.submitted, std::memory_order_relaxed);
+    }
+    buf.fill = 0;
+    buf.submitted = 0;
+    m_free.push_back(index);
+    m_inflight.fetch_sub(1, std::memory_order_relaxed);
+    io_uring_cqe_seen(m_ring.get(), cqe);
+    cqe = nullptr;
+    ret = io_uring_peek_cqe(m_ring.get(), &cqe);
+  }
+}
+
+void
+IoUringFileWriter::acquire_buffer()
+{
+  reap(false);
+  if (m_free.empty()) {
+    m_stalls.fetch_add(1, std::memory_order_relaxed);
+    while (m_free.empty()) {
+      reap(true);
+    }
+  }
+  m_current = m_free.back();
+  m_free.pop_back();
+}
+
+void
+IoUringFileWriter::close()
+{
+  if (!is_open()) {
+    return;
+  }
+  Buffer& buf = m_buffers[m_current];
+  const std::size_t aligned = buf.fill / alignment * alignment;
+  const std::size_t tail = buf.fill - aligned;
+  const uint64_t tail_offset = m_file_offset + aligned;
+  if (aligned > 0) {
+    submit(m_current, aligned);
+  }
+  while (m_inflight.load(std::memory_order_relaxed) > 0) {
+    reap(true);
+  }
+
+  // The unaligned tail cannot go through O_DIRECT
+  if (tail > 0 && !m_submit_failed) {
+    if ((m_open_flags & O_DIRECT) != 0) {
+      fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+    }
+    if (::pwrite(m_fd, buf.data + aligned, tail, static_cast<off_t>(tail_offset)) != static_cast<ssize_t>(tail)) {
+      m_errors.fetch_add(1, std::memory_order_relaxed);
+      ers::error(AsyncWriterError(ERS_HERE, m_filename, "failed to write the unaligned tail"));
+    } else {
+      m_bytes_written.fetch_add(tail, std::memory_order_relaxed);
+    }
+  }
+
+  io_uring_queue_exit(m_ring.get());
+  ::close(m_fd);
+  m_fd = -1;
+  release_buffers();
+}
+
+#else
+
+void
+IoUringFileWriter::open(const std::string& filename, std::size_t, unsigned, bool)
+{
+  throw AsyncWriterNotSupported(ERS_HERE, filename);
+}
+
+bool
+IoUringFileWriter::write(const char*, std::size_t)
+{
+  return false;
+}
+
+void
+IoUringFileWriter::close()
+{}
+
+void
+IoUringFileWriter::submit(unsigned, std::size_t)
+{}
+
+void
+IoUringFileWriter::reap(bool)
+{}
+
+void
+IoUringFileWriter::acquire_buffer()
+{}
+
+#endif // WITH_LIBURING_SUPPORT
+
+void
+IoUringFileWriter::release_buffers()
+{
+  for (auto& buf : m_buffers) {
+    std::free(buf.data);
+  }
+  m_buffers.clear();
+  m_free.clear();
+  m_ring.reset();
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
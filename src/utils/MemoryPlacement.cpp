@@ -0,0 +1,274 @@
+/**
+ * @file MemoryPlacement.cpp Huge page backing, NUMA binding and prefaulting of large buffers
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/utils/MemoryPlacement.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef WITH_LIBNUMA_SUPPORT
+#include <numa.h>
+#include <numaif.h>
+#endif
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace {
+constexpr std::size_t s_2m = std::size_t(1) << 21;
+constexpr std::size_t s_1g = std::size_t(1) << 30;
+
+std::size_t
+base_page_size()
+{
+  return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+} // namespace
+
+PageBacking
+parse_page_backing(const std::string& name)
+{
+  if (name == "Default") {
+    return PageBacking::kDefault;
+  }
+  if (name == "Transparent") {
+    return PageBacking::kTransparent;
+  }
+  if (name == "HugeTLB2M") {
+    return PageBacking::kHugeTLB2M;
+  }
+  if (name == "HugeTLB1G") {
+    return PageBacking::kHugeTLB1G;
+  }
+  throw std::invalid_argument("Unknown page backing " + name);
+}
+
+std::string
+to_string(PageBacking backing)
+{
+  switch (backing) {
+    case PageBacking::kTransparent:
+      return "Transparent";
+    case PageBacking::kHugeTLB2M:
+      return "HugeTLB2M";
+    case PageBacking::kHugeTLB1G:
+      return "HugeTLB1G";
+    default:
+      return "Default";
+  }
+}
+
+bool
+HugePageRegion::map(std::size_t bytes, PageBacking backing, int numa_node)
+{
+  unmap();
+  if (backing != PageBacking::kHugeTLB2M && backing != PageBacking::kHugeTLB1G) {
+    return false;
+  }
+  const std::size_t page_size = backing == PageBacking::kHugeTLB1G ? s_1g : s_2m;
+  const int size_flag = (backing == PageBacking::kHugeTLB1G ? 30 : 21) << MAP_HUGE_SHIFT;
+  const std::size_t size = (bytes + page_size - 1) / page_size * page_size;
+
+  void* data =
+    mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | size_flag, -1, 0);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  m_data = data;
+  m_size = size;
+  m_page_size = page_size;
+  // Binding must precede the first touch: hugetlb pages are not migrated afterwards
+  bind_to_numa_node(m_data, m_size, numa_node);
+  return true;
+}
+
+void
+HugePageRegion::unmap()
+{
+  if (m_data != nullptr) {
+    munmap(m_data, m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+  m_page_size = 0;
+}
+
+void
+advise_transparent_huge_pages(void* data, std::size_t bytes)
+{
+  auto begin = (reinterpret_cast<uintptr_t>(data) + s_2m - 1) & ~(s_2m - 1);
+  auto end = (reinterpret_cast<uintptr_t>(data) + bytes) & ~(s_2m - 1);
+  if (end > begin) {
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE); // NOLINT
+  }
+}
+
+void
+bind_to_numa_node(void* data, std::size_t bytes, int numa_node)
+{
+#ifdef WITH_LIBNUMA_SUPPORT
+  if (numa_node < 0 || numa_available() < 0 || numa_node > numa_max_node()) {
+    return;
+  }
+  const std::size_t page = base_page_size();
+  auto begin = reinterpret_cast<uintptr_t>(data) & ~(page - 1);
+  auto end = reinterpret_cast<uintptr_t>(data) + bytes;
+  unsigned long nodemask[16] = {}; // NOLINT
+  nodemask[numa_node / (8 * sizeof(unsigned long))] |= 1UL << (numa_node % (8 * sizeof(unsigned long))); // NOLINT
+  mbind(reinterpret_cast<void*>(begin), end - begin, MPOL_BIND, nodemask, 8 * sizeof(nodemask), MPOL_MF_MOVE); // NOLINT
+#else
+  (void)data;
+  (void)bytes;
+  (void)numa_node;
+#endif
+}
+
+void
+prefault_pages(void* data, std::size_t bytes, std::size_t page_size)
+{
+  if (page_size == 0) {
+    page_size = base_page_size();
+  }
+  // Writes, not reads: a read fault would only map the shared zero page
+  volatile char* bytes_ptr = static_cast<volatile char*>(data);
+  for (std::size_t offset = 0; offset < bytes; offset += page_size) {
+    bytes_ptr[offset] = bytes_ptr[offset];
+  }
+  if (bytes > 0) {
+    bytes_ptr[bytes - 1] = bytes_ptr[bytes - 1];
+  }
+}
+
+namespace {
+thread_local std::vector<std::function<void()>>* t_deferred_steps = nullptr;
+} // namespace
+
+void
+prepare_memory(std::function<void()> step)
+{
+  if (t_deferred_steps != nullptr) {
+    t_deferred_steps->push_back(std::move(step));
+  } else {
+    step();
+  }
+}
+
+std::vector<std::function<void()>>
+defer_memory_preparation(const std::function<void()>& configure)
+{
+  std::vector<std::function<void()>> steps;
+  struct Collect
+  {
+    std::vector<std::function<void()>>* outer;
+    ~Collect() { t_deferred_steps = outer; }
+  } collect{ t_deferred_steps };
+  t_deferred_steps = &steps;
+  configure();
+  return steps;
+}
+
+std::size_t
+release_pages(void* data, std::size_t bytes, std::size_t page_size)
+{
+  if (page_size == 0) {
+    page_size = base_page_size();
+  }
+  auto begin = (reinterpret_cast<uintptr_t>(data) + page_size - 1) & ~(page_size - 1);
+  auto end = (reinterpret_cast<uintptr_t>(data) + bytes) & ~(page_size - 1);
+  if (end <= begin || madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED) != 0) { // NOLINT
+    return 0;
+  }
+  return end - begin;
+}
+
+MemoryPlacement
+query_memory_placement(const void* data, std::size_t bytes, int requested_node, std::size_t max_samples)
+{
+  MemoryPlacement placement;
+  placement.requested_node = requested_node;
+  placement.bytes = bytes;
+  if (data == nullptr || bytes == 0) {
+    return placement;
+  }
+
+#ifdef WITH_LIBNUMA_SUPPORT
+  if (numa_available() >= 0 && max_samples > 0) {
+    const std::size_t page = base_page_size();
+    const std::size_t pages = (bytes + page - 1) / page;
+    const std::size_t samples = std::min(pages, max_samples);
+    std::vector<void*> addresses(samples);
+    std::vector<int> status(samples, -1);
+    for (std::size_t i = 0; i < samples; ++i) {
+      std::size_t page_index = i * pages / samples;
+      const uintptr_t address = reinterpret_cast<uintptr_t>(data) + page_index * page; // NOLINT
+      addresses[i] = reinterpret_cast<void*>(address & ~(page - 1));                     // NOLINT
+    }
+    if (move_pages(0, samples, addresses.data(), nullptr, status.data(), 0) == 0) {
+      std::map<int, std::size_t> per_node;
+      for (int node : status) {
+        if (node >= 0) {
+          ++per_node[node];
+        }
+      }
+      std::size_t best = 0;
+      for (auto& [node, count] : per_node) {
+        if (count > best) {
+          best = count;
+          placement.majority_node = node;
+        }
+      }
+      int reference = requested_node >= 0 ? requested_node : placement.majority_node;
+      placement.local_fraction = static_cast<double>(per_node[reference]) / static_cast<double>(samples);
+    }
+  }
+#else
+  (void)max_samples;
+#endif
+
+  // Sum huge page usage of every mapping that overlaps the buffer
+  auto begin = reinterpret_cast<uintptr_t>(data);
+  auto end = begin + bytes;
+  std::ifstream smaps("/proc/self/smaps");
+  std::string line;
+  bool overlaps = false;
+  std::size_t huge_kb = 0;
+  while (std::getline(smaps, line)) {
+    uintptr_t vma_begin = 0;
+    uintptr_t vma_end = 0;
+    char dash = 0;
+    std::istringstream header(line);
+    if (line.find(':') > line.find(' ') && header >> std::hex >> vma_begin >> dash >> vma_end && dash == '-') {
+      overlaps = vma_begin < end && vma_end > begin;
+      continue;
+    }
+    if (!overlaps) {
+      continue;
+    }
+    for (const char* key : { "AnonHugePages:", "Private_Hugetlb:", "Shared_Hugetlb:" }) {
+      if (line.rfind(key, 0) == 0) {
+        huge_kb += std::stoull(line.substr(std::string(key).size()));
+      }
+    }
+  }
+  placement.huge_page_bytes = std::min(bytes, huge_kb * 1024);
+  return placement;
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
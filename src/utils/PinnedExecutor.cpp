@@ -0,0 +1,225 @@
+/**
+ * @file PinnedExecutor.cpp PinnedExecutor implementation
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/utils/PinnedExecutor.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#ifdef WITH_LIBNUMA_SUPPORT
+#include <numa.h>
+#endif
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace {
+
+int
+node_of_cpu(int cpu)
+{
+#ifdef WITH_LIBNUMA_SUPPORT
+  if (numa_available() >= 0) {
+    return numa_node_of_cpu(cpu);
+  }
+#endif
+  (void)cpu;
+  return -1;
+}
+
+std::vector<int>
+cpus_of_node(int node)
+{
+  std::vector<int> cpus;
+#ifdef WITH_LIBNUMA_SUPPORT
+  if (node >= 0 && numa_available() >= 0) {
+    struct bitmask* mask = numa_allocate_cpumask();
+    if (numa_node_to_cpus(node, mask) == 0) {
+      for (unsigned cpu = 0; cpu < mask->size; ++cpu) {
+        if (numa_bitmask_isbitset(mask, cpu)) {
+          cpus.push_back(static_cast<int>(cpu));
+        }
+      }
+    }
+    numa_free_cpumask(mask);
+  }
+#endif
+  (void)node;
+  return cpus;
+}
+
+} // namespace
+
+std::vector<int>
+parse_cpu_list(const std::string& list)
+{
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    range.erase(std::remove_if(range.begin(), range.end(), ::isspace), range.end());
+    if (range.empty()) {
+      continue;
+    }
+    auto dash = range.find('-');
+    std::size_t end_first = 0;
+    std::size_t end_last = 0;
+    int first = std::stoi(range.substr(0, dash), &end_first);
+    int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1), &end_last);
+    bool trailing = end_first != (dash == std::string::npos ? range.size() : dash) ||
+                    (dash != std::string::npos && end_last != range.size() - dash - 1);
+    if (first < 0 || last < first || trailing) {
+      throw std::invalid_argument("Malformed CPU range " + range);
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  return cpus;
+}
+
+void
+PinnedExecutor::start(std::size_t num_workers, std::vector<int> cpus, int numa_node, const std::string& name)
+{
+  stop();
+  if (cpus.empty()) {
+    cpus = cpus_of_node(numa_node);
+  }
+  if (num_workers == 0) {
+    num_workers = cpus.empty() ? std::max(1U, std::thread::hardware_concurrency()) : cpus.size();
+  }
+
+  m_stop = false;
+  m_workers.clear();
+  for (std::size_t i = 0; i < num_workers; ++i) {
+    auto worker = std::make_unique<Worker>();
+    if (!cpus.empty()) {
+      // A worker may run anywhere on the node of its CPU, so that inherited bindings are never a single core
+      int cpu = cpus[i % cpus.size()];
+      worker->node = node_of_cpu(cpu);
+      for (int other : cpus) {
+        if (other == cpu || (worker->node >= 0 && node_of_cpu(other) == worker->node)) {
+          worker->cpus.push_back(other);
+        }
+      }
+      if (worker->node < 0) {
+        worker->cpus = cpus;
+      }
+    }
+    m_workers.push_back(std::move(worker));
+  }
+
+  for (std::size_t i = 0; i < num_workers; ++i) {
+    m_workers[i]->thread = std::thread(&PinnedExecutor::run, this, i, name.substr(0, 12));
+  }
+}
+
+void
+PinnedExecutor::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  for (auto& worker : m_workers) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+  }
+}
+
+void
+PinnedExecutor::post(task_t task)
+{
+  if (m_workers.empty()) {
+    throw std::logic_error("PinnedExecutor::post() called before start()");
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tasks.push_back(std::move(task));
+  }
+  m_wake.notify_one();
+}
+
+void
+PinnedExecutor::post(task_t task, std::size_t worker)
+{
+  if (m_workers.empty()) {
+    throw std::logic_error("PinnedExecutor::post() called before start()");
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_workers[worker % m_workers.size()]->tasks.push_back(std::move(task));
+  }
+  // The condition variable is shared: make sure the addressed worker is among the woken ones
+  m_wake.notify_all();
+}
+
+PinnedExecutor::Stats
+PinnedExecutor::stats() const
+{
+  Stats stats;
+  stats.executed = m_executed.load(std::memory_order_relaxed);
+  stats.failed = m_failed.load(std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  stats.queued = m_tasks.size();
+  for (auto& worker : m_workers) {
+    stats.queued += worker->tasks.size();
+  }
+  return stats;
+}
+
+void
+PinnedExecutor::run(std::size_t index, const std::string& name)
+{
+  auto& self = *m_workers[index];
+  pthread_setname_np(pthread_self(), (name + "-" + std::to_string(index)).substr(0, 15).c_str());
+  if (!self.cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : self.cpus) {
+      CPU_SET(cpu, &set);
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+#ifdef WITH_LIBNUMA_SUPPORT
+  if (self.node >= 0 && numa_available() >= 0) {
+    numa_set_preferred(self.node);
+  }
+#endif
+
+  while (true) {
+    task_t task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wake.wait(lock, [&] { return m_stop || !self.tasks.empty() || !m_tasks.empty(); });
+      // Own tasks first, they cannot run anywhere else
+      auto& queue = !self.tasks.empty() ? self.tasks : m_tasks;
+      if (queue.empty()) {
+        return;
+      }
+      task = std::move(queue.front());
+      queue.pop_front();
+    }
+    try {
+      task();
+    } catch (...) {
+      m_failed.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_executed.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
@@ -0,0 +1,156 @@
+/**
+ * @file RatePacer.cpp TscClock and RatePacer implementation
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/utils/RatePacer.hpp"
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#include <chrono>
+#include <thread>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace {
+
+int64_t
+steady_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+struct TscCalibration
+{
+  bool invariant = false;
+  double ns_per_tick = 0.;
+  uint64_t tsc0 = 0;
+  int64_t ns0 = 0;
+
+  TscCalibration()
+  {
+#if defined(__x86_64__)
+    unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0 || (edx & (1U << 8)) == 0) {
+      return;
+    }
+    // 20 ms against steady_clock gives a frequency error well below 1 ppm per us of clock granularity
+    tsc0 = __rdtsc();
+    ns0 = steady_ns();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    uint64_t tsc1 = __rdtsc();
+    int64_t ns1 = steady_ns();
+    if (tsc1 > tsc0 && ns1 > ns0) {
+      ns_per_tick = static_cast<double>(ns1 - ns0) / static_cast<double>(tsc1 - tsc0);
+      invariant = true;
+    }
+#endif
+  }
+};
+
+const TscCalibration&
+calibration()
+{
+  static const TscCalibration instance;
+  return instance;
+}
+
+inline void
+cpu_relax()
+{
+#if defined(__x86_64__)
+  _mm_pause();
+#endif
+}
+
+} // namespace
+
+void
+TscClock::calibrate()
+{
+  calibration();
+}
+
+int64_t
+TscClock::now_ns()
+{
+#if defined(__x86_64__)
+  const auto& cal = calibration();
+  if (cal.invariant) {
+    return cal.ns0 + static_cast<int64_t>(static_cast<double>(__rdtsc() - cal.tsc0) * cal.ns_per_tick);
+  }
+#endif
+  return steady_ns();
+}
+
+bool
+TscClock::uses_tsc()
+{
+  return calibration().invariant;
+}
+
+uint64_t
+TscClock::ticks()
+{
+#if defined(__x86_64__)
+  if (calibration().invariant) {
+    return __rdtsc();
+  }
+#endif
+  return static_cast<uint64_t>(steady_ns());
+}
+
+double
+TscClock::ns_per_tick()
+{
+  const auto& cal = calibration();
+  return cal.invariant ? cal.ns_per_tick : 1.;
+}
+
+void
+RatePacer::start(double rate_hz, bool spin)
+{
+  m_rate_hz = rate_hz;
+  m_spin = spin;
+  m_period_ns = rate_hz > 0. ? 1e9 / rate_hz : 0.;
+  m_start_ns = TscClock::now_ns();
+  m_next_element = 0;
+  m_slips = 0;
+}
+
+int64_t
+RatePacer::wait(uint64_t n)
+{
+  const int64_t deadline = m_start_ns + static_cast<int64_t>(static_cast<double>(m_next_element) * m_period_ns);
+  m_next_element += n;
+
+  int64_t now = TscClock::now_ns();
+  const int64_t spin_window = m_spin ? spin_window_ns : 0;
+  if (deadline - now > spin_window) {
+    std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - now - spin_window));
+    now = TscClock::now_ns();
+  }
+  while (m_spin && now < deadline) {
+    cpu_relax();
+    now = TscClock::now_ns();
+  }
+
+  const int64_t lateness = now - deadline;
+  if (lateness > max_lag_ns) {
+    // Restart the schedule from here rather than sending a burst
+    m_start_ns = now;
+    m_next_element = n;
+    ++m_slips;
+  }
+  return lateness;
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
@@ -0,0 +1,163 @@
+/**
+ * @file RingSegmentWriter.cpp RingSegmentWriter implementation
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/utils/RingSegmentWriter.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <system_error>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace {
+
+std::string
+segment_name(const std::string& prefix, const std::string& tag, uint64_t sequence)
+{
+  char seq[32];
+  std::snprintf(seq, sizeof(seq), "%06llu", static_cast<unsigned long long>(sequence));
+  return prefix + '.' + tag + '.' + seq;
+}
+
+void
+remove_with_index(const std::string& filename)
+{
+  std::error_code ec;
+  std::filesystem::remove(filename, ec);
+  std::filesystem::remove(TimestampIndex::sidecar_name(filename), ec);
+}
+
+} // namespace
+
+void
+RingSegmentWriter::open(const Settings& settings)
+{
+  close();
+  m_settings = settings;
+  m_settings.max_segments = std::max(2u, settings.max_segments);
+  m_settings.segment_bytes = std::max<uint64_t>(settings.segment_bytes, settings.element_size);
+
+  // Ring segments of an earlier configuration would never be rotated out
+  std::filesystem::path prefix(m_settings.prefix);
+  auto directory = prefix.has_parent_path() ? prefix.parent_path() : std::filesystem::path(".");
+  const std::string ring_stem = prefix.filename().string() + ".ring.";
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+    if (entry.path().filename().string().compare(0, ring_stem.size(), ring_stem) == 0) {
+      std::filesystem::remove(entry.path(), ec);
+    }
+  }
+
+  m_segments.clear();
+  m_segment_fill = 0;
+  m_sequence = 0;
+  m_oldest_timestamp = 0;
+  m_newest_timestamp = 0;
+  m_segment_count = 0;
+  m_open = true;
+}
+
+bool
+RingSegmentWriter::write(const char* element, uint64_t timestamp)
+{
+  if (m_writer.is_open() && m_segment_fill + m_settings.element_size > m_settings.segment_bytes) {
+    finish_segment();
+  }
+  if (!m_writer.is_open()) {
+    start_segment(timestamp);
+  }
+  if (m_index.is_open()) {
+    m_index.add(timestamp, m_segment_fill);
+  }
+  m_segment_fill += m_settings.element_size;
+  m_bytes_accepted.fetch_add(m_settings.element_size, std::memory_order_relaxed);
+  m_newest_timestamp.store(timestamp, std::memory_order_relaxed);
+  return m_writer.write(element, m_settings.element_size);
+}
+
+std::size_t
+RingSegmentWriter::seal()
+{
+  finish_segment();
+  if (m_segments.empty()) {
+    return 0;
+  }
+  const std::string tag = "freeze." + std::to_string(m_segments.front().first_timestamp);
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < m_segments.size(); ++i) {
+    const auto& segment = m_segments[i];
+    auto frozen = segment_name(m_settings.prefix, tag, i);
+    std::error_code ec;
+    std::filesystem::rename(segment.filename, frozen, ec);
+    if (ec) {
+      TLOG() << "Could not keep ring segment " << segment.filename << ": " << ec.message();
+      continue;
+    }
+    std::filesystem::rename(TimestampIndex::sidecar_name(segment.filename), TimestampIndex::sidecar_name(frozen), ec);
+    ++kept;
+  }
+  m_segments.clear();
+  m_segment_count = 0;
+  m_oldest_timestamp = 0;
+  m_newest_timestamp = 0;
+  m_sealed_sets.fetch_add(1, std::memory_order_relaxed);
+  return kept;
+}
+
+void
+RingSegmentWriter::close()
+{
+  finish_segment();
+  m_open = false;
+}
+
+void
+RingSegmentWriter::start_segment(uint64_t timestamp)
+{
+  if (m_segments.size() == m_settings.max_segments) {
+    delete_oldest_segment();
+  }
+  auto filename = segment_name(m_settings.prefix, "ring", m_sequence++);
+  // The counters of the writer restart with every file
+  m_closed_stalls.fetch_add(m_writer.stalls(), std::memory_order_relaxed);
+  m_closed_errors.fetch_add(m_writer.errors(), std::memory_order_relaxed);
+  m_writer.open(filename, m_settings.buffer_size, m_settings.queue_depth, m_settings.use_o_direct);
+  if (m_settings.index_stride > 0) {
+    m_index.open(filename, static_cast<uint32_t>(m_settings.element_size), m_settings.index_stride);
+  }
+  m_segments.push_back({ filename, timestamp });
+  m_segment_fill = 0;
+  m_oldest_timestamp.store(m_segments.front().first_timestamp, std::memory_order_relaxed);
+  m_segment_count.store(static_cast<unsigned>(m_segments.size()), std::memory_order_relaxed);
+}
+
+void
+RingSegmentWriter::finish_segment()
+{
+  if (!m_writer.is_open()) {
+    return;
+  }
+  m_writer.close();
+  m_index.close();
+}
+
+void
+RingSegmentWriter::delete_oldest_segment()
+{
+  remove_with_index(m_segments.front().filename);
+  m_segments.pop_front();
+  if (!m_segments.empty()) {
+    m_oldest_timestamp.store(m_segments.front().first_timestamp, std::memory_order_relaxed);
+  }
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
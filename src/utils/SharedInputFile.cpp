@@ -0,0 +1,165 @@
+/**
+ * @file SharedInputFile.cpp SharedInputFile implementation
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/utils/SharedInputFile.hpp"
+
+#include "fdreadoutmodules/FDReadoutModulesIssues.hpp"
+
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace {
+
+using key_t = std::tuple<std::string, std::size_t, std::size_t, PageBacking>;
+
+//! One per file, so that files are loaded concurrently while the users of one wait for it
+struct RegistryEntry
+{
+  std::mutex mutex;
+  std::weak_ptr<const SharedInputFile> file;
+};
+
+std::mutex s_registry_mutex;
+std::map<key_t, std::shared_ptr<RegistryEntry>> s_registry;
+
+//! Closes the descriptor on every exit path of load()
+struct FileDescriptor
+{
+  int fd;
+  ~FileDescriptor()
+  {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+};
+
+bool
+read_fully(int fd, uint8_t* dst, std::size_t bytes)
+{
+  std::size_t done = 0;
+  while (done < bytes) {
+    ssize_t n = ::pread(fd, dst + done, bytes - done, static_cast<off_t>(done));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    done += static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+} // namespace
+
+std::shared_ptr<const SharedInputFile>
+SharedInputFile::open(const std::string& path, std::size_t element_size, std::size_t size_limit, PageBacking backing)
+{
+  std::shared_ptr<RegistryEntry> entry;
+  {
+    std::lock_guard<std::mutex> lk(s_registry_mutex);
+    auto& slot = s_registry[key_t{ path, element_size, size_limit, backing }];
+    if (!slot) {
+      slot = std::make_shared<RegistryEntry>();
+    }
+    entry = slot;
+  }
+  // Loading under the lock of the file makes concurrent users of the same file wait for the first one
+  std::lock_guard<std::mutex> lk(entry->mutex);
+  if (auto existing = entry->file.lock()) {
+    return existing;
+  }
+  std::shared_ptr<SharedInputFile> file(new SharedInputFile());
+  file->load(path, element_size, size_limit, backing);
+  entry->file = file;
+  return file;
+}
+
+void
+SharedInputFile::load(const std::string& path, std::size_t element_size, std::size_t size_limit, PageBacking backing)
+{
+  auto start = std::chrono::steady_clock::now();
+  FileDescriptor file{ ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+  struct stat st;
+  if (file.fd < 0 || ::fstat(file.fd, &st) != 0) {
+    throw EmulatorInputError(ERS_HERE, path, std::strerror(errno));
+  }
+  std::size_t bytes = static_cast<std::size_t>(st.st_size);
+  if (size_limit > 0 && bytes > size_limit) {
+    bytes = size_limit;
+  }
+  m_element_size = element_size > 0 ? element_size : 1;
+  bytes -= bytes % m_element_size;
+  if (bytes == 0) {
+    throw EmulatorInputError(ERS_HERE, path, "no complete element of " + std::to_string(m_element_size) + " bytes");
+  }
+
+  if (backing == PageBacking::kDefault) {
+    // Page cache pages, shared with every other process replaying the file
+    void* data = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED | MAP_POPULATE, file.fd, 0);
+    if (data == MAP_FAILED) {
+      throw EmulatorInputError(ERS_HERE, path, std::string("mmap failed: ") + std::strerror(errno));
+    }
+    m_data = static_cast<const uint8_t*>(data);
+    m_mapped_bytes = bytes;
+  } else {
+    uint8_t* dst = nullptr;
+    if (backing == PageBacking::kHugeTLB2M || backing == PageBacking::kHugeTLB1G) {
+      m_huge_pages = std::make_unique<HugePageRegion>();
+      if (m_huge_pages->map(bytes, backing, -1)) {
+        dst = static_cast<uint8_t*>(m_huge_pages->data());
+        m_mapped_bytes = m_huge_pages->size();
+      } else {
+        ers::warning(HugePagesUnavailable(ERS_HERE, to_string(backing), bytes, std::strerror(errno)));
+        m_huge_pages.reset();
+        backing = PageBacking::kTransparent;
+      }
+    }
+    if (dst == nullptr) {
+      void* data = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (data == MAP_FAILED) {
+        throw EmulatorInputError(ERS_HERE, path, std::string("mmap failed: ") + std::strerror(errno));
+      }
+      advise_transparent_huge_pages(data, bytes);
+      dst = static_cast<uint8_t*>(data);
+      m_mapped_bytes = bytes;
+    }
+    m_data = dst;
+    if (!read_fully(file.fd, dst, bytes)) {
+      throw EmulatorInputError(ERS_HERE, path, "short read");
+    }
+    ::mprotect(dst, m_mapped_bytes, PROT_READ);
+  }
+  m_size = bytes;
+  m_backing = backing;
+  m_load_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+SharedInputFile::~SharedInputFile()
+{
+  if (m_huge_pages) {
+    m_huge_pages->unmap();
+  } else if (m_data != nullptr) {
+    ::munmap(const_cast<uint8_t*>(m_data), m_mapped_bytes);
+  }
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
@@ -0,0 +1,80 @@
+/**
+ * @file StartupProfile.cpp StartupProfile and startup pool implementation
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/utils/StartupProfile.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace {
+
+constexpr std::size_t default_startup_threads = 8;
+
+void
+raise_to(std::atomic<uint64_t>& target, uint64_t value)
+{
+  uint64_t current = target.load(std::memory_order_relaxed);
+  while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+  }
+}
+
+} // namespace
+
+PinnedExecutor*
+startup_pool()
+{
+  static std::unique_ptr<PinnedExecutor> pool = []() -> std::unique_ptr<PinnedExecutor> {
+    std::size_t threads = std::min<std::size_t>(std::max(1U, std::thread::hardware_concurrency()),
+                                                default_startup_threads);
+    if (const char* value = std::getenv("FDREADOUTMODULES_STARTUP_THREADS")) {
+      threads = std::strtoul(value, nullptr, 10);
+    }
+    if (threads == 0) {
+      return nullptr;
+    }
+    // Unbound: the links it prepares place their memory themselves
+    auto started = std::make_unique<PinnedExecutor>();
+    started->start(threads, {}, -1, "startup");
+    return started;
+  }();
+  return pool.get();
+}
+
+void
+StartupProfile::add_preparation(uint64_t queued_us, uint64_t prepare_us)
+{
+  m_prepare_total_us.fetch_add(prepare_us, std::memory_order_relaxed);
+  raise_to(m_prepare_max_us, prepare_us);
+  raise_to(m_queued_max_us, queued_us);
+  m_prepared.fetch_add(1, std::memory_order_relaxed);
+}
+
+opmon::StartupTimingInfo
+StartupProfile::info() const
+{
+  auto ms = [](const std::atomic<uint64_t>& us) { return us.load(std::memory_order_relaxed) / 1000.; };
+  opmon::StartupTimingInfo info;
+  info.set_init_ms(ms(init_us));
+  info.set_conf_ms(ms(conf_us));
+  info.set_conf_wait_ms(ms(conf_wait_us));
+  info.set_start_ms(ms(start_us));
+  info.set_links_prepared(m_prepared.load(std::memory_order_relaxed));
+  info.set_prepare_max_ms(ms(m_prepare_max_us));
+  info.set_prepare_total_ms(ms(m_prepare_total_us));
+  info.set_queued_max_ms(ms(m_queued_max_us));
+  auto pool = startup_pool();
+  info.set_startup_threads(pool != nullptr ? pool->size() : 0);
+  return info;
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
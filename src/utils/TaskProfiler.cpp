@@ -0,0 +1,176 @@
+/**
+ * @file TaskProfiler.cpp TaskProfile and ProcessorProfiler implementation
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/utils/TaskProfiler.hpp"
+
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <utility>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace {
+
+uint32_t
+current_tid()
+{
+  thread_local const uint32_t tid = static_cast<uint32_t>(syscall(SYS_gettid));
+  return tid;
+}
+
+} // namespace
+
+void
+TaskProfile::record(uint64_t begin, uint64_t end, uint64_t frames)
+{
+  const uint64_t ticks = end - begin;
+  m_samples.add();
+  m_sampled_frames.add(frames);
+  m_ticks.add(ticks);
+  uint64_t max_ticks = m_max_ticks.load(std::memory_order_relaxed);
+  while (ticks > max_ticks && !m_max_ticks.compare_exchange_weak(max_ticks, ticks, std::memory_order_relaxed)) {
+  }
+  if (m_waits_for_input) {
+    if (m_previous_end != 0 && begin > m_previous_end) {
+      m_gaps.add();
+      m_gap_ticks.add(begin - m_previous_end);
+    }
+    // Sampling every call: the next gap starts here
+    m_previous_end = m_sample_every.load(std::memory_order_relaxed) == 1 ? end : 0;
+  }
+
+  if (!m_tracing.load(std::memory_order_relaxed)) {
+    return;
+  }
+  const std::size_t head = m_trace_head.load(std::memory_order_relaxed);
+  if (head - m_trace_tail.load(std::memory_order_acquire) == trace_capacity) {
+    m_trace_dropped.add();
+    return;
+  }
+  m_trace[head % trace_capacity] = Sample{ TscClock::now_ns(), ticks, current_tid(), sched_getcpu() };
+  m_trace_head.store(head + 1, std::memory_order_release);
+}
+
+TaskProfile::Interval
+TaskProfile::interval()
+{
+  Interval now;
+  now.calls = m_calls.load();
+  now.frames = m_frames.load();
+  now.samples = m_samples.load();
+  now.sampled_frames = m_sampled_frames.load();
+  now.ticks = m_ticks.load();
+  now.gaps = m_gaps.load();
+  now.gap_ticks = m_gap_ticks.load();
+  now.trace_dropped = m_trace_dropped.load();
+
+  Interval delta;
+  delta.calls = now.calls - m_last.calls;
+  delta.frames = now.frames - m_last.frames;
+  delta.samples = now.samples - m_last.samples;
+  delta.sampled_frames = now.sampled_frames - m_last.sampled_frames;
+  delta.ticks = now.ticks - m_last.ticks;
+  delta.gaps = now.gaps - m_last.gaps;
+  delta.gap_ticks = now.gap_ticks - m_last.gap_ticks;
+  delta.trace_dropped = now.trace_dropped - m_last.trace_dropped;
+  delta.max_ticks = m_max_ticks.exchange(0, std::memory_order_relaxed);
+  m_last = now;
+  return delta;
+}
+
+void
+TaskProfile::drain_trace(std::vector<Sample>& out)
+{
+  const std::size_t head = m_trace_head.load(std::memory_order_acquire);
+  std::size_t tail = m_trace_tail.load(std::memory_order_relaxed);
+  for (; tail != head; ++tail) {
+    out.push_back(m_trace[tail % trace_capacity]);
+  }
+  m_trace_tail.store(tail, std::memory_order_release);
+}
+
+ProcessorProfiler::~ProcessorProfiler()
+{
+  disable();
+}
+
+TaskProfile*
+ProcessorProfiler::add_task(const std::string& name, bool waits_for_input)
+{
+  std::lock_guard<std::mutex> lock(m_tasks_mutex);
+  m_tasks.push_back(std::make_unique<TaskProfile>(name, waits_for_input, m_sample_every, m_tracing));
+  return m_tasks.back().get();
+}
+
+void
+ProcessorProfiler::clear_tasks()
+{
+  std::lock_guard<std::mutex> lock(m_trace_mutex);
+  flush_trace_locked();
+  std::lock_guard<std::mutex> tasks_lock(m_tasks_mutex);
+  m_tasks.clear();
+}
+
+bool
+ProcessorProfiler::enable(uint32_t sample_every, const std::string& trace_file)
+{
+  TscClock::calibrate();
+  std::lock_guard<std::mutex> lock(m_trace_mutex);
+  m_tracing.store(false, std::memory_order_relaxed);
+  if (m_trace_file.is_open()) {
+    flush_trace_locked();
+    m_trace_file.close();
+  }
+  bool opened = true;
+  if (sample_every > 0 && !trace_file.empty()) {
+    m_trace_file.open(trace_file, std::ios::out | std::ios::app);
+    opened = m_trace_file.is_open();
+    m_tracing.store(opened, std::memory_order_relaxed);
+  }
+  m_sample_every.store(sample_every, std::memory_order_relaxed);
+  return opened;
+}
+
+void
+ProcessorProfiler::flush_trace()
+{
+  std::lock_guard<std::mutex> lock(m_trace_mutex);
+  flush_trace_locked();
+}
+
+void
+ProcessorProfiler::flush_trace_locked()
+{
+  std::lock_guard<std::mutex> tasks_lock(m_tasks_mutex);
+  for (auto& task : m_tasks) {
+    m_trace_buffer.clear();
+    task->drain_trace(m_trace_buffer);
+    if (!m_trace_file.is_open()) {
+      continue;
+    }
+    char line[64];
+    for (const auto& sample : m_trace_buffer) {
+      std::snprintf(line,
+                    sizeof(line),
+                    "%u [%03d] %lld.%09lld: ",
+                    sample.tid,
+                    sample.cpu,
+                    static_cast<long long>(sample.time_ns / 1000000000),
+                    static_cast<long long>(sample.time_ns % 1000000000));
+      m_trace_file << "fdreadout " << line << sample.ticks << " cycles:\n\t0 " << task->name() << " (" << m_name
+                   << ")\n\n";
+    }
+  }
+  m_trace_file.flush();
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
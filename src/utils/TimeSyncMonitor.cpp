@@ -0,0 +1,102 @@
+/**
+ * @file TimeSyncMonitor.cpp TimeSyncMonitor implementation
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/utils/TimeSyncMonitor.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+TimeSyncMonitor::TimeSyncMonitor(uint64_t clock_frequency_hz)
+  : m_clock_frequency_hz(clock_frequency_hz > 0 ? clock_frequency_hz : 62500000)
+{}
+
+void
+TimeSyncMonitor::record(uint32_t source,
+                        uint64_t daq_time,
+                        int64_t system_time_ns,
+                        uint64_t sequence_number,
+                        int64_t now_ns)
+{
+  const int64_t lag_ns = system_time_ns - static_cast<int64_t>(ticks_to_ns(daq_time));
+
+  std::lock_guard<std::mutex> lk(m_mutex);
+  Source& s = m_sources[source];
+  if (s.messages > 0 && sequence_number > s.last_sequence + 1) {
+    s.sequence_gaps += sequence_number - s.last_sequence - 1;
+  }
+  s.last_sequence = sequence_number;
+  ++s.messages;
+  s.last_lag_ns = lag_ns;
+  if (lag_ns < 0) {
+    ++s.lag_negative;
+  } else {
+    s.lag_ns.record(static_cast<uint64_t>(lag_ns));
+  }
+
+  if (s.interval_messages == 0) {
+    s.x0_ns = system_time_ns;
+    s.y0_ns = lag_ns;
+  }
+  ++s.interval_messages;
+  s.delivery_sum_ns += static_cast<double>(now_ns - system_time_ns);
+  const double x = static_cast<double>(system_time_ns - s.x0_ns);
+  const double y = static_cast<double>(lag_ns - s.y0_ns);
+  s.sx += x;
+  s.sy += y;
+  s.sxx += x * x;
+  s.sxy += x * y;
+  s.syy += y * y;
+}
+
+std::vector<std::pair<uint32_t, TimeSyncMonitor::Summary>>
+TimeSyncMonitor::summarize()
+{
+  std::vector<std::pair<uint32_t, Summary>> summaries;
+  std::lock_guard<std::mutex> lk(m_mutex);
+  summaries.reserve(m_sources.size());
+  for (auto& [id, s] : m_sources) {
+    Summary summary;
+    summary.messages = s.messages;
+    summary.sequence_gaps = s.sequence_gaps;
+    summary.lag_negative = s.lag_negative;
+    summary.last_lag_ns = s.last_lag_ns;
+    summary.lag_ns = s.lag_ns.snapshot_and_reset();
+
+    const double n = static_cast<double>(s.interval_messages);
+    if (s.interval_messages > 0) {
+      summary.delivery_delay_mean_ns = s.delivery_sum_ns / n;
+    }
+    if (s.interval_messages > 2) {
+      const double var_x = s.sxx - s.sx * s.sx / n;
+      const double cov_xy = s.sxy - s.sx * s.sy / n;
+      const double var_y = s.syy - s.sy * s.sy / n;
+      if (var_x > 0.) {
+        const double slope = cov_xy / var_x; // ns of lag per ns of source time
+        summary.drift_ppm = slope * 1e6;
+        summary.jitter_ns = std::sqrt(std::max(var_y - slope * cov_xy, 0.) / n);
+      }
+    }
+    s.interval_messages = 0;
+    s.delivery_sum_ns = 0.;
+    s.sx = s.sy = s.sxx = s.sxy = s.syy = 0.;
+    summaries.emplace_back(id, summary);
+  }
+  return summaries;
+}
+
+void
+TimeSyncMonitor::clear()
+{
+  std::lock_guard<std::mutex> lk(m_mutex);
+  m_sources.clear();
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
@@ -0,0 +1,138 @@
+/**
+ * @file TimerWheel.cpp TimerWheel implementation
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/utils/TimerWheel.hpp"
+
+#include <limits>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace {
+
+constexpr unsigned kWheelBits = TimerWheel::slot_bits * TimerWheel::levels;
+
+// Slots first + 1 .. first + count of a level, wrapping around
+uint64_t
+passed_slots(uint64_t first, uint64_t count)
+{
+  if (count >= 64) {
+    return ~uint64_t{ 0 };
+  }
+  const uint64_t run = (uint64_t{ 1 } << count) - 1;
+  const unsigned start = static_cast<unsigned>((first + 1) & 63);
+  return start == 0 ? run : (run << start) | (run >> (64 - start));
+}
+
+} // namespace
+
+void
+TimerWheel::reset(uint64_t now)
+{
+  for (unsigned level = 0; level < levels; ++level) {
+    for (auto& slot : m_slots[level]) {
+      slot.clear();
+    }
+    m_occupied[level] = 0;
+  }
+  m_overflow.clear();
+  m_size = 0;
+  m_now = now;
+}
+
+bool
+TimerWheel::insert(uint64_t key, uint64_t id)
+{
+  if (key <= m_now) {
+    return false;
+  }
+  place(Item{ key, id });
+  ++m_size;
+  return true;
+}
+
+void
+TimerWheel::place(const Item& item)
+{
+  // The highest bit in which the key differs from the current time selects the level
+  const unsigned msb = 63 - static_cast<unsigned>(__builtin_clzll(item.key ^ m_now));
+  const unsigned level = msb / slot_bits;
+  if (level >= levels) {
+    m_overflow.push_back(item);
+    return;
+  }
+  const unsigned slot = static_cast<unsigned>(item.key >> (level * slot_bits)) & (slots - 1);
+  m_slots[level][slot].push_back(item);
+  m_occupied[level] |= uint64_t{ 1 } << slot;
+}
+
+void
+TimerWheel::advance(uint64_t now, std::vector<uint64_t>& expired)
+{
+  if (now <= m_now) {
+    return;
+  }
+  const uint64_t before = m_now;
+  m_now = now;
+  if (m_size == 0) {
+    return;
+  }
+
+  // Every id in a level has the same higher digits as the time it was placed at and a larger digit in
+  // the level. The slots the time has passed hold ids that are due or belong to a lower level now.
+  m_moving.clear();
+  bool all_levels_passed = true;
+  for (unsigned level = 0; level < levels; ++level) {
+    const uint64_t from = before >> (level * slot_bits);
+    const uint64_t to = now >> (level * slot_bits);
+    if (from == to) {
+      all_levels_passed = false;
+      break;
+    }
+    uint64_t passed = m_occupied[level] & passed_slots(from, to - from);
+    m_occupied[level] &= ~passed;
+    while (passed != 0) {
+      auto& slot = m_slots[level][__builtin_ctzll(passed)];
+      m_moving.insert(m_moving.end(), slot.begin(), slot.end());
+      slot.clear();
+      passed &= passed - 1;
+    }
+  }
+  if (all_levels_passed && (before >> kWheelBits) != (now >> kWheelBits)) {
+    m_moving.insert(m_moving.end(), m_overflow.begin(), m_overflow.end());
+    m_overflow.clear();
+  }
+
+  for (const auto& item : m_moving) {
+    if (item.key <= now) {
+      expired.push_back(item.id);
+      --m_size;
+    } else {
+      place(item);
+    }
+  }
+}
+
+uint64_t
+TimerWheel::next_due() const
+{
+  for (unsigned level = 0; level < levels; ++level) {
+    if (m_occupied[level] != 0) {
+      const unsigned shift = level * slot_bits;
+      const uint64_t slot = static_cast<uint64_t>(__builtin_ctzll(m_occupied[level]));
+      const uint64_t higher = (m_now >> (shift + slot_bits)) << (shift + slot_bits);
+      return higher | (slot << shift);
+    }
+  }
+  if (!m_overflow.empty()) {
+    return ((m_now >> kWheelBits) + 1) << kWheelBits;
+  }
+  return std::numeric_limits<uint64_t>::max();
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
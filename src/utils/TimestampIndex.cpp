@@ -0,0 +1,139 @@
+/**
+ * @file TimestampIndex.cpp TimestampIndexWriter and TimestampIndex implementation
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/utils/TimestampIndex.hpp"
+#include "fdreadoutmodules/FDReadoutModulesIssues.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace {
+constexpr char s_magic[8] = { 'F', 'D', 'T', 'S', 'I', 'D', 'X', '1' };
+} // namespace
+
+void
+TimestampIndexWriter::open(const std::string& data_file, uint32_t element_size, uint32_t stride)
+{
+  close();
+  m_stride = std::max<uint32_t>(1, stride);
+  m_countdown = 0;
+  m_sidecar = TimestampIndex::sidecar_name(data_file);
+  m_stream.open(m_sidecar, std::ios::binary | std::ios::trunc);
+  if (!m_stream.is_open()) {
+    ers::warning(TimestampIndexUnavailable(ERS_HERE, m_sidecar, std::strerror(errno)));
+    return;
+  }
+  m_stream.write(s_magic, sizeof(s_magic));
+  m_stream.write(reinterpret_cast<const char*>(&element_size), sizeof(element_size)); // NOLINT
+  m_stream.write(reinterpret_cast<const char*>(&m_stride), sizeof(m_stride));         // NOLINT
+  check_stream();
+}
+
+void
+TimestampIndexWriter::append(uint64_t timestamp, uint64_t offset)
+{
+  TimestampIndexEntry entry{ timestamp, offset };
+  m_stream.write(reinterpret_cast<const char*>(&entry), sizeof(entry)); // NOLINT
+  check_stream();
+}
+
+void
+TimestampIndexWriter::check_stream()
+{
+  if (m_stream.fail()) {
+    // A truncated sidecar would still load, so drop it rather than leave a partial index behind
+    ers::warning(TimestampIndexUnavailable(ERS_HERE, m_sidecar, "write failed"));
+    m_stream.close();
+    std::remove(m_sidecar.c_str());
+  }
+}
+
+void
+TimestampIndexWriter::close()
+{
+  if (m_stream.is_open()) {
+    m_stream.close();
+  }
+}
+
+bool
+TimestampIndex::load(const std::string& data_file)
+{
+  m_data_file = data_file;
+  m_entries.clear();
+
+  std::ifstream data(data_file, std::ios::binary | std::ios::ate);
+  std::ifstream in(sidecar_name(data_file), std::ios::binary | std::ios::ate);
+  if (!data.is_open() || !in.is_open()) {
+    return false;
+  }
+  m_file_size = static_cast<uint64_t>(data.tellg());
+
+  const auto sidecar_size = static_cast<std::size_t>(in.tellg());
+  constexpr std::size_t header_size = sizeof(s_magic) + 2 * sizeof(uint32_t);
+  if (sidecar_size < header_size) {
+    return false;
+  }
+  in.seekg(0);
+  char magic[sizeof(s_magic)];
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char*>(&m_element_size), sizeof(m_element_size)); // NOLINT
+  in.read(reinterpret_cast<char*>(&m_stride), sizeof(m_stride));             // NOLINT
+  if (!in || std::memcmp(magic, s_magic, sizeof(s_magic)) != 0) {
+    return false;
+  }
+
+  m_entries.resize((sidecar_size - header_size) / sizeof(TimestampIndexEntry));
+  in.read(reinterpret_cast<char*>(m_entries.data()), // NOLINT
+          static_cast<std::streamsize>(m_entries.size() * sizeof(TimestampIndexEntry)));
+  return static_cast<bool>(in);
+}
+
+TimestampIndex::ByteRange
+TimestampIndex::locate(uint64_t begin, uint64_t end) const
+{
+  if (m_entries.empty() || begin >= end) {
+    return { 0, 0 };
+  }
+  auto by_ts = [](const TimestampIndexEntry& e, uint64_t ts) { return e.timestamp < ts; };
+
+  // Last entry at or before begin: the window cannot start earlier than this element
+  auto first = std::lower_bound(m_entries.begin(), m_entries.end(), begin, by_ts);
+  if (first == m_entries.end() || (first != m_entries.begin() && first->timestamp > begin)) {
+    --first;
+  }
+  // First entry at or after end: no element of the window lies beyond it
+  auto last = std::lower_bound(first, m_entries.end(), end, by_ts);
+
+  ByteRange range{ first->offset, last == m_entries.end() ? m_file_size : last->offset };
+  range.end = std::min(range.end, m_file_size);
+  return range;
+}
+
+std::vector<char>
+TimestampIndex::read_window(uint64_t begin, uint64_t end) const
+{
+  auto range = locate(begin, end);
+  std::vector<char> bytes(static_cast<std::size_t>(range.end - range.begin));
+  if (bytes.empty()) {
+    return bytes;
+  }
+  std::ifstream in(m_data_file, std::ios::binary);
+  in.seekg(static_cast<std::streamoff>(range.begin));
+  in.read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  bytes.resize(static_cast<std::size_t>(in.gcount()));
+  return bytes;
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
@@ -0,0 +1,202 @@
+/**
+ * @file WIBEthAdcCodec.cpp WIBEthAdcCodec implementation
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/utils/WIBEthAdcCodec.hpp"
+
+#include "fdreadoutmodules/utils/FrameLayout.hpp"
+
+#include <cstring>
+
+namespace dunedaq {
+namespace fdreadoutmodules {
+
+namespace {
+
+using Frame = WIBEthAdcCodec::Frame;
+
+constexpr uint8_t kRaw = 0;
+constexpr uint8_t kCoded = 1;
+
+constexpr std::size_t kSamples = 64;
+constexpr std::size_t kChannels = 64;
+constexpr unsigned kAdcBits = 14;
+constexpr uint16_t kAdcMask = (1u << kAdcBits) - 1;
+constexpr std::size_t kHeaderSize = offsetof(Frame, adc_words);
+constexpr std::size_t kSampleSize = sizeof(Frame::adc_words[0]);
+
+static_assert(sizeof(Frame::adc_words) == kSamples * kSampleSize, "Unexpected WIBEth ADC block");
+static_assert(kSampleSize * 8 == kChannels * kAdcBits, "Unexpected WIBEth sample packing");
+
+// The 14 bit channels of one sample are packed little endian, 4 channels in every 7 bytes. Each
+// group is read with one unaligned load; the last one would run past the frame and is taken from
+// the last word instead.
+void
+unpack_sample(const uint64_t* words, uint16_t* adc)
+{
+  const auto* bytes = reinterpret_cast<const uint8_t*>(words); // NOLINT
+  for (std::size_t g = 0; g < kChannels / 4; ++g) {
+    uint64_t group = 0;
+    if (g + 1 < kChannels / 4) {
+      std::memcpy(&group, bytes + 7 * g, sizeof(group));
+    } else {
+      group = words[kSampleSize / sizeof(uint64_t) - 1] >> 8;
+    }
+    adc[4 * g] = group & kAdcMask;
+    adc[4 * g + 1] = (group >> 14) & kAdcMask;
+    adc[4 * g + 2] = (group >> 28) & kAdcMask;
+    adc[4 * g + 3] = (group >> 42) & kAdcMask;
+  }
+}
+
+// Groups are stored in ascending order, the zero top byte of each being overwritten by the next
+void
+pack_sample(const uint16_t* adc, uint64_t* words)
+{
+  auto* bytes = reinterpret_cast<uint8_t*>(words); // NOLINT
+  for (std::size_t g = 0; g < kChannels / 4; ++g) {
+    const uint64_t group = uint64_t{ adc[4 * g] } | uint64_t{ adc[4 * g + 1] } << 14 |
+                           uint64_t{ adc[4 * g + 2] } << 28 | uint64_t{ adc[4 * g + 3] } << 42;
+    std::memcpy(bytes + 7 * g, &group, g + 1 < kChannels / 4 ? sizeof(group) : 7);
+  }
+}
+
+// Difference modulo 2^14 as a signed 14 bit value, zigzag coded so that small magnitudes have few bits
+uint16_t
+zigzag_delta(uint16_t value, uint16_t previous)
+{
+  const int32_t d = static_cast<int32_t>((value - previous) & kAdcMask);
+  const int32_t s = (d ^ 0x2000) - 0x2000;
+  return static_cast<uint16_t>((s << 1) ^ (s >> 31));
+}
+
+uint16_t
+undo_zigzag_delta(uint16_t z, uint16_t previous)
+{
+  const int32_t s = static_cast<int32_t>(z >> 1) ^ -static_cast<int32_t>(z & 1);
+  return static_cast<uint16_t>((previous + s) & kAdcMask);
+}
+
+} // namespace
+
+WIBEthAdcCodec::WIBEthAdcCodec()
+  : m_kernels(frame_kernels())
+  , m_timestamp_offset(find_frame_layout("WIBEthFrame")->timestamp_offset)
+{}
+
+std::size_t
+WIBEthAdcCodec::encode(const Frame& frame, uint8_t* out) const
+{
+  const uint8_t* const limit = out + max_encoded_size;
+  uint8_t* p = out;
+  *p++ = kCoded;
+  std::memcpy(p, &frame, kHeaderSize);
+  p += kHeaderSize;
+
+  uint16_t previous[kChannels] = {};
+  uint16_t adc[kChannels];
+  uint16_t deltas[kChannels];
+  uint64_t planes[16];
+  for (std::size_t t = 0; t < kSamples; ++t) {
+    unpack_sample(frame.adc_words[t], adc);
+    uint16_t any = 0;
+    for (std::size_t c = 0; c < kChannels; ++c) {
+      deltas[c] = zigzag_delta(adc[c], previous[c]);
+      previous[c] = adc[c];
+      any |= deltas[c];
+    }
+    const unsigned width = any == 0 ? 0 : 32 - __builtin_clz(any);
+    if (p + 1 + width * sizeof(uint64_t) > limit) {
+      out[0] = kRaw;
+      std::memcpy(out + 1, &frame, sizeof(Frame));
+      return max_encoded_size;
+    }
+    m_kernels.pack_bitplanes(deltas, width, planes);
+    *p++ = static_cast<uint8_t>(width);
+    std::memcpy(p, planes, width * sizeof(uint64_t));
+    p += width * sizeof(uint64_t);
+  }
+  return static_cast<std::size_t>(p - out);
+}
+
+const uint8_t*
+WIBEthAdcCodec::decode(const uint8_t* in, const uint8_t* end, Frame& frame) const
+{
+  if (end - in < static_cast<std::ptrdiff_t>(1 + kHeaderSize)) {
+    return nullptr;
+  }
+  if (in[0] == kRaw) {
+    if (end - in < static_cast<std::ptrdiff_t>(max_encoded_size)) {
+      return nullptr;
+    }
+    std::memcpy(&frame, in + 1, sizeof(Frame));
+    return in + max_encoded_size;
+  }
+  if (in[0] != kCoded) {
+    return nullptr;
+  }
+  const uint8_t* p = in + 1;
+  std::memcpy(&frame, p, kHeaderSize);
+  p += kHeaderSize;
+
+  uint16_t previous[kChannels] = {};
+  uint16_t deltas[kChannels];
+  uint64_t planes[16];
+  for (std::size_t t = 0; t < kSamples; ++t) {
+    if (p == end || *p > kAdcBits) {
+      return nullptr;
+    }
+    const unsigned width = *p++;
+    if (end - p < static_cast<std::ptrdiff_t>(width * sizeof(uint64_t))) {
+      return nullptr;
+    }
+    std::memcpy(planes, p, width * sizeof(uint64_t));
+    p += width * sizeof(uint64_t);
+    m_kernels.unpack_bitplanes(planes, width, deltas);
+    for (std::size_t c = 0; c < kChannels; ++c) {
+      previous[c] = undo_zigzag_delta(deltas[c], previous[c]);
+    }
+    pack_sample(previous, frame.adc_words[t]);
+  }
+  return p;
+}
+
+const uint8_t*
+WIBEthAdcCodec::skip(const uint8_t* in, const uint8_t* end)
+{
+  if (end - in < static_cast<std::ptrdiff_t>(1 + kHeaderSize)) {
+    return nullptr;
+  }
+  if (in[0] == kRaw) {
+    return end - in < static_cast<std::ptrdiff_t>(max_encoded_size) ? nullptr : in + max_encoded_size;
+  }
+  if (in[0] != kCoded) {
+    return nullptr;
+  }
+  const uint8_t* p = in + 1 + kHeaderSize;
+  for (std::size_t t = 0; t < kSamples; ++t) {
+    if (p == end || *p > kAdcBits) {
+      return nullptr;
+    }
+    const std::size_t bytes = *p++ * sizeof(uint64_t);
+    if (end - p < static_cast<std::ptrdiff_t>(bytes)) {
+      return nullptr;
+    }
+    p += bytes;
+  }
+  return p;
+}
+
+uint64_t
+WIBEthAdcCodec::peek_timestamp(const uint8_t* in) const
+{
+  uint64_t timestamp = 0;
+  std::memcpy(&timestamp, in + 1 + m_timestamp_offset, sizeof(timestamp));
+  return timestamp;
+}
+
+} // namespace fdreadoutmodules
+} // namespace dunedaq
@@ -0,0 +1,359 @@
+/**
+ * @file readout_model_benchmark.cxx Standalone benchmark of the far detector readout models
+ *
+ * Builds the latency buffer, frame processor and request handler specializations that
+ * FDDataHandlerModule::create_readout() uses, feeds them synthetic superchunks at a configurable
+ * rate and fires DataRequests against the buffer from a second thread. No IOManager, network or
+ * run control is involved. Without --config only the latency buffer is configured, so only ingest
+ * and memory figures are reported.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "fdreadoutmodules/ReadoutModelSpecializations.hpp"
+#include "fdreadoutmodules/utils/LogLinearHistogram.hpp"
+
+#include "appmodel/DataHandlerConf.hpp"
+#include "appmodel/DataHandlerModule.hpp"
+#include "conffwk/Configuration.hpp"
+#include "datahandlinglibs/FrameErrorRegistry.hpp"
+#include "dfmessages/DataRequest.hpp"
+#include "logging/Logging.hpp"
+
+#include "boost/program_options.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace po = boost::program_options;
+
+using namespace dunedaq;
+using namespace dunedaq::fdreadoutmodules;
+
+namespace {
+
+struct BenchmarkConfig
+{
+  double rate_khz = 0.;            // 0 means unpaced
+  double duration_s = 10.;
+  std::size_t lb_size = 100000;    // superchunks, used when no configuration database is given
+  double request_rate_hz = 1000.;
+  uint64_t window_ticks = 62500;   // 1 ms at 62.5 MHz
+  uint64_t window_offset_ticks = 0; // distance of the window end from the newest timestamp
+  bool postprocess = false;
+  bool pds_buckets = false;        // PDSFrame with the timestamp bucket latency buffer
+  bool wibeth_compressed = false;  // WIBEthFrame with the compressed latency buffer
+  uint32_t batch_size = 1;         // superchunks preprocessed and written together, as BatchedDataHandlingModel
+  uint32_t profile_every = 0;      // time one call of each processor task in this many, 0 for none
+};
+
+//! Expose the protected request path so requests can be timed without IOManager
+template<class RequestHandlerType>
+class BenchmarkRequestHandler : public RequestHandlerType
+{
+public:
+  using RequestHandlerType::RequestHandlerType;
+  using RequestHandlerType::data_request;
+};
+
+std::size_t
+resident_bytes()
+{
+  std::ifstream statm("/proc/self/statm");
+  std::size_t pages_total = 0, pages_resident = 0;
+  statm >> pages_total >> pages_resident;
+  return pages_resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+template<class Specialization>
+void
+run_benchmark(const BenchmarkConfig& cfg, const appmodel::DataHandlerModule* modconf)
+{
+  using readout_t = typename Specialization::readout_t;
+  using clock = std::chrono::steady_clock;
+
+  std::unique_ptr<datahandlinglibs::FrameErrorRegistry> error_registry(new datahandlinglibs::FrameErrorRegistry());
+  const std::size_t rss_before = resident_bytes();
+
+  auto latency_buffer = std::make_shared<typename Specialization::latency_buffer_t>();
+  auto processor = std::make_unique<typename Specialization::processor_t>(error_registry, cfg.postprocess);
+  BenchmarkRequestHandler<typename Specialization::request_handler_t> request_handler(latency_buffer, error_registry);
+
+  // Without a configuration the processor has no tasks and the request handler no source or fragment type:
+  // only the latency buffer is exercised, and no processor or request figures are reported
+  const bool configured = modconf != nullptr;
+  std::size_t lb_size = cfg.lb_size;
+  if (configured) {
+    auto lb_conf = modconf->get_module_configuration()->get_latency_buffer();
+    lb_size = lb_conf->get_size();
+    latency_buffer->conf(lb_conf);
+    processor->conf(modconf);
+    processor->profiler().enable(cfg.profile_every, "");
+    request_handler.conf(modconf);
+  } else {
+    latency_buffer->allocate_memory(lb_size);
+  }
+  const std::size_t rss_configured = resident_bytes();
+
+  // The benchmark plays the role of the cleanup thread: pops and requests must not overlap
+  std::mutex buffer_mutex;
+  std::atomic<bool> running{ true };
+  std::atomic<uint64_t> newest_timestamp{ 0 };
+  LogLinearHistogram<> request_latency_ns;
+  LogLinearHistogram<> fragment_bytes;
+  uint64_t requests_issued = 0;
+
+  std::thread requester([&]() {
+    if (!configured) {
+      return;
+    }
+    auto period = std::chrono::duration<double>(1. / cfg.request_rate_hz);
+    auto next = clock::now();
+    dfmessages::DataRequest dr;
+    while (running.load(std::memory_order_relaxed)) {
+      next += std::chrono::duration_cast<clock::duration>(period);
+      std::this_thread::sleep_until(next);
+      uint64_t newest = newest_timestamp.load(std::memory_order_acquire);
+      if (newest < cfg.window_ticks + cfg.window_offset_ticks) {
+        continue;
+      }
+      dr.request_number = requests_issued;
+      dr.trigger_number = requests_issued;
+      dr.trigger_timestamp = newest - cfg.window_offset_ticks;
+      dr.request_information.window_end = newest - cfg.window_offset_ticks;
+      dr.request_information.window_begin = dr.request_information.window_end - cfg.window_ticks;
+      std::lock_guard<std::mutex> lk(buffer_mutex);
+      auto start = clock::now();
+      auto result = request_handler.data_request(dr);
+      request_latency_ns.record(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count());
+      if (result.fragment) {
+        fragment_bytes.record(result.fragment->get_size());
+      }
+      ++requests_issued;
+    }
+  });
+
+  readout_t payload;
+  const uint64_t tick_step = readout_t::expected_tick_difference * payload.get_num_frames();
+  const std::size_t pop_limit = lb_size * 8 / 10;
+  const std::size_t pop_size = lb_size / 10;
+  const std::size_t batch_size = std::max<uint32_t>(cfg.batch_size, 1);
+  const auto period = cfg.rate_khz > 0. ? std::chrono::duration<double, std::milli>(batch_size / cfg.rate_khz)
+                                        : std::chrono::duration<double, std::milli>(0.);
+  std::vector<readout_t> batch(batch_size);
+  std::vector<readout_t*> batch_elements;
+  for (auto& element : batch) {
+    batch_elements.push_back(&element);
+  }
+  LogLinearHistogram<> preprocess_ns;
+  uint64_t timestamp = tick_step;
+  uint64_t frames = 0;
+
+  const auto start = clock::now();
+  const auto end = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(cfg.duration_s));
+  auto next = start;
+  while (clock::now() < end) {
+    if (cfg.rate_khz > 0.) {
+      next += std::chrono::duration_cast<clock::duration>(period);
+      while (clock::now() < next) {
+      }
+    }
+    if (batch_size == 1) {
+      payload.fake_timestamps(timestamp, readout_t::expected_tick_difference);
+
+      if (configured) {
+        auto t0 = clock::now();
+        processor->preprocess_item(&payload);
+        preprocess_ns.record(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0).count());
+      }
+
+      readout_t element = payload;
+      latency_buffer->write(std::move(element));
+      if (configured) {
+        processor->postprocess_item(&payload);
+      }
+    } else {
+      for (auto& element : batch) {
+        element.fake_timestamps(timestamp, readout_t::expected_tick_difference);
+        timestamp += tick_step;
+      }
+      timestamp -= tick_step;
+
+      if (configured) {
+        auto t0 = clock::now();
+        for (auto& element : batch) {
+          processor->preprocess_item(&element);
+        }
+        preprocess_ns.record(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0).count() /
+                             batch_size);
+      }
+
+      if constexpr (detail::has_write_batch<typename Specialization::latency_buffer_t, readout_t>::value) {
+        latency_buffer->write_batch(batch_elements.data(), batch_size);
+      } else {
+        for (auto& element : batch) {
+          latency_buffer->write(std::move(element));
+        }
+      }
+      if (configured) {
+        for (const auto& element : batch) {
+          processor->postprocess_item(&element);
+        }
+      }
+      frames += batch_size - 1;
+    }
+    newest_timestamp.store(timestamp, std::memory_order_release);
+
+    if (latency_buffer->occupancy() > pop_limit) {
+      std::lock_guard<std::mutex> lk(buffer_mutex);
+      latency_buffer->pop(pop_size);
+    }
+    timestamp += tick_step;
+    ++frames;
+  }
+  const double elapsed_s = std::chrono::duration<double>(clock::now() - start).count();
+  running = false;
+  requester.join();
+
+  auto pre = preprocess_ns.snapshot_and_reset();
+  auto lat = request_latency_ns.snapshot_and_reset();
+  auto frag = fragment_bytes.snapshot_and_reset();
+
+  TLOG() << "=== " << Specialization::data_type << " (" << (configured ? "configured" : "unconfigured") << ") ===";
+  TLOG() << "  ingest:      " << frames << " superchunks in " << elapsed_s << " s, " << frames / elapsed_s
+         << " superchunks/s";
+  if (configured) {
+    TLOG() << "  processor:   preprocess mean " << pre.mean() << " ns, p99 " << pre.percentile(0.99) << " ns, max "
+           << pre.max << " ns per superchunk";
+    TLOG() << "  requests:    " << lat.entries << " served, latency p50 " << lat.percentile(0.50) / 1000.
+           << " us, p99 " << lat.percentile(0.99) / 1000. << " us, max " << lat.max / 1000. << " us";
+    TLOG() << "  fragments:   mean " << frag.mean() << " B, max " << frag.max << " B";
+  } else {
+    TLOG() << "  processor and requests: not run, pass --config and --module to configure them";
+  }
+  TLOG() << "  memory:      latency buffer " << lb_size * sizeof(readout_t) / (1024. * 1024.) << " MiB nominal, RSS +"
+         << (rss_configured - rss_before) / (1024. * 1024.) << " MiB after conf, RSS "
+         << resident_bytes() / (1024. * 1024.) << " MiB at end";
+  if constexpr (detail::has_compression_stats<typename Specialization::latency_buffer_t>::value) {
+    auto stats = latency_buffer->compression_stats();
+    const double ratio = stats.stored_bytes > 0 ? static_cast<double>(stats.retained_bytes) / stats.stored_bytes : 0.;
+    const double encode_ns =
+      stats.frames_encoded > 0 ? static_cast<double>(stats.encode_ns) / stats.frames_encoded : 0.;
+    TLOG() << "  compression: " << latency_buffer->occupancy() << " superchunks in " << stats.stored_bytes
+           << " B, ratio " << ratio << ", encode " << encode_ns << " ns per frame";
+  }
+  if (configured && cfg.profile_every > 0) {
+    processor->profiler().for_each_task([&](TaskProfile& task) {
+      auto interval = task.interval();
+      const double ticks_per_frame =
+        interval.sampled_frames > 0 ? static_cast<double>(interval.ticks) / interval.sampled_frames : 0.;
+      TLOG() << "  task:        " << task.name() << ", " << interval.calls << " calls, " << ticks_per_frame
+             << " cycles (" << ticks_per_frame * TscClock::ns_per_tick() << " ns) per frame over "
+             << interval.samples << " samples";
+    });
+  }
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  BenchmarkConfig cfg;
+  std::vector<std::string> data_types;
+  std::string config_db;
+  std::string module_id;
+
+  po::options_description desc("Standalone benchmark of the far detector readout models");
+  // clang-format off
+  desc.add_options()
+    ("help,h", "Print this help")
+    ("data-type,d", po::value<std::vector<std::string>>(&data_types),
+       "WIBEthFrame, TDEEthFrame, PDSFrame or PDSStreamFrame (repeatable, default: all)")
+    ("rate-khz,r", po::value<double>(&cfg.rate_khz)->default_value(cfg.rate_khz), "Superchunk rate, 0 for unpaced")
+    ("duration,t", po::value<double>(&cfg.duration_s)->default_value(cfg.duration_s), "Duration per data type [s]")
+    ("lb-size", po::value<std::size_t>(&cfg.lb_size)->default_value(cfg.lb_size), "Latency buffer size [superchunks]")
+    ("request-rate-hz", po::value<double>(&cfg.request_rate_hz)->default_value(cfg.request_rate_hz), "DataRequest rate")
+    ("window-ticks", po::value<uint64_t>(&cfg.window_ticks)->default_value(cfg.window_ticks), "Request window width")
+    ("window-offset-ticks", po::value<uint64_t>(&cfg.window_offset_ticks)->default_value(cfg.window_offset_ticks),
+       "Distance of the window end from the newest timestamp")
+    ("postprocess", po::bool_switch(&cfg.postprocess), "Enable post-processing in the frame processor")
+    ("pds-buckets", po::bool_switch(&cfg.pds_buckets), "Use the timestamp bucket latency buffer for PDSFrame")
+    ("wibeth-compressed", po::bool_switch(&cfg.wibeth_compressed),
+       "Use the compressed latency buffer for WIBEthFrame")
+    ("batch-size", po::value<uint32_t>(&cfg.batch_size)->default_value(cfg.batch_size),
+       "Superchunks preprocessed and written to the latency buffer together")
+    ("profile-every", po::value<uint32_t>(&cfg.profile_every)->default_value(cfg.profile_every),
+       "Time one call in this many of each frame processor task (needs --config)")
+    ("config,c", po::value<std::string>(&config_db), "OKS database to configure the models from")
+    ("module,m", po::value<std::string>(&module_id), "DataHandlerModule uid in the OKS database");
+  // clang-format on
+
+  po::variables_map vm;
+  try {
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+  } catch (const po::error& e) {
+    TLOG() << e.what() << "\n" << desc;
+    return 1;
+  }
+  if (vm.count("help")) {
+    TLOG() << desc;
+    return 0;
+  }
+
+  std::unique_ptr<conffwk::Configuration> confdb;
+  const appmodel::DataHandlerModule* modconf = nullptr;
+  if (!config_db.empty()) {
+    confdb = std::make_unique<conffwk::Configuration>("oksconflibs:" + config_db);
+    modconf = confdb->get<appmodel::DataHandlerModule>(module_id);
+    if (modconf == nullptr) {
+      TLOG() << "DataHandlerModule " << module_id << " not found in " << config_db;
+      return 1;
+    }
+    // Same choice of models as the data handler modules, including the latency buffer flavour
+    bool supported = specializations::with_specialization(modconf, [&](auto spec) {
+      run_benchmark<decltype(spec)>(cfg, modconf);
+      return true;
+    });
+    if (!supported) {
+      TLOG() << "Unsupported data type " << modconf->get_module_configuration()->get_input_data_type();
+      return 1;
+    }
+    return 0;
+  }
+  if (data_types.empty()) {
+    data_types = { "WIBEthFrame", "TDEEthFrame", "PDSFrame", "PDSStreamFrame" };
+  }
+
+  namespace fds = dunedaq::fdreadoutmodules::specializations;
+  for (const auto& dt : data_types) {
+    if (dt.find("WIBEthFrame") != std::string::npos && cfg.wibeth_compressed) {
+      run_benchmark<fds::WIBEthCompressed>(cfg, modconf);
+    } else if (dt.find("WIBEthFrame") != std::string::npos) {
+      run_benchmark<fds::WIBEth<false, false, false>>(cfg, modconf);
+    } else if (dt.find("TDEEthFrame") != std::string::npos) {
+      run_benchmark<fds::TDEEth<false, false, false>>(cfg, modconf);
+    } else if (dt.find("PDSStreamFrame") != std::string::npos) {
+      run_benchmark<fds::PDSStream<false, false, false>>(cfg, modconf);
+    } else if (dt.find("PDSFrame") != std::string::npos && cfg.pds_buckets) {
+      run_benchmark<fds::PDSBuckets>(cfg, modconf);
+    } else if (dt.find("PDSFrame") != std::string::npos) {
+      run_benchmark<fds::PDS>(cfg, modconf);
+    } else {
+      TLOG() << "Unsupported data type " << dt;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,140 @@
+/**
+ * @file FragmentCache_test.cxx Unit tests of the cache of recently served readout windows
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "fdreadoutmodules/utils/FragmentCache.hpp"
+
+#define BOOST_TEST_MODULE FragmentCache_test // NOLINT
+
+#include "boost/test/unit_test.hpp"
+
+#include <cstdint>
+#include <memory>
+
+using namespace dunedaq::fdreadoutmodules;
+
+namespace {
+
+std::shared_ptr<const FragmentCache::Entry>
+make_entry(uint64_t begin, uint64_t end, std::size_t bytes = 100)
+{
+  return std::make_shared<const FragmentCache::Entry>(FragmentCache::Entry{ begin, end, std::vector<char>(bytes) });
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(FragmentCache_test)
+
+BOOST_AUTO_TEST_CASE(DisabledCacheKeepsNothing)
+{
+  FragmentCache cache;
+  BOOST_REQUIRE(!cache.enabled());
+  uint64_t begin = 0;
+  uint64_t end = 0;
+  BOOST_REQUIRE(!cache.admit(100, 200, begin, end));
+  cache.insert(make_entry(100, 200));
+  BOOST_REQUIRE(cache.find(100, 200) == nullptr);
+  BOOST_REQUIRE_EQUAL(cache.stats().entries, 0);
+}
+
+BOOST_AUTO_TEST_CASE(AdmitsOverlappingWindowsWidened)
+{
+  FragmentCache cache;
+  cache.configure(4, 1 << 20);
+  uint64_t begin = 0;
+  uint64_t end = 0;
+
+  // A first window is only remembered
+  BOOST_REQUIRE(!cache.admit(100, 200, begin, end));
+  BOOST_REQUIRE_EQUAL(begin, 100);
+  BOOST_REQUIRE_EQUAL(end, 200);
+
+  // A disjoint one neither
+  BOOST_REQUIRE(!cache.admit(300, 400, begin, end));
+
+  // An overlapping one is admitted, widened to the union
+  BOOST_REQUIRE(cache.admit(150, 250, begin, end));
+  BOOST_REQUIRE_EQUAL(begin, 100);
+  BOOST_REQUIRE_EQUAL(end, 250);
+  BOOST_REQUIRE_EQUAL(cache.stats().merged, 1);
+
+  // The same window again is admitted as is
+  BOOST_REQUIRE(cache.admit(150, 250, begin, end));
+  BOOST_REQUIRE_EQUAL(begin, 100);
+  BOOST_REQUIRE_EQUAL(end, 250);
+
+  // Windows that only touch do not overlap
+  BOOST_REQUIRE(!cache.admit(400, 500, begin, end));
+
+  cache.clear();
+  BOOST_REQUIRE(!cache.admit(150, 250, begin, end));
+}
+
+BOOST_AUTO_TEST_CASE(FindsExactAndContainedWindows)
+{
+  FragmentCache cache;
+  cache.configure(4, 1 << 20);
+  cache.insert(make_entry(100, 300));
+
+  BOOST_REQUIRE(cache.find(100, 300) != nullptr);
+  BOOST_REQUIRE(cache.find(150, 250) != nullptr);
+  BOOST_REQUIRE(cache.find(50, 250) == nullptr);
+  BOOST_REQUIRE(cache.find(150, 301) == nullptr);
+
+  auto stats = cache.stats();
+  BOOST_REQUIRE_EQUAL(stats.lookups, 4);
+  BOOST_REQUIRE_EQUAL(stats.exact_hits, 1);
+  BOOST_REQUIRE_EQUAL(stats.contained_hits, 1);
+}
+
+BOOST_AUTO_TEST_CASE(EvictsLeastRecentlyUsedByCount)
+{
+  FragmentCache cache;
+  cache.configure(3, 1 << 20);
+  cache.insert(make_entry(0, 100));
+  cache.insert(make_entry(100, 200));
+  cache.insert(make_entry(200, 300));
+
+  // Using the oldest entry makes the second one the least recently used
+  BOOST_REQUIRE(cache.find(0, 100) != nullptr);
+  cache.insert(make_entry(300, 400));
+
+  BOOST_REQUIRE(cache.find(0, 100) != nullptr);
+  BOOST_REQUIRE(cache.find(100, 200) == nullptr);
+  BOOST_REQUIRE(cache.find(200, 300) != nullptr);
+  BOOST_REQUIRE(cache.find(300, 400) != nullptr);
+  auto stats = cache.stats();
+  BOOST_REQUIRE_EQUAL(stats.entries, 3);
+  BOOST_REQUIRE_EQUAL(stats.insertions, 4);
+  BOOST_REQUIRE_EQUAL(stats.evictions, 1);
+}
+
+BOOST_AUTO_TEST_CASE(EvictsByBytes)
+{
+  FragmentCache cache;
+  cache.configure(10, 1000);
+  cache.insert(make_entry(0, 100, 400));
+  cache.insert(make_entry(100, 200, 400));
+  cache.insert(make_entry(200, 300, 400));
+
+  BOOST_REQUIRE(cache.find(0, 100) == nullptr);
+  BOOST_REQUIRE_EQUAL(cache.stats().bytes, 800);
+
+  // Larger than the whole cache: not inserted, nothing evicted
+  cache.insert(make_entry(300, 400, 1001));
+  BOOST_REQUIRE(cache.find(300, 400) == nullptr);
+  auto stats = cache.stats();
+  BOOST_REQUIRE_EQUAL(stats.entries, 2);
+  BOOST_REQUIRE_EQUAL(stats.evictions, 1);
+
+  cache.clear();
+  stats = cache.stats();
+  BOOST_REQUIRE_EQUAL(stats.entries, 0);
+  BOOST_REQUIRE_EQUAL(stats.bytes, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
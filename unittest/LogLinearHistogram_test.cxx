@@ -0,0 +1,114 @@
+/**
+ * @file LogLinearHistogram_test.cxx Unit tests of the log-linear histogram used for hot-path sampling
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "fdreadoutmodules/utils/LogLinearHistogram.hpp"
+
+#define BOOST_TEST_MODULE LogLinearHistogram_test // NOLINT
+
+#include "boost/test/unit_test.hpp"
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+using namespace dunedaq::fdreadoutmodules;
+
+namespace {
+
+template<class Histogram>
+void
+check_bucket_bounds(unsigned sub_bucket_bits, unsigned max_value_bits)
+{
+  // Buckets tile [0, 2^max_value_bits) without gap or overlap
+  uint64_t lower = 0;
+  for (std::size_t i = 0; i < Histogram::num_buckets; ++i) {
+    const uint64_t upper = Histogram::bucket_upper_bound(i);
+    BOOST_REQUIRE_GE(upper, lower);
+    BOOST_REQUIRE_EQUAL(Histogram::bucket_index(lower), i);
+    BOOST_REQUIRE_EQUAL(Histogram::bucket_index(upper), i);
+    // Relative width bounded by the sub-bucket precision
+    BOOST_REQUIRE_LE((upper - lower) << sub_bucket_bits, upper);
+    lower = upper + 1;
+  }
+  BOOST_REQUIRE_EQUAL(lower, uint64_t(1) << max_value_bits);
+
+  // Larger values land in the last bucket
+  BOOST_REQUIRE_EQUAL(Histogram::bucket_index(lower), Histogram::num_buckets - 1);
+  BOOST_REQUIRE_EQUAL(Histogram::bucket_index(UINT64_MAX), Histogram::num_buckets - 1);
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(LogLinearHistogram_test)
+
+BOOST_AUTO_TEST_CASE(BucketBounds)
+{
+  check_bucket_bounds<LogLinearHistogram<>>(4, 48);
+  check_bucket_bounds<LogLinearHistogram<2, 20>>(2, 20);
+  check_bucket_bounds<LogLinearHistogram<7, 63>>(7, 63);
+}
+
+BOOST_AUTO_TEST_CASE(SmallValuesAreExact)
+{
+  using Histogram = LogLinearHistogram<>;
+  for (uint64_t value = 0; value < 2 * Histogram::sub_buckets; ++value) {
+    BOOST_REQUIRE_EQUAL(Histogram::bucket_upper_bound(Histogram::bucket_index(value)), value);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(SnapshotAndPercentiles)
+{
+  LogLinearHistogram<> histogram;
+  for (uint64_t value = 1; value <= 1000; ++value) {
+    histogram.record(value);
+  }
+  auto snapshot = histogram.snapshot_and_reset();
+  BOOST_REQUIRE_EQUAL(snapshot.entries, 1000);
+  BOOST_REQUIRE_EQUAL(snapshot.sum, 500500);
+  BOOST_REQUIRE_EQUAL(snapshot.max, 1000);
+  BOOST_REQUIRE_CLOSE(snapshot.mean(), 500.5, 1e-9);
+
+  // Upper edge of the bucket: not below the exact quantile, within the bucket precision above it
+  const uint64_t p50 = snapshot.percentile(0.5);
+  BOOST_REQUIRE_GE(p50, 500);
+  BOOST_REQUIRE_LE(p50, 500 + 500 / LogLinearHistogram<>::sub_buckets);
+  BOOST_REQUIRE_EQUAL(snapshot.percentile(1.), 1000);
+  BOOST_REQUIRE_EQUAL(snapshot.percentile(0.), 1);
+
+  auto empty = histogram.snapshot_and_reset();
+  BOOST_REQUIRE_EQUAL(empty.entries, 0);
+  BOOST_REQUIRE_EQUAL(empty.max, 0);
+  BOOST_REQUIRE_EQUAL(empty.percentile(0.99), 0);
+}
+
+BOOST_AUTO_TEST_CASE(ConcurrentRecordsAreAllCounted)
+{
+  constexpr unsigned threads = 4;
+  constexpr uint64_t records = 100000;
+  LogLinearHistogram<> histogram;
+  uint64_t entries = 0;
+  std::vector<std::thread> writers;
+  for (unsigned t = 0; t < threads; ++t) {
+    writers.emplace_back([&histogram, t]() {
+      for (uint64_t i = 0; i < records; ++i) {
+        histogram.record(i * (t + 1));
+      }
+    });
+  }
+  // Drained while recording: every record lands in exactly one snapshot
+  for (int i = 0; i < 10; ++i) {
+    entries += histogram.snapshot_and_reset().entries;
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+  entries += histogram.snapshot_and_reset().entries;
+  BOOST_REQUIRE_EQUAL(entries, threads * records);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,143 @@
+/**
+ * @file TimerWheel_test.cxx Unit tests of the timer wheel keyed on DAQ timestamps
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "fdreadoutmodules/utils/TimerWheel.hpp"
+
+#define BOOST_TEST_MODULE TimerWheel_test // NOLINT
+
+#include "boost/test/unit_test.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace dunedaq::fdreadoutmodules;
+
+BOOST_AUTO_TEST_SUITE(TimerWheel_test)
+
+BOOST_AUTO_TEST_CASE(RejectsKeysNotInTheFuture)
+{
+  TimerWheel wheel;
+  wheel.reset(1000);
+  BOOST_REQUIRE(!wheel.insert(999, 1));
+  BOOST_REQUIRE(!wheel.insert(1000, 2));
+  BOOST_REQUIRE(wheel.insert(1001, 3));
+  BOOST_REQUIRE_EQUAL(wheel.size(), 1);
+  BOOST_REQUIRE_EQUAL(wheel.next_due(), 1001);
+}
+
+BOOST_AUTO_TEST_CASE(ExpiresAtTheKey)
+{
+  TimerWheel wheel;
+  wheel.reset(0);
+  std::vector<uint64_t> expired;
+  BOOST_REQUIRE(wheel.insert(100, 1));
+  BOOST_REQUIRE(wheel.insert(5000, 2));
+  BOOST_REQUIRE(wheel.insert(5000, 3));
+
+  wheel.advance(99, expired);
+  BOOST_REQUIRE(expired.empty());
+  wheel.advance(100, expired);
+  BOOST_REQUIRE_EQUAL(expired.size(), 1);
+  BOOST_REQUIRE_EQUAL(expired[0], 1);
+
+  expired.clear();
+  wheel.advance(4999, expired);
+  BOOST_REQUIRE(expired.empty());
+  BOOST_REQUIRE_LE(wheel.next_due(), 5000);
+  wheel.advance(5000, expired);
+  std::sort(expired.begin(), expired.end());
+  BOOST_REQUIRE(expired == (std::vector<uint64_t>{ 2, 3 }));
+  BOOST_REQUIRE_EQUAL(wheel.size(), 0);
+  BOOST_REQUIRE_EQUAL(wheel.next_due(), UINT64_MAX);
+}
+
+BOOST_AUTO_TEST_CASE(TimeDoesNotGoBack)
+{
+  TimerWheel wheel;
+  wheel.reset(1000);
+  std::vector<uint64_t> expired;
+  BOOST_REQUIRE(wheel.insert(2000, 1));
+  wheel.advance(1500, expired);
+  wheel.advance(1200, expired);
+  BOOST_REQUIRE_EQUAL(wheel.now(), 1500);
+  BOOST_REQUIRE(expired.empty());
+}
+
+BOOST_AUTO_TEST_CASE(JumpsAcrossLevelsAndOverflow)
+{
+  TimerWheel wheel;
+  wheel.reset(12345);
+  std::vector<uint64_t> expired;
+  const uint64_t far = 12345 + (uint64_t(1) << 40);
+  BOOST_REQUIRE(wheel.insert(12345 + 70, 1));
+  BOOST_REQUIRE(wheel.insert(12345 + 64 * 64 * 3, 2));
+  BOOST_REQUIRE(wheel.insert(far, 3));
+
+  // One jump past the two near keys but short of the far one
+  wheel.advance(far - 1, expired);
+  std::sort(expired.begin(), expired.end());
+  BOOST_REQUIRE(expired == (std::vector<uint64_t>{ 1, 2 }));
+  BOOST_REQUIRE_EQUAL(wheel.size(), 1);
+
+  expired.clear();
+  wheel.advance(far, expired);
+  BOOST_REQUIRE(expired == (std::vector<uint64_t>{ 3 }));
+}
+
+BOOST_AUTO_TEST_CASE(ResetDropsEverything)
+{
+  TimerWheel wheel;
+  wheel.reset(0);
+  BOOST_REQUIRE(wheel.insert(10, 1));
+  BOOST_REQUIRE(wheel.insert(uint64_t(1) << 50, 2));
+  wheel.reset(5);
+  BOOST_REQUIRE_EQUAL(wheel.size(), 0);
+  std::vector<uint64_t> expired;
+  wheel.advance(uint64_t(1) << 51, expired);
+  BOOST_REQUIRE(expired.empty());
+}
+
+BOOST_AUTO_TEST_CASE(MatchesAnOrderedMap)
+{
+  TimerWheel wheel;
+  std::multimap<uint64_t, uint64_t> reference;
+  std::mt19937_64 rng(7);
+  uint64_t now = 1000000;
+  wheel.reset(now);
+  std::vector<uint64_t> expired;
+  uint64_t id = 0;
+
+  for (int step = 0; step < 2000; ++step) {
+    for (int i = 0; i < 10; ++i) {
+      // Delays spread over every level and the overflow
+      const uint64_t key = now + 1 + (rng() >> (rng() % 64));
+      BOOST_REQUIRE(wheel.insert(key, id));
+      reference.emplace(key, id++);
+    }
+    if (!reference.empty()) {
+      BOOST_REQUIRE_LE(wheel.next_due(), reference.begin()->first);
+    }
+    now += rng() >> (20 + rng() % 44);
+    expired.clear();
+    wheel.advance(now, expired);
+
+    std::vector<uint64_t> due;
+    for (auto it = reference.begin(); it != reference.end() && it->first <= now; it = reference.erase(it)) {
+      due.push_back(it->second);
+    }
+    std::sort(expired.begin(), expired.end());
+    std::sort(due.begin(), due.end());
+    BOOST_REQUIRE(expired == due);
+    BOOST_REQUIRE_EQUAL(wheel.size(), reference.size());
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
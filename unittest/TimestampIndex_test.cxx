@@ -0,0 +1,135 @@
+/**
+ * @file TimestampIndex_test.cxx Unit tests of the sparse timestamp index of recorded raw files
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "fdreadoutmodules/utils/TimestampIndex.hpp"
+
+#define BOOST_TEST_MODULE TimestampIndex_test // NOLINT
+
+#include "boost/test/unit_test.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace dunedaq::fdreadoutmodules;
+
+namespace {
+
+struct Element
+{
+  uint64_t timestamp;
+  uint64_t payload[7];
+  uint64_t get_timestamp() const { return timestamp; }
+};
+
+constexpr uint64_t tick = 32;
+constexpr uint64_t first_timestamp = 1000;
+constexpr std::size_t elements = 1000;
+constexpr uint32_t stride = 16;
+
+// Writes elements with a timestamp every tick to a fresh file, removed with its sidecar at the end
+struct RecordedFile
+{
+  RecordedFile()
+    : name((std::filesystem::temp_directory_path() / ("TimestampIndex_test_" + std::to_string(getpid()) + ".bin"))
+             .string())
+  {
+    std::ofstream out(name, std::ios::binary | std::ios::trunc);
+    for (std::size_t i = 0; i < elements; ++i) {
+      Element element{ first_timestamp + i * tick, { i } };
+      out.write(reinterpret_cast<const char*>(&element), sizeof(element)); // NOLINT
+    }
+  }
+  ~RecordedFile()
+  {
+    std::remove(name.c_str());
+    std::remove(TimestampIndex::sidecar_name(name).c_str());
+  }
+
+  std::string name;
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(TimestampIndex_test)
+
+BOOST_AUTO_TEST_CASE(WriterKeepsOneEntryPerStride)
+{
+  RecordedFile file;
+  TimestampIndexWriter writer;
+  writer.open(file.name, sizeof(Element), stride);
+  BOOST_REQUIRE(writer.is_open());
+  for (std::size_t i = 0; i < elements; ++i) {
+    writer.add(first_timestamp + i * tick, i * sizeof(Element));
+  }
+  writer.close();
+
+  TimestampIndex index;
+  BOOST_REQUIRE(index.load(file.name));
+  BOOST_REQUIRE_EQUAL(index.element_size(), sizeof(Element));
+  BOOST_REQUIRE_EQUAL(index.stride(), stride);
+  BOOST_REQUIRE_EQUAL(index.file_size(), elements * sizeof(Element));
+  BOOST_REQUIRE_EQUAL(index.entries().size(), (elements + stride - 1) / stride);
+  for (std::size_t e = 0; e < index.entries().size(); ++e) {
+    BOOST_REQUIRE_EQUAL(index.entries()[e].timestamp, first_timestamp + e * stride * tick);
+    BOOST_REQUIRE_EQUAL(index.entries()[e].offset, e * stride * sizeof(Element));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(LocateCoversTheWindow)
+{
+  RecordedFile file;
+  BOOST_REQUIRE(build_timestamp_index<Element>(file.name, stride));
+  TimestampIndex index;
+  BOOST_REQUIRE(index.load(file.name));
+
+  const uint64_t begin = first_timestamp + 100 * tick + 5;
+  const uint64_t end = first_timestamp + 300 * tick;
+  auto range = index.locate(begin, end);
+  BOOST_REQUIRE_EQUAL(range.begin % sizeof(Element), 0);
+  BOOST_REQUIRE_LE(range.begin, 101 * sizeof(Element));
+  BOOST_REQUIRE_GE(range.end, 300 * sizeof(Element));
+  BOOST_REQUIRE_LE(range.end - range.begin, (200 + 2 * stride) * sizeof(Element));
+
+  auto found = index.read_elements<Element>(begin, end);
+  BOOST_REQUIRE_EQUAL(found.size(), 199);
+  BOOST_REQUIRE_EQUAL(found.front().get_timestamp(), first_timestamp + 101 * tick);
+  BOOST_REQUIRE_EQUAL(found.back().get_timestamp(), first_timestamp + 299 * tick);
+
+  // Windows past the end are clamped to the file, empty windows map to nothing
+  range = index.locate(first_timestamp + elements * tick, first_timestamp + 2 * elements * tick);
+  BOOST_REQUIRE_EQUAL(range.end, index.file_size());
+  range = index.locate(end, begin);
+  BOOST_REQUIRE_EQUAL(range.end - range.begin, 0);
+}
+
+BOOST_AUTO_TEST_CASE(MissingSidecarDoesNotLoad)
+{
+  RecordedFile file;
+  TimestampIndex index;
+  BOOST_REQUIRE(!index.load(file.name));
+  BOOST_REQUIRE(index.entries().empty());
+}
+
+BOOST_AUTO_TEST_CASE(UnwritableSidecarStaysClosed)
+{
+  const std::string data_file = "/nonexistent_directory/TimestampIndex_test.bin";
+  TimestampIndexWriter writer;
+  writer.open(data_file, sizeof(Element), stride);
+  BOOST_REQUIRE(!writer.is_open());
+  writer.add(first_timestamp, 0);
+  writer.close();
+  BOOST_REQUIRE(!std::filesystem::exists(TimestampIndex::sidecar_name(data_file)));
+  BOOST_REQUIRE(!build_timestamp_index<Element>(data_file, stride));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,167 @@
+/**
+ * @file WIBEthAdcCodec_test.cxx Unit tests of the lossless WIBEth frame codec
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "fdreadoutmodules/utils/WIBEthAdcCodec.hpp"
+
+#define BOOST_TEST_MODULE WIBEthAdcCodec_test // NOLINT
+
+#include "boost/test/unit_test.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace dunedaq::fdreadoutmodules;
+using Frame = WIBEthAdcCodec::Frame;
+
+namespace {
+
+constexpr uint16_t adc_mask = 0x3fff;
+
+Frame
+make_frame(uint64_t timestamp)
+{
+  Frame frame;
+  std::memset(&frame, 0, sizeof(frame));
+  frame.daq_header.timestamp = timestamp;
+  frame.header.channel = 3;
+  return frame;
+}
+
+// Pedestal per channel with a few counts of noise, as on a quiet link
+Frame
+make_quiet_frame(uint64_t timestamp, std::mt19937& rng)
+{
+  Frame frame = make_frame(timestamp);
+  std::normal_distribution<double> noise(0, 4);
+  for (int sample = 0; sample < Frame::s_time_samples; ++sample) {
+    for (int channel = 0; channel < Frame::s_num_channels; ++channel) {
+      frame.set_adc(channel, sample, static_cast<uint16_t>(900 + 40 * (channel % 5) + static_cast<int>(noise(rng))));
+    }
+  }
+  return frame;
+}
+
+Frame
+make_random_frame(uint64_t timestamp, std::mt19937& rng)
+{
+  Frame frame = make_frame(timestamp);
+  for (int sample = 0; sample < Frame::s_time_samples; ++sample) {
+    for (int channel = 0; channel < Frame::s_num_channels; ++channel) {
+      frame.set_adc(channel, sample, static_cast<uint16_t>(rng() & adc_mask));
+    }
+  }
+  return frame;
+}
+
+// Encodes frame, checks decode() and skip() agree on its end and returns the decoded frame
+Frame
+round_trip(const WIBEthAdcCodec& codec, const Frame& frame, std::size_t& encoded_size)
+{
+  std::vector<uint8_t> buffer(WIBEthAdcCodec::max_encoded_size);
+  encoded_size = codec.encode(frame, buffer.data());
+  BOOST_REQUIRE_LE(encoded_size, WIBEthAdcCodec::max_encoded_size);
+  BOOST_REQUIRE_EQUAL(codec.peek_timestamp(buffer.data()), frame.daq_header.timestamp);
+
+  const uint8_t* end = buffer.data() + encoded_size;
+  Frame decoded;
+  std::memset(&decoded, 0xff, sizeof(decoded));
+  const uint8_t* next = codec.decode(buffer.data(), end, decoded);
+  BOOST_REQUIRE(next == end);
+  BOOST_REQUIRE(WIBEthAdcCodec::skip(buffer.data(), end) == end);
+  return decoded;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(WIBEthAdcCodec_test)
+
+BOOST_AUTO_TEST_CASE(QuietFramesShrinkAndRoundTrip)
+{
+  WIBEthAdcCodec codec;
+  std::mt19937 rng(1);
+  for (uint64_t i = 0; i < 100; ++i) {
+    Frame frame = make_quiet_frame(1000 + 2048 * i, rng);
+    std::size_t encoded_size = 0;
+    Frame decoded = round_trip(codec, frame, encoded_size);
+    BOOST_REQUIRE_LT(encoded_size, sizeof(Frame) / 2);
+    BOOST_REQUIRE(std::memcmp(&decoded, &frame, sizeof(Frame)) == 0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(NoisyFramesAreStoredRaw)
+{
+  WIBEthAdcCodec codec;
+  std::mt19937 rng(2);
+  Frame frame = make_random_frame(5000, rng);
+  std::size_t encoded_size = 0;
+  Frame decoded = round_trip(codec, frame, encoded_size);
+  BOOST_REQUIRE_EQUAL(encoded_size, WIBEthAdcCodec::max_encoded_size);
+  BOOST_REQUIRE(std::memcmp(&decoded, &frame, sizeof(Frame)) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(FullScaleSwingsRoundTrip)
+{
+  WIBEthAdcCodec codec;
+  Frame frame = make_frame(7000);
+  for (int sample = 0; sample < Frame::s_time_samples; ++sample) {
+    for (int channel = 0; channel < Frame::s_num_channels; ++channel) {
+      frame.set_adc(channel, sample, (sample + channel) % 2 == 0 ? 0 : adc_mask);
+    }
+  }
+  std::size_t encoded_size = 0;
+  Frame decoded = round_trip(codec, frame, encoded_size);
+  for (int sample = 0; sample < Frame::s_time_samples; ++sample) {
+    for (int channel = 0; channel < Frame::s_num_channels; ++channel) {
+      BOOST_REQUIRE_EQUAL(decoded.get_adc(channel, sample), frame.get_adc(channel, sample));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(FramesDecodeInSequence)
+{
+  WIBEthAdcCodec codec;
+  std::mt19937 rng(3);
+  std::vector<Frame> frames;
+  for (uint64_t i = 0; i < 20; ++i) {
+    frames.push_back(i % 7 == 0 ? make_random_frame(2048 * i, rng) : make_quiet_frame(2048 * i, rng));
+  }
+  std::vector<uint8_t> buffer(frames.size() * WIBEthAdcCodec::max_encoded_size);
+  std::size_t size = 0;
+  for (const auto& frame : frames) {
+    size += codec.encode(frame, buffer.data() + size);
+  }
+
+  const uint8_t* in = buffer.data();
+  const uint8_t* end = buffer.data() + size;
+  Frame decoded;
+  for (const auto& frame : frames) {
+    BOOST_REQUIRE_EQUAL(codec.peek_timestamp(in), frame.daq_header.timestamp);
+    in = codec.decode(in, end, decoded);
+    BOOST_REQUIRE(in != nullptr);
+    BOOST_REQUIRE(std::memcmp(&decoded, &frame, sizeof(Frame)) == 0);
+  }
+  BOOST_REQUIRE(in == end);
+}
+
+BOOST_AUTO_TEST_CASE(TruncatedInputIsRejected)
+{
+  WIBEthAdcCodec codec;
+  std::mt19937 rng(4);
+  Frame frame = make_quiet_frame(1000, rng);
+  std::vector<uint8_t> buffer(WIBEthAdcCodec::max_encoded_size);
+  const std::size_t size = codec.encode(frame, buffer.data());
+  Frame decoded;
+  for (std::size_t cut : { std::size_t(0), std::size_t(1), size / 2, size - 1 }) {
+    BOOST_REQUIRE(codec.decode(buffer.data(), buffer.data() + cut, decoded) == nullptr);
+    BOOST_REQUIRE(WIBEthAdcCodec::skip(buffer.data(), buffer.data() + cut) == nullptr);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()